@@ -0,0 +1,136 @@
+/**
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * Audio mixer microbenchmark. Mixes 64 concurrent looping clips into a 4096 frame
+ * buffer with every mixing kernel the build supports, checks that they agree and
+ * reports the time per mix. Allocations are counted by routing the mixer's mallocs
+ * through the bench allocators.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define malloc( size ) bench_alloc( size )
+#define realloc( ptr, size ) bench_realloc( ptr, size )
+#define free( ptr ) bench_dealloc( ptr )
+
+#define VUL_DEFINE
+#define VUL_AUDIO_SAMPLE_16BIT
+#define VUL_AUDIO_ERROR_STDERR
+#include <vul_timer.h>
+#include <vul_audio.h>
+
+#define BENCH_CLIP_COUNT 64
+#define BENCH_FRAMES 4096
+#define BENCH_CHANNELS 2
+#define BENCH_ITERATIONS 2000
+
+typedef struct {
+	const char *name;
+	void ( *mix_span )( s32 *dst, const s16 *src, u64 count, s32 volume );
+	void ( *clamp_span )( s16 *dst, const s32 *src, u64 count );
+} bench_kernel;
+
+static bench_kernel bench_kernels[ ] = {
+	{ "scalar", vul__audio_mix_span_scalar, vul__audio_clamp_span_scalar },
+#ifdef VUL__AUDIO_SSE2
+	{ "sse2", vul__audio_mix_span_sse2, vul__audio_clamp_span_sse2 },
+#endif
+#ifdef VUL__AUDIO_AVX2
+	{ "avx2", vul__audio_mix_span_avx2, vul__audio_clamp_span_avx2 },
+#endif
+};
+
+/*
+ * Resets the mixer to 64 playing, looping clips. Clip lengths differ so the loop
+ * points land on different frames of the mix buffer.
+ */
+static void bench_reset( vul__audio_mixer *mixer, s16 **data )
+{
+	u32 i;
+
+	mixer->count = BENCH_CLIP_COUNT;
+	for( i = 0; i < BENCH_CLIP_COUNT; ++i ) {
+		vul__audio_mixer_clip *clip = &mixer->clips[ i ];
+		clip->id = i + 1;
+		clip->samples = data[ i ];
+		clip->sample_count = BENCH_FRAMES + 997 * i;
+		clip->current_offset = ( 31 * i ) * BENCH_CHANNELS;
+		clip->channels = BENCH_CHANNELS;
+		clip->playing = 1;
+		clip->looping = 1;
+		clip->keep_after_finish = 1;
+		clip->volume = 0.25f + 0.75f * ( f32 )i / ( f32 )BENCH_CLIP_COUNT;
+	}
+}
+
+int main( int argc, char **argv )
+{
+	vul__audio_mixer mixer;
+	vul_timer *timer;
+	s16 *data[ BENCH_CLIP_COUNT ];
+	s16 *reference;
+	char name[ 64 ];
+	u64 len, micros, allocs;
+	u32 i, j, k, seed;
+
+	bench_begin( argc, argv, "Audio mixer benchmarks, 64 looping clips into 4096 stereo frames" );
+
+	vul__audio_mixer_init( &mixer, BENCH_CHANNELS, BENCH_FRAMES, BENCH_CLIP_COUNT );
+	seed = 0x12345678;
+	for( i = 0; i < BENCH_CLIP_COUNT; ++i ) {
+		len = ( BENCH_FRAMES + 997 * i ) * BENCH_CHANNELS;
+		data[ i ] = ( s16* )malloc( sizeof( s16 ) * len );
+		for( j = 0; j < len; ++j ) {
+			seed = seed * 1664525u + 1013904223u;
+			data[ i ][ j ] = ( s16 )( seed >> 16 );
+		}
+	}
+	reference = ( s16* )malloc( sizeof( s16 ) * BENCH_FRAMES * BENCH_CHANNELS );
+	timer = vul_timer_create( );
+
+	for( k = 0; k < sizeof( bench_kernels ) / sizeof( bench_kernels[ 0 ] ); ++k ) {
+		mixer.mix_span = bench_kernels[ k ].mix_span;
+		mixer.clamp_span = bench_kernels[ k ].clamp_span;
+		sprintf( name, "audio_mix_%s", bench_kernels[ k ].name );
+
+		// One mix from a known state to compare against the scalar kernels
+		bench_reset( &mixer, data );
+		vul__audio_mix( &mixer );
+		if( k == 0 ) {
+			memcpy( reference, mixer.samples, sizeof( s16 ) * BENCH_FRAMES * BENCH_CHANNELS );
+		} else if( memcmp( reference, mixer.samples, sizeof( s16 ) * BENCH_FRAMES * BENCH_CHANNELS ) ) {
+			bench_fail( name, "output differs from scalar" );
+		}
+
+		bench_reset( &mixer, data );
+		allocs = bench_allocations( );
+		vul_timer_reset( timer );
+		for( i = 0; i < BENCH_ITERATIONS; ++i ) {
+			vul__audio_mix( &mixer );
+		}
+		micros = vul_timer_get_micros( timer );
+		bench_report( name, BENCH_ITERATIONS, micros, bench_allocations( ) - allocs );
+	}
+
+	vul_timer_destroy( timer );
+	free( reference );
+	for( i = 0; i < BENCH_CLIP_COUNT; ++i ) {
+		free( data[ i ] );
+	}
+	vul__audio_mixer_destroy( &mixer );
+	return bench_end( );
+}
@@ -0,0 +1,105 @@
+/**
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned long long bench_allocation_count = 0;
+static int bench_json = 0;
+static int bench_failed = 0;
+static unsigned int bench_state = 0x12345678;
+
+void *bench_alloc( size_t size )
+{
+	++bench_allocation_count;
+	return malloc( size );
+}
+
+void *bench_realloc( void *ptr, size_t size )
+{
+	++bench_allocation_count;
+	return realloc( ptr, size );
+}
+
+void bench_dealloc( void *ptr )
+{
+	free( ptr );
+}
+
+unsigned long long bench_allocations( )
+{
+	return bench_allocation_count;
+}
+
+void bench_begin( int argc, char **argv, const char *title )
+{
+	int i;
+
+	for( i = 1; i < argc; ++i ) {
+		if( strcmp( argv[ i ], "--json" ) == 0 ) {
+			bench_json = 1;
+		}
+	}
+	if( !bench_json ) {
+		printf( "%s\n%-32s %12s %14s %14s\n", title, "benchmark", "ops", "ns/op", "allocs/op" );
+	}
+}
+
+void bench_report( const char *name, unsigned long long ops, unsigned long long micros, unsigned long long allocs )
+{
+	double ns, per;
+
+	ns = ops ? ( double )micros * 1000.0 / ( double )ops : 0.0;
+	per = ops ? ( double )allocs / ( double )ops : 0.0;
+	if( bench_json ) {
+		printf( "{\"name\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f}\n", name, ops, ns, per );
+	} else {
+		printf( "%-32s %12llu %14.1f %14.2f\n", name, ops, ns, per );
+	}
+	fflush( stdout );
+}
+
+void bench_fail( const char *name, const char *reason )
+{
+	bench_failed = 1;
+	if( bench_json ) {
+		printf( "{\"name\":\"%s\",\"error\":\"%s\"}\n", name, reason );
+	} else {
+		printf( "%-32s FAILED: %s\n", name, reason );
+	}
+}
+
+int bench_end( )
+{
+	return bench_failed;
+}
+
+void bench_seed( unsigned int seed )
+{
+	bench_state = seed;
+}
+
+unsigned int bench_rand( )
+{
+	bench_state = bench_state * 1664525u + 1013904223u;
+	return bench_state >> 8;
+}
+
+float bench_randf( float min, float max )
+{
+	return min + ( max - min ) * ( float )( bench_rand( ) & 0xffff ) / 65535.f;
+}
@@ -0,0 +1,69 @@
+/**
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * Shared benchmark harness. Counts allocations made through the bench allocators
+ * and reports results either as a table or, with --json on the command line, as
+ * one JSON object per line for regression tracking:
+ *     {"name":"scene_sort_10k","ops":50,"ns_per_op":123.4,"allocs_per_op":0.00}
+ *
+ * The engine benchmarks build the library with SL_ALLOC/SL_REALLOC/SL_DEALLOC set
+ * to bench_alloc/bench_realloc/bench_dealloc and force-include this header, so
+ * every allocation the engine makes through its allocator is counted.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SLENDERER_BENCH_H
+#define SLENDERER_BENCH_H
+
+#include <stddef.h>
+
+/**
+ * Counting allocators. Allocations and reallocations both count as one.
+ */
+void *bench_alloc( size_t size );
+void *bench_realloc( void *ptr, size_t size );
+void bench_dealloc( void *ptr );
+
+/**
+ * Number of allocations made through the bench allocators so far.
+ */
+unsigned long long bench_allocations( );
+
+/**
+ * Parses the command line (--json selects JSON output) and prints the header.
+ */
+void bench_begin( int argc, char **argv, const char *title );
+
+/**
+ * Reports a benchmark that ran ops operations in the given microseconds and made
+ * the given number of allocations while doing so.
+ */
+void bench_report( const char *name, unsigned long long ops, unsigned long long micros, unsigned long long allocs );
+
+/**
+ * Reports a failed correctness check, and makes bench_end return non-zero.
+ */
+void bench_fail( const char *name, const char *reason );
+
+/**
+ * Returns the process exit code; non-zero if any check failed.
+ */
+int bench_end( );
+
+/**
+ * Deterministic pseudo random numbers, so every run measures the same work.
+ */
+void bench_seed( unsigned int seed );
+unsigned int bench_rand( );
+float bench_randf( float min, float max );
+
+#endif
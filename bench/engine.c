@@ -0,0 +1,837 @@
+/**
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * Engine microbenchmarks: adding and removing sprites, sorting 10k and 100k
+ * sprite layers and re-sorting one after a few changes, stepping the simulator
+ * at 1k/10k/50k bodies with each broadphase, updating 10k transform animations,
+ * picking entities at a position (with some moving in between), dispatching
+ * mouse moves, queueing and draining key events, looking up 100k pair keys in
+ * the hash map, packing 2k images into a texture atlas and loading 64 textures
+ * asynchronously (timing only the render thread's share).
+ * Every run does the same work (seeded random numbers, zero velocity bodies,
+ * animations far from finishing), so numbers are comparable between runs.
+ * Needs a GL context for the scenes' post quads, which it gets from an
+ * offscreen window; run it under xvfb-run where there's no display.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "bench.h"
+#include "slenderer.h"
+#include <stdio.h>
+#include <vul_timer.h>
+
+#define BENCH_SPRITES 10000
+#define BENCH_SPRITE_ROUNDS 20
+#define BENCH_SORT_ITERATIONS 50
+#define BENCH_SORT_PROGRAMS 8
+#define BENCH_SORT_TEXTURES 32
+#define BENCH_RESORT_SPRITES 100000
+#define BENCH_RESORT_ITERATIONS 100
+#define BENCH_SIM_WORK 1000000 // Bodies stepped per simulator benchmark
+#define BENCH_ANIM_TRANSFORMS 10000
+#define BENCH_ANIM_ITERATIONS 1000
+#define BENCH_PICK_QUERIES 10000
+#define BENCH_PICK_MOVES 16 // Sprites moved before every query of the moving picking benchmark
+#define BENCH_MOUSE_MOVES 10000
+#define BENCH_INPUT_FRAMES 10000
+#define BENCH_KEY_EVENTS 100000
+#define BENCH_MAP_KEYS 100000
+#define BENCH_ATLAS_IMAGES 2000
+#define BENCH_ATLAS_PAGE 1024
+#define BENCH_LOAD_TEXTURES 64
+#define BENCH_LOAD_SIZE 256
+
+/*
+ * Adds a sprite at a random position in [-1,1]^2 with the given size, program and texture.
+ */
+static unsigned int bench_add_sprite( sl_scene *scene, unsigned int layer, f32 size, unsigned int program_id, unsigned int texture_id )
+{
+	v2 center, scale, flip;
+	sl_box uvs;
+
+	center = vec2( bench_randf( -1.f, 1.f ), bench_randf( -1.f, 1.f ) );
+	scale = vec2( size, size );
+	flip = vec2( 0.f, 0.f );
+	sl_bset_scalar( &uvs, 0.f, 0.f, 1.f, 1.f );
+	return sl_scene_add_sprite( scene, layer, &center, &scale, 0.f, texture_id, program_id, 0, &uvs, &flip, NULL, 0 );
+}
+
+/*
+ * Adds a scene to the offscreen window and returns its id. Scene pointers move
+ * when more scenes are added, so benchmarks look them up by id.
+ */
+static unsigned int bench_new_scene( )
+{
+	return sl_renderer_add_scene( 0, 0 )->scene_id;
+}
+
+static void bench_scene_add_remove( )
+{
+	sl_scene *scene;
+	vul_timer *timer;
+	unsigned int *ids, tmp;
+	u64 add_micros, remove_micros, add_allocs, remove_allocs, allocs;
+	u32 r, i, j;
+
+	scene = sl_renderer_get_scene_by_id( bench_new_scene( ) );
+	ids = ( unsigned int* )malloc( sizeof( unsigned int ) * BENCH_SPRITES );
+	timer = vul_timer_create( );
+	add_micros = remove_micros = add_allocs = remove_allocs = 0;
+	bench_seed( 1 );
+	for( r = 0; r < BENCH_SPRITE_ROUNDS; ++r ) {
+		allocs = bench_allocations( );
+		vul_timer_reset( timer );
+		for( i = 0; i < BENCH_SPRITES; ++i ) {
+			ids[ i ] = bench_add_sprite( scene, i % SL_MAX_LAYERS, 0.01f, 0, 0 );
+		}
+		add_micros += vul_timer_get_micros( timer );
+		add_allocs += bench_allocations( ) - allocs;
+
+		// Remove in random order so removals hit the middle of the layers
+		for( i = BENCH_SPRITES - 1; i > 0; --i ) {
+			j = bench_rand( ) % ( i + 1 );
+			tmp = ids[ i ]; ids[ i ] = ids[ j ]; ids[ j ] = tmp;
+		}
+		allocs = bench_allocations( );
+		vul_timer_reset( timer );
+		for( i = 0; i < BENCH_SPRITES; ++i ) {
+			sl_scene_remove_sprite( scene, ids[ i ], 0xffffffff );
+		}
+		remove_micros += vul_timer_get_micros( timer );
+		remove_allocs += bench_allocations( ) - allocs;
+	}
+	bench_report( "scene_add_sprite", ( u64 )BENCH_SPRITES * BENCH_SPRITE_ROUNDS, add_micros, add_allocs );
+	bench_report( "scene_remove_sprite", ( u64 )BENCH_SPRITES * BENCH_SPRITE_ROUNDS, remove_micros, remove_allocs );
+
+	vul_timer_destroy( timer );
+	free( ids );
+}
+
+/*
+ * Checks that the render order of layer 0 holds every entity once, ordered by
+ * program, then texture, and that every entity's slot points at where it is.
+ */
+static void bench_check_sorted( sl_scene *scene, const char *name )
+{
+	u8 *seen;
+	u32 i, a, b, size;
+
+	size = SL_LAYER_SIZE( scene, 0 );
+	if( SL_LAYER_ORDER_SIZE( scene, 0 ) != size ) {
+		bench_fail( name, "render order is the wrong size" );
+		return;
+	}
+	seen = ( u8* )calloc( size, 1 );
+	for( i = 0; i < size; ++i ) {
+		a = SL_LAYER_ORDER( scene, 0, i );
+		if( a >= size || seen[ a ] ) {
+			bench_fail( name, "render order is not a permutation of the layer" );
+			free( seen );
+			return;
+		}
+		seen[ a ] = 1;
+	}
+	free( seen );
+	for( i = 1; i < size; ++i ) {
+		a = SL_LAYER_ORDER( scene, 0, i - 1 );
+		b = SL_LAYER_ORDER( scene, 0, i );
+		if( SL_LAYER_PROGRAM( scene, 0, a ) > SL_LAYER_PROGRAM( scene, 0, b )
+			|| ( SL_LAYER_PROGRAM( scene, 0, a ) == SL_LAYER_PROGRAM( scene, 0, b )
+				 && SL_LAYER_TEXTURE( scene, 0, a ) > SL_LAYER_TEXTURE( scene, 0, b ) ) ) {
+			bench_fail( name, "layer is not sorted" );
+			return;
+		}
+	}
+	for( i = 0; i < size; ++i ) {
+		if( sl_scene_get_transform( scene, SL_LAYER_ID( scene, 0, i ) ) != SL_LAYER_TRANSFORM( scene, 0, i ) ) {
+			bench_fail( name, "slots point at the wrong entity" );
+			return;
+		}
+	}
+}
+
+static void bench_scene_sort( u32 sprites, const char *name )
+{
+	sl_scene *scene;
+	vul_timer *timer;
+	unsigned int *ids;
+	u64 micros, allocs, start;
+	u32 i, k;
+
+	scene = sl_renderer_get_scene_by_id( bench_new_scene( ) );
+	ids = ( unsigned int* )malloc( sizeof( unsigned int ) * sprites );
+	bench_seed( 2 );
+	for( i = 0; i < sprites; ++i ) {
+		ids[ i ] = bench_add_sprite( scene, 0, 0.01f, 0, 0 );
+	}
+	timer = vul_timer_create( );
+	micros = allocs = 0;
+	for( k = 0; k < BENCH_SORT_ITERATIONS; ++k ) {
+		// Give every sprite a new random program and texture, which dirties the layer
+		for( i = 0; i < sprites; ++i ) {
+			sl_scene_set_program( scene, ids[ i ], bench_rand( ) % BENCH_SORT_PROGRAMS );
+			sl_scene_set_texture( scene, ids[ i ], bench_rand( ) % BENCH_SORT_TEXTURES );
+		}
+
+		start = bench_allocations( );
+		vul_timer_reset( timer );
+		sl_scene_sort( scene );
+		micros += vul_timer_get_micros( timer );
+		allocs += bench_allocations( ) - start;
+	}
+	bench_report( name, BENCH_SORT_ITERATIONS, micros, allocs );
+
+	bench_check_sorted( scene, name );
+
+	vul_timer_destroy( timer );
+	free( ids );
+}
+
+/*
+ * Re-sorts a sorted 100k sprite layer each frame after a few sprites changed.
+ * Each frame every sprite's transform is touched, changes sprites get a new
+ * texture and one sprite is replaced, as a game would do.
+ */
+static void bench_scene_resort( u32 changes, const char *name )
+{
+	sl_scene *scene;
+	vul_timer *timer;
+	unsigned int *ids;
+	u64 micros, allocs, start;
+	u32 i, j, k;
+
+	scene = sl_renderer_get_scene_by_id( bench_new_scene( ) );
+	ids = ( unsigned int* )malloc( sizeof( unsigned int ) * BENCH_RESORT_SPRITES );
+	bench_seed( 5 );
+	for( i = 0; i < BENCH_RESORT_SPRITES; ++i ) {
+		ids[ i ] = bench_add_sprite( scene, 0, 0.01f, bench_rand( ) % BENCH_SORT_PROGRAMS, bench_rand( ) % BENCH_SORT_TEXTURES );
+	}
+	sl_scene_sort( scene );
+
+	timer = vul_timer_create( );
+	micros = allocs = 0;
+	for( k = 0; k < BENCH_RESORT_ITERATIONS; ++k ) {
+		for( i = 0; i < BENCH_RESORT_SPRITES; ++i ) {
+			sl_scene_get_transform( scene, ids[ i ] )->a20 += 0.001f;
+		}
+		for( i = 0; i < changes; ++i ) {
+			sl_scene_set_texture( scene, ids[ bench_rand( ) % BENCH_RESORT_SPRITES ], bench_rand( ) % BENCH_SORT_TEXTURES );
+		}
+		if( changes ) {
+			j = bench_rand( ) % BENCH_RESORT_SPRITES;
+			sl_scene_remove_sprite( scene, ids[ j ], 0 );
+			ids[ j ] = bench_add_sprite( scene, 0, 0.01f, bench_rand( ) % BENCH_SORT_PROGRAMS, bench_rand( ) % BENCH_SORT_TEXTURES );
+		}
+
+		start = bench_allocations( );
+		vul_timer_reset( timer );
+		sl_scene_sort( scene );
+		micros += vul_timer_get_micros( timer );
+		allocs += bench_allocations( ) - start;
+	}
+	bench_report( name, BENCH_RESORT_ITERATIONS, micros, allocs );
+	bench_check_sorted( scene, name );
+
+	vul_timer_destroy( timer );
+	free( ids );
+}
+
+static void bench_simulator_update( u32 bodies, u32 method, const char *name )
+{
+	sl_scene *scene;
+	sl_simulator *sim;
+	vul_timer *timer;
+	unsigned int scene_id, id;
+	v2 velocity;
+	u64 micros, allocs;
+	u32 i, iterations;
+	f32 size;
+
+	scene_id = bench_new_scene( );
+	scene = sl_renderer_get_scene_by_id( scene_id );
+	sim = sl_renderer_get_simulator_for_scene( scene_id );
+
+	// Density stays the same with the body count, so each body has a few neighbours
+	size = 2.f / ( f32 )sqrt( ( f64 )bodies );
+	sl_simulator_set_broadphase( sim, method, 2.f * size ); // Quads span twice their scale
+	velocity = vec2( 0.f, 0.f );
+	bench_seed( 3 );
+	for( i = 0; i < bodies; ++i ) {
+		id = bench_add_sprite( scene, 0, size, 0, 0 );
+		sl_simulator_add_entity( sim, id, &velocity );
+	}
+	sl_simulator_update( sim ); // Sizes the AABB and pair vectors
+
+	iterations = BENCH_SIM_WORK / bodies;
+	timer = vul_timer_create( );
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	for( i = 0; i < iterations; ++i ) {
+		sl_simulator_update( sim );
+	}
+	micros = vul_timer_get_micros( timer );
+	bench_report( name, iterations, micros, bench_allocations( ) - allocs );
+
+	vul_timer_destroy( timer );
+}
+
+static void bench_animator_update( )
+{
+	sl_scene *scene;
+	sl_animator *anim;
+	vul_timer *timer;
+	unsigned int scene_id, id;
+	sl_affine end;
+	u64 micros, allocs;
+	u32 i;
+
+	scene_id = bench_new_scene( );
+	scene = sl_renderer_get_scene_by_id( scene_id );
+	anim = sl_renderer_get_animator_for_scene( scene_id );
+
+	bench_seed( 4 );
+	for( i = 0; i < BENCH_ANIM_TRANSFORMS; ++i ) {
+		id = bench_add_sprite( scene, i % SL_MAX_LAYERS, 0.01f, 0, 0 );
+		end = *sl_scene_get_transform( scene, id );
+		end.a20 = bench_randf( -1.f, 1.f );
+		end.a21 = bench_randf( -1.f, 1.f );
+		// An hour long, so nothing finishes and the work stays the same
+		sl_animator_add_affine( anim, id, &end, 3600000ull, SL_ANIMATION_RUNNING_PERIODIC );
+	}
+
+	timer = vul_timer_create( );
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	for( i = 0; i < BENCH_ANIM_ITERATIONS; ++i ) {
+		sl_animator_update( anim );
+	}
+	micros = vul_timer_get_micros( timer );
+	bench_report( "animator_update_10k", BENCH_ANIM_ITERATIONS, micros, bench_allocations( ) - allocs );
+
+	vul_timer_destroy( timer );
+}
+
+/*
+ * Picks like sl_scene_get_entities_at_pos did before the spatial index: every
+ * entity of every layer, top down.
+ */
+static void bench_pick_reference( vul_vector *vec, sl_scene *scene, v2 *pos )
+{
+	int i;
+	u32 j;
+	sl_box aabb;
+
+	for( i = SL_MAX_LAYERS - 1; i >= 0; --i ) {
+		for( j = 0; j < SL_LAYER_SIZE( scene, i ); ++j ) {
+			sl_entity_aabb_transform( &aabb, SL_LAYER_TRANSFORM( scene, i, j ) );
+			if( !SL_LAYER_HIDDEN( scene, i, j ) && sl_binside( &aabb, pos ) ) {
+				vul_vector_add( vec, &SL_LAYER_ID( scene, i, j ) );
+			}
+		}
+	}
+}
+
+/*
+ * Checks that a pick found the same entities, in the same order, as the reference.
+ */
+static SL_BOOL bench_check_pick( vul_vector *hits, vul_vector *expected, sl_scene *scene, v2 *pos, const char *name )
+{
+	vul_vector_resize( expected, 0, VUL_FALSE, VUL_FALSE );
+	bench_pick_reference( expected, scene, pos );
+	if( vul_vector_size( hits ) != vul_vector_size( expected ) 
+		|| memcmp( vul_vector_begin( hits ), vul_vector_begin( expected ), sizeof( unsigned int ) * vul_vector_size( hits ) ) != 0 ) {
+		bench_fail( name, "picked entities differ from a full scan" );
+		return SL_FALSE;
+	}
+	return SL_TRUE;
+}
+
+static void bench_entities_at_pos( )
+{
+	sl_scene *scene;
+	vul_vector *hits, *expected;
+	vul_timer *timer;
+	v2 *queries;
+	unsigned int *ids;
+	u64 micros, allocs, hit_count;
+	u32 i, j;
+
+	scene = sl_renderer_get_scene_by_id( bench_new_scene( ) );
+	bench_seed( 5 );
+	ids = ( unsigned int* )malloc( sizeof( unsigned int ) * BENCH_SPRITES );
+	for( i = 0; i < BENCH_SPRITES; ++i ) {
+		ids[ i ] = bench_add_sprite( scene, i % SL_MAX_LAYERS, 0.05f, 0, 0 );
+	}
+	queries = ( v2* )malloc( sizeof( v2 ) * BENCH_PICK_QUERIES );
+	for( i = 0; i < BENCH_PICK_QUERIES; ++i ) {
+		queries[ i ] = vec2( bench_randf( -1.f, 1.f ), bench_randf( -1.f, 1.f ) );
+	}
+	hits = vul_vector_create( sizeof( unsigned int ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	expected = vul_vector_create( sizeof( unsigned int ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+
+	timer = vul_timer_create( );
+	hit_count = 0;
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	for( i = 0; i < BENCH_PICK_QUERIES; ++i ) {
+		vul_vector_resize( hits, 0, VUL_FALSE, VUL_FALSE );
+		sl_scene_get_entities_at_pos( hits, scene, &queries[ i ] );
+		hit_count += vul_vector_size( hits );
+	}
+	micros = vul_timer_get_micros( timer );
+	bench_report( "scene_get_entities_at_pos_10k", BENCH_PICK_QUERIES, micros, bench_allocations( ) - allocs );
+	if( hit_count == 0 ) {
+		bench_fail( "scene_get_entities_at_pos_10k", "no query hit anything" );
+	}
+	for( i = 0; i < BENCH_PICK_QUERIES; i += 10 ) {
+		vul_vector_resize( hits, 0, VUL_FALSE, VUL_FALSE );
+		sl_scene_get_entities_at_pos( hits, scene, &queries[ i ] );
+		if( !bench_check_pick( hits, expected, scene, &queries[ i ], "scene_get_entities_at_pos_10k" ) ) {
+			break;
+		}
+	}
+
+	// Sprites drifting between cursor moves; only they are re-indexed
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	for( i = 0; i < BENCH_PICK_QUERIES; ++i ) {
+		for( j = 0; j < BENCH_PICK_MOVES; ++j ) {
+			sl_scene_get_transform( scene, ids[ bench_rand( ) % BENCH_SPRITES ] )->a20 += bench_randf( -0.1f, 0.1f );
+		}
+		vul_vector_resize( hits, 0, VUL_FALSE, VUL_FALSE );
+		sl_scene_get_entities_at_pos( hits, scene, &queries[ i ] );
+	}
+	micros = vul_timer_get_micros( timer );
+	bench_report( "scene_entities_at_pos_10k_moving", BENCH_PICK_QUERIES, micros, bench_allocations( ) - allocs );
+	for( i = 0; i < BENCH_PICK_QUERIES; i += 10 ) {
+		vul_vector_resize( hits, 0, VUL_FALSE, VUL_FALSE );
+		sl_scene_get_entities_at_pos( hits, scene, &queries[ i ] );
+		if( !bench_check_pick( hits, expected, scene, &queries[ i ], "scene_entities_at_pos_10k_moving" ) ) {
+			break;
+		}
+	}
+
+	vul_timer_destroy( timer );
+	vul_vector_destroy( hits );
+	vul_vector_destroy( expected );
+	free( queries );
+	free( ids );
+}
+
+static u32 bench_mouse_overs, bench_mouse_outs;
+
+static void bench_mouse_over( unsigned int scene_id, unsigned int entity_id )
+{
+	++bench_mouse_overs;
+}
+
+static void bench_mouse_out( unsigned int scene_id, unsigned int entity_id )
+{
+	++bench_mouse_outs;
+}
+
+/*
+ * Sweeps the cursor across a scene of 10k sprites with hover callbacks on all
+ * of them. The sweep is done once to grow the controller's buffers, then timed;
+ * the timed sweep must not allocate.
+ */
+static void bench_mouse_move( )
+{
+	sl_scene *scene;
+	GLFWwindow *handle;
+	vul_timer *timer;
+	unsigned int scene_id, id;
+	u64 micros, allocs;
+	u32 i, round;
+	double x, y;
+
+	scene_id = bench_new_scene( );
+	scene = sl_renderer_get_scene_by_id( scene_id );
+	handle = sl_renderer_get_window_by_id( scene->window_id )->handle;
+	bench_seed( 7 );
+	for( i = 0; i < BENCH_SPRITES; ++i ) {
+		id = bench_add_sprite( sl_renderer_get_scene_by_id( scene_id ), i % SL_MAX_LAYERS, 0.05f, 0, 0 );
+		sl_controller_add_mouse_over_callback( scene_id, id, bench_mouse_over );
+		sl_controller_add_mouse_out_callback( scene_id, id, bench_mouse_out );
+	}
+
+	timer = vul_timer_create( );
+	for( round = 0; round < 2; ++round ) {
+		bench_mouse_overs = bench_mouse_outs = 0;
+		allocs = bench_allocations( );
+		vul_timer_reset( timer );
+		for( i = 0; i < BENCH_MOUSE_MOVES; ++i ) {
+			// A zigzag across the window, which the stubbed and offscreen windows both make 64x64
+			x = ( double )( i % 640 ) * 0.1;
+			y = ( double )( ( i / 640 ) * 4 % 64 );
+			sl_controller_glfw_mouse_pos_callback( handle, x, y );
+		}
+		micros = vul_timer_get_micros( timer );
+		allocs = bench_allocations( ) - allocs;
+	}
+	bench_report( "controller_mouse_move_10k", BENCH_MOUSE_MOVES, micros, allocs );
+	if( allocs != 0 ) {
+		bench_fail( "controller_mouse_move_10k", "dispatching a mouse move allocated" );
+	}
+	if( bench_mouse_overs == 0 || bench_mouse_outs == 0 ) {
+		bench_fail( "controller_mouse_move_10k", "no mouse over or out was dispatched" );
+	}
+
+	vul_timer_destroy( timer );
+}
+
+/*
+ * Feeds a frame's worth of key presses and releases through the queue, drains
+ * it and takes an input state snapshot, and checks what came out each frame.
+ */
+static void bench_input_queue( )
+{
+	sl_input_event event;
+	sl_input_state state;
+	GLFWwindow *handle;
+	vul_timer *timer;
+	u64 micros, allocs;
+	u32 i, frame, count;
+	int key;
+	SL_BOOL ok;
+
+	handle = sl_renderer_get_window_by_id( 0 )->handle;
+	sl_controller_set_event_queueing( SL_TRUE );
+	timer = vul_timer_create( );
+	ok = SL_TRUE;
+
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	for( frame = 0; frame < BENCH_INPUT_FRAMES && ok; ++frame ) {
+		// Press 8 keys, release the first 4
+		for( i = 0; i < 8; ++i ) {
+			sl_controller_glfw_key_callback( handle, GLFW_KEY_A + ( int )( ( frame + i ) % 26 ), 0, GLFW_PRESS, 0 );
+		}
+		for( i = 0; i < 4; ++i ) {
+			sl_controller_glfw_key_callback( handle, GLFW_KEY_A + ( int )( ( frame + i ) % 26 ), 0, GLFW_RELEASE, 0 );
+		}
+		count = 0;
+		while( sl_controller_poll_event( &event ) ) {
+			key = GLFW_KEY_A + ( int )( ( frame + count % 8 ) % 26 );
+			ok = ok && event.type == SL_INPUT_KEY && event.data.key.key == key
+					&& event.data.key.action == ( count < 8 ? GLFW_PRESS : GLFW_RELEASE );
+			++count;
+		}
+		sl_controller_get_input_state( &state );
+		ok = ok && count == 12 && sl_controller_key_down( GLFW_KEY_A + ( int )( ( frame + 4 ) % 26 ) )
+				&& !sl_controller_key_down( GLFW_KEY_A + ( int )( frame % 26 ) )
+				&& ( state.keys_pressed[ ( GLFW_KEY_A + frame % 26 ) >> 5 ] >> ( ( GLFW_KEY_A + frame % 26 ) & 31 ) ) & 1;
+		// Let go of everything for the next frame
+		for( i = 4; i < 8; ++i ) {
+			sl_controller_glfw_key_callback( handle, GLFW_KEY_A + ( int )( ( frame + i ) % 26 ), 0, GLFW_RELEASE, 0 );
+		}
+		while( sl_controller_poll_event( &event ) ) {
+		}
+		sl_controller_get_input_state( &state );
+	}
+	micros = vul_timer_get_micros( timer );
+	bench_report( "controller_input_queue_10k_frames", BENCH_INPUT_FRAMES, micros, bench_allocations( ) - allocs );
+	if( !ok ) {
+		bench_fail( "controller_input_queue_10k_frames", "wrong events or input state" );
+	}
+
+	sl_controller_set_event_queueing( SL_FALSE );
+	vul_timer_destroy( timer );
+}
+
+static u32 bench_key_presses, bench_key_releases;
+
+static void bench_key_press_a( GLFWwindow *win_handle, int key, int scancode, int modifiers )
+{
+	++bench_key_presses;
+}
+
+static void bench_key_press_b( GLFWwindow *win_handle, int key, int scancode, int modifiers )
+{
+	bench_key_presses += 2;
+}
+
+static void bench_key_release( GLFWwindow *win_handle, int key, int scancode, int modifiers )
+{
+	++bench_key_releases;
+}
+
+/*
+ * Presses and releases the letter keys, with two press callbacks and a release
+ * callback on each, then checks every callback ran once per event. Removing a
+ * press callback must leave the other.
+ */
+static void bench_key_dispatch( )
+{
+	GLFWwindow *handle;
+	vul_timer *timer;
+	u64 micros, allocs;
+	u32 i;
+	int key;
+
+	handle = sl_renderer_get_window_by_id( 0 )->handle;
+	for( key = GLFW_KEY_A; key < GLFW_KEY_A + 26; ++key ) {
+		sl_controller_add_key_press_callback( key, bench_key_press_a );
+		sl_controller_add_key_press_callback( key, bench_key_press_b );
+		sl_controller_add_key_press_callback( key, bench_key_press_a ); // Already there
+		sl_controller_add_key_release_callback( key, bench_key_release );
+	}
+	timer = vul_timer_create( );
+	bench_key_presses = bench_key_releases = 0;
+
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	for( i = 0; i < BENCH_KEY_EVENTS; i += 2 ) {
+		key = GLFW_KEY_A + ( int )( ( i / 2 ) % 26 );
+		sl_controller_glfw_key_callback( handle, key, 0, GLFW_PRESS, 0 );
+		sl_controller_glfw_key_callback( handle, key, 0, GLFW_RELEASE, 0 );
+	}
+	micros = vul_timer_get_micros( timer );
+	bench_report( "controller_key_dispatch_100k", BENCH_KEY_EVENTS, micros, bench_allocations( ) - allocs );
+	if( bench_key_presses != BENCH_KEY_EVENTS / 2 * 3 || bench_key_releases != BENCH_KEY_EVENTS / 2 ) {
+		bench_fail( "controller_key_dispatch_100k", "wrong number of key callbacks" );
+	}
+
+	bench_key_presses = 0;
+	for( key = GLFW_KEY_A; key < GLFW_KEY_A + 26; ++key ) {
+		sl_controller_remove_key_press_callback( key, bench_key_press_a );
+		sl_controller_glfw_key_callback( handle, key, 0, GLFW_PRESS, 0 );
+		sl_controller_remove_key_press_callback( key, bench_key_press_b );
+		sl_controller_remove_key_release_callback( key, bench_key_release );
+		sl_controller_glfw_key_callback( handle, key, 0, GLFW_RELEASE, 0 );
+	}
+	if( bench_key_presses != 26 * 2 ) {
+		bench_fail( "controller_key_dispatch_100k", "removing a key callback dropped the wrong one" );
+	}
+
+	vul_timer_destroy( timer );
+}
+
+/*
+ * The key of the i-th entry of the hash map benchmark: scene and entity id pairs
+ * like the controller's, with consecutive entities spread over a few scenes.
+ */
+static u64 bench_map_key( u32 i )
+{
+	return SL_HASH_MAP_PAIR( i % 8, i / 8 );
+}
+
+/*
+ * Inserts 100k pair keys, looks them all up along with as many missing ones,
+ * then removes every other key, checking the map against what went in.
+ */
+static void bench_hash_map( )
+{
+	sl_hash_map map;
+	vul_timer *timer;
+	u64 micros, allocs;
+	u32 i, *value;
+	SL_BOOL ok;
+
+	sl_hash_map_create( &map, sizeof( u32 ) );
+	timer = vul_timer_create( );
+	ok = SL_TRUE;
+
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	for( i = 0; i < BENCH_MAP_KEYS; ++i ) {
+		sl_hash_map_insert( &map, bench_map_key( i ), &i );
+	}
+	micros = vul_timer_get_micros( timer );
+	bench_report( "hash_map_insert_100k", BENCH_MAP_KEYS, micros, bench_allocations( ) - allocs );
+	ok = ok && map.count == BENCH_MAP_KEYS;
+
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	for( i = 0; i < BENCH_MAP_KEYS; ++i ) {
+		value = ( u32* )sl_hash_map_get( &map, bench_map_key( i ) );
+		ok = ok && value != NULL && *value == i;
+		ok = ok && sl_hash_map_get( &map, bench_map_key( i + BENCH_MAP_KEYS ) ) == NULL;
+	}
+	micros = vul_timer_get_micros( timer );
+	bench_report( "hash_map_get_100k", BENCH_MAP_KEYS * 2, micros, bench_allocations( ) - allocs );
+
+	for( i = 0; i < BENCH_MAP_KEYS; i += 2 ) {
+		ok = ok && sl_hash_map_remove( &map, bench_map_key( i ) );
+	}
+	ok = ok && !sl_hash_map_remove( &map, bench_map_key( 0 ) ) && map.count == BENCH_MAP_KEYS / 2;
+	for( i = 0; i < BENCH_MAP_KEYS; ++i ) {
+		value = ( u32* )sl_hash_map_get( &map, bench_map_key( i ) );
+		ok = ok && ( i & 1 ? value != NULL && *value == i : value == NULL );
+	}
+	if( !ok ) {
+		bench_fail( "hash_map_get_100k", "the map lost, kept or changed an entry" );
+	}
+
+	sl_hash_map_destroy( &map );
+	vul_timer_destroy( timer );
+}
+
+/*
+ * Checks that every atlas image lies inside its page and overlaps no other.
+ */
+static void bench_check_atlas( sl_atlas *atlas, const char *name )
+{
+	sl_atlas_image *a, *b;
+	u32 i, j, count;
+
+	count = vul_vector_size( atlas->images );
+	for( i = 0; i < count; ++i ) {
+		a = ( sl_atlas_image* )vul_vector_get( atlas->images, i );
+		if( a->x + a->width > atlas->page_width || a->y + a->height > atlas->page_height ) {
+			bench_fail( name, "image outside its page" );
+			return;
+		}
+		for( j = i + 1; j < count; ++j ) {
+			b = ( sl_atlas_image* )vul_vector_get( atlas->images, j );
+			if( a->page == b->page 
+				&& a->x < b->x + b->width && b->x < a->x + a->width 
+				&& a->y < b->y + b->height && b->y < a->y + a->height ) {
+				bench_fail( name, "images overlap" );
+				return;
+			}
+		}
+	}
+}
+
+static void bench_atlas( )
+{
+	sl_atlas atlas;
+	vul_timer *timer;
+	unsigned char *pixels;
+	u64 micros, allocs;
+	u32 i;
+
+	pixels = ( unsigned char* )malloc( 64 * 64 * 4 );
+	memset( pixels, 0xff, 64 * 64 * 4 );
+	sl_atlas_create( &atlas, BENCH_ATLAS_PAGE, BENCH_ATLAS_PAGE );
+	timer = vul_timer_create( );
+	bench_seed( 6 );
+
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	for( i = 0; i < BENCH_ATLAS_IMAGES; ++i ) {
+		sl_atlas_add_image( &atlas, pixels, 8 + bench_rand( ) % 57, 8 + bench_rand( ) % 57 );
+	}
+	micros = vul_timer_get_micros( timer );
+	bench_report( "atlas_add_image_2k", BENCH_ATLAS_IMAGES, micros, bench_allocations( ) - allocs );
+	bench_check_atlas( &atlas, "atlas_add_image_2k" );
+
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	sl_atlas_repack( &atlas );
+	micros = vul_timer_get_micros( timer );
+	bench_report( "atlas_repack_2k", 1, micros, bench_allocations( ) - allocs );
+	bench_check_atlas( &atlas, "atlas_repack_2k" );
+
+	vul_timer_destroy( timer );
+	sl_atlas_destroy( &atlas );
+	free( pixels );
+}
+
+/*
+ * Writes an uncompressed 32-bit TGA of the given size, which stb_image reads.
+ */
+static void bench_write_tga( const char *path, u32 width, u32 height )
+{
+	unsigned char header[ 18 ];
+	unsigned char *pixels;
+	FILE *f;
+
+	memset( header, 0, sizeof( header ) );
+	header[ 2 ] = 2; // Uncompressed true color
+	header[ 12 ] = width & 0xff; header[ 13 ] = ( width >> 8 ) & 0xff;
+	header[ 14 ] = height & 0xff; header[ 15 ] = ( height >> 8 ) & 0xff;
+	header[ 16 ] = 32;
+	pixels = ( unsigned char* )malloc( width * height * 4 );
+	memset( pixels, 0x80, width * height * 4 );
+	f = fopen( path, "wb" );
+	fwrite( header, 1, sizeof( header ), f );
+	fwrite( pixels, 1, width * height * 4, f );
+	fclose( f );
+	free( pixels );
+}
+
+static void bench_texture_load_async( )
+{
+	unsigned int ids[ BENCH_LOAD_TEXTURES ];
+	char path[ 64 ];
+	sl_texture *tex;
+	vul_timer *timer;
+	u64 micros, allocs;
+	u32 i;
+
+	for( i = 0; i < BENCH_LOAD_TEXTURES; ++i ) {
+		snprintf( path, sizeof( path ), "bench_texture_%u.tga", i );
+		bench_write_tga( path, BENCH_LOAD_SIZE, BENCH_LOAD_SIZE );
+	}
+	timer = vul_timer_create( );
+
+	// Only the render thread's time counts; the workers decode while it sleeps
+	allocs = bench_allocations( );
+	vul_timer_reset( timer );
+	for( i = 0; i < BENCH_LOAD_TEXTURES; ++i ) {
+		snprintf( path, sizeof( path ), "bench_texture_%u.tga", i );
+		ids[ i ] = sl_texture_load_async( path );
+	}
+	micros = vul_timer_get_micros( timer );
+	while( sl_texture_loads_pending( ) ) {
+		vul_sleep( 1 );
+		vul_timer_reset( timer );
+		sl_texture_loader_update( &sl_renderer_global->texture_loader, SL_TEXTURE_UPLOAD_BUDGET );
+		micros += vul_timer_get_micros( timer );
+	}
+	bench_report( "texture_load_async_64", BENCH_LOAD_TEXTURES, micros, bench_allocations( ) - allocs );
+
+	for( i = 0; i < BENCH_LOAD_TEXTURES; ++i ) {
+		tex = sl_renderer_get_texture_by_id( ids[ i ] );
+		if( tex->load_state != SL_TEXTURE_LOADED || tex->width != BENCH_LOAD_SIZE || tex->height != BENCH_LOAD_SIZE ) {
+			bench_fail( "texture_load_async_64", "texture not loaded" );
+			break;
+		}
+	}
+	for( i = 0; i < BENCH_LOAD_TEXTURES; ++i ) {
+		snprintf( path, sizeof( path ), "bench_texture_%u.tga", i );
+		remove( path );
+	}
+	vul_timer_destroy( timer );
+}
+
+int main( int argc, char **argv )
+{
+	sl_renderer_create( );
+	sl_renderer_open_offscreen( 64, 64 );
+
+	bench_begin( argc, argv, "Engine benchmarks" );
+	bench_scene_add_remove( );
+	bench_scene_sort( 10000, "scene_sort_10k" );
+	bench_scene_sort( 100000, "scene_sort_100k" );
+	bench_scene_resort( 0, "scene_resort_100k_unchanged" );
+	bench_scene_resort( 16, "scene_resort_100k_16_changed" );
+	bench_simulator_update( 1000, SL_BROADPHASE_SWEEP_AND_PRUNE, "simulator_update_1k_sweep" );
+	bench_simulator_update( 10000, SL_BROADPHASE_SWEEP_AND_PRUNE, "simulator_update_10k_sweep" );
+	bench_simulator_update( 50000, SL_BROADPHASE_SWEEP_AND_PRUNE, "simulator_update_50k_sweep" );
+	bench_simulator_update( 1000, SL_BROADPHASE_SPATIAL_HASH, "simulator_update_1k_hash" );
+	bench_simulator_update( 10000, SL_BROADPHASE_SPATIAL_HASH, "simulator_update_10k_hash" );
+	bench_simulator_update( 50000, SL_BROADPHASE_SPATIAL_HASH, "simulator_update_50k_hash" );
+	bench_animator_update( );
+	bench_entities_at_pos( );
+	bench_mouse_move( );
+	bench_input_queue( );
+	bench_key_dispatch( );
+	bench_hash_map( );
+	bench_atlas( );
+	bench_texture_load_async( );
+
+	sl_renderer_destroy( );
+	return bench_end( );
+}
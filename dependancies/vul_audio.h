@@ -11,7 +11,12 @@
  *  - Mobile: iOS & Android
  *
  * @TODO(thynn): Hide a statically linked version behind a define? Would this be useful?
- * @TODO(thynn): Make the mixer wide (SSE, AVX and NEON at least).
+ * @TODO(thynn): NEON mixing kernels.
+ *
+ * With 16-bit samples the mixer uses SSE2 or AVX2 kernels when the compiler targets
+ * them (__SSE2__/__AVX2__, or x64 on MSVC). Define VUL_AUDIO_NO_SIMD to force the
+ * scalar kernels. All kernels apply volume in the same fixed point, so their
+ * output is bit-identical.
  *
  * Linux and OSX variation require linking with pthreads (because dlopen-ing
  * libpthread.so simply does not work!).
@@ -46,6 +51,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <stdio.h>
 
 #if defined( VUL_WINDOWS )
@@ -100,8 +106,41 @@ typedef struct vul__audio_mixer_clip {
 
 	b32 playing, looping, keep_after_finish;
 	f32 volume;
+
+	// Streamed clips have no samples; the mixer pulls each period from stream_read instead.
+	// The stream handles looping itself and sets *finished once it has no more data.
+	u64 ( *stream_read )( smp *dst, u64 frame_count, b32 *finished, void *user_data );
+	void *stream_data;
+	b32 stream_finished;
+	b32 stream_rewind; // Passed to the next read as *finished, asking the stream to start over
 } vul__audio_mixer_clip;
 
+// Size of the command queue between the controlling thread and the mixer. Must be a power of two.
+#ifndef VUL_AUDIO_COMMAND_QUEUE_SIZE
+#define VUL_AUDIO_COMMAND_QUEUE_SIZE 256
+#endif
+
+typedef enum vul__audio_command_type {
+	VUL__AUDIO_COMMAND_PLAY,
+	VUL__AUDIO_COMMAND_PAUSE,
+	VUL__AUDIO_COMMAND_RESUME,
+	VUL__AUDIO_COMMAND_REMOVE,
+	VUL__AUDIO_COMMAND_VOLUME,
+	VUL__AUDIO_COMMAND_GLOBAL_VOLUME
+} vul__audio_command_type;
+
+typedef struct vul__audio_command {
+	vul__audio_command_type type;
+	u64 id;
+	b32 looping, keep, reset;
+	f32 volume;
+} vul__audio_command;
+
+// Volumes are applied as fixed point numbers with this many fractional bits.
+// 14 bits keeps unity gain exact while still fitting a signed 16-bit lane.
+#define VUL__AUDIO_VOLUME_SHIFT 14
+#define VUL__AUDIO_MIXBUF_ALIGNMENT 32
+
 typedef struct vul__audio_mixer {
 	vul__audio_mixer_clip *clips;
 	u64 count, size, next_id;
@@ -109,9 +148,20 @@ typedef struct vul__audio_mixer {
 	f32 volume;
 	u32 channels;
 
-	smx *mixbuf;
+	smx *mixbuf; // Aligned to VUL__AUDIO_MIXBUF_ALIGNMENT bytes
 	smp *samples;
+	smp *stream_samples; // Scratch space streamed clips are read into
 	u32 mixbuf_sample_count;
+
+	// Mixing kernels, picked in vul__audio_mixer_init. mix_span adds count interleaved samples
+	// scaled by a fixed point volume to dst, clamp_span saturates count mixed samples into dst.
+	void ( *mix_span )( smx *dst, const smp *src, u64 count, s32 volume );
+	void ( *clamp_span )( smp *dst, const smx *src, u64 count );
+
+	// Single producer, single consumer ring of commands. The controlling thread is the only
+	// one to write command_head, the mixer the only one to write command_tail.
+	vul__audio_command commands[ VUL_AUDIO_COMMAND_QUEUE_SIZE ];
+	volatile u32 command_head, command_tail;
 } vul__audio_mixer;
 
 typedef enum vul__audio_lib {
@@ -269,6 +319,23 @@ vul_audio_return vul_audio_init( vul_audio_device *out,
  */
 u64 vul_audio_clip_add( vul_audio_device *dev, smp *data, u64 sample_count, u32 channels, f32 volume );
 
+/*
+ * Adds a streamed clip to the mixer. Instead of owning samples, the mixer calls
+ * read from the mixer thread every mix period to fill dst with up to frame_count
+ * interleaved frames of the given channel count, and uses the returned frame count
+ * (fewer frames than asked for is an underrun and plays silence). read must not
+ * block, and sets *finished once the stream has ended; looping is up to the stream.
+ * If *finished is already set when read is called, the stream is asked to start
+ * over from the beginning; this happens when a finished stream is played or
+ * resumed again (which needs keep set when it was played), or after pausing it
+ * with reset set. The stream may not have more channels than the mixer. The mixer
+ * never frees user_data; remove the clip before destroying it.
+ * Otherwise behaves like vul_audio_clip_add.
+ */
+u64 vul_audio_stream_add( vul_audio_device *dev, u32 channels, f32 volume,
+								  u64 ( *read )( smp *dst, u64 frame_count, b32 *finished, void *user_data ),
+								  void *user_data );
+
 /*
  * Pauses the clip with the given identifier. If reset is set, the current sample
  * of the clip is set to the first sample (in effect restarting the clip).
@@ -309,6 +376,23 @@ vul_audio_return vul_audio_clip_volume( vul_audio_device *dev, u64 id, f32 vol )
  */
 vul_audio_return vul_audio_set_global_volume( vul_audio_device *dev, f32 volume );
 
+//----------------------
+// Queued Mixer API
+//
+// These queue the command in a lock-free ring that the internal mixer drains at the
+// start of every mix period, so they never wait for the mixer thread. They may only be
+// called from a single thread. Commands take effect in order, at most one mix period
+// late. If the queue is full (VUL_AUDIO_COMMAND_QUEUE_SIZE commands in flight) the
+// command is dropped and VUL_ERROR returned. A custom mix_function never sees the queue.
+//
+
+vul_audio_return vul_audio_clip_play_queued( vul_audio_device *dev, u64 id, b32 looping, b32 keep );
+vul_audio_return vul_audio_clip_pause_queued( vul_audio_device *dev, u64 id, b32 reset );
+vul_audio_return vul_audio_clip_resume_queued( vul_audio_device *dev, u64 id );
+vul_audio_return vul_audio_clip_remove_queued( vul_audio_device *dev, u64 id );
+vul_audio_return vul_audio_clip_volume_queued( vul_audio_device *dev, u64 id, f32 vol );
+vul_audio_return vul_audio_set_global_volume_queued( vul_audio_device *dev, f32 volume );
+
 
 #ifdef _cplusplus
 }
@@ -379,6 +463,177 @@ char vul_last_error[ 1024 ];
 
 vul_audio_return vul__audio_write( vul_audio_device *dev, void *samples, u32 sample_count );
 
+// Define these before the VUL_DEFINE include to time each mix period with your own profiler.
+// BEGIN may open a block that END closes; both are placed in the same scope.
+#ifndef VUL_AUDIO_PROFILE_MIX_BEGIN
+	#define VUL_AUDIO_PROFILE_MIX_BEGIN( )
+	#define VUL_AUDIO_PROFILE_MIX_END( )
+#endif
+
+// Acquire/release access to the command queue indices
+#if defined( _MSC_VER )
+	#define VUL__AUDIO_LOAD_ACQUIRE( ptr ) vul__audio_load_acquire( ptr )
+	#define VUL__AUDIO_STORE_RELEASE( ptr, val ) vul__audio_store_release( ptr, val )
+static u32 vul__audio_load_acquire( volatile u32 *ptr )
+{
+	u32 val = *ptr;
+	MemoryBarrier( );
+	return val;
+}
+static void vul__audio_store_release( volatile u32 *ptr, u32 val )
+{
+	MemoryBarrier( );
+	*ptr = val;
+}
+#else
+	#define VUL__AUDIO_LOAD_ACQUIRE( ptr ) __atomic_load_n( ptr, __ATOMIC_ACQUIRE )
+	#define VUL__AUDIO_STORE_RELEASE( ptr, val ) __atomic_store_n( ptr, val, __ATOMIC_RELEASE )
+#endif
+
+#if defined( VUL_AUDIO_SAMPLE_16BIT ) && !defined( VUL_AUDIO_NO_SIMD )
+	#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+		#define VUL__AUDIO_SSE2
+		#include <emmintrin.h>
+	#endif
+	#if defined( __AVX2__ )
+		#define VUL__AUDIO_AVX2
+		#include <immintrin.h>
+	#endif
+#endif
+
+/*
+ * Allocates memory aligned to the given power of two. The pointer malloc returned
+ * is stored right before the aligned block. Free with vul__audio_free_aligned.
+ */
+void *vul__audio_alloc_aligned( size_t size, size_t alignment )
+{
+	void *raw;
+	uintptr_t aligned;
+
+	raw = malloc( size + alignment + sizeof( void* ) );
+	if( !raw ) {
+		return 0;
+	}
+	aligned = ( ( uintptr_t )raw + sizeof( void* ) + alignment - 1 ) & ~( ( uintptr_t )alignment - 1 );
+	( ( void** )aligned )[ -1 ] = raw;
+	return ( void* )aligned;
+}
+
+void vul__audio_free_aligned( void *ptr )
+{
+	if( ptr ) {
+		free( ( ( void** )ptr )[ -1 ] );
+	}
+}
+
+/*
+ * Converts a [0,1] volume to the fixed point the mixing kernels use.
+ */
+s32 vul__audio_volume_fixed( f32 volume )
+{
+	return ( s32 )( volume * ( f32 )( 1 << VUL__AUDIO_VOLUME_SHIFT ) + 0.5f );
+}
+
+void vul__audio_mix_span_scalar( smx *dst, const smp *src, u64 count, s32 volume )
+{
+	for( u64 i = 0; i < count; ++i ) {
+		dst[ i ] += ( ( smx )src[ i ] * volume ) >> VUL__AUDIO_VOLUME_SHIFT;
+	}
+}
+
+void vul__audio_clamp_span_scalar( smp *dst, const smx *src, u64 count )
+{
+	for( u64 i = 0; i < count; ++i ) {
+		smx expanded = src[ i ];
+		if( expanded > clamp_max ) {
+			expanded = clamp_max;
+		} else if( expanded < clamp_min ) {
+			expanded = clamp_min;
+		}
+		dst[ i ] = ( smp )expanded;
+	}
+}
+
+#ifdef VUL__AUDIO_SSE2
+void vul__audio_mix_span_sse2( smx *dst, const smp *src, u64 count, s32 volume )
+{
+	__m128i vol, zero, s, lo, hi;
+	u64 i;
+
+	// Interleaving samples with zeros makes madd compute sample * volume per 32-bit lane
+	vol = _mm_set1_epi32( volume & 0xffff );
+	zero = _mm_setzero_si128( );
+
+	// Scalar until dst is aligned, then 8 samples at a time, then the scalar tail
+	for( i = 0; i < count && ( ( uintptr_t )( dst + i ) & 15 ); ++i ) {
+		dst[ i ] += ( ( smx )src[ i ] * volume ) >> VUL__AUDIO_VOLUME_SHIFT;
+	}
+	for( ; i + 8 <= count; i += 8 ) {
+		s = _mm_loadu_si128( ( const __m128i* )( src + i ) );
+		lo = _mm_srai_epi32( _mm_madd_epi16( _mm_unpacklo_epi16( s, zero ), vol ), VUL__AUDIO_VOLUME_SHIFT );
+		hi = _mm_srai_epi32( _mm_madd_epi16( _mm_unpackhi_epi16( s, zero ), vol ), VUL__AUDIO_VOLUME_SHIFT );
+		_mm_store_si128( ( __m128i* )( dst + i ), _mm_add_epi32( _mm_load_si128( ( __m128i* )( dst + i ) ), lo ) );
+		_mm_store_si128( ( __m128i* )( dst + i + 4 ), _mm_add_epi32( _mm_load_si128( ( __m128i* )( dst + i + 4 ) ), hi ) );
+	}
+	for( ; i < count; ++i ) {
+		dst[ i ] += ( ( smx )src[ i ] * volume ) >> VUL__AUDIO_VOLUME_SHIFT;
+	}
+}
+
+void vul__audio_clamp_span_sse2( smp *dst, const smx *src, u64 count )
+{
+	__m128i a, b;
+	u64 i;
+
+	// packs saturates to the 16-bit range, which is exactly our clamp
+	for( i = 0; i + 8 <= count; i += 8 ) {
+		a = _mm_loadu_si128( ( const __m128i* )( src + i ) );
+		b = _mm_loadu_si128( ( const __m128i* )( src + i + 4 ) );
+		_mm_storeu_si128( ( __m128i* )( dst + i ), _mm_packs_epi32( a, b ) );
+	}
+	vul__audio_clamp_span_scalar( dst + i, src + i, count - i );
+}
+#endif
+
+#ifdef VUL__AUDIO_AVX2
+void vul__audio_mix_span_avx2( smx *dst, const smp *src, u64 count, s32 volume )
+{
+	__m256i vol, lo, hi;
+	u64 i;
+
+	vol = _mm256_set1_epi32( volume );
+
+	for( i = 0; i < count && ( ( uintptr_t )( dst + i ) & 31 ); ++i ) {
+		dst[ i ] += ( ( smx )src[ i ] * volume ) >> VUL__AUDIO_VOLUME_SHIFT;
+	}
+	for( ; i + 16 <= count; i += 16 ) {
+		lo = _mm256_cvtepi16_epi32( _mm_loadu_si128( ( const __m128i* )( src + i ) ) );
+		hi = _mm256_cvtepi16_epi32( _mm_loadu_si128( ( const __m128i* )( src + i + 8 ) ) );
+		lo = _mm256_srai_epi32( _mm256_mullo_epi32( lo, vol ), VUL__AUDIO_VOLUME_SHIFT );
+		hi = _mm256_srai_epi32( _mm256_mullo_epi32( hi, vol ), VUL__AUDIO_VOLUME_SHIFT );
+		_mm256_store_si256( ( __m256i* )( dst + i ), _mm256_add_epi32( _mm256_load_si256( ( __m256i* )( dst + i ) ), lo ) );
+		_mm256_store_si256( ( __m256i* )( dst + i + 8 ), _mm256_add_epi32( _mm256_load_si256( ( __m256i* )( dst + i + 8 ) ), hi ) );
+	}
+	for( ; i < count; ++i ) {
+		dst[ i ] += ( ( smx )src[ i ] * volume ) >> VUL__AUDIO_VOLUME_SHIFT;
+	}
+}
+
+void vul__audio_clamp_span_avx2( smp *dst, const smx *src, u64 count )
+{
+	__m256i a, b;
+	u64 i;
+
+	for( i = 0; i + 16 <= count; i += 16 ) {
+		a = _mm256_loadu_si256( ( const __m256i* )( src + i ) );
+		b = _mm256_loadu_si256( ( const __m256i* )( src + i + 8 ) );
+		// packs works per 128-bit lane; put the quarters back in order
+		_mm256_storeu_si256( ( __m256i* )( dst + i ), _mm256_permute4x64_epi64( _mm256_packs_epi32( a, b ), 0xd8 ) );
+	}
+	vul__audio_clamp_span_scalar( dst + i, src + i, count - i );
+}
+#endif
+
 void vul__audio_mixer_init( vul__audio_mixer *mixer, u32 channels, u32 buffer_sample_count, u32 clip_count_initial )
 {
 	memset( mixer, 0, sizeof( vul__audio_mixer ) );
@@ -386,69 +641,80 @@ void vul__audio_mixer_init( vul__audio_mixer *mixer, u32 channels, u32 buffer_sa
 	mixer->size = clip_count_initial;
 	mixer->count = 0;
    mixer->next_id = 1;
+	mixer->volume = 1.f;
 	mixer->channels = channels;
 	mixer->mixbuf_sample_count = buffer_sample_count;
-	mixer->mixbuf  = ( smx* )malloc( sizeof( smx ) * mixer->mixbuf_sample_count * mixer->channels * 2 );
+	mixer->mixbuf  = ( smx* )vul__audio_alloc_aligned( sizeof( smx ) * mixer->mixbuf_sample_count * mixer->channels * 2,
+																	  VUL__AUDIO_MIXBUF_ALIGNMENT );
 	mixer->samples = ( smp* )malloc( sizeof( smp ) * mixer->mixbuf_sample_count * mixer->channels );
+	mixer->stream_samples = ( smp* )malloc( sizeof( smp ) * mixer->mixbuf_sample_count * mixer->channels );
+
+	// Pick the widest kernels we were compiled for
+#if defined( VUL__AUDIO_AVX2 )
+	mixer->mix_span = vul__audio_mix_span_avx2;
+	mixer->clamp_span = vul__audio_clamp_span_avx2;
+#elif defined( VUL__AUDIO_SSE2 )
+	mixer->mix_span = vul__audio_mix_span_sse2;
+	mixer->clamp_span = vul__audio_clamp_span_sse2;
+#else
+	mixer->mix_span = vul__audio_mix_span_scalar;
+	mixer->clamp_span = vul__audio_clamp_span_scalar;
+#endif
 }
 
 void vul__audio_mixer_destroy( vul__audio_mixer *mixer )
 {
 	if( mixer ) {
-		free( mixer->mixbuf );
 		if( mixer->samples ) {
 			free( mixer->samples );
 			mixer->samples = 0;
 		}
+		if( mixer->stream_samples ) {
+			free( mixer->stream_samples );
+			mixer->stream_samples = 0;
+		}
 		if( mixer->mixbuf ) {
-			free( mixer->mixbuf );
+			vul__audio_free_aligned( mixer->mixbuf );
 			mixer->mixbuf = 0;
 		}
 		if( mixer->clips ) {
 			free( mixer->clips );
 			mixer->clips = 0;
 		}
-		free( mixer );
-		mixer = 0;
 	}
 }
 
 void vul__audio_clip_remove_internal( vul__audio_mixer *mixer, u64 idx )
 {
-   if( idx >= 1 ) {
-      for( u64 i = idx + 1; i < mixer->count; ++i ) {
-         memcpy( &mixer->clips[ i - 1 ], &mixer->clips[ i ], sizeof( vul__audio_mixer_clip ) );
-      }
+   for( u64 i = idx + 1; i < mixer->count; ++i ) {
+      memcpy( &mixer->clips[ i - 1 ], &mixer->clips[ i ], sizeof( vul__audio_mixer_clip ) );
    }
       
    mixer->count -= 1;
 }
 
-u64 vul_audio_clip_add( vul_audio_device *dev, smp *data, u64 sample_count, u32 channels, f32 volume )
+/*
+ * Appends a clip that is not playing to the mixer, growing the clip collection
+ * if needed. The mixer must be locked. Returns 0 if the collection can't grow.
+ */
+vul__audio_mixer_clip *vul__audio_clip_add_internal( vul__audio_mixer *mixer, smp *data, u64 sample_count, 
+																	  u32 channels, f32 volume )
 {
-	if( !dev ) {
-      ERR_NORETURN( "No audio device supplied.\n" );
-		return 0;
-	}
+	vul__audio_mixer_clip *clip;
 
-   if( VUL_ERROR == vul__audio_mixer_wait_and_lock( dev ) ) {
-      ERR_NORETURN( "Failed to lock audio mixer.\n" );
-		return 0;
-   }
-
-	if( dev->mixer.count == dev->mixer.size - 1 ) {
+	if( mixer->count == mixer->size - 1 ) {
 		vul__audio_mixer_clip* ptr;
-		ptr = realloc( dev->mixer.clips, sizeof( vul__audio_mixer_clip ) * dev->mixer.size * 2 );
+		ptr = realloc( mixer->clips, sizeof( vul__audio_mixer_clip ) * mixer->size * 2 );
 		if( ptr == 0 ) {
 			ERR_NORETURN( "Failed to reallocate mixer clip collection." );
 			return 0;
 		}
-		dev->mixer.clips = ptr;
-		dev->mixer.size *= 2;
+		mixer->clips = ptr;
+		mixer->size *= 2;
 	}
 
-	vul__audio_mixer_clip *clip = &dev->mixer.clips[ dev->mixer.count ];
-	clip->id = dev->mixer.next_id++;
+	clip = &mixer->clips[ mixer->count ];
+	clip->id = mixer->next_id++;
 	clip->samples = data;
 	clip->sample_count = sample_count;
 	clip->channels = channels;
@@ -456,15 +722,89 @@ u64 vul_audio_clip_add( vul_audio_device *dev, smp *data, u64 sample_count, u32
 	clip->playing = 0;
 	clip->looping = 0;
    clip->keep_after_finish = 0;
+	clip->stream_read = 0;
+	clip->stream_data = 0;
+	clip->stream_finished = 0;
+	clip->stream_rewind = 0;
 	if( volume < 0.f || volume > 1.f ) {
 		ERR_NORETURN( "Volume should be in range [0,1]. Value was clamped." );
 	}
 	clip->volume = volume > 1.f ? 1.f : volume < 0.f ? 0.f : volume;
-   dev->mixer.count++;
+   mixer->count++;
+
+	return clip;
+}
+
+u64 vul_audio_clip_add( vul_audio_device *dev, smp *data, u64 sample_count, u32 channels, f32 volume )
+{
+	vul__audio_mixer_clip *clip;
+	u64 id;
+
+	if( !dev ) {
+      ERR_NORETURN( "No audio device supplied.\n" );
+		return 0;
+	}
+
+   if( VUL_ERROR == vul__audio_mixer_wait_and_lock( dev ) ) {
+      ERR_NORETURN( "Failed to lock audio mixer.\n" );
+		return 0;
+   }
+
+	clip = vul__audio_clip_add_internal( &dev->mixer, data, sample_count, channels, volume );
+	id = clip ? clip->id : 0;
 
    vul__audio_mixer_release( dev );
 
-	return clip->id;
+	return id;
+}
+
+u64 vul_audio_stream_add( vul_audio_device *dev, u32 channels, f32 volume,
+								  u64 ( *read )( smp *dst, u64 frame_count, b32 *finished, void *user_data ),
+								  void *user_data )
+{
+	vul__audio_mixer_clip *clip;
+	u64 id;
+
+	if( !dev ) {
+      ERR_NORETURN( "No audio device supplied.\n" );
+		return 0;
+	}
+	if( !read ) {
+      ERR_NORETURN( "No stream read function supplied.\n" );
+		return 0;
+	}
+	if( channels > dev->mixer.channels ) {
+      ERR_NORETURN( "Streams can't have more channels than the mixer.\n" );
+		return 0;
+	}
+
+   if( VUL_ERROR == vul__audio_mixer_wait_and_lock( dev ) ) {
+      ERR_NORETURN( "Failed to lock audio mixer.\n" );
+		return 0;
+   }
+
+	id = 0;
+	clip = vul__audio_clip_add_internal( &dev->mixer, 0, 0, channels, volume );
+	if( clip ) {
+		clip->stream_read = read;
+		clip->stream_data = user_data;
+		id = clip->id;
+	}
+
+   vul__audio_mixer_release( dev );
+
+	return id;
+}
+
+/*
+ * A finished stream that is played again starts over, like a kept clip does.
+ */
+static void vul__audio_stream_replay( vul__audio_mixer_clip *clip )
+{
+	if( clip->stream_read && clip->stream_finished ) {
+		clip->stream_finished = 0;
+		clip->stream_rewind = 1;
+	}
 }
 
 vul_audio_return vul_audio_clip_pause( vul_audio_device *dev, u64 id, b32 reset )
@@ -493,6 +833,7 @@ vul_audio_return vul_audio_clip_pause( vul_audio_device *dev, u64 id, b32 reset
 	dev->mixer.clips[ idx ].playing = 0;
    if( reset ) {
       dev->mixer.clips[ idx ].current_offset = 0;
+      dev->mixer.clips[ idx ].stream_rewind = dev->mixer.clips[ idx ].stream_read != 0;
    }
 
    vul__audio_mixer_release( dev );
@@ -523,6 +864,7 @@ vul_audio_return vul_audio_clip_play( vul_audio_device *dev, u64 id, b32 looping
       ERR( "Clip not found, can't play it." );
 	}
 
+	vul__audio_stream_replay( &dev->mixer.clips[ idx ] );
 	dev->mixer.clips[ idx ].playing = 1;
 	dev->mixer.clips[ idx ].looping = looping;
    dev->mixer.clips[ idx ].keep_after_finish = keep;
@@ -555,6 +897,7 @@ vul_audio_return vul_audio_clip_resume( vul_audio_device *dev, u64 id )
       ERR( "Clip not found, can't resume it." );
 	}
 
+	vul__audio_stream_replay( &dev->mixer.clips[ idx ] );
 	dev->mixer.clips[ idx ].playing = 1;
 
    vul__audio_mixer_release( dev );
@@ -644,64 +987,230 @@ vul_audio_return vul_audio_set_global_volume( vul_audio_device *dev, f32 volume
    return VUL_OK;
 }
 
-// @TODO(thynn): SIMD mixing. We should define types and functions ala 
-// sse_add = _mm_add_epi32 / _mm_add_epi16 / vadd_s32 / vadd_s16
-// For this we need to enforce clips->channels == mixer->channels
-// anyway so we can process bytes in order without repacking, and then we need to malloc mixbuf aligned
-// and handle non-aligned first and last bytes separately. For now, we do it scalar
+/*
+ * Pushes a command onto the mixer's command queue. Only touches command_head, so
+ * it never waits for the mixer.
+ */
+vul_audio_return vul__audio_command_push( vul_audio_device *dev, const vul__audio_command *cmd )
+{
+	u32 head, tail;
+
+	if( !dev ) {
+		ERR( "No audio device supplied.\n" );
+	}
+	head = dev->mixer.command_head;
+	tail = VUL__AUDIO_LOAD_ACQUIRE( &dev->mixer.command_tail );
+	if( head - tail >= VUL_AUDIO_COMMAND_QUEUE_SIZE ) {
+		ERR( "Audio command queue is full, command dropped.\n" );
+	}
+	dev->mixer.commands[ head & ( VUL_AUDIO_COMMAND_QUEUE_SIZE - 1 ) ] = *cmd;
+	VUL__AUDIO_STORE_RELEASE( &dev->mixer.command_head, head + 1 );
+
+	return VUL_OK;
+}
+
+vul_audio_return vul_audio_clip_play_queued( vul_audio_device *dev, u64 id, b32 looping, b32 keep )
+{
+	vul__audio_command cmd;
+
+	memset( &cmd, 0, sizeof( cmd ) );
+	cmd.type = VUL__AUDIO_COMMAND_PLAY;
+	cmd.id = id;
+	cmd.looping = looping;
+	cmd.keep = keep;
+	return vul__audio_command_push( dev, &cmd );
+}
+
+vul_audio_return vul_audio_clip_pause_queued( vul_audio_device *dev, u64 id, b32 reset )
+{
+	vul__audio_command cmd;
+
+	memset( &cmd, 0, sizeof( cmd ) );
+	cmd.type = VUL__AUDIO_COMMAND_PAUSE;
+	cmd.id = id;
+	cmd.reset = reset;
+	return vul__audio_command_push( dev, &cmd );
+}
+
+vul_audio_return vul_audio_clip_resume_queued( vul_audio_device *dev, u64 id )
+{
+	vul__audio_command cmd;
+
+	memset( &cmd, 0, sizeof( cmd ) );
+	cmd.type = VUL__AUDIO_COMMAND_RESUME;
+	cmd.id = id;
+	return vul__audio_command_push( dev, &cmd );
+}
+
+vul_audio_return vul_audio_clip_remove_queued( vul_audio_device *dev, u64 id )
+{
+	vul__audio_command cmd;
+
+	memset( &cmd, 0, sizeof( cmd ) );
+	cmd.type = VUL__AUDIO_COMMAND_REMOVE;
+	cmd.id = id;
+	return vul__audio_command_push( dev, &cmd );
+}
+
+vul_audio_return vul_audio_clip_volume_queued( vul_audio_device *dev, u64 id, f32 vol )
+{
+	vul__audio_command cmd;
+
+	memset( &cmd, 0, sizeof( cmd ) );
+	cmd.type = VUL__AUDIO_COMMAND_VOLUME;
+	cmd.id = id;
+	cmd.volume = vol > 1.f ? 1.f : vol < 0.f ? 0.f : vol;
+	return vul__audio_command_push( dev, &cmd );
+}
+
+vul_audio_return vul_audio_set_global_volume_queued( vul_audio_device *dev, f32 volume )
+{
+	vul__audio_command cmd;
+
+	memset( &cmd, 0, sizeof( cmd ) );
+	cmd.type = VUL__AUDIO_COMMAND_GLOBAL_VOLUME;
+	cmd.volume = volume > 1.f ? 1.f : volume < 0.f ? 0.f : volume;
+	return vul__audio_command_push( dev, &cmd );
+}
+
+/*
+ * Applies all queued commands to the mixer. Called by the mixer thread, with the
+ * mixer lock held, at the start of each mix period. Commands for clips that no
+ * longer exist are ignored.
+ */
+void vul__audio_mixer_drain_commands( vul__audio_mixer *mixer )
+{
+	vul__audio_command *cmd;
+	vul__audio_mixer_clip *clip;
+	u32 head, tail;
+	u64 idx;
+
+	head = VUL__AUDIO_LOAD_ACQUIRE( &mixer->command_head );
+	for( tail = mixer->command_tail; tail != head; ++tail ) {
+		cmd = &mixer->commands[ tail & ( VUL_AUDIO_COMMAND_QUEUE_SIZE - 1 ) ];
+		if( cmd->type == VUL__AUDIO_COMMAND_GLOBAL_VOLUME ) {
+			mixer->volume = cmd->volume;
+			continue;
+		}
+		for( idx = 0; idx < mixer->count; ++idx ) {
+			if( mixer->clips[ idx ].id == cmd->id ) {
+				break;
+			}
+		}
+		if( idx == mixer->count ) {
+			continue;
+		}
+		clip = &mixer->clips[ idx ];
+		switch( cmd->type ) {
+		case VUL__AUDIO_COMMAND_PLAY:
+			vul__audio_stream_replay( clip );
+			clip->playing = 1;
+			clip->looping = cmd->looping;
+			clip->keep_after_finish = cmd->keep;
+			break;
+		case VUL__AUDIO_COMMAND_PAUSE:
+			clip->playing = 0;
+			if( cmd->reset ) {
+				clip->current_offset = 0;
+				clip->stream_rewind = clip->stream_read != 0;
+			}
+			break;
+		case VUL__AUDIO_COMMAND_RESUME:
+			vul__audio_stream_replay( clip );
+			clip->playing = 1;
+			break;
+		case VUL__AUDIO_COMMAND_REMOVE:
+			vul__audio_clip_remove_internal( mixer, idx );
+			break;
+		case VUL__AUDIO_COMMAND_VOLUME:
+			clip->volume = cmd->volume;
+			break;
+		default:
+			break;
+		}
+	}
+	VUL__AUDIO_STORE_RELEASE( &mixer->command_tail, tail );
+}
+
+/*
+ * Mixes frames of interleaved samples with src_channels channels into the mix buffer
+ * starting at frame dst_frame. Sources with the mixer's channel count are mixed with
+ * the wide kernel; others channel by channel, dropping extra channels.
+ */
+void vul__audio_mix_clip( vul__audio_mixer *mixer, const smp *src, u32 src_channels,
+								  u64 dst_frame, u64 frames, s32 volume )
+{
+	u32 min_channels;
+	smx *dst;
+
+	dst = mixer->mixbuf + dst_frame * mixer->channels;
+	if( src_channels == mixer->channels ) {
+		mixer->mix_span( dst, src, frames * mixer->channels, volume );
+		return;
+	}
+	min_channels = src_channels < mixer->channels ? src_channels : mixer->channels;
+	for( u64 j = 0; j < frames; ++j ) {
+		for( u32 k = 0; k < min_channels; ++k ) {
+			dst[ j * mixer->channels + k ] += ( ( smx )src[ j * src_channels + k ] * volume ) 
+														 >> VUL__AUDIO_VOLUME_SHIFT;
+		}
+	}
+}
+
 void vul__audio_mix( vul__audio_mixer *mixer )
 {
-	u32 sample_count, min_channels, ofs;
-	smp sample;
+	u64 sample_count, remaining;
+	s32 volume;
+
+	VUL_AUDIO_PROFILE_MIX_BEGIN( );
+	vul__audio_mixer_drain_commands( mixer );
 
 	// Mix
 	memset( mixer->mixbuf, 0, mixer->mixbuf_sample_count * mixer->channels * sizeof( smx ) );
 	for( u64 i = 0; i < mixer->count; ++i ) {
-		if( !mixer->clips[ i ].playing ) {
+		vul__audio_mixer_clip *clip = &mixer->clips[ i ];
+		if( !clip->playing ) {
 			continue;
 		}
-		min_channels = mixer->clips[ i ].channels < mixer->channels 
-						 ? mixer->clips[ i ].channels : mixer->channels;
-		sample_count = mixer->clips[ i ].sample_count - ( mixer->clips[ i ].current_offset / mixer->clips[ i ].channels );
-		sample_count = sample_count > mixer->mixbuf_sample_count ? mixer->mixbuf_sample_count : sample_count;
-		for( u64 j = 0; j < sample_count; ++j ) {
-			for( u32 k = 0; k < min_channels; ++k ) {
-				ofs = mixer->clips[ i ].current_offset + j * mixer->clips[ i ].channels + k;
-				mixer->mixbuf[ j * mixer->channels + k ] += ( smx )( ( f64 )mixer->clips[ i ].samples[ ofs ] * 
-																					  ( f64 )mixer->clips[ i ].volume );
-			}
+		volume = vul__audio_volume_fixed( clip->volume * mixer->volume );
+		if( clip->stream_read ) {
+			clip->stream_finished = clip->stream_rewind;
+			clip->stream_rewind = 0;
+			// Streams never have more channels than the mixer, so a period always fits the scratch buffer
+			sample_count = clip->stream_read( mixer->stream_samples, mixer->mixbuf_sample_count,
+														 &clip->stream_finished, clip->stream_data );
+			sample_count = sample_count > mixer->mixbuf_sample_count ? mixer->mixbuf_sample_count : sample_count;
+			vul__audio_mix_clip( mixer, mixer->stream_samples, clip->channels, 0, sample_count, volume );
+			continue;
 		}
-		mixer->clips[ i ].current_offset += sample_count * mixer->clips[ i ].channels;
-		// Handle looping
-		if( ( mixer->clips[ i ].current_offset / mixer->clips[ i ].channels ) == mixer->clips[ i ].sample_count && mixer->clips[ i ].looping ) {
-			s64 remaining = ( s64 )mixer->mixbuf_sample_count - ( s64 )sample_count;
-			for( u64 j = sample_count * mixer->channels; 
-             j < remaining * mixer->channels; ++j ) {
-				for( u32 k = 0; k < min_channels; ++k ) {
-					ofs = j * mixer->clips[ i ].channels + k;
-					mixer->mixbuf[ j * mixer->channels + k ] += ( smx )( ( f64 )mixer->clips[ i ].samples[ ofs ] *
-																						  ( f64 )mixer->clips[ i ].volume );
-				}
-			}
-			mixer->clips[ i ].current_offset = remaining * mixer->channels;
+		sample_count = clip->sample_count - ( clip->current_offset / clip->channels );
+		sample_count = sample_count > mixer->mixbuf_sample_count ? mixer->mixbuf_sample_count : sample_count;
+		vul__audio_mix_clip( mixer, clip->samples + clip->current_offset, clip->channels, 0, sample_count, volume );
+		clip->current_offset += sample_count * clip->channels;
+		// Handle looping; fill the rest of the period from the start of the clip
+		if( ( clip->current_offset / clip->channels ) == clip->sample_count && clip->looping ) {
+			remaining = mixer->mixbuf_sample_count - sample_count;
+			remaining = remaining > clip->sample_count ? clip->sample_count : remaining;
+			vul__audio_mix_clip( mixer, clip->samples, clip->channels, sample_count, remaining, volume );
+			clip->current_offset = remaining * clip->channels;
 		}
 	}
 
 	// Clamp into the upload-buffer
-	memset( mixer->samples, 0, mixer->mixbuf_sample_count * mixer->channels * sizeof( smp ) );
-	for( u64 i = 0; i < mixer->mixbuf_sample_count * mixer->channels; ++i ) {
-		smx expanded = mixer->mixbuf[ i ];
-		if( expanded > clamp_max ) {
-			expanded = clamp_max;
-		} else if( expanded < clamp_min ) {
-			expanded = clamp_min;
-		}
-		mixer->samples[ i ] = ( smp )expanded;
-	}
+	mixer->clamp_span( mixer->samples, mixer->mixbuf, mixer->mixbuf_sample_count * mixer->channels );
 
 	// Remove non-looping clips that are done. Back to front to minimize copying, but still inefficient.
+	// Streams loop on their own, so a finished stream is done regardless of the looping flag.
 	for( s64 i = ( s64 )mixer->count - 1; i >= 0; --i ) {
-		if( ( mixer->clips[ i ].current_offset / mixer->clips[ i ].channels ) == mixer->clips[ i ].sample_count ) {
+		if( mixer->clips[ i ].stream_read ) {
+			if( mixer->clips[ i ].stream_finished && mixer->clips[ i ].playing ) {
+				if( mixer->clips[ i ].keep_after_finish ) {
+					mixer->clips[ i ].playing = 0;
+				} else {
+					vul__audio_clip_remove_internal( mixer, i );
+				}
+			}
+		} else if( ( mixer->clips[ i ].current_offset / mixer->clips[ i ].channels ) == mixer->clips[ i ].sample_count ) {
 			if( !mixer->clips[ i ].looping ) {
             if( mixer->clips[ i ].keep_after_finish ) {
                mixer->clips[ i ].playing = 0;
@@ -712,6 +1221,7 @@ void vul__audio_mix( vul__audio_mixer *mixer )
 			}
 		}
 	}
+	VUL_AUDIO_PROFILE_MIX_END( );
 }
 
 #if defined( VUL_WINDOWS ) || defined( VUL_LINUX )
@@ -10,6 +10,8 @@
  * We mix the audio in _update and store it in the state's buffer.
  * The portaudio stream is written from that buffer in _update.
  * Mixing is correct for up to 2^16-1 clips. It might overflow if we have more.
+ * Play/stop/pause/resume/remove/volume calls are queued to the mixer thread through
+ * a lock-free ring and never wait on it, so they must all come from the same thread.
  *
  * ? If public domain is not legally valid in your legal jurisdiction
  *   the MIT licence applies (see the LICENCE file)
@@ -37,6 +39,8 @@
 #define STB_VORBIS_HEADER_ONLY
 #include <stb_vorbis.h>
 
+#include "audio/stream.h"
+
 #ifndef SL_BOOL
 	#define SL_BOOL int
 	#define SL_TRUE 1
@@ -55,6 +59,10 @@ typedef struct sl_aurator {
    // All clips belonging to this aurator
    u64 *clips;
    u64 clip_count;
+   // Streamed clips belonging to this aurator, and their clip ids. Also listed in clips.
+   sl_audio_stream **streams;
+   u64 *stream_ids;
+   u64 stream_count;
 } sl_aurator;
 
 /*
@@ -91,9 +99,20 @@ void sl_aurator_finalize( );
 u64 sl_aurator_load_ogg( sl_aurator *aurator, char *path );
 
 /*
- * Play a clip (looping if wanted)
+ * Opens an ogg vorbis file for streaming and returns an ID for it. The file is
+ * decoded on its own thread while playing instead of up front, which is what
+ * long tracks (music) should use. Returns 0 on failure.
+ * A stream played with keep set can be played again once it has finished, and
+ * then starts over, as it does after being stopped with reset set.
+ */
+u64 sl_aurator_stream_ogg( sl_aurator *aurator, char *path );
+
+/*
+ * Play a clip (looping if wanted). Returns SL_FALSE if the mixer's command queue
+ * is full and the clip wasn't queued; that clears within a mix period, so try
+ * again next frame.
  */
-void sl_aurator_play( sl_aurator *aurator, u64 clip_id, b32 looping, b32 keep );
+b32 sl_aurator_play( sl_aurator *aurator, u64 clip_id, b32 looping, b32 keep );
 /* 
  * Stop a clip (reseting it's state if wanted).
  */
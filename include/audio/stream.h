@@ -0,0 +1,100 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain?
+ *
+ * Streamed audio. Decodes an Ogg Vorbis file incrementally on its own thread
+ * into a ring buffer that the mixer pulls from, so long tracks never have to be
+ * decoded into memory up front. The decode thread is the only writer of the ring,
+ * the mixer thread the only reader; neither ever waits on the other.
+ *
+ * ? If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SLENDERER_AUDIO_STREAM_H
+#define SLENDERER_AUDIO_STREAM_H
+
+#include <vul_types.h>
+#if defined( VUL_WINDOWS )
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+
+#define STB_VORBIS_HEADER_ONLY
+#include <stb_vorbis.h>
+
+#ifndef SL_BOOL
+	#define SL_BOOL int
+	#define SL_TRUE 1
+	#define SL_FALSE 0
+#endif
+
+#ifndef SL_MIN
+	#define SL_MIN(a, b) ( ( a ) <= ( b ) ? ( a ) : ( b ) )
+#endif
+
+// Size of the decoded ring in frames. Must be a power of two. At 44.1kHz this is ~0.75s.
+#define SL_AUDIO_STREAM_RING_FRAMES 0x8000
+// Most frames decoded per call into stb_vorbis before checking for room again.
+#define SL_AUDIO_STREAM_DECODE_FRAMES 0x1000
+// How long the decode thread sleeps when the ring is full.
+#define SL_AUDIO_STREAM_SLEEP_MS 5
+
+// Steps of a rewind: the mixer requests it, the decode thread seeks back to the
+// start and marks it done, and the mixer then skips the frames decoded before it.
+#define SL_AUDIO_STREAM_REWIND_NONE 0
+#define SL_AUDIO_STREAM_REWIND_REQUESTED 1
+#define SL_AUDIO_STREAM_REWIND_DONE 2
+
+typedef struct sl_audio_stream {
+	stb_vorbis *vorbis;
+	u32 channels;
+	s16 *ring; // SL_AUDIO_STREAM_RING_FRAMES * channels interleaved samples
+
+	// Frame counters; the decode thread only writes head, the mixer only writes tail.
+	volatile u32 head, tail;
+	volatile u32 looping, eof, quit;
+	volatile u32 rewind; // SL_AUDIO_STREAM_REWIND_*
+	u32 rewind_head; // First frame decoded after the last rewind; valid once it's done
+
+#if defined( VUL_WINDOWS )
+	HANDLE thread;
+#else
+	pthread_t thread;
+#endif
+} sl_audio_stream;
+
+/*
+ * Opens an Ogg Vorbis file for streaming and starts its decode thread. Audio is
+ * output with the given channel count (stb_vorbis maps mono to both stereo channels).
+ * Returns NULL if the file can't be opened or its sample rate doesn't match.
+ */
+sl_audio_stream *sl_audio_stream_open_ogg( const char *path, u32 channels, u32 sample_rate );
+
+/*
+ * Stops the decode thread, closes the file and frees the stream. The stream must
+ * no longer be in the mixer.
+ */
+void sl_audio_stream_destroy( sl_audio_stream *stream );
+
+/*
+ * Sets whether the decode thread restarts the file when it reaches the end.
+ */
+void sl_audio_stream_set_looping( sl_audio_stream *stream, SL_BOOL looping );
+
+/*
+ * The mixer's read function (see vul_audio_stream_add). Copies up to frame_count
+ * decoded frames to dst and returns how many it copied. If *finished is set on
+ * entry, the decode thread is told to start over from the beginning of the file;
+ * until it has, the stream reads no frames.
+ */
+u64 sl_audio_stream_read( s16 *dst, u64 frame_count, b32 *finished, void *stream );
+
+#endif
@@ -0,0 +1,197 @@
+/**
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * Frame profiler. Code is timed in named zones; each zone accumulates the time spent in it
+ * during a frame, and the last SL_PROFILER_FRAME_COUNT frames are kept in a ring for
+ * min/avg/p99/max queries. The renderer instruments its own frame (setup, animation,
+ * simulation, sort, each layer, post and swap) and ends a frame on every buffer swap.
+ *
+ * A range of frames can also be captured to a chrome://tracing/Perfetto JSON file. The
+ * capture includes zones timed on any thread, like the audio mixer and stream decoders.
+ *
+ * Define SL_PROFILER in the build to enable it. Without it the zone macros compile
+ * to plain blocks and none of the functions below exist. sl_renderer_create initializes
+ * the profiler before it starts any other thread, and the thread calling it owns the
+ * frame stats; zones timed on other threads only show up in captured traces. Zones may
+ * be timed from any thread, but only the owning thread may end frames, query stats or
+ * start captures. Anything timed before initialization is dropped.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SLENDERER_PROFILER_H
+#define SLENDERER_PROFILER_H
+
+#include <vul_types.h>
+#include <vul_timer.h>
+
+#ifdef SL_PROFILER
+
+#define SL_PROFILER_FRAME_COUNT 128 // Frames kept in the ring
+#define SL_PROFILER_MAX_ZONES 64
+#define SL_PROFILER_ZONE_NAME_MAX 32
+#define SL_PROFILER_NO_ZONE 0xffffffff
+#define SL_PROFILER_FRAME_ZONE 0 // The zone holding whole frame times, named "frame"
+#define SL_PROFILER_MAX_THREADS 16 // Threads that can be named in traces
+#define SL_PROFILER_TRACE_EVENTS_PER_FRAME 256 // Trace events reserved per captured frame
+
+typedef struct {
+	u64 min, avg, p99, max; // Microseconds spent in the zone per frame
+	f32 calls; // Average times the zone was entered per frame
+	u32 frames; // How many frames the stats are over
+} sl_profiler_stats;
+
+typedef struct {
+	u32 zone;
+	u32 thread;
+	u64 start, duration; // Microseconds
+	volatile u32 written; // Set once the other fields are, so a capture never reads half an event
+} sl_profiler_trace_event;
+
+typedef struct sl_profiler_trace_buffer {
+	sl_profiler_trace_event *events;
+	u32 capacity;
+	struct sl_profiler_trace_buffer *next; // The buffer of the capture before this one
+} sl_profiler_trace_buffer;
+
+typedef struct {
+	char names[ SL_PROFILER_MAX_ZONES ][ SL_PROFILER_ZONE_NAME_MAX ];
+	u32 zone_count;
+
+	// One slot more than the frames kept, for the frame being recorded
+	u64 micros[ SL_PROFILER_FRAME_COUNT + 1 ][ SL_PROFILER_MAX_ZONES ]; // Time per zone per frame
+	u16 calls[ SL_PROFILER_FRAME_COUNT + 1 ][ SL_PROFILER_MAX_ZONES ]; // Entries per zone per frame
+	u32 current; // Ring index of the frame being recorded
+	u32 frame_count; // Number of finished frames in the ring
+
+	vul_timer timer;
+	u64 frame_start;
+
+	// Trace capture. Events are appended lock-free from any thread, which may still be
+	// writing to a capture's buffer after it ended, so every capture gets a new one and
+	// the old ones are only freed by sl_profiler_shutdown.
+	sl_profiler_trace_buffer *volatile trace; // Buffer of the latest capture, heading the older ones
+	volatile u32 event_count;
+	volatile u32 capturing;
+	u32 capture_frames_left;
+	char capture_path[ 256 ];
+
+	char thread_names[ SL_PROFILER_MAX_THREADS ][ SL_PROFILER_ZONE_NAME_MAX ];
+	volatile u32 thread_count;
+	volatile u32 zone_lock;
+} sl_profiler;
+
+/**
+ * Starts the clock and registers the frame zone, making the calling thread the one
+ * that owns the frame stats. Must be called before any other thread uses the
+ * profiler; later calls do nothing.
+ */
+void sl_profiler_init( );
+
+/**
+ * Frees the trace buffers. No other thread may be using the profiler anymore;
+ * sl_renderer_destroy calls it once the threads it started have stopped.
+ */
+void sl_profiler_shutdown( );
+
+/**
+ * Returns the id of the zone with the given name, registering it if it's new.
+ * Ids are stable for the lifetime of the program. Returns SL_PROFILER_NO_ZONE
+ * if all SL_PROFILER_MAX_ZONES zones are taken or the profiler isn't initialized.
+ */
+u32 sl_profiler_zone_id( const char *name );
+
+/**
+ * Like sl_profiler_zone_id, but looks the zone up only while *cache is still
+ * SL_PROFILER_NO_ZONE, and stores the id there. The cache is read and written
+ * atomically, so it may be shared by threads.
+ */
+u32 sl_profiler_zone_id_cached( volatile u32 *cache, const char *name );
+
+/**
+ * Current time in microseconds; the start value passed to sl_profiler_record.
+ */
+u64 sl_profiler_now( );
+
+/**
+ * Adds the time since start to the given zone in the current frame.
+ */
+void sl_profiler_record( u32 zone, u64 start );
+
+/**
+ * Finishes the current frame, recording its total time in the "frame" zone, and
+ * starts the next one.
+ */
+void sl_profiler_end_frame( );
+
+/**
+ * Aggregates the stored frames of a zone into out. Frames where the zone was never
+ * entered are skipped. Returns SL_FALSE if the zone doesn't exist or was never entered.
+ */
+int sl_profiler_get_stats( const char *name, sl_profiler_stats *out );
+
+/**
+ * Drops all recorded frames. Zones stay registered.
+ */
+void sl_profiler_reset( );
+
+/**
+ * Names the calling thread in captured traces. Only the first name given sticks,
+ * so it is cheap to call every time a thread enters its work loop.
+ */
+void sl_profiler_name_thread( const char *name );
+
+/**
+ * Captures every zone timed on any thread during the next frame_count frames, then
+ * writes them as a chrome://tracing/Perfetto JSON file to path. Events past
+ * SL_PROFILER_TRACE_EVENTS_PER_FRAME per frame on average are dropped. The event
+ * buffer of every capture is kept until sl_profiler_shutdown.
+ * Returns SL_FALSE if a capture is already running or memory can't be had.
+ */
+int sl_profiler_capture_trace( const char *path, u32 frame_count );
+
+/**
+ * Whether a trace capture is running.
+ */
+int sl_profiler_is_capturing( );
+
+/**
+ * Times the enclosed code as the zone with the given name. Opens a block that
+ * SL_PROFILE_ZONE_END closes, so the pair must be in the same scope.
+ */
+#define SL_PROFILE_ZONE_BEGIN( name ) {\
+	static volatile u32 sl__profile_zone_cache = SL_PROFILER_NO_ZONE;\
+	u32 sl__profile_zone = sl_profiler_zone_id_cached( &sl__profile_zone_cache, name );\
+	u64 sl__profile_start = sl_profiler_now( );
+
+/**
+ * Like SL_PROFILE_ZONE_BEGIN, but for a zone id looked up beforehand.
+ */
+#define SL_PROFILE_ZONE_BEGIN_ID( id ) {\
+	u32 sl__profile_zone = ( id );\
+	u64 sl__profile_start = sl_profiler_now( );
+
+#define SL_PROFILE_ZONE_END( ) \
+	sl_profiler_record( sl__profile_zone, sl__profile_start );\
+	}
+
+#define SL_PROFILE_END_FRAME( ) sl_profiler_end_frame( )
+
+#else
+
+#define SL_PROFILE_ZONE_BEGIN( name ) {
+#define SL_PROFILE_ZONE_BEGIN_ID( id ) {
+#define SL_PROFILE_ZONE_END( ) }
+#define SL_PROFILE_END_FRAME( )
+
+#endif
+
+#endif
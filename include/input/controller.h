@@ -19,11 +19,12 @@
 
 #include <stdio.h>
 
-#include <vul_hash_map.h>
 #include <vul_resizable_array.h>
+#include <vul_timer.h>
 
 #include "vul_cmath.h"
 #include "renderer/scene.h"
+#include "utilities/hash_map.h"
 #include "slenderer.h"
 
 
@@ -32,10 +33,6 @@
 
 #define SL_CONTROLLER_UNIVERSAL 0xffffffff
 
-#define SL_MOUSE_BUCKET_COUNT 64
-#define SL_KEY_BUCKET_COUNT 32
-#define SL_WINDOW_BUCKET_COUNT 4
-
 #define SL_MOUSE_ENTER_EXIT_CALLBACK( name ) void (*name)( GLFWwindow *win_handle, int entered )
 #define SL_MOUSE_DOWN_CALLBACK( name ) void (*name)( unsigned int scene_id, unsigned int entity_id, int button )
 #define SL_MOUSE_UP_CALLBACK( name ) void (*name)( unsigned int scene_id, unsigned int entity_id, int button )
@@ -55,23 +52,84 @@
 #define SL_KEY_RELEASED_PROTO void (*)( GLFWwindow*, int, int, int )
 #define SL_KEY_REPEAT_PROTO void (*)( GLFWwindow*, int, int, int )
 
+#define SL_INPUT_CALLBACK_SLOTS 4 // Callbacks per key or mouse button and action
+#define SL_INPUT_QUEUE_SIZE 256 // Events the queue holds between drains; a power of two
+#define SL_INPUT_KEY_WORDS ( ( GLFW_KEY_LAST + 32 ) / 32 ) // Words of a bitset with a bit per key
+
+// Types of queued input events
+#define SL_INPUT_KEY 0
+#define SL_INPUT_CHAR 1
+#define SL_INPUT_MOUSE_MOVE 2
+#define SL_INPUT_MOUSE_BUTTON 3
+#define SL_INPUT_MOUSE_SCROLL 4
+#define SL_INPUT_MOUSE_ENTER_EXIT 5
+
+/**
+ * An input event as GLFW delivered it, with the time it arrived.
+ */
+typedef struct {
+	u32 type; // SL_INPUT_*
+	GLFWwindow *window;
+	u64 time; // Microseconds since the controller was created
+	union {
+		struct { int key, scancode, action, mods; } key;
+		struct { int button, action, mods; } button;
+		struct { double x, y; } pos; // Cursor position in window coordinates, or scroll offsets
+		unsigned int codepoint;
+		int entered;
+	} data;
+} sl_input_event;
+
+/**
+ * Keyboard and mouse state. Bits are indexed by GLFW key and mouse button; the
+ * pressed and released bits and the scroll accumulate between snapshots, so no
+ * press shorter than a frame is missed.
+ */
 typedef struct {
-	vul_hash_map *mouse_enter_exit_callbacks; // Hashmap of < GLFWwindow*, SL_MOUSE_ENTER_EXIT_CALLBACK >
-	vul_hash_map *mouse_down_callbacks; // Hashmap of < entity_id, SL_MOUSE_DOWN_CALLBACK >
-	vul_hash_map *mouse_up_callbacks; // Hashmap of < entity_id, SL_MOUSE_UP_CALLBACK >
-	vul_hash_map *mouse_over_callbacks; // Hashmap of < entity_id, SL_MOUSE_OVER_CALLBACK >
-	vul_hash_map *mouse_out_callbacks; // Hashmap of < entity_id, SL_MOUSE_OUT_CALLBACK >
-	vul_hash_map *key_pressed_callbacks; // Hashmap of < key, SL_KEY_PRESSED >
-	vul_hash_map *key_released_callbacks; // Hashmap of < key, SL_KEY_RELEASED >
-	vul_hash_map *key_repeat_callbacks; // Hashmap of < key, SL_KEY_REPEAT >
+	u32 keys_down[ SL_INPUT_KEY_WORDS ];
+	u32 keys_pressed[ SL_INPUT_KEY_WORDS ];
+	u32 keys_released[ SL_INPUT_KEY_WORDS ];
+	u32 buttons_down, buttons_pressed, buttons_released;
+	v2 mouse_pos; // Normalized like sl_controller's mouse_pos, of the latest move
+	v2 scroll;
+} sl_input_state;
+
+typedef struct {
+	sl_hash_map mouse_enter_exit_callbacks; // Map of GLFWwindow* to SL_MOUSE_ENTER_EXIT_CALLBACK
+	sl_hash_map mouse_down_callbacks; // Map of SL_HASH_MAP_PAIR( scene_id, entity_id ) to SL_MOUSE_DOWN_CALLBACK
+	sl_hash_map mouse_up_callbacks; // Map of SL_HASH_MAP_PAIR( scene_id, entity_id ) to SL_MOUSE_UP_CALLBACK
+	sl_hash_map mouse_over_callbacks; // Map of SL_HASH_MAP_PAIR( scene_id, entity_id ) to SL_MOUSE_OVER_CALLBACK
+	sl_hash_map mouse_out_callbacks; // Map of SL_HASH_MAP_PAIR( scene_id, entity_id ) to SL_MOUSE_OUT_CALLBACK
 	
-	vul_list_element *hash_map_keys; // List of unsigned integers we use as keys in the hashmaps.
-	vul_list_element *hash_map_key_pairs; // List of unsigned integers we use as keys in the hashmaps.
-	vul_list_element *hash_map_ptr_keys; // List of pointers we use as keys in the hashmaps.
+	// Indexed by GLFW key or mouse button. The callbacks are in registration order, NULL after the last.
+	SL_KEY_PRESSED( key_pressed_callbacks[ GLFW_KEY_LAST + 1 ][ SL_INPUT_CALLBACK_SLOTS ] );
+	SL_KEY_RELEASED( key_released_callbacks[ GLFW_KEY_LAST + 1 ][ SL_INPUT_CALLBACK_SLOTS ] );
+	SL_KEY_REPEAT( key_repeat_callbacks[ GLFW_KEY_LAST + 1 ][ SL_INPUT_CALLBACK_SLOTS ] );
+	SL_MOUSE_DOWN_CALLBACK( button_down_callbacks[ GLFW_MOUSE_BUTTON_LAST + 1 ][ SL_INPUT_CALLBACK_SLOTS ] );
+	SL_MOUSE_UP_CALLBACK( button_up_callbacks[ GLFW_MOUSE_BUTTON_LAST + 1 ][ SL_INPUT_CALLBACK_SLOTS ] );
+	// Registered for SL_CONTROLLER_UNIVERSAL scene and entity, called for every button
+	SL_MOUSE_DOWN_CALLBACK( mouse_down_universal );
+	SL_MOUSE_UP_CALLBACK( mouse_up_universal );
 
 	v2 mouse_pos;
 	v2 mouse_pos_prev;
-	vul_vector *mouse_overs; // Vector of entity_id (unisgned integers) that the mouse is currently over.
+	vul_vector *mouse_overs; // Vector of u64, sorted. The ( scene_id << 32 ) | entity_id pairs the mouse is currently over.
+	
+	// Scratch buffers, kept between events so dispatching never allocates once they have grown
+	vul_vector *mouse_overs_next; // Vector of u64; what the mouse is over after the current move, sorted
+	vul_vector *hover_hits; // Vector of u64; the same in picking order, topmost first in each scene
+	vul_vector *scenes; // Vector of sl_scene*; the scenes of the window the event is for
+	vul_vector *hits; // Vector of entity ids; what one scene picked
+
+	SL_BOOL coalesce_mouse; // See sl_controller_set_mouse_coalescing
+	GLFWwindow *pending_mouse_window; // Window of the last cursor move not yet dispatched, NULL if none
+
+	sl_input_state state; // Kept up to date as events arrive, queued or not
+	SL_BOOL queue_events; // See sl_controller_set_event_queueing
+	sl_input_event events[ SL_INPUT_QUEUE_SIZE ]; // Ring of queued events
+	u32 event_head, event_count;
+	u32 events_dropped; // Events that arrived while the queue was full
+	vul_timer *timer; // Event timestamps
 } sl_controller;
 
 /**
@@ -95,101 +153,133 @@ void sl_controller_destroy( );
 void sl_controller_register_window( sl_window *win );
 
 /**
- * Adds a mouse enter/exit callback.
+ * When enabled, cursor moves only record the position, and mouse over/out
+ * callbacks are dispatched once per frame for the latest position by
+ * sl_controller_flush. Mouse buttons dispatch any pending move first, so they
+ * always see up to date hovering. Off by default.
  */
-void sl_controller_add_mouse_enter_exit_callback( GLFWwindow* win_handle, SL_MOUSE_ENTER_EXIT_CALLBACK( callback ) );
+void sl_controller_set_mouse_coalescing( SL_BOOL enabled );
 
 /**
- * Adds a key down callback for the given key. Replaces any already registered callback for that key.
+ * Dispatches the cursor move recorded while coalescing, if any. Called by the
+ * renderer after polling events when it swaps buffers.
  */
-void sl_controller_add_key_press_callback( int key, SL_KEY_PRESSED( callback ) );
+void sl_controller_flush( );
 
 /**
- * Adds a key up callback for the given key. Replaces any already registered callback for that key.
+ * When enabled, GLFW's callbacks (which run inside the buffer swap) only record
+ * events into a ring of SL_INPUT_QUEUE_SIZE, and the game drains it where it
+ * wants to in its frame, with sl_controller_poll_event or
+ * sl_controller_dispatch_events. Events arriving while the ring is full are
+ * dropped and counted in events_dropped; the input state stays correct. Turning
+ * it off dispatches what's queued. Off by default.
  */
-void sl_controller_add_key_release_callback( int key, SL_KEY_RELEASED( callback ) );
+void sl_controller_set_event_queueing( SL_BOOL enabled );
 
 /**
- * Adds a key up callback for the given key. Replaces any already registered callback for that key.
+ * Takes the oldest queued event. Returns SL_FALSE if there are none. Events
+ * taken this way don't reach the registered callbacks.
  */
-void sl_controller_add_key_repeat_callback( int key, SL_KEY_REPEAT( callback ) );
+SL_BOOL sl_controller_poll_event( sl_input_event *event );
 
 /**
- * Adds a mouse down callback for the given entity. 
- * Replaces any already registered callback for that entity.
- * If the entity is SL_CONTROLLER_UNIVERSAL, it is registered as a universal 
- * callback for that button in that scene. If scene is SL_CONTROLLER_UNIVERSAL,
- * it is registered as universal for all scenes (for that entity id).
+ * Drains the queue, calling the registered callbacks for every event in order
+ * as if it had just arrived.
  */
-void sl_controller_add_mouse_down_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_DOWN_CALLBACK( callback ) );
+void sl_controller_dispatch_events( );
 
 /**
- * Adds a mouse up callback for the given entity. 
- * Replaces any already registered callback for that entity.
- * If the entity is SL_CONTROLLER_UNIVERSAL, it is registered as a universal 
- * callback for that button in that scene. If scene is SL_CONTROLLER_UNIVERSAL,
- * it is registered as universal for all scenes (for that entity id).
+ * Copies the keyboard and mouse state, then clears its pressed and released
+ * bits and scroll; call once per frame. Needs no hash map lookups and works
+ * whether events are queued or not.
  */
-void sl_controller_add_mouse_up_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_UP_CALLBACK( callback ) );
+void sl_controller_get_input_state( sl_input_state *state );
 
 /**
- * Adds a mouse over callback for the given entity. 
- * Replaces any already registered callback for that entity.
+ * Whether a key or mouse button is currently down.
  */
-void sl_controller_add_mouse_over_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_OVER_CALLBACK( callback ) );
+SL_BOOL sl_controller_key_down( int key );
+SL_BOOL sl_controller_mouse_button_down( int button );
 
 /**
- * Adds a mouse out callback for the given entity. 
- * Replaces any already registered callback for that entity.
+ * Adds a mouse enter/exit callback.
  */
-void sl_controller_add_mouse_out_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_OUT_CALLBACK( callback ) );
+void sl_controller_add_mouse_enter_exit_callback( GLFWwindow* win_handle, SL_MOUSE_ENTER_EXIT_CALLBACK( callback ) );
+
+/**
+ * Adds a key down callback for the given key. A key takes up to
+ * SL_INPUT_CALLBACK_SLOTS callbacks, called in the order they were added;
+ * adding one that is already registered does nothing.
+ */
+void sl_controller_add_key_press_callback( int key, SL_KEY_PRESSED( callback ) );
+
+/**
+ * Adds a key up callback for the given key, like sl_controller_add_key_press_callback.
+ */
+void sl_controller_add_key_release_callback( int key, SL_KEY_RELEASED( callback ) );
 
 /**
- * Hashes an integer key. Since we know our entity_ids are consecutive, unique ids,
- * and keys are also unique and somewhat uniformely distributed, we just use the
- * integers directly.
+ * Adds a key repeat callback for the given key, like sl_controller_add_key_press_callback.
  */
-u32 sl_controller_hash_func( const u8* data, u32 len );
+void sl_controller_add_key_repeat_callback( int key, SL_KEY_REPEAT( callback ) );
 
 /**
- * Compares two integer keys of a vul_hash_map_element
+ * Removes a callback from the given key. Does nothing if it isn't registered.
  */
-int sl_controller_compare_func( void *a, void *b );
+void sl_controller_remove_key_press_callback( int key, SL_KEY_PRESSED( callback ) );
+void sl_controller_remove_key_release_callback( int key, SL_KEY_RELEASED( callback ) );
+void sl_controller_remove_key_repeat_callback( int key, SL_KEY_REPEAT( callback ) );
 
 /**
-* Compares two unsigned integers (used when comparing vul_list_element)
-*/
-int sl_controller_compare_func_raw( void *a, void *b );
+ * Adds a mouse down callback for the given button, wherever the window is
+ * clicked. It's called with SL_CONTROLLER_UNIVERSAL as scene and entity, after
+ * the callbacks of the entities and scenes. Takes up to SL_INPUT_CALLBACK_SLOTS
+ * callbacks per button, like the key callbacks.
+ */
+void sl_controller_add_button_down_callback( int button, SL_MOUSE_DOWN_CALLBACK( callback ) );
 
 /**
- * Hashes a key of two integers. We shift the first 16 bits left, then add the second.
+ * Adds a mouse up callback for the given button, like sl_controller_add_button_down_callback.
  */
-u32 sl_controller_hash_func_pair( const u8* data, u32 len );
+void sl_controller_add_button_up_callback( int button, SL_MOUSE_UP_CALLBACK( callback ) );
 
 /**
- * Compares two two-integer keys of a vul_hash_map_element
+ * Removes a callback from the given button. Does nothing if it isn't registered.
  */
-int sl_controller_compare_func_pair( void *a, void *b );
+void sl_controller_remove_button_down_callback( int button, SL_MOUSE_DOWN_CALLBACK( callback ) );
+void sl_controller_remove_button_up_callback( int button, SL_MOUSE_UP_CALLBACK( callback ) );
+
 /**
-* Compares two two-uint keys (used when comparing vul_list_element)
-*/
-int sl_controller_compare_func_raw_pair( void *a, void *b );
+ * Adds a mouse down callback for the given entity. 
+ * Replaces any already registered callback for that entity.
+ * If the entity is SL_CONTROLLER_UNIVERSAL, it is registered as a universal 
+ * callback for that button in that scene. If scene is SL_CONTROLLER_UNIVERSAL,
+ * it is registered as universal for all scenes (for that entity id). If both are,
+ * it is called for any click in the window, after the button's callbacks.
+ */
+void sl_controller_add_mouse_down_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_DOWN_CALLBACK( callback ) );
+
 /**
- * Hashes a pointer key. Since we know our entity_ids are consecutive, unique ids,
- * and keys are also unique and somewhat uniformely distributed, we just use the
- * integers directly.
+ * Adds a mouse up callback for the given entity. 
+ * Replaces any already registered callback for that entity.
+ * If the entity is SL_CONTROLLER_UNIVERSAL, it is registered as a universal 
+ * callback for that button in that scene. If scene is SL_CONTROLLER_UNIVERSAL,
+ * it is registered as universal for all scenes (for that entity id). If both are,
+ * it is called for any click in the window, after the button's callbacks.
  */
-u32 sl_controller_hash_ptr_func( const u8* data, u32 len );
+void sl_controller_add_mouse_up_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_UP_CALLBACK( callback ) );
 
 /**
- * Compares two pointer keys of a vul_hash_map_element
+ * Adds a mouse over callback for the given entity. 
+ * Replaces any already registered callback for that entity.
  */
-int sl_controller_compare_ptr_func( void *a, void *b );
+void sl_controller_add_mouse_over_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_OVER_CALLBACK( callback ) );
 
 /**
-* Compares two pointer keys (used when comparing vul_list_element)
-*/
-int sl_controller_compare_ptr_func_raw( void *a, void *b );
+ * Adds a mouse out callback for the given entity. 
+ * Replaces any already registered callback for that entity.
+ */
+void sl_controller_add_mouse_out_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_OUT_CALLBACK( callback ) );
 
 // Callback functions registered with glfw. These call the controller's equivalent functions.
 
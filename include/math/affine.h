@@ -0,0 +1,68 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * A 2D affine transform; the only part of an entity's 4x4 world matrix that
+ * is ever not identity. Stored column major like vul_cmath's matrices, so the
+ * named fields match the m44 ones with the z row and column dropped
+ * (a20/a21 here are a30/a31 there), and it uploads straight to a vec2[ 3 ]
+ * uniform or a mat3x2 attribute.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SLENDERER_AFFINE_H
+#define SLENDERER_AFFINE_H
+#include <vul_types.h>
+#include <vul_cmath.h>
+
+typedef struct {
+	union {
+		f32 A[ 6 ];
+		struct {
+			f32 a00, a01, // First column
+				a10, a11, // Second column
+				a20, a21; // Translation
+		};
+		v2 c[ 3 ];
+	};
+} sl_affine;
+
+/**
+ * Sets the identity transform.
+ */
+void sl_affine_identity( sl_affine *result );
+/**
+ * Sets the transform of a quad centered at center, with the given half extents
+ * and rotation in radians. Y is flipped, as it is in OpenGL.
+ */
+void sl_affine_set_trs( sl_affine *result, const v2 *center, const v2 *scale, const float rotation );
+
+/**
+ * Expands a transform into the equivalent 4x4 matrix.
+ */
+void sl_affine_to_m44( m44 *result, const sl_affine *a );
+/**
+ * Extracts the 2D affine part of a 4x4 matrix; z and projective terms are dropped.
+ */
+void sl_affine_from_m44( sl_affine *result, const m44 *m );
+
+/**
+ * Linearly interpolates between two transforms, element by element.
+ */
+void sl_affine_lerp( sl_affine *result, const sl_affine *a, const sl_affine *b, const float t );
+
+/**
+ * Transforms a point.
+ */
+void sl_affine_transform( v2 *result, const sl_affine *a, const v2 *p );
+
+#endif
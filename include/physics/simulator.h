@@ -19,22 +19,26 @@
 #define SLENDERER_SIMULATOR_H
 
 #include <vul_resizable_array.h>
-#include <vul_hash_map.h>
 #include <vul_timer.h>
 
 #include "vul_cmath.h"
 #include "math/box.h"
+#include "physics/broadphase.h"
 #include "renderer/entity.h"
 #include "renderer/scene.h"
+#include "utilities/hash_map.h"
 
-#define SL_SIMULATOR_CALLBACK_BUCKETS 16
+#define SL_SIMULATOR_DEFAULT_STEP ( 1.f / 60.f )
+#define SL_SIMULATOR_DEFAULT_MAX_SUBSTEPS 8
 
 #define SL_MIN( a, b ) ( ( a ) <= ( b ) ? ( a ) : ( b ) )
 #define SL_MAX( a, b ) ( ( a ) >= ( b ) ? ( a ) : ( b ) )
 
 typedef struct sl_simulator_entity {
-	const sl_entity *entity;
+	unsigned int entity_id;
+	const sl_affine *transform; // The entity's transform. Refreshed every update; the scene moves entities when it sorts
 	v2 pos;
+	v2 prev_pos; // Position before the last step, used to interpolate in fixed step mode
 	v2 velocity;
 	// @TODO: Mass!
 	vul_vector *forces; // Vector of v2s
@@ -43,17 +47,23 @@ typedef struct sl_simulator_entity {
 typedef void( *sl_simulator_collider_pair_callback )( sl_scene* s, sl_simulator_entity* a, sl_simulator_entity *b, double time_frame_delta );
 
 typedef struct {
-	unsigned int entity_id_a;
-	unsigned int entity_id_b;
-} sl_simulator_collider_pair;
+	sl_simulator_collider_pair_callback callback;
+	unsigned int entity_id_first; // The id given first on registration; the callback gets it as a.
+} sl_simulator_collision_callback;
 
 typedef struct {
 	vul_vector *entities; // Vector of sl_simulator_quads
-	vul_hash_map *collision_callbacks; // Hashmap of < sl_simulator_collider_pair, sl_simulator_collider_pair_callback >.
-	vul_list_element *collission_callback_keys; // List if sl_simulator_collider_pair
+	sl_hash_map collision_callbacks; // Map of SL_HASH_MAP_PAIR( lower id, higher id ) to sl_simulator_collision_callback
 	u32 scene_id;
+	sl_broadphase broadphase;
+	vul_vector *aabbs; // Vector of sl_box, the AABB of each entity this step
+	vul_vector *pairs; // Vector of sl_broadphase_pair, the overlapping entities this step
 	vul_timer *clock;
 	unsigned long long last_time;
+	int fixed_step; // Boolean, SL_TRUE if we advance in fixed steps instead of by the frame time
+	float step; // Length of a fixed step, in seconds
+	u32 max_substeps; // Most fixed steps taken per update before we drop the backlog
+	double accumulator; // Elapsed time not yet simulated, in seconds
 } sl_simulator;
 
 /**
@@ -66,6 +76,13 @@ void sl_simulator_create( sl_simulator *sim, sl_scene *scene );
  */
 void sl_simulator_destroy( sl_simulator *sim );
 
+/**
+ * Selects the broadphase used to find colliding entities; one of the
+ * SL_BROADPHASE_* methods. The cell size is only used by the spatial hash.
+ * SL_BROADPHASE_DEFAULT is used until this is called.
+ */
+void sl_simulator_set_broadphase( sl_simulator *sim, u32 method, f32 cell_size );
+
 /**
  * Adds a quad with the given start velocity to the simulation.
  */
@@ -85,17 +102,18 @@ void sl_simulator_add_impulse( sl_simulator *sim, unsigned int entity_id, v2 *im
 
 /**
  * Adds a collission callback for a pair of quads.
- * @NOTE: Order of quad ids is irrelevant; they are stored as a = min(a,b) 
- * and b = max(a,b) internally.
+ * @NOTE: They are stored as a = min(a,b) and b = max(a,b) internally, but the
+ * callback is called once per collision with entity_id_a as its a argument.
  */
 void sl_simulator_add_callback( sl_simulator *sim, unsigned int entity_id_a, unsigned int entity_id_b, sl_simulator_collider_pair_callback callback );
 
 /**
- * Updates the physics simulation:
+ * Updates the physics simulation by the time since the last update, in one
+ * variable step or in fixed steps (see sl_simulator_set_fixed_step). Each step:
  *		-Apply forces
  *		-Update positions
  *		-Move the actual rendering quads.
- *		-Run n2n collission checks
+ *		-Find overlapping pairs with the broadphase
  *			-Call callbacks for the respective collission if registered
  * @NOTE: If no callback exists, collissions aren't handled. If the callback wants to update
  *        opsitions (and it should), it also needs to update the rendering quad!
@@ -103,14 +121,21 @@ void sl_simulator_add_callback( sl_simulator *sim, unsigned int entity_id_a, uns
 void sl_simulator_update( sl_simulator *sim );
 
 /**
- * Hash function for the collission callback hash map.
+ * Switches the simulator to fixed step mode: each update consumes the elapsed
+ * time in steps of the given length (at most max_substeps of them) and places the
+ * rendering quads between the last two steps. Results no longer depend on the
+ * frame rate. A step <= 0 switches back to variable steps. Changing the mode or
+ * the step restarts the clock, so the next update doesn't catch up on time that
+ * passed before the call.
  */
-u32 sl_simulator_callback_hash( const u8 *key, u32 keylen );
+void sl_simulator_set_fixed_step( sl_simulator *sim, float step, u32 max_substeps );
 
 /**
- * Comparison function for the collission callback hash map.
+ * Advances the simulation by the given number of fixed steps, ignoring the clock.
+ * Meant for headless runs, tests and replays. Uses the step set with
+ * sl_simulator_set_fixed_step, or SL_SIMULATOR_DEFAULT_STEP if none was.
  */
-int sl_simulator_callback_comp( void *a, void *b );
+void sl_simulator_step( sl_simulator *sim, u32 ticks );
 
 /**
  * Simple callback for quad vs. quad collissions.
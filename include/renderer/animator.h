@@ -53,8 +53,8 @@ typedef struct {
 	unsigned int entity_id;
 	unsigned long long start_time;
 	unsigned long long end_time;
-	m44 start_world_mat;
-	m44 end_world_mat;
+	sl_affine start_transform;
+	sl_affine end_transform;
 	sl_animation_state state;
 	// @TODO: Add interpolation-type enum, "linear", "quadratic_Accel", "quadratic_decel" etc.
 } sl_animation_transform;
@@ -100,6 +100,12 @@ void sl_animator_destroy( sl_animator *animator );
  * State must be either SL_ANIMATION_RUNNING, SL_ANIMATION_RUNNING_LOOPED or 
  * SL_ANIMATION_RUNNING_PERIODIC.
  */
+unsigned int sl_animator_add_affine( sl_animator *animator, unsigned int entity_id, const sl_affine *end_transform, unsigned long long length_in_ms, sl_animation_state state );
+
+/**
+ * Same as sl_animator_add_affine, taking the end transform as a 4x4 world matrix.
+ * Only its 2D affine part is animated.
+ */
 unsigned int sl_animator_add_transform( sl_animator *animator, unsigned int entity_id, const m44 *end_world_matrix, unsigned long long length_in_ms, sl_animation_state state );
 
 /**
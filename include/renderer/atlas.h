@@ -0,0 +1,94 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * Texture atlases: packs many RGBA8 images into a few large texture pages, so
+ * sprites using different images share a texture and are drawn in the same runs.
+ * Images are placed with a bottom-left skyline packer; one that fits in no page
+ * opens a new one. Each page is a normal renderer texture; sprites use the page's
+ * texture id and the image's uvs (see sl_atlas_get_uvs).
+ *
+ * Images can be added at any time; each is uploaded into its page on its own and
+ * never moves, so uvs already handed out stay valid. sl_atlas_repack packs all
+ * images again, tallest first, to reclaim the space lost to adding images in no
+ * particular order; it does move images, so fetch their uvs again afterwards.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SLENDERER_ATLAS_H
+#define SLENDERER_ATLAS_H
+
+#include <vul_resizable_array.h>
+#include "math/box.h"
+
+#define SL_ATLAS_PADDING 1 // Empty pixels right of and above every image, against bleeding
+#define SL_ATLAS_INVALID_IMAGE 0xffffffff
+
+typedef struct {
+	u32 x, y, width; // A horizontal segment at height y, covering [x, x + width)
+} sl_atlas_skyline_node;
+
+typedef struct {
+	unsigned int texture_id; // Renderer texture of the page
+	vul_vector *skyline; // Vector of sl_atlas_skyline_node, left to right, covering the page
+} sl_atlas_page;
+
+typedef struct {
+	u32 page;
+	u32 x, y, width, height; // In pixels
+	unsigned char *pixels; // Copy of the RGBA8 image, kept for repacking
+} sl_atlas_image;
+
+typedef struct sl_atlas {
+	u32 page_width, page_height;
+	vul_vector *pages; // Vector of sl_atlas_page
+	vul_vector *images; // Vector of sl_atlas_image. Indices are image ids
+} sl_atlas;
+
+/**
+ * Creates an empty atlas with pages of the given size. Pages are created as
+ * needed.
+ */
+void sl_atlas_create( sl_atlas *atlas, u32 page_width, u32 page_height );
+
+/**
+ * Destroys the atlas. The page textures belong to the renderer and are
+ * destroyed with it.
+ */
+void sl_atlas_destroy( sl_atlas *atlas );
+
+/**
+ * Packs a tightly packed RGBA8 image into the atlas and uploads it. Returns the
+ * image id, or SL_ATLAS_INVALID_IMAGE if it is larger than a page.
+ * \note: requires an OpenGL context to pre-exist.
+ */
+u32 sl_atlas_add_image( sl_atlas *atlas, const unsigned char *pixels, u32 width, u32 height );
+
+/**
+ * Loads an image file with stb_image and adds it as with sl_atlas_add_image.
+ * Returns SL_ATLAS_INVALID_IMAGE if it can't be loaded or doesn't fit a page.
+ */
+u32 sl_atlas_add_file( sl_atlas *atlas, const char *path );
+
+/**
+ * Gets the texture id of the image's page and the image's uv box in it, as
+ * sl_scene_add_sprite takes them.
+ */
+void sl_atlas_get_uvs( sl_atlas *atlas, u32 image, unsigned int *texture_id, sl_box *uvs );
+
+/**
+ * Packs all images again, tallest first, and re-uploads the pages that changed.
+ * Pages left empty are kept for future images. Returns the number of images
+ * that moved; their uvs, and maybe texture ids, must be fetched again.
+ */
+u32 sl_atlas_repack( sl_atlas *atlas );
+
+#endif
@@ -19,12 +19,22 @@
 
 #include <vul_types.h>
 #include "math/box.h"
+#include "math/affine.h"
 #include "vul_cmath.h"
 #include "renderer/program.h"
 
+// Layout of the packed sort keys, most significant field first: layer, program,
+// texture, renderable. Ids too wide for their field are truncated, which only
+// costs batching; the render loop compares the full ids before binding.
+#define SL_SORT_KEY_LAYER_BITS 4
+#define SL_SORT_KEY_PROGRAM_BITS 16
+#define SL_SORT_KEY_TEXTURE_BITS 28
+#define SL_SORT_KEY_RENDERABLE_BITS 16
+
 typedef struct {
+	u64 sort_key; // See sl_entity_sort_key. The key the entity is in the render order under; set when sorted
 	unsigned int entity_id;
-	m44 world_matrix;
+	sl_affine transform; // World transform; the m44 the shaders see is this with an identity z
 	sl_box uvs;
 	v2 flip_uvs;
 	unsigned int texture_id;
@@ -32,28 +42,65 @@ typedef struct {
 	unsigned int renderable_id;
 	float color[ 4 ];
 	unsigned char hidden; // Boolean, 0 if false
+	unsigned char queued; // Boolean; set while in its scene's re-sort queue
 } sl_entity;
 
+/**
+ * The per-instance attributes of an entity as streamed to instanced programs.
+ * Layout matches the instance_* attributes of sl_program_default_instanced_vp_src.
+ */
+typedef struct {
+	sl_affine transform; // A mat3x2 attribute, three vec2 columns
+	float color[ 4 ];
+	sl_box texcoord_offset_scale;
+} sl_entity_instance;
+
 /**
  * Calculate the AABB of a quad.
  */
 void sl_entity_aabb( sl_box *result, const sl_entity *q );
 
 /**
- * Calculate the world matrix of a quad.
+ * Calculate the AABB of a quad with the given transform.
+ */
+void sl_entity_aabb_transform( sl_box *result, const sl_affine *transform );
+
+/**
+ * Calculate the transform of a quad.
  */
 void sl_entity_create_world_matrix( sl_entity *result, const v2 *center, const v2 *scale, const float rotation );
 
 /**
- * Used to sort quads internally in layers, this first compares
- * program ids, then texture ids.
+ * Calculate a quad's world matrix as a full 4x4 matrix. Kept for code written
+ * against m44 world matrices; the entities themselves store an sl_affine.
+ */
+void sl_entity_world_matrix( m44 *result, const v2 *center, const v2 *scale, const float rotation );
+
+/**
+ * Packs what an entity is sorted and batched by into a single key; entities
+ * sorted by it are grouped by layer, then program, texture and renderable.
+ */
+u64 sl_entity_sort_key( const unsigned int layer, const unsigned int program_id, const unsigned int texture_id, const unsigned int renderable_id );
+
+/**
+ * Compares two quads in the order of their sort keys: program ids, then
+ * texture ids, then renderable ids. Returns <0, 0 or >0 like strcmp.
  */
 int sl_entity_sort( const void *a, const void *b );
 
 /**
  * Bind the quad's parameters to the rendering program. This means we upload
- * MVP matrix, color and texture coordinate scales and offsets.
+ * the transform, color and texture coordinate scales and offsets. The transform
+ * goes to the vec2[ 3 ] "transform" uniform if the program has one, otherwise
+ * it is expanded to the mat4 "mvp" uniform older programs use.
+ * Takes the fields rather than an sl_entity so it works with either layer storage.
+ */
+void sl_entity_bind( const sl_affine *transform, const float color[ 4 ], const sl_box *uvs, const v2 *flip_uvs, const v2 *camera_offset, sl_program *prog );
+
+/**
+ * Write the quad's parameters into an instance record for instanced programs.
+ * This is the same data sl_entity_bind uploads as uniforms.
  */
-void sl_entity_bind( sl_entity *entity, v2 *camera_offset, sl_program *prog );
+void sl_entity_pack_instance( sl_entity_instance *result, const sl_affine *transform, const float color[ 4 ], const sl_box *uvs, const v2 *flip_uvs, const v2 *camera_offset );
 
 #endif
@@ -28,8 +28,33 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <vul_resizable_array.h>
+
 #include "renderer/window.h"
 
+// Instanced drawing needs glDrawElementsInstanced and vertex attribute divisors,
+// neither of which exist in legacy GL or GLES 2.0.
+#if !defined( SL_LEGACY_OPENGL ) && !defined( SL_OPENGL_ES )
+	#define SL_INSTANCING
+#endif
+
+// Vertex attribute locations, bound before linking every program.
+#define SL_ATTRIB_POSITION 0
+#define SL_ATTRIB_TEXCOORD 1
+#define SL_ATTRIB_INSTANCE_TRANSFORM 2 // A mat3x2 takes three consecutive slots, one per column
+#define SL_ATTRIB_INSTANCE_COLOR 5
+#define SL_ATTRIB_INSTANCE_TEXCOORD_OFFSET_SCALE 6
+
+#define SL_PROGRAM_UNIFORM_NAME_MAX 64 // Longest uniform name (including terminator) we register
+
+/**
+ * A named uniform registered with a program, with its location resolved.
+ */
+typedef struct {
+	char name[ SL_PROGRAM_UNIFORM_NAME_MAX ];
+	GLint location;
+} sl_program_uniform;
+
 typedef struct sl_program {
 	unsigned int program_id;
 
@@ -39,6 +64,17 @@ typedef struct sl_program {
 	GLuint gl_vp_id;
 	GLuint gl_fp_id;
 	GLuint gl_prog_id;
+
+	int reads_instances; // Boolean, set on link if the program reads the per-instance attributes
+	int instanced; // Boolean, set if it does and the context has attribute divisors
+
+	// Locations of the uniforms we set every draw, resolved once on link. -1 if not present.
+	GLint loc_transform; // vec2[ 3 ], the 2x3 affine transform
+	GLint loc_mvp; // mat4, set instead when the program has no transform uniform
+	GLint loc_color;
+	GLint loc_texcoord_offset_scale;
+	GLint loc_texture;
+	vul_vector *uniforms; // Vector of sl_program_uniform. Additional uniforms registered by name
 } sl_program;
 
 /**
@@ -58,15 +94,44 @@ const char *sl_program_default_post_vp_src;
  * Default post-process fragment program.
  */
 const char *sl_program_default_post_fp_src;
+#ifdef SL_INSTANCING
+/**
+ * Default instanced vertex program. Reads the world matrix, color and texture
+ * coordinate offset/scale from per-instance attributes instead of uniforms,
+ * so entities drawn with it are batched into one draw call per run of
+ * entities sharing program, texture and renderable.
+ */
+const char *sl_program_default_instanced_vp_src;
+/**
+ * Default instanced fragment program.
+ */
+const char *sl_program_default_instanced_fp_src;
+#endif
 
 /**
  * Creates a new program with the given sources.
  * Assumes prog->vert_prog_src and prog->frag_prog_src have
- * been set to the correct sources.
+ * been set to the correct sources. Programs whose vertex program
+ * uses the instance_transform attribute are flagged as instanced, if the
+ * context supports instancing.
  * \note: requires an OpenGL context to pre-exist.
  */
 void sl_program_create( sl_program* prog );
 
+/**
+ * Registers a named uniform with the program and returns its location, or -1
+ * if the program has no such active uniform. Resolve the uniforms of custom
+ * (post) programs once through this instead of calling glGetUniformLocation
+ * every frame. Registering an already registered name just returns it.
+ */
+GLint sl_program_register_uniform( sl_program *prog, const char *name );
+
+/**
+ * Looks up the location of a uniform registered with sl_program_register_uniform.
+ * Does not touch GL; returns -1 if the name was never registered.
+ */
+GLint sl_program_get_uniform( sl_program *prog, const char *name );
+
 /**
  * Destroys a program and its shaders.
  * Sources are NOT freed, as this allows us
@@ -75,12 +140,12 @@ void sl_program_create( sl_program* prog );
 void sl_program_destroy( sl_program* prog );
 
 /**
- * Binds a program for rendering.
+ * Binds a program for rendering. Nothing is issued if it is already bound.
  */
 void sl_program_bind( sl_program* prog );
 
 /**
- * Unbinds a program after rendering.
+ * Unbinds a program after rendering. Not needed before binding another.
  */
 void sl_program_unbind( sl_program* prog );
 
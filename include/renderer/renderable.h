@@ -69,13 +69,42 @@ void sl_renderable_create_hex_flat( sl_renderable *ren, sl_box *uv_aabb );
 void sl_renderable_destroy( sl_renderable *ren );
 
 /**
- * Bind the Vertex Array and its buffers for rendering.
+ * Bind the Vertex Array for rendering. It holds the buffers and enabled
+ * attribute arrays, so nothing else is bound.
  */
 void sl_renderable_bind( sl_renderable *ren );
 
 /**
- * Unbind the Vertex Array and its buffers after rendering.
+ * Unbind the Vertex Array after rendering. Not needed before binding another.
  */
 void sl_renderable_unbind( );
 
+#ifdef SL_INSTANCING
+/**
+ * Whether the context has vertex attribute divisors, core in GL 3.3 or through
+ * ARB_instanced_arrays. Without them programs are never flagged as instanced,
+ * and their entities are drawn one by one.
+ */
+int sl_renderable_instancing_supported( );
+
+/**
+ * Sets the per-instance attributes to the given instance's values for the next
+ * draws, for programs that read them when instancing isn't supported. The
+ * attribute arrays must be disabled.
+ */
+void sl_renderable_set_instance( const sl_entity_instance *instance );
+
+/**
+ * Point the per-instance attributes of the bound Vertex Array at the
+ * sl_entity_instance records starting offset bytes into the given buffer.
+ * The renderable must be bound.
+ */
+void sl_renderable_bind_instances( sl_renderable *ren, GLuint instance_buffer, u32 offset );
+
+/**
+ * Disable the per-instance attributes after an instanced draw.
+ */
+void sl_renderable_unbind_instances( );
+#endif
+
 #endif
@@ -33,17 +33,92 @@
 #include "renderer/entity.h"
 #include "renderer/renderable.h"
 #include "renderer/texture.h"
+#include "renderer/spatial.h"
+
 #include "renderer/window.h"
 
+#ifndef SL_BOOL
+	#define SL_BOOL int
+	#define SL_TRUE 1
+	#define SL_FALSE 0
+#endif
+
 #define SL_MAX_LAYERS 16
 #define SL_LAYER_CHUNK_SIZE 8
 // Texture ID indicating that this is a textureless quad.
 #define SL_INVISIBLE_TEXTURE 0xffffffff
 
+// Entity ids are handles: the low bits index the scene's slot table, the high bits
+// hold the slot's generation, which is bumped on removal so stale ids miss.
+#define SL_ENTITY_SLOT_BITS 20
+#define SL_ENTITY_SLOT_MASK ( ( 1u << SL_ENTITY_SLOT_BITS ) - 1u )
+#define SL_ENTITY_GENERATION_MASK ( 0xffffffffu >> SL_ENTITY_SLOT_BITS )
+#define SL_ENTITY_MAX_SLOTS SL_ENTITY_SLOT_MASK // The last slot is never used so no id is ever 0xffffffff
+#define SL_ENTITY_FREE_SLOT 0xff // Layer of a slot that isn't in use
+#define SL_ENTITY_NO_SLOT 0xffffffff // End of the free list
+
+/**
+ * Where an entity lives in the scene. Indexed by the slot bits of the entity id.
+ */
+typedef struct {
+	u32 index; // Index into the layer if in use, next free slot if not
+	u16 generation;
+	u8 layer; // SL_ENTITY_FREE_SLOT if the slot is free
+} sl_scene_slot;
+
+#ifdef SL_SOA_LAYERS
+#define SL_ENTITY_FLAG_HIDDEN 0x1
+#define SL_ENTITY_FLAG_QUEUED 0x2 // In the scene's re-sort queue
+
+/**
+ * What a layer is sorted and batched by.
+ */
+typedef struct {
+	unsigned int program_id;
+	unsigned int texture_id;
+	unsigned int renderable_id;
+} sl_entity_key;
+
+/**
+ * A layer stored as one array per field, so sorting only compares keys and
+ * the render loop, culling and picking only stream the fields they read.
+ */
+typedef struct {
+	u32 count, capacity;
+	unsigned int *ids;
+	sl_affine *transforms;
+	v4 *colors;
+	sl_box *uvs;
+	v2 *flip_uvs;
+	sl_entity_key *keys;
+	u64 *sort_keys; // See sl_entity_sort_key. The key the entity is in the render order under; set when sorted
+	u8 *flags; // SL_ENTITY_FLAG_*
+} sl_layer;
+#endif
+
+/**
+ * The packed key of an entity and its index in the layer; what the radix sort
+ * sorts when a layer's render order is rebuilt.
+ */
+typedef struct {
+	u64 key;
+	u32 index;
+} sl_layer_sort_entry;
+
 typedef struct {
+#ifdef SL_SOA_LAYERS
+	sl_layer layers[ SL_MAX_LAYERS ]; // MAX_LAYERS layers of entities, stored as one array per field.
+#else
 	vul_vector *layers[ SL_MAX_LAYERS ]; // Vector of sl_entity. MAX_LAYERS arrays of entities, one for each layer.
-	unsigned short layer_dirty; // Each bit indicates whether a layer must be re-sorted
-	unsigned int next_entity_id; // ID of the next added entity.
+#endif
+	unsigned short layer_dirty; // Each bit indicates whether a layer's re-sort queue is non-empty
+	vul_vector *resort[ SL_MAX_LAYERS ]; // Vector of entity ids. Entities whose key or position changed since the last sort
+	vul_vector *order[ SL_MAX_LAYERS ]; // Vector of u32. Each layer's entity indices in render order: by sort key, then index
+	sl_layer_sort_entry *sort_entries; // Radix sort buffers; two halves of sort_capacity entries
+	u32 sort_capacity;
+	vul_vector *slots; // Vector of sl_scene_slot. Maps entity ids to layer and index.
+	u32 free_slot; // Head of the list of free slots
+	sl_spatial_index spatial; // Entity AABBs per layer, for picking
 	u32 window_id;
 	unsigned int scene_id;
 	u32 post_program_id; // Post processing program; by default the normal shader!
@@ -52,6 +127,45 @@ typedef struct {
 	v2 camera_pos;
 } sl_scene;
 
+/**
+ * The render order of layer l: SL_LAYER_ORDER( scene, l, i ) is the index of the
+ * i-th entity to draw. Sorting only reorders this, never the entities themselves.
+ * Up to date after sl_scene_sort.
+ */
+#define SL_LAYER_ORDER_SIZE( scene, l ) ( ( scene )->order[ l ]->size )
+#define SL_LAYER_ORDER( scene, l, i ) ( ( ( u32* )( scene )->order[ l ]->list )[ i ] )
+
+/**
+ * Accessors for the entity at index i of layer l, whichever way the layers are
+ * stored. Indices are only stable until the next add or remove.
+ */
+#ifdef SL_SOA_LAYERS
+#define SL_LAYER_SIZE( scene, l ) ( ( scene )->layers[ l ].count )
+#define SL_LAYER_ID( scene, l, i ) ( ( scene )->layers[ l ].ids[ i ] )
+#define SL_LAYER_TRANSFORM( scene, l, i ) ( &( scene )->layers[ l ].transforms[ i ] )
+#define SL_LAYER_COLOR( scene, l, i ) ( ( scene )->layers[ l ].colors[ i ].A )
+#define SL_LAYER_UVS( scene, l, i ) ( &( scene )->layers[ l ].uvs[ i ] )
+#define SL_LAYER_FLIP_UVS( scene, l, i ) ( &( scene )->layers[ l ].flip_uvs[ i ] )
+#define SL_LAYER_PROGRAM( scene, l, i ) ( ( scene )->layers[ l ].keys[ i ].program_id )
+#define SL_LAYER_TEXTURE( scene, l, i ) ( ( scene )->layers[ l ].keys[ i ].texture_id )
+#define SL_LAYER_RENDERABLE( scene, l, i ) ( ( scene )->layers[ l ].keys[ i ].renderable_id )
+#define SL_LAYER_SORT_KEY( scene, l, i ) ( ( scene )->layers[ l ].sort_keys[ i ] )
+#define SL_LAYER_HIDDEN( scene, l, i ) ( ( scene )->layers[ l ].flags[ i ] & SL_ENTITY_FLAG_HIDDEN )
+#else
+#define SL_LAYER_ENTITY( scene, l, i ) ( &( ( sl_entity* )( scene )->layers[ l ]->list )[ i ] )
+#define SL_LAYER_SIZE( scene, l ) ( ( scene )->layers[ l ]->size )
+#define SL_LAYER_ID( scene, l, i ) ( SL_LAYER_ENTITY( scene, l, i )->entity_id )
+#define SL_LAYER_TRANSFORM( scene, l, i ) ( &SL_LAYER_ENTITY( scene, l, i )->transform )
+#define SL_LAYER_COLOR( scene, l, i ) ( SL_LAYER_ENTITY( scene, l, i )->color )
+#define SL_LAYER_UVS( scene, l, i ) ( &SL_LAYER_ENTITY( scene, l, i )->uvs )
+#define SL_LAYER_FLIP_UVS( scene, l, i ) ( &SL_LAYER_ENTITY( scene, l, i )->flip_uvs )
+#define SL_LAYER_PROGRAM( scene, l, i ) ( SL_LAYER_ENTITY( scene, l, i )->program_id )
+#define SL_LAYER_TEXTURE( scene, l, i ) ( SL_LAYER_ENTITY( scene, l, i )->texture_id )
+#define SL_LAYER_RENDERABLE( scene, l, i ) ( SL_LAYER_ENTITY( scene, l, i )->renderable_id )
+#define SL_LAYER_SORT_KEY( scene, l, i ) ( SL_LAYER_ENTITY( scene, l, i )->sort_key )
+#define SL_LAYER_HIDDEN( scene, l, i ) ( SL_LAYER_ENTITY( scene, l, i )->hidden )
+#endif
+
 /**
  * Create a scene.
  */
@@ -62,7 +176,7 @@ void sl_scene_create( sl_scene *scene, u32 parent_window_id, unsigned int scene_
 void sl_scene_destroy( sl_scene *scene );
 
 /**
- * Resorts all the layers' quads into the correct order for rendering if needed.
+ * Brings the render order of every layer with queued quads up to date.
  */
 void sl_scene_sort( sl_scene *scene );
 
@@ -84,13 +198,17 @@ unsigned int sl_scene_add_sprite( sl_scene *scene, const unsigned int layer,
 
 /**
  * Removes the quad with the given id. If a layer == 0xffffffff, all layers are searched.
+ * The last quad of the layer is moved into its place, and the layer is marked as dirty.
  */
 void sl_scene_remove_sprite( sl_scene *scene, const unsigned int id, const unsigned int layer );
 
+#ifndef SL_SOA_LAYERS
 /**
  * Returns a volitile pointer to the quad with the given id.
  * If a layer == 0xffffffff, all layers are searched.
  * The layer of the quad is marked as dirty.
+ * Not available with SL_SOA_LAYERS, where there is no sl_entity to point to;
+ * use the field accessors below, which work with either storage.
  */
 sl_entity *sl_scene_get_volitile_entity( sl_scene *scene, const unsigned int id, const unsigned int layer );
 
@@ -99,11 +217,51 @@ sl_entity *sl_scene_get_volitile_entity( sl_scene *scene, const unsigned int id,
  * If a layer == 0xffffffff, all layers are searched.
  */
 const sl_entity *sl_scene_get_const_entity( sl_scene *scene, const unsigned int id, const unsigned int layer );
+#endif
+
+/**
+ * Field accessors for the entity with the given id. The pointers are valid until
+ * the next add, remove or sort of the scene; NULL if the id is stale.
+ * The transform, color and uvs don't affect sorting, so changing them through
+ * these never marks the layer dirty. Getting the transform marks the entity as
+ * moved, so picking looks at its AABB again.
+ */
+sl_affine *sl_scene_get_transform( sl_scene *scene, const unsigned int id );
+float *sl_scene_get_color( sl_scene *scene, const unsigned int id );
+sl_box *sl_scene_get_uvs( sl_scene *scene, const unsigned int id );
+
+/**
+ * The entity's transform as a 4x4 world matrix, for code written against m44.
+ * Setting drops the z and projective parts, which the renderer never used.
+ * Returns SL_FALSE if the id is stale.
+ */
+SL_BOOL sl_scene_get_world_matrix( sl_scene *scene, const unsigned int id, m44 *result );
+SL_BOOL sl_scene_set_world_matrix( sl_scene *scene, const unsigned int id, const m44 *world_matrix );
+
+/**
+ * Setters for the fields the layers are sorted by; these mark the layer dirty.
+ */
+void sl_scene_set_texture( sl_scene *scene, const unsigned int id, const unsigned int texture_id );
+void sl_scene_set_program( sl_scene *scene, const unsigned int id, const unsigned int program_id );
+void sl_scene_set_renderable( sl_scene *scene, const unsigned int id, const unsigned int renderable_id );
+
+/**
+ * Shows or hides the entity with the given id.
+ */
+void sl_scene_set_hidden( sl_scene *scene, const unsigned int id, unsigned char is_hidden );
 
 /**
  * Populates a vector of all quad ids that intersect a ray into the scene at the given position.
  * It searches top down, so the first hit is the topmost intersected quad.
+ * Hidden quads are skipped. Only the quads that moved since the last query are
+ * re-indexed, then each layer's quadtree is searched.
  */
 void sl_scene_get_entities_at_pos( vul_vector *vec, sl_scene *scene, v2 *pos );
 
+/**
+ * Populates a vector of all quad ids whose AABB overlaps the given box, in the
+ * same order as sl_scene_get_entities_at_pos.
+ */
+void sl_scene_get_entities_in_box( vul_vector *vec, sl_scene *scene, const sl_box *area );
+
 #endif
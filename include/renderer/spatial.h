@@ -0,0 +1,110 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * Spatial index of a scene's entities, for picking. Every layer has a loose
+ * quadtree: an entity sits in the deepest node whose cell holds its center and
+ * is at least as large as its AABB, so it lies within the cell grown by half its
+ * size on every side. Queries only visit nodes whose grown cells they touch.
+ * Empty nodes are recycled, and the root doubles toward entities outside it.
+ *
+ * Entries are indexed by the entity's slot in the scene. The scene marks entities
+ * whose transform may have changed as moved and refreshes just those before a
+ * query, so the index is updated incrementally rather than rebuilt.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SLENDERER_SPATIAL_H
+#define SLENDERER_SPATIAL_H
+
+#include <vul_types.h>
+#include <vul_resizable_array.h>
+
+#include "math/box.h"
+
+#define SL_SPATIAL_LAYERS 16 // Same as SL_MAX_LAYERS
+#define SL_SPATIAL_NONE 0xffffffff
+#define SL_SPATIAL_MAX_DEPTH 16 // Entities are pushed at most this many levels below the root
+#define SL_SPATIAL_MAX_GROWTH 64 // Doublings of the root to reach an entity before it's kept in the root instead
+
+typedef struct {
+	v2 min_p; // Corner of the node's cell
+	f32 size; // Side of the cell
+	u32 parent;
+	u32 children[ 4 ]; // By quadrant: bit 0 set right, bit 1 set above. SL_SPATIAL_NONE if absent
+	u32 first; // First entry in the node, or the next free node if the node is free
+	u32 count; // Entries in the node and below it
+} sl_spatial_node;
+
+typedef struct {
+	sl_box aabb;
+	u32 node; // SL_SPATIAL_NONE if the slot isn't indexed
+	u32 prev, next; // Neighbours in the node's list of entries
+	u8 layer;
+	u8 moved; // Boolean; set while in the moved list
+} sl_spatial_entry;
+
+typedef struct {
+	vul_vector *nodes; // Vector of sl_spatial_node
+	u32 root, free_node;
+} sl_spatial_tree;
+
+typedef struct sl_spatial_index {
+	sl_spatial_tree trees[ SL_SPATIAL_LAYERS ];
+	vul_vector *entries; // Vector of sl_spatial_entry, indexed by entity slot
+	vul_vector *moved; // Vector of u32; slots whose transform may have changed since the last refresh
+} sl_spatial_index;
+
+/**
+ * Creates an empty index.
+ */
+void sl_spatial_create( sl_spatial_index *index );
+
+/**
+ * Destroys an index.
+ */
+void sl_spatial_destroy( sl_spatial_index *index );
+
+/**
+ * Indexes the entity in the given slot and layer with the given AABB.
+ */
+void sl_spatial_insert( sl_spatial_index *index, u32 slot, u32 layer, const sl_box *aabb );
+
+/**
+ * Drops the entity in the given slot from the index.
+ */
+void sl_spatial_remove( sl_spatial_index *index, u32 slot );
+
+/**
+ * Moves the entity in the given slot to its new AABB. Nothing is done if the
+ * AABB didn't change.
+ */
+void sl_spatial_update( sl_spatial_index *index, u32 slot, const sl_box *aabb );
+
+/**
+ * Adds the slot to the moved list, once, for the owner to refresh before the
+ * next query.
+ */
+void sl_spatial_mark_moved( sl_spatial_index *index, u32 slot );
+
+/**
+ * Appends the slots of all entities in the layer whose AABB holds the point.
+ * The order is unspecified.
+ */
+void sl_spatial_query_point( sl_spatial_index *index, u32 layer, const v2 *pos, vul_vector *slots );
+
+/**
+ * Appends the slots of all entities in the layer whose AABB overlaps the box.
+ * The order is unspecified.
+ */
+void sl_spatial_query_box( sl_spatial_index *index, u32 layer, const sl_box *area, vul_vector *slots );
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * Shadows the GL state the renderer touches (bound program, textures, vertex
+ * array, array buffer, framebuffer, blending, depth test and viewport) so calls
+ * that wouldn't change anything are never issued. Every window's context has its
+ * own sl_gl_state, made current along with the context. Counts issued and
+ * skipped calls, summed over all contexts.
+ *
+ * If you bind things or change this state with raw GL calls, call
+ * sl_gl_state_invalidate afterwards.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SLENDERER_STATE_H
+#define SLENDERER_STATE_H
+
+#include <GL/glew.h>
+#include <vul_types.h>
+
+#define SL_GL_STATE_TEXTURE_UNITS 8
+#define SL_GL_STATE_UNKNOWN 0xffffffff // Value of a binding we don't know
+
+typedef struct sl_gl_state {
+	GLuint program;
+	GLuint active_texture; // Index of the active texture unit
+	GLuint textures[ SL_GL_STATE_TEXTURE_UNITS ]; // GL_TEXTURE_2D binding of each unit
+	GLuint vertex_array;
+	GLuint array_buffer;
+	GLuint framebuffer;
+	GLuint blend; // 0, 1 or SL_GL_STATE_UNKNOWN; as are the capabilities below
+	GLuint depth_test;
+	GLuint texture_2d; // Only meaningful in legacy GL
+	GLenum blend_src, blend_dst;
+	GLint viewport[ 4 ]; // Width is -1 if unknown
+	struct sl_gl_state *next; // Next of all created states
+} sl_gl_state;
+
+/**
+ * Sets up a new state with every value unknown, and adds it to the states
+ * sl_gl_state_deleted updates. Done by the window when it creates its context.
+ */
+void sl_gl_state_create( sl_gl_state *state );
+
+/**
+ * Removes the state from the created ones, and clears the current state if it
+ * was this one. Does not free the state.
+ */
+void sl_gl_state_destroy( sl_gl_state *state );
+
+/**
+ * Sets every tracked value of the state to unknown, so the next call for each
+ * is issued. Call after changing any of it with raw GL calls.
+ */
+void sl_gl_state_invalidate( sl_gl_state *state );
+
+/**
+ * Makes the state the one the calls below go through. Done by the window when
+ * it makes its context current.
+ */
+void sl_gl_state_make_current( sl_gl_state *state );
+
+/**
+ * Returns the current state.
+ */
+sl_gl_state *sl_gl_state_get_current( );
+
+/**
+ * Gets the number of GL calls issued and skipped through the state trackers
+ * since the counters were last reset.
+ */
+void sl_gl_state_get_counters( u64 *issued, u64 *skipped );
+
+/**
+ * Resets the issued and skipped counters.
+ */
+void sl_gl_state_reset_counters( );
+
+/**
+ * Tells every created state an object was deleted. In the current context GL
+ * unbinds deleted textures, vertex arrays, buffers and framebuffers; the program
+ * is forgotten. Other contexts sharing the object keep it bound while its name may
+ * be reused, so the name is forgotten in their states. binding is the binding query
+ * for the object type: GL_CURRENT_PROGRAM, GL_TEXTURE_BINDING_2D,
+ * GL_VERTEX_ARRAY_BINDING, GL_ARRAY_BUFFER_BINDING or GL_FRAMEBUFFER_BINDING.
+ */
+void sl_gl_state_deleted( GLenum binding, GLuint name );
+
+/**
+ * glUseProgram, if the program isn't already in use.
+ */
+void sl_gl_use_program( GLuint program );
+
+/**
+ * Binds the texture to GL_TEXTURE_2D of the given unit, if not already bound.
+ * Only changes the active texture unit if it has to bind.
+ */
+void sl_gl_bind_texture( GLuint unit, GLuint texture );
+
+/**
+ * glBindVertexArray, if the vertex array isn't already bound.
+ */
+void sl_gl_bind_vertex_array( GLuint vertex_array );
+
+/**
+ * Binds the buffer to GL_ARRAY_BUFFER, if not already bound.
+ */
+void sl_gl_bind_array_buffer( GLuint buffer );
+
+/**
+ * Binds the framebuffer to GL_FRAMEBUFFER, if not already bound.
+ */
+void sl_gl_bind_framebuffer( GLuint framebuffer );
+
+/**
+ * glEnable/glDisable of GL_BLEND, GL_DEPTH_TEST or (legacy) GL_TEXTURE_2D, if
+ * it would change anything.
+ */
+void sl_gl_set_capability( GLenum capability, int enabled );
+
+/**
+ * glBlendFunc, if the factors differ from the current ones.
+ */
+void sl_gl_blend_func( GLenum src, GLenum dst );
+
+/**
+ * glViewport, if the viewport differs from the current one.
+ */
+void sl_gl_viewport( GLint x, GLint y, GLint width, GLint height );
+
+#endif
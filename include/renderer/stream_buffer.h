@@ -0,0 +1,91 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * A vertex buffer for data that is rewritten every frame, like instance records.
+ * The buffer is split into SL_STREAM_BUFFER_FRAMES regions used round robin, one
+ * per frame; a fence is placed after each frame's draws and only waited on when
+ * the ring comes back around to its region, so writing never waits on draws still
+ * reading earlier frames. How it is written depends on what the driver offers:
+ * -GL 4.4/ARB_buffer_storage: mapped once, persistently and coherently; writes go
+ *  straight to the mapping.
+ * -GL 3.2/ARB_sync: every write maps its range unsynchronized.
+ * -Otherwise: writes are uploaded with glBufferSubData, and the buffer is orphaned
+ *  whenever it fills up.
+ * Not available with SL_LEGACY_OPENGL or SL_OPENGL_ES.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SLENDERER_STREAM_BUFFER_H
+#define SLENDERER_STREAM_BUFFER_H
+
+#include "renderer/state.h"
+
+#if !defined( SL_LEGACY_OPENGL ) && !defined( SL_OPENGL_ES )
+
+#define SL_STREAM_BUFFER_FRAMES 3
+#define SL_STREAM_BUFFER_ALIGNMENT 16 // Writes start at multiples of this many bytes
+
+typedef enum {
+	SL_STREAM_BUFFER_PERSISTENT,
+	SL_STREAM_BUFFER_MAPPED,
+	SL_STREAM_BUFFER_ORPHANED
+} sl_stream_buffer_mode;
+
+typedef struct sl_stream_buffer {
+	GLuint buffer;
+	sl_stream_buffer_mode mode;
+	u32 region_size; // Bytes per frame
+	u32 region; // Region written this frame
+	u32 offset; // Next write offset into the region (orphaned: into the whole buffer)
+	u32 reserved; // Size of the open write, 0 if none
+	GLsync fences[ SL_STREAM_BUFFER_FRAMES ];
+	unsigned char *mapping; // Persistent mapping of the whole buffer, or the staging
+							// copy of the open write when orphaned
+	u64 stalls; // Times a write had to wait for the GPU to release its region
+} sl_stream_buffer;
+
+/**
+ * Creates a stream buffer that holds region_size bytes per frame. It grows if a
+ * frame writes more. Needs a current context.
+ */
+void sl_stream_buffer_create( sl_stream_buffer *stream, u32 region_size );
+
+/**
+ * Destroys a stream buffer.
+ */
+void sl_stream_buffer_destroy( sl_stream_buffer *stream );
+
+/**
+ * Opens a write of up to size bytes and returns where to write them. offset is
+ * set to where they will be in the buffer, for attribute pointers. The write must
+ * be closed with sl_stream_buffer_commit before drawing from it or opening another.
+ * May replace the buffer if it has to grow, so read stream->buffer after this.
+ */
+void *sl_stream_buffer_reserve( sl_stream_buffer *stream, u32 size, u32 *offset );
+
+/**
+ * Closes the open write, of which only the first used bytes were written.
+ * Leaves the buffer bound to GL_ARRAY_BUFFER.
+ */
+void sl_stream_buffer_commit( sl_stream_buffer *stream, u32 used );
+
+/**
+ * Ends the frame: fences the draws made from this frame's region and moves on to
+ * the next one. Call once per presented frame, after its last draw from the
+ * buffer; a region has to hold everything the frame draws, so ending it more
+ * often would wrap the ring within a frame.
+ */
+void sl_stream_buffer_end_frame( sl_stream_buffer *stream );
+
+#endif
+
+#endif
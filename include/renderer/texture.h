@@ -19,6 +19,11 @@
 
 #include "renderer/program.h"
 
+// Load states of a texture, see sl_texture_load_async
+#define SL_TEXTURE_LOADED 0
+#define SL_TEXTURE_LOADING 1 // Still shows a placeholder
+#define SL_TEXTURE_LOAD_FAILED 2 // Shows the placeholder for good
+
 typedef struct {
 	unsigned int texture_id;
 	GLuint gl_id;
@@ -26,6 +31,7 @@ typedef struct {
 	unsigned int height;
 	GLenum format;
 	GLenum internal_format;
+	unsigned int load_state;
 } sl_texture;
 
 /**
@@ -40,12 +46,13 @@ void sl_texture_create( sl_texture* tex, void *data, unsigned int width, unsigne
 void sl_texture_destroy( sl_texture* tex );
 
 /**
- * Binds a texture for rendering/editing.
+ * Binds a texture to unit 0 for rendering/editing. The texture isn't rebound
+ * if it already is.
  */
 void sl_texture_bind( sl_program *prog, sl_texture* tex );
 
 /**
- * Unbinds a texture after rendering/editing.
+ * Unbinds a texture after rendering/editing. Not needed before binding another.
  */
 void sl_texture_unbind( sl_texture* tex );
 
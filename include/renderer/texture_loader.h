@@ -0,0 +1,121 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * Asynchronous texture loading. sl_texture_load_async hands the file to a pool
+ * of worker threads that decode it with stb_image, and immediately returns the id
+ * of a texture showing a 1x1 placeholder. Once per frame, when its buffers are
+ * swapped, the render thread uploads decoded images in row chunks, at most
+ * SL_TEXTURE_UPLOAD_BUDGET bytes per frame, into a fresh GL texture which replaces
+ * the placeholder when complete. Sprites can use the id right away; they show the
+ * real image as soon as it's in. The texture's load_state tells how it's going.
+ *
+ * The workers are started by the first load and run until the renderer is
+ * destroyed, sleeping until a slot is queued for them. At most
+ * SL_TEXTURE_LOADER_SLOTS images are being decoded or waiting for upload at a
+ * time, which bounds the memory held by decoded images; further requests wait in
+ * a queue.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SLENDERER_TEXTURE_LOADER_H
+#define SLENDERER_TEXTURE_LOADER_H
+
+#include <vul_types.h>
+#include <vul_resizable_array.h>
+#if defined( VUL_WINDOWS )
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+
+#include "renderer/state.h"
+
+#define SL_TEXTURE_LOADER_THREADS 2
+#define SL_TEXTURE_LOADER_SLOTS 32 // Images decoding or waiting for upload at once
+#define SL_TEXTURE_LOADER_FAILURE_MAX 64 // Longest failure reason kept, including the terminator
+#ifndef SL_TEXTURE_UPLOAD_BUDGET
+	#define SL_TEXTURE_UPLOAD_BUDGET ( 4 * 1024 * 1024 ) // Bytes uploaded per frame, however many scenes it renders
+#endif
+
+// States of a slot, owned by the thread that may move it on
+#define SL_TEXTURE_SLOT_FREE 0 // Main thread
+#define SL_TEXTURE_SLOT_QUEUED 1 // Any worker may claim it
+#define SL_TEXTURE_SLOT_DECODING 2 // The worker that claimed it
+#define SL_TEXTURE_SLOT_DECODED 3 // Main thread; pixels is set
+#define SL_TEXTURE_SLOT_FAILED 4 // Main thread
+
+typedef struct {
+	volatile u32 state;
+	char *path;
+	unsigned int texture_id;
+	unsigned char *pixels; // RGBA8, from stbi_load
+	int width, height;
+	char failure[ SL_TEXTURE_LOADER_FAILURE_MAX ]; // stb_image's reason, copied by the worker once decoding failed
+	// Upload progress, main thread only
+	GLuint gl_id; // Texture being uploaded into, 0 until started
+	int rows_uploaded;
+} sl_texture_load_slot;
+
+typedef struct {
+	char *path;
+	unsigned int texture_id;
+} sl_texture_load_request;
+
+typedef struct sl_texture_loader {
+	sl_texture_load_slot slots[ SL_TEXTURE_LOADER_SLOTS ];
+	vul_vector *queue; // Vector of sl_texture_load_request that found no free slot yet
+	u32 pending; // Loads requested but not yet finished
+	volatile u32 quit;
+	int started;
+	// Workers wait to be woken once for every slot queued, and once each to quit
+#if defined( VUL_WINDOWS )
+	HANDLE threads[ SL_TEXTURE_LOADER_THREADS ];
+	HANDLE wake; // Semaphore counting the wakeups
+#else
+	pthread_t threads[ SL_TEXTURE_LOADER_THREADS ];
+	pthread_mutex_t wake_lock;
+	pthread_cond_t wake;
+	u32 wakeups; // Wakeups not yet taken by a worker, under wake_lock
+#endif
+} sl_texture_loader;
+
+/**
+ * Initializes the loader. Its threads are started by the first load.
+ */
+void sl_texture_loader_create( sl_texture_loader *loader );
+
+/**
+ * Stops the workers and drops all loads that haven't finished.
+ */
+void sl_texture_loader_destroy( sl_texture_loader *loader );
+
+/**
+ * Uploads decoded images, at most budget bytes of them, and finishes the
+ * textures that are complete. Called by the renderer once per frame, at the swap.
+ * Needs the context the textures belong to to be current.
+ */
+void sl_texture_loader_update( sl_texture_loader *loader, u32 budget );
+
+/**
+ * Starts loading an image file into a new texture and returns its id. Until the
+ * image is in, the texture is a 1x1 transparent placeholder with load_state
+ * SL_TEXTURE_LOADING; if decoding fails it stays so, with SL_TEXTURE_LOAD_FAILED.
+ * \note: requires an OpenGL context to pre-exist.
+ */
+unsigned int sl_texture_load_async( const char *path );
+
+/**
+ * Returns the number of loads that haven't finished yet.
+ */
+u32 sl_texture_loads_pending( );
+
+#endif
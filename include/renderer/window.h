@@ -27,6 +27,8 @@
 #include <GLFW/glfw3native.h>
 #endif
 
+#include "renderer/state.h"
+
 #ifdef SL_DEBUG
 	#include <assert.h>
 #else
@@ -37,6 +39,9 @@ typedef struct sl_window {
 	unsigned int window_id;
 	GLFWwindow *handle;
 	GLuint fbo, fbo_texture, rbo_depth;
+	int offscreen; // Hidden window; swapping only waits for the GPU to finish
+	GLuint post_fbo, post_texture; // Offscreen windows only; post renders here instead of to the window
+	sl_gl_state *gl_state; // Shadow of the GL state of the window's context
 } sl_window;
 
 /**
@@ -48,6 +53,23 @@ typedef struct sl_window {
  */
 void sl_window_create( sl_window* win, unsigned int width, unsigned int height, const char *title, int fullscreen, int vsync, sl_window *context_share );
 
+/**
+ * Creates a hidden window & context for rendering that is never shown, e.g. when
+ * benchmarking or testing against Mesa's llvmpipe on a CI machine. This is still a
+ * GLFW window, so it needs a display connection (run under Xvfb where there's no
+ * display), unless built with SL_OSMESA and GLFW is new enough to create the context
+ * through OSMesa instead of the native API. Rendering works as for a visible window,
+ * but nothing is ever presented and vsync is off. Post processing renders to an FBO
+ * of its own instead of the window, whose pixels are undefined while it's hidden.
+ * \note: requires sl_renderer_init to have been called prior.
+ */
+void sl_window_create_offscreen( sl_window* win, unsigned int width, unsigned int height, sl_window *context_share );
+
+/**
+ * Makes the window's context and GL state tracker current, if they aren't.
+ */
+void sl_window_make_current( sl_window *win );
+
 /**
  * Destroys a window.
  */
@@ -80,6 +102,17 @@ void sl_window_bind_framebuffer_post( sl_window *win );
  */
 void sl_window_swap_buffers( sl_window *win );
 
+/**
+ * Reads back the window's pixels as tightly packed RGBA8, top row first, into out,
+ * which must hold width * height * 4 bytes of the window's framebuffer size.
+ * If from_fbo, reads the scene as rendered before post processing, otherwise the
+ * post processed image; for a visible window the latter is only valid until the
+ * buffers are swapped. Offscreen windows are always read from their FBOs. Legacy
+ * GL has no FBO and always reads the window's back buffer, which is undefined for
+ * offscreen windows. Waits for all rendering to finish, so this is slow.
+ */
+void sl_window_read_pixels( sl_window *win, int from_fbo, unsigned char *out );
+
 /**
  * Window size change callback.
  * Recreates the FBO in the new size.
@@ -79,11 +79,15 @@ void sl_print( u32 max_length, const char *fmt, ... );
 #include "renderer/window.h"
 #include "renderer/scene.h"
 #include "renderer/texture.h"
+#include "renderer/atlas.h"
+#include "renderer/texture_loader.h"
 #include "renderer/program.h"
 #include "renderer/animator.h"
 #include "renderer/renderable.h"
+#include "renderer/stream_buffer.h"
 #include "physics/simulator.h"
 #include "input/controller.h"
+#include "debug/profiler.h"
 
 #ifndef SL_NO_AUDIO
 #include "audio/aurator.h"
@@ -91,17 +95,26 @@ void sl_print( u32 max_length, const char *fmt, ... );
 #define SL_AUDIO_SAMPLE_RATE 44100
 #endif
 
+#define SL_INSTANCE_STREAM_INSTANCES 4096 // Instances per frame, over all its scenes, the instance stream starts out holding
+
 typedef struct {
 	vul_vector *windows; // Vector of sl_window
 	vul_vector *scenes; // Vector of sl_scene
 	vul_vector *animators; // Vector of sl_animator
 	vul_vector *simulators; // Vector of sl_simulator
 	vul_vector *textures; // Vector of sl_texture. An array with all the textures
+	sl_texture_loader texture_loader; // Decodes and uploads the textures loaded with sl_texture_load_async
 	vul_vector *programs; // Vector of sl_program. An array with all the programs
 	vul_vector *renderables; // Vector of sl_renderable. Ones that are not sprite-animated
 							   // should use the same one. Ohters should have their own.
 #ifndef SL_NO_AUDIO
 	vul_vector *aurators; // Vector of sl_aurator.
+#endif
+#ifdef SL_INSTANCING
+	sl_stream_buffer instance_stream; // Instanced runs are packed straight into this
+#endif
+#ifdef SL_PROFILER
+	u32 profiler_layer_zones[ SL_MAX_LAYERS ]; // Profiler zone ids of the layers, "layer N"
 #endif
 	u32 next_scene_id;
 } sl_renderer;
@@ -123,14 +136,39 @@ void sl_renderer_destroy( );
  */
 sl_window *sl_renderer_open_window( unsigned int width, unsigned int height, const char *title, int fullscreen, int vsync );
 
+/**
+ * Creates a hidden window and adds it to the renderer, for rendering that is never
+ * shown; it still needs a display connection (see sl_window_create_offscreen). Swapping its buffers only waits for the
+ * frame to finish, so sl_renderer_render_scene can be timed as usual and its output
+ * read back with sl_renderer_read_pixels.
+ */
+sl_window *sl_renderer_open_offscreen( unsigned int width, unsigned int height );
+
+/**
+ * Reads back the pixels of the window at the given index; see sl_window_read_pixels.
+ */
+void sl_renderer_read_pixels( unsigned int window_index, SL_BOOL from_fbo, unsigned char *out );
+
 /**
  * Closes a window and removes it from the renderer.
  */
 void sl_renderer_close_window( u32 win_id );
 
+#ifdef SL_PROFILER
+/**
+ * Captures the next frame_count frames, including the audio mixer and stream
+ * decode threads, and writes them to path as chrome://tracing/Perfetto JSON.
+ * Returns SL_FALSE if a capture is already running.
+ */
+SL_BOOL sl_renderer_capture_trace( const char *path, u32 frame_count );
+#endif
+
 /**
  * Renders the scene at the given index to the window at the given index.
  * Applies the given camera offset to all coorindates before rendering.
+ * Pass swap_buffers for the last scene of each frame only; that ends the frame,
+ * which recycles the instance stream, uploads decoded textures and ends the
+ * profiler's frame.
  */
 void sl_renderer_render_scene( unsigned int scene_index, unsigned int window_index, SL_BOOL swap_buffers );
 
@@ -180,7 +218,8 @@ sl_program *sl_renderer_allocate_program( );
 /**
  * Renders a single quad using leagcy GL
  */
-void sl_renderer_draw_legacy_instance( v2 *camera_offset, sl_renderable *rend, sl_entity *entity );
+void sl_renderer_draw_legacy_instance( v2 *camera_offset, sl_renderable *rend, const sl_affine *transform, const float color[ 4 ],
+									   const sl_box *entity_uvs, const v2 *flip_uvs );
 #else
 /**
  * Renders a single quad instance. Binds the world matrix uniform, then draws.
@@ -188,6 +227,16 @@ void sl_renderer_draw_legacy_instance( v2 *camera_offset, sl_renderable *rend, s
 void sl_renderer_draw_instance( sl_renderable *ren );
 #endif
 
+#ifdef SL_INSTANCING
+/**
+ * Renders count instances of a renderable in a single draw call. Copies the
+ * instance records into the instance stream buffer, binds them as per-instance
+ * attributes, then draws. The program, texture and renderable must already be bound.
+ * Without instancing support they are drawn one by one instead.
+ */
+void sl_renderer_draw_instances( sl_renderable *ren, const sl_entity_instance *instances, u32 count );
+#endif
+
 /**
  * A callback function that handles errors in GLFW. We assert false in debug mode,
  * and print to STDERR in release mode.
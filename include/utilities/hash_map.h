@@ -0,0 +1,86 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * Open addressing hash map from 64-bit integer keys to values of a fixed size.
+ * Every key the engine looks up, entity ids, pairs of them or pointers, fits in
+ * 64 bits, so keys are stored inline and compared as integers.
+ *
+ * Collisions are resolved by linear probing with Robin Hood insertion: an entry
+ * further from its home slot than the one in its way takes that slot, and the
+ * displaced entry probes on. This keeps probe lengths short and even, and lets
+ * lookups of missing keys stop as soon as they reach an entry closer to home than
+ * they are. Removal shifts the following entries back instead of leaving
+ * tombstones. Keys and probe distances sit together in one array, the values in
+ * another, so a lookup reads consecutive memory until it finds its key. The table
+ * doubles once it is SL_HASH_MAP_MAX_LOAD full.
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef SLENDERER_HASH_MAP_H
+#define SLENDERER_HASH_MAP_H
+
+#include <vul_types.h>
+
+#define SL_HASH_MAP_MIN_CAPACITY 16 // Slots of the smallest table; a power of two
+#define SL_HASH_MAP_MAX_LOAD 7 // Eighths of the slots in use before the table grows
+
+// Builds a key of two 32-bit integers
+#define SL_HASH_MAP_PAIR( a, b ) ( ( ( u64 )( a ) << 32 ) | ( u64 )( u32 )( b ) )
+
+typedef struct {
+	u64 key;
+	u32 dist; // Distance from the key's home slot plus one; 0 if the slot is empty
+} sl_hash_map_slot;
+
+typedef struct sl_hash_map {
+	sl_hash_map_slot *slots;
+	u8 *values; // value_size bytes per slot, then two spare values used while inserting
+	u32 capacity; // Slots, a power of two; 0 until the first insert
+	u32 count;
+	u32 value_size;
+} sl_hash_map;
+
+/**
+ * Creates an empty map for values of the given size. Nothing is allocated until
+ * the first insert.
+ */
+void sl_hash_map_create( sl_hash_map *map, u32 value_size );
+
+/**
+ * Destroys a map.
+ */
+void sl_hash_map_destroy( sl_hash_map *map );
+
+/**
+ * Removes all entries, keeping the table.
+ */
+void sl_hash_map_clear( sl_hash_map *map );
+
+/**
+ * Returns the value of the given key, or NULL if it isn't in the map. The
+ * pointer is valid until the next insert or remove.
+ */
+void *sl_hash_map_get( const sl_hash_map *map, u64 key );
+
+/**
+ * Copies the value in under the given key, replacing any value it had, and
+ * returns where it's stored. The pointer is valid until the next insert or remove.
+ * The value must not point into the map, which may be reallocated.
+ */
+void *sl_hash_map_insert( sl_hash_map *map, u64 key, const void *value );
+
+/**
+ * Removes the given key. Returns SL_FALSE if it wasn't in the map.
+ */
+int sl_hash_map_remove( sl_hash_map *map, u64 key );
+
+#endif
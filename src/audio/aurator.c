@@ -17,10 +17,17 @@
 
 #include "slenderer.h"
 
+// Show the mixer thread's mix periods in profiler traces
+#ifdef SL_PROFILER
+	#define VUL_AUDIO_PROFILE_MIX_BEGIN( ) sl_profiler_name_thread( "audio mixer" ); SL_PROFILE_ZONE_BEGIN( "audio mix" )
+	#define VUL_AUDIO_PROFILE_MIX_END( ) SL_PROFILE_ZONE_END( )
+#endif
 #define VUL_DEFINE
 #include <vul_audio.h>
 
 static vul_audio_device *sl_aurator_device = 0;
+// Last volume requested; the mixer applies it once it drains the command queue.
+static f32 sl_aurator_volume = 1.f;
 
 #ifdef VUL_WINDOWS
 void sl_aurator_create( sl_aurator *ret, u32 parent_scene, u32 channel_count, u32 sample_rate, HWND win )
@@ -35,6 +42,9 @@ void sl_aurator_create( sl_aurator *ret, u32 parent_scene, u32 channel_count, u3
 
    ret->clips = 0;
    ret->clip_count = 0;
+   ret->streams = 0;
+   ret->stream_ids = 0;
+   ret->stream_count = 0;
 
 	if( !sl_aurator_device ) {
 		sl_aurator_device = ( vul_audio_device* )SL_ALLOC( sizeof( vul_audio_device ) );
@@ -57,8 +67,23 @@ void sl_aurator_create( sl_aurator *ret, u32 parent_scene, u32 channel_count, u3
 
 void sl_aurator_destroy( sl_aurator *aurator )
 {
+   u64 i;
+
 	assert( aurator );
 
+   // Make sure the mixer is done with a stream before it goes away
+   for( i = 0; i < aurator->stream_count; ++i ) {
+      vul_audio_clip_remove( sl_aurator_device, aurator->stream_ids[ i ] );
+      sl_audio_stream_destroy( aurator->streams[ i ] );
+   }
+   if( aurator->stream_count ) {
+      SL_DEALLOC( aurator->streams );
+      SL_DEALLOC( aurator->stream_ids );
+      aurator->streams = 0;
+      aurator->stream_ids = 0;
+      aurator->stream_count = 0;
+   }
+
    if( aurator->clip_count ) {
       SL_DEALLOC( aurator->clips );
       aurator->clip_count = 0;
@@ -74,14 +99,37 @@ void sl_aurator_finalize( )
 	}
 }
 
-void sl_aurator_play( sl_aurator *aurator, u64 clip_id, b32 looping, b32 keep )
+b32 sl_aurator_play( sl_aurator *aurator, u64 clip_id, b32 looping, b32 keep )
 {
-   assert( VUL_OK == vul_audio_clip_play( sl_aurator_device, clip_id, looping, keep ) );
+   vul_audio_return err;
+   u64 i;
+
+#ifdef SL_DEBUG
+   assert( sl_aurator_device );
+#else
+   if( !sl_aurator_device ) {
+      sl_print( 256, "Tried to play clip %llu without an audio device.\n", ( unsigned long long )clip_id );
+      return SL_FALSE;
+   }
+#endif
+   for( i = 0; i < aurator->stream_count; ++i ) {
+      if( aurator->stream_ids[ i ] == clip_id ) {
+         sl_audio_stream_set_looping( aurator->streams[ i ], looping );
+         break;
+      }
+   }
+   err = vul_audio_clip_play_queued( sl_aurator_device, clip_id, looping, keep );
+   if( err != VUL_OK ) {
+      // The mixer drains the queue every mix period, so this passes; let the caller retry
+      sl_print( 256, "Audio command queue full, clip %llu not played.\n", ( unsigned long long )clip_id );
+      return SL_FALSE;
+   }
+   return SL_TRUE;
 }
 
 void sl_aurator_stop( sl_aurator *aurator, u64 clip_id, b32 reset )
 {
-   vul_audio_clip_pause( sl_aurator_device, clip_id, reset );
+   vul_audio_clip_pause_queued( sl_aurator_device, clip_id, reset );
 }
 
 void sl_aurator_remove_all( sl_aurator *aurator )
@@ -91,7 +139,7 @@ void sl_aurator_remove_all( sl_aurator *aurator )
       return;
    }
    for( i = 0; i < aurator->clip_count; ++i ) {
-      vul_audio_clip_remove( sl_aurator_device, aurator->clips[ i ] );
+      vul_audio_clip_remove_queued( sl_aurator_device, aurator->clips[ i ] );
    }
 }
 
@@ -103,7 +151,7 @@ void sl_aurator_pause_all( sl_aurator *aurator, b32 reset )
    }
 
    for( i = 0; i < aurator->clip_count; ++i ) {
-      vul_audio_clip_pause( sl_aurator_device, aurator->clips[ i ], reset );
+      vul_audio_clip_pause_queued( sl_aurator_device, aurator->clips[ i ], reset );
    }
 }
 
@@ -115,8 +163,23 @@ void sl_aurator_resume_all( sl_aurator *aurator )
    }
 
    for( i = 0; i < aurator->clip_count; ++i ) {
-      vul_audio_clip_resume( sl_aurator_device, aurator->clips[ i ] );
+      vul_audio_clip_resume_queued( sl_aurator_device, aurator->clips[ i ] );
+   }
+}
+
+/*
+ * Appends a clip id to the aurator's list of clips.
+ */
+static void sl_aurator_add_clip_id( sl_aurator *aurator, u64 id )
+{
+   if( aurator->clip_count == 0 ) {
+      aurator->clips = ( u64* )SL_ALLOC( sizeof( u64 ) );
+   } else {
+      u64 *p = ( u64* )SL_REALLOC( aurator->clips, sizeof( u64 ) * ( aurator->clip_count + 1 ) );
+      assert( p );
+      aurator->clips = p;
    }
+   aurator->clips[ aurator->clip_count++ ] = id;
 }
 
 u64 sl_aurator_load_ogg( sl_aurator *aurator, char *path )
@@ -161,14 +224,40 @@ u64 sl_aurator_load_ogg( sl_aurator *aurator, char *path )
    id = vul_audio_clip_add( sl_aurator_device, stream, sample_count, 
                             sl_aurator_device->mixer.channels, 1.0f );
 
-   if( aurator->clip_count == 0 ) {
-      aurator->clips = ( u64* )SL_ALLOC( sizeof( u64 ) );
+   sl_aurator_add_clip_id( aurator, id );
+
+   return id;
+}
+
+u64 sl_aurator_stream_ogg( sl_aurator *aurator, char *path )
+{
+   sl_audio_stream *stream;
+   u64 id;
+
+   stream = sl_audio_stream_open_ogg( path, sl_aurator_device->mixer.channels, sl_aurator_device->sample_rate );
+   if( !stream ) {
+      return 0;
+   }
+   id = vul_audio_stream_add( sl_aurator_device, stream->channels, 1.0f, sl_audio_stream_read, stream );
+   if( !id ) {
+      sl_audio_stream_destroy( stream );
+      return 0;
+   }
+
+   if( aurator->stream_count == 0 ) {
+      aurator->streams = ( sl_audio_stream** )SL_ALLOC( sizeof( sl_audio_stream* ) );
+      aurator->stream_ids = ( u64* )SL_ALLOC( sizeof( u64 ) );
    } else {
-      u64 *p = ( u64* )SL_REALLOC( aurator->clips, sizeof( u64 ) * ( aurator->clip_count + 1 ) );
-      assert( p );
-      aurator->clips = p;
+      sl_audio_stream **s = ( sl_audio_stream** )SL_REALLOC( aurator->streams, sizeof( sl_audio_stream* ) * ( aurator->stream_count + 1 ) );
+      u64 *p = ( u64* )SL_REALLOC( aurator->stream_ids, sizeof( u64 ) * ( aurator->stream_count + 1 ) );
+      assert( s && p );
+      aurator->streams = s;
+      aurator->stream_ids = p;
    }
-   aurator->clips[ aurator->clip_count++ ] = id;
+   aurator->streams[ aurator->stream_count ] = stream;
+   aurator->stream_ids[ aurator->stream_count++ ] = id;
+
+   sl_aurator_add_clip_id( aurator, id );
 
    return id;
 }
@@ -177,11 +266,12 @@ void sl_aurator_set_volume( sl_aurator *aurator, f32 vol )
 {
 	assert( 0.f <= vol && vol <= 1.f );
 
-   vul_audio_set_global_volume( sl_aurator_device, vol );
+   sl_aurator_volume = vol;
+   vul_audio_set_global_volume_queued( sl_aurator_device, vol );
 }
 
 f32 sl_aurator_get_volume( sl_aurator *aurator )
 {
-   return sl_aurator_device->mixer.volume;
+   return sl_aurator_volume;
 }
 
@@ -0,0 +1,200 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain?
+ *
+ * ? If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "audio/stream.h"
+
+#include <string.h>
+#include <vul_timer.h>
+
+#include "slenderer.h"
+
+// Acquire/release access to the fields shared between the decode and mixer threads
+#if defined( _MSC_VER )
+static u32 sl_audio_stream_load( volatile u32 *ptr )
+{
+	u32 val = *ptr;
+	MemoryBarrier( );
+	return val;
+}
+static void sl_audio_stream_store( volatile u32 *ptr, u32 val )
+{
+	MemoryBarrier( );
+	*ptr = val;
+}
+#else
+	#define sl_audio_stream_load( ptr ) __atomic_load_n( ptr, __ATOMIC_ACQUIRE )
+	#define sl_audio_stream_store( ptr, val ) __atomic_store_n( ptr, val, __ATOMIC_RELEASE )
+#endif
+
+/*
+ * Decodes into the free part of the ring until told to quit. Sleeps while the
+ * ring is full or the file has ended, unless asked to rewind.
+ */
+static void sl_audio_stream_decode( sl_audio_stream *stream )
+{
+	u32 head, tail, space, offset, frames;
+	int decoded;
+
+#ifdef SL_PROFILER
+	sl_profiler_name_thread( "ogg decode" );
+#endif
+	while( !sl_audio_stream_load( &stream->quit ) ) {
+		head = stream->head;
+		if( sl_audio_stream_load( &stream->rewind ) == SL_AUDIO_STREAM_REWIND_REQUESTED ) {
+			// Everything decoded from head on is from the start again; the mixer skips to it
+			stb_vorbis_seek_start( stream->vorbis );
+			stream->rewind_head = head;
+			sl_audio_stream_store( &stream->eof, SL_FALSE );
+			sl_audio_stream_store( &stream->rewind, SL_AUDIO_STREAM_REWIND_DONE );
+		}
+		tail = sl_audio_stream_load( &stream->tail );
+		space = SL_AUDIO_STREAM_RING_FRAMES - ( head - tail );
+		if( space == 0 || stream->eof ) {
+			vul_sleep( SL_AUDIO_STREAM_SLEEP_MS );
+			continue;
+		}
+
+		// Decode straight into the ring, up to the point it wraps
+		offset = head & ( SL_AUDIO_STREAM_RING_FRAMES - 1 );
+		frames = SL_MIN( space, SL_AUDIO_STREAM_RING_FRAMES - offset );
+		frames = SL_MIN( frames, SL_AUDIO_STREAM_DECODE_FRAMES );
+		SL_PROFILE_ZONE_BEGIN( "ogg decode" );
+		decoded = stb_vorbis_get_samples_short_interleaved( stream->vorbis, stream->channels,
+																			 stream->ring + offset * stream->channels,
+																			 frames * stream->channels );
+		SL_PROFILE_ZONE_END( );
+		if( decoded > 0 ) {
+			sl_audio_stream_store( &stream->head, head + ( u32 )decoded );
+		} else if( sl_audio_stream_load( &stream->looping ) ) {
+			stb_vorbis_seek_start( stream->vorbis );
+		} else {
+			sl_audio_stream_store( &stream->eof, SL_TRUE );
+		}
+	}
+}
+
+#if defined( VUL_WINDOWS )
+static DWORD WINAPI sl_audio_stream_thread( LPVOID data )
+{
+	sl_audio_stream_decode( ( sl_audio_stream* )data );
+	return 0;
+}
+#else
+static void *sl_audio_stream_thread( void *data )
+{
+	sl_audio_stream_decode( ( sl_audio_stream* )data );
+	return NULL;
+}
+#endif
+
+sl_audio_stream *sl_audio_stream_open_ogg( const char *path, u32 channels, u32 sample_rate )
+{
+	sl_audio_stream *stream;
+	stb_vorbis_info info;
+	int error;
+
+	stream = ( sl_audio_stream* )SL_ALLOC( sizeof( sl_audio_stream ) );
+	memset( stream, 0, sizeof( sl_audio_stream ) );
+
+	stream->vorbis = stb_vorbis_open_filename( path, &error, NULL );
+	if( !stream->vorbis ) {
+		printf( "Failed to open file %s for streaming (error %d).\n", path, error );
+		SL_DEALLOC( stream );
+		return NULL;
+	}
+	info = stb_vorbis_get_info( stream->vorbis );
+	if( info.sample_rate != sample_rate ) {
+		printf( "Sample rate mismatch: set %d vs wanted %d (file %s)\n", sample_rate, info.sample_rate, path );
+		stb_vorbis_close( stream->vorbis );
+		SL_DEALLOC( stream );
+		return NULL;
+	}
+
+	stream->channels = channels;
+	stream->ring = ( s16* )SL_ALLOC( sizeof( s16 ) * SL_AUDIO_STREAM_RING_FRAMES * channels );
+
+#if defined( VUL_WINDOWS )
+	stream->thread = CreateThread( NULL, 0, sl_audio_stream_thread, stream, 0, NULL );
+	if( !stream->thread ) {
+#else
+	if( pthread_create( &stream->thread, NULL, sl_audio_stream_thread, stream ) ) {
+#endif
+		printf( "Failed to start the decode thread for %s.\n", path );
+		stb_vorbis_close( stream->vorbis );
+		SL_DEALLOC( stream->ring );
+		SL_DEALLOC( stream );
+		return NULL;
+	}
+
+	return stream;
+}
+
+void sl_audio_stream_destroy( sl_audio_stream *stream )
+{
+	assert( stream );
+
+	sl_audio_stream_store( &stream->quit, SL_TRUE );
+#if defined( VUL_WINDOWS )
+	WaitForSingleObject( stream->thread, INFINITE );
+	CloseHandle( stream->thread );
+#else
+	pthread_join( stream->thread, NULL );
+#endif
+	stb_vorbis_close( stream->vorbis );
+	SL_DEALLOC( stream->ring );
+	SL_DEALLOC( stream );
+}
+
+void sl_audio_stream_set_looping( sl_audio_stream *stream, SL_BOOL looping )
+{
+	sl_audio_stream_store( &stream->looping, looping ? SL_TRUE : SL_FALSE );
+}
+
+u64 sl_audio_stream_read( s16 *dst, u64 frame_count, b32 *finished, void *data )
+{
+	sl_audio_stream *stream;
+	u32 head, tail, eof, available, frames, offset, first, rewind;
+
+	stream = ( sl_audio_stream* )data;
+
+	if( *finished ) {
+		sl_audio_stream_store( &stream->rewind, SL_AUDIO_STREAM_REWIND_REQUESTED );
+	}
+	rewind = sl_audio_stream_load( &stream->rewind );
+	if( rewind == SL_AUDIO_STREAM_REWIND_REQUESTED ) {
+		*finished = SL_FALSE;
+		return 0;
+	}
+	if( rewind == SL_AUDIO_STREAM_REWIND_DONE ) {
+		// Drop what was decoded before the seek
+		sl_audio_stream_store( &stream->tail, stream->rewind_head );
+		sl_audio_stream_store( &stream->rewind, SL_AUDIO_STREAM_REWIND_NONE );
+	}
+
+	// Read eof before head; once eof is set, head is final.
+	eof = sl_audio_stream_load( &stream->eof );
+	head = sl_audio_stream_load( &stream->head );
+	tail = stream->tail;
+	available = head - tail;
+	frames = ( u32 )SL_MIN( ( u64 )available, frame_count );
+
+	offset = tail & ( SL_AUDIO_STREAM_RING_FRAMES - 1 );
+	first = SL_MIN( frames, SL_AUDIO_STREAM_RING_FRAMES - offset );
+	memcpy( dst, stream->ring + offset * stream->channels, sizeof( s16 ) * first * stream->channels );
+	memcpy( dst + first * stream->channels, stream->ring, sizeof( s16 ) * ( frames - first ) * stream->channels );
+	sl_audio_stream_store( &stream->tail, tail + frames );
+
+	*finished = eof && frames == available;
+	return frames;
+}
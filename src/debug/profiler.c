@@ -0,0 +1,394 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "debug/profiler.h"
+
+#ifdef SL_PROFILER
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "slenderer.h"
+
+// Atomics and thread locals for the parts of the profiler other threads touch
+#if defined( _MSC_VER )
+	#define SL_PROFILER_THREAD_LOCAL __declspec( thread )
+	#define SL_PROFILER_FETCH_ADD( ptr, val ) ( u32 )InterlockedExchangeAdd( ( volatile LONG* )( ptr ), ( LONG )( val ) )
+	#define SL_PROFILER_EXCHANGE( ptr, val ) ( u32 )InterlockedExchange( ( volatile LONG* )( ptr ), ( LONG )( val ) )
+	#define SL_PROFILER_LOAD( ptr ) ( u32 )InterlockedCompareExchange( ( volatile LONG* )( ptr ), 0, 0 )
+	#define SL_PROFILER_STORE( ptr, val ) InterlockedExchange( ( volatile LONG* )( ptr ), ( LONG )( val ) )
+	#define SL_PROFILER_LOAD_PTR( ptr ) InterlockedCompareExchangePointer( ( PVOID volatile* )( ptr ), NULL, NULL )
+	#define SL_PROFILER_STORE_PTR( ptr, val ) InterlockedExchangePointer( ( PVOID volatile* )( ptr ), ( PVOID )( val ) )
+#else
+	#define SL_PROFILER_THREAD_LOCAL __thread
+	#define SL_PROFILER_FETCH_ADD( ptr, val ) __atomic_fetch_add( ptr, val, __ATOMIC_ACQ_REL )
+	#define SL_PROFILER_EXCHANGE( ptr, val ) __atomic_exchange_n( ptr, val, __ATOMIC_ACQUIRE )
+	#define SL_PROFILER_LOAD( ptr ) __atomic_load_n( ptr, __ATOMIC_ACQUIRE )
+	#define SL_PROFILER_STORE( ptr, val ) __atomic_store_n( ptr, val, __ATOMIC_RELEASE )
+	#define SL_PROFILER_LOAD_PTR( ptr ) __atomic_load_n( ptr, __ATOMIC_ACQUIRE )
+	#define SL_PROFILER_STORE_PTR( ptr, val ) __atomic_store_n( ptr, val, __ATOMIC_RELEASE )
+#endif
+
+static sl_profiler sl_profiler_state;
+static volatile u32 sl_profiler_initialized = SL_FALSE;
+// Index of the calling thread plus one; 0 until the thread first uses the profiler
+static SL_PROFILER_THREAD_LOCAL u32 sl_profiler_thread_slot = 0;
+
+/*
+ * Returns the index of the calling thread, handing out a new one on first use.
+ * The thread that initializes the profiler is thread 0.
+ */
+static u32 sl_profiler_thread_index( )
+{
+	if( !sl_profiler_thread_slot ) {
+		sl_profiler_thread_slot = SL_PROFILER_FETCH_ADD( &sl_profiler_state.thread_count, 1 ) + 1;
+	}
+	return sl_profiler_thread_slot - 1;
+}
+
+void sl_profiler_init( )
+{
+	if( SL_PROFILER_LOAD( &sl_profiler_initialized ) ) {
+		return;
+	}
+	memset( &sl_profiler_state, 0, sizeof( sl_profiler ) );
+	vul_timer_reset( &sl_profiler_state.timer );
+	strcpy( sl_profiler_state.names[ SL_PROFILER_FRAME_ZONE ], "frame" );
+	sl_profiler_state.zone_count = 1;
+	sl_profiler_thread_slot = 1;
+	sl_profiler_state.thread_count = 1;
+	// Publish the state last; other threads ignore the profiler until then
+	SL_PROFILER_STORE( &sl_profiler_initialized, SL_TRUE );
+}
+
+void sl_profiler_shutdown( )
+{
+	sl_profiler_trace_buffer *buffer, *next;
+
+	SL_PROFILER_STORE( &sl_profiler_state.capturing, SL_FALSE );
+	for( buffer = sl_profiler_state.trace; buffer; buffer = next ) {
+		next = buffer->next;
+		SL_DEALLOC( buffer->events );
+		SL_DEALLOC( buffer );
+	}
+	sl_profiler_state.trace = NULL;
+}
+
+static int sl_profiler_compare_u64( const void *a, const void *b )
+{
+	u64 x, y;
+
+	x = *( const u64* )a;
+	y = *( const u64* )b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/*
+ * Returns the id of the zone with the given name, or SL_PROFILER_NO_ZONE.
+ */
+static u32 sl_profiler_find_zone( const char *name )
+{
+	u32 i;
+
+	for( i = 0; i < sl_profiler_state.zone_count; ++i ) {
+		if( strncmp( sl_profiler_state.names[ i ], name, SL_PROFILER_ZONE_NAME_MAX - 1 ) == 0 ) {
+			return i;
+		}
+	}
+	return SL_PROFILER_NO_ZONE;
+}
+
+u32 sl_profiler_zone_id( const char *name )
+{
+	u32 i;
+
+	if( !SL_PROFILER_LOAD( &sl_profiler_initialized ) ) {
+		return SL_PROFILER_NO_ZONE;
+	}
+	// Zones may be registered from several threads; a spin lock is plenty since it happens once per zone
+	while( SL_PROFILER_EXCHANGE( &sl_profiler_state.zone_lock, 1 ) ) {
+	}
+	i = sl_profiler_find_zone( name );
+	if( i == SL_PROFILER_NO_ZONE ) {
+		if( sl_profiler_state.zone_count == SL_PROFILER_MAX_ZONES ) {
+			sl_print( 128, "Profiler is out of zones, not timing %s.\n", name );
+		} else {
+			i = sl_profiler_state.zone_count;
+			strncpy( sl_profiler_state.names[ i ], name, SL_PROFILER_ZONE_NAME_MAX - 1 );
+			sl_profiler_state.names[ i ][ SL_PROFILER_ZONE_NAME_MAX - 1 ] = 0;
+			SL_PROFILER_STORE( &sl_profiler_state.zone_count, i + 1 );
+		}
+	}
+	SL_PROFILER_STORE( &sl_profiler_state.zone_lock, 0 );
+	return i;
+}
+
+u32 sl_profiler_zone_id_cached( volatile u32 *cache, const char *name )
+{
+	u32 zone;
+
+	zone = SL_PROFILER_LOAD( cache );
+	if( zone == SL_PROFILER_NO_ZONE ) {
+		// Threads racing here all get the same id, so it doesn't matter whose store lands
+		zone = sl_profiler_zone_id( name );
+		SL_PROFILER_STORE( cache, zone );
+	}
+	return zone;
+}
+
+u64 sl_profiler_now( )
+{
+	return vul_timer_get_micros( &sl_profiler_state.timer );
+}
+
+/*
+ * Appends an event to the running capture, if any. Safe from any thread.
+ */
+static void sl_profiler_trace( u32 zone, u32 thread, u64 start, u64 end )
+{
+	sl_profiler_trace_buffer *buffer;
+	sl_profiler_trace_event *ev;
+	u32 idx;
+
+	if( !SL_PROFILER_LOAD( &sl_profiler_state.capturing ) ) {
+		return;
+	}
+	// If a new capture starts meanwhile, the event lands in the old buffer, which is kept
+	buffer = ( sl_profiler_trace_buffer* )SL_PROFILER_LOAD_PTR( &sl_profiler_state.trace );
+	idx = SL_PROFILER_FETCH_ADD( &sl_profiler_state.event_count, 1 );
+	if( idx >= buffer->capacity ) {
+		return;
+	}
+	ev = &buffer->events[ idx ];
+	ev->zone = zone;
+	ev->thread = thread;
+	ev->start = start;
+	ev->duration = end - start;
+	SL_PROFILER_STORE( &ev->written, SL_TRUE );
+}
+
+/*
+ * Writes a string as a JSON string literal.
+ */
+static void sl_profiler_write_json_string( FILE *f, const char *str )
+{
+	fputc( '"', f );
+	for( ; *str; ++str ) {
+		if( *str == '"' || *str == '\\' ) {
+			fputc( '\\', f );
+		} else if( ( unsigned char )*str < 0x20 ) {
+			continue;
+		}
+		fputc( *str, f );
+	}
+	fputc( '"', f );
+}
+
+/*
+ * Ends the running capture and writes it to the capture path.
+ */
+static void sl_profiler_write_trace( )
+{
+	sl_profiler_trace_buffer *buffer;
+	sl_profiler_trace_event *ev;
+	FILE *f;
+	u32 i, count, threads;
+	char thread_name[ SL_PROFILER_ZONE_NAME_MAX ];
+
+	SL_PROFILER_STORE( &sl_profiler_state.capturing, SL_FALSE );
+	buffer = sl_profiler_state.trace;
+	count = SL_PROFILER_LOAD( &sl_profiler_state.event_count );
+	if( count > buffer->capacity ) {
+		sl_print( 128, "Profiler trace dropped %u events.\n", count - buffer->capacity );
+		count = buffer->capacity;
+	}
+
+	f = fopen( sl_profiler_state.capture_path, "w" );
+	if( !f ) {
+		sl_print( 512, "Could not open %s to write the profiler trace.\n", sl_profiler_state.capture_path );
+		return;
+	}
+	fprintf( f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+	threads = SL_MIN( SL_PROFILER_LOAD( &sl_profiler_state.thread_count ), SL_PROFILER_MAX_THREADS );
+	for( i = 0; i < threads; ++i ) {
+		if( sl_profiler_state.thread_names[ i ][ 0 ] ) {
+			strcpy( thread_name, sl_profiler_state.thread_names[ i ] );
+		} else if( i == 0 ) {
+			strcpy( thread_name, "main" );
+		} else {
+			snprintf( thread_name, SL_PROFILER_ZONE_NAME_MAX, "thread %u", i );
+		}
+		fprintf( f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", i );
+		sl_profiler_write_json_string( f, thread_name );
+		fprintf( f, "}},\n" );
+	}
+	for( i = 0; i < count; ++i ) {
+		ev = &buffer->events[ i ];
+		if( !SL_PROFILER_LOAD( &ev->written ) ) {
+			continue;
+		}
+		fprintf( f, "{\"name\":" );
+		sl_profiler_write_json_string( f, sl_profiler_state.names[ ev->zone ] );
+		fprintf( f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%llu},\n",
+					ev->thread, ( unsigned long long )ev->start, ( unsigned long long )ev->duration );
+	}
+	// A last metadata event keeps the array free of a trailing comma
+	fprintf( f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"slenderer\"}}\n]}\n" );
+	fclose( f );
+}
+
+void sl_profiler_record( u32 zone, u64 start )
+{
+	u64 now;
+	u32 thread;
+
+	if( zone >= SL_PROFILER_MAX_ZONES || !SL_PROFILER_LOAD( &sl_profiler_initialized ) ) {
+		return;
+	}
+	now = sl_profiler_now( );
+	thread = sl_profiler_thread_index( );
+	if( thread == 0 ) {
+		sl_profiler_state.micros[ sl_profiler_state.current ][ zone ] += now - start;
+		sl_profiler_state.calls[ sl_profiler_state.current ][ zone ] += 1;
+	}
+	sl_profiler_trace( zone, thread, start, now );
+}
+
+void sl_profiler_end_frame( )
+{
+	u64 now;
+
+	now = sl_profiler_now( );
+	sl_profiler_state.micros[ sl_profiler_state.current ][ SL_PROFILER_FRAME_ZONE ] = now - sl_profiler_state.frame_start;
+	sl_profiler_state.calls[ sl_profiler_state.current ][ SL_PROFILER_FRAME_ZONE ] = 1;
+	sl_profiler_trace( SL_PROFILER_FRAME_ZONE, 0, sl_profiler_state.frame_start, now );
+	sl_profiler_state.frame_start = now;
+
+	if( sl_profiler_state.capturing && --sl_profiler_state.capture_frames_left == 0 ) {
+		sl_profiler_write_trace( );
+	}
+
+	sl_profiler_state.current = ( sl_profiler_state.current + 1 ) % ( SL_PROFILER_FRAME_COUNT + 1 );
+	if( sl_profiler_state.frame_count < SL_PROFILER_FRAME_COUNT ) {
+		++sl_profiler_state.frame_count;
+	}
+	memset( sl_profiler_state.micros[ sl_profiler_state.current ], 0, sizeof( sl_profiler_state.micros[ 0 ] ) );
+	memset( sl_profiler_state.calls[ sl_profiler_state.current ], 0, sizeof( sl_profiler_state.calls[ 0 ] ) );
+}
+
+int sl_profiler_get_stats( const char *name, sl_profiler_stats *out )
+{
+	u64 samples[ SL_PROFILER_FRAME_COUNT ];
+	u64 sum, calls;
+	u32 zone, i, frame, n;
+
+	assert( out );
+	memset( out, 0, sizeof( sl_profiler_stats ) );
+
+	zone = sl_profiler_find_zone( name );
+	if( zone == SL_PROFILER_NO_ZONE ) {
+		return SL_FALSE;
+	}
+
+	// Only finished frames; the current one is still being recorded
+	n = 0;
+	sum = 0;
+	calls = 0;
+	for( i = 1; i <= sl_profiler_state.frame_count; ++i ) {
+		frame = ( sl_profiler_state.current + SL_PROFILER_FRAME_COUNT + 1 - i ) % ( SL_PROFILER_FRAME_COUNT + 1 );
+		if( sl_profiler_state.calls[ frame ][ zone ] == 0 ) {
+			continue;
+		}
+		samples[ n++ ] = sl_profiler_state.micros[ frame ][ zone ];
+		sum += sl_profiler_state.micros[ frame ][ zone ];
+		calls += sl_profiler_state.calls[ frame ][ zone ];
+	}
+	if( n == 0 ) {
+		return SL_FALSE;
+	}
+
+	qsort( samples, n, sizeof( u64 ), sl_profiler_compare_u64 );
+	out->min = samples[ 0 ];
+	out->max = samples[ n - 1 ];
+	out->avg = sum / n;
+	out->p99 = samples[ ( n * 99 + 99 ) / 100 - 1 ]; // Nearest rank
+	out->calls = ( f32 )calls / ( f32 )n;
+	out->frames = n;
+
+	return SL_TRUE;
+}
+
+void sl_profiler_reset( )
+{
+	memset( sl_profiler_state.micros, 0, sizeof( sl_profiler_state.micros ) );
+	memset( sl_profiler_state.calls, 0, sizeof( sl_profiler_state.calls ) );
+	sl_profiler_state.current = 0;
+	sl_profiler_state.frame_count = 0;
+	sl_profiler_state.frame_start = sl_profiler_now( );
+}
+
+void sl_profiler_name_thread( const char *name )
+{
+	u32 thread;
+
+	if( !SL_PROFILER_LOAD( &sl_profiler_initialized ) ) {
+		return;
+	}
+	thread = sl_profiler_thread_index( );
+	if( thread >= SL_PROFILER_MAX_THREADS || sl_profiler_state.thread_names[ thread ][ 0 ] ) {
+		return;
+	}
+	strncpy( sl_profiler_state.thread_names[ thread ], name, SL_PROFILER_ZONE_NAME_MAX - 1 );
+}
+
+int sl_profiler_capture_trace( const char *path, u32 frame_count )
+{
+	sl_profiler_trace_buffer *buffer;
+	u32 capacity;
+
+	if( !SL_PROFILER_LOAD( &sl_profiler_initialized ) || sl_profiler_state.capturing || frame_count == 0 ) {
+		return SL_FALSE;
+	}
+
+	// Never reuse the last capture's buffer; a thread could still be finishing an event in it
+	capacity = frame_count * SL_PROFILER_TRACE_EVENTS_PER_FRAME;
+	buffer = ( sl_profiler_trace_buffer* )SL_ALLOC( sizeof( sl_profiler_trace_buffer ) );
+	if( !buffer ) {
+		return SL_FALSE;
+	}
+	buffer->events = ( sl_profiler_trace_event* )SL_ALLOC( sizeof( sl_profiler_trace_event ) * capacity );
+	if( !buffer->events ) {
+		SL_DEALLOC( buffer );
+		return SL_FALSE;
+	}
+	memset( buffer->events, 0, sizeof( sl_profiler_trace_event ) * capacity );
+	buffer->capacity = capacity;
+	buffer->next = sl_profiler_state.trace;
+	SL_PROFILER_STORE_PTR( &sl_profiler_state.trace, buffer );
+
+	strncpy( sl_profiler_state.capture_path, path, sizeof( sl_profiler_state.capture_path ) - 1 );
+	sl_profiler_state.capture_path[ sizeof( sl_profiler_state.capture_path ) - 1 ] = 0;
+	sl_profiler_state.capture_frames_left = frame_count;
+	SL_PROFILER_STORE( &sl_profiler_state.event_count, 0 );
+	SL_PROFILER_STORE( &sl_profiler_state.capturing, SL_TRUE );
+
+	return SL_TRUE;
+}
+
+int sl_profiler_is_capturing( )
+{
+	return sl_profiler_state.capturing;
+}
+
+#endif
@@ -12,9 +12,9 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
-#define VUL_DEFINE
-#include <vul_hash_map.h>
-#undef VUL_DEFINE
+#include <stdlib.h>
+#include <string.h>
+
 #include "input/controller.h"
 
 sl_controller *sl_controller_global = NULL;
@@ -23,22 +23,35 @@ void sl_controller_create( )
 {
 	sl_controller_global = ( sl_controller* )SL_ALLOC( sizeof( sl_controller ) );
 
-	sl_controller_global->mouse_enter_exit_callbacks = vul_map_create( SL_WINDOW_BUCKET_COUNT, sl_controller_hash_ptr_func, sl_controller_compare_ptr_func, malloc, free );
-	sl_controller_global->mouse_down_callbacks = vul_map_create( SL_MOUSE_BUCKET_COUNT, sl_controller_hash_func_pair, sl_controller_compare_func_pair, malloc, free );
-	sl_controller_global->mouse_up_callbacks = vul_map_create( SL_MOUSE_BUCKET_COUNT, sl_controller_hash_func_pair, sl_controller_compare_func_pair, malloc, free );
-	sl_controller_global->mouse_over_callbacks = vul_map_create( SL_MOUSE_BUCKET_COUNT, sl_controller_hash_func_pair, sl_controller_compare_func_pair, malloc, free );
-	sl_controller_global->mouse_out_callbacks = vul_map_create( SL_MOUSE_BUCKET_COUNT, sl_controller_hash_func_pair, sl_controller_compare_func_pair, malloc, free );
-	sl_controller_global->key_pressed_callbacks = vul_map_create( SL_MOUSE_BUCKET_COUNT, sl_controller_hash_func, sl_controller_compare_func, malloc, free );
-	sl_controller_global->key_released_callbacks = vul_map_create( SL_MOUSE_BUCKET_COUNT, sl_controller_hash_func, sl_controller_compare_func, malloc, free );
-	sl_controller_global->key_repeat_callbacks = vul_map_create( SL_MOUSE_BUCKET_COUNT, sl_controller_hash_func, sl_controller_compare_func, malloc, free );
-
-	sl_controller_global->hash_map_keys = NULL;
-	sl_controller_global->hash_map_key_pairs = NULL;
-	sl_controller_global->hash_map_ptr_keys = NULL;
+	sl_hash_map_create( &sl_controller_global->mouse_enter_exit_callbacks, sizeof( SL_MOUSE_ENTER_EXIT_PROTO ) );
+	sl_hash_map_create( &sl_controller_global->mouse_down_callbacks, sizeof( SL_MOUSE_DOWN_PROTO ) );
+	sl_hash_map_create( &sl_controller_global->mouse_up_callbacks, sizeof( SL_MOUSE_UP_PROTO ) );
+	sl_hash_map_create( &sl_controller_global->mouse_over_callbacks, sizeof( SL_MOUSE_OVER_PROTO ) );
+	sl_hash_map_create( &sl_controller_global->mouse_out_callbacks, sizeof( SL_MOUSE_OUT_PROTO ) );
+	memset( sl_controller_global->key_pressed_callbacks, 0, sizeof( sl_controller_global->key_pressed_callbacks ) );
+	memset( sl_controller_global->key_released_callbacks, 0, sizeof( sl_controller_global->key_released_callbacks ) );
+	memset( sl_controller_global->key_repeat_callbacks, 0, sizeof( sl_controller_global->key_repeat_callbacks ) );
+	memset( sl_controller_global->button_down_callbacks, 0, sizeof( sl_controller_global->button_down_callbacks ) );
+	memset( sl_controller_global->button_up_callbacks, 0, sizeof( sl_controller_global->button_up_callbacks ) );
+	sl_controller_global->mouse_down_universal = NULL;
+	sl_controller_global->mouse_up_universal = NULL;
 
 	sl_controller_global->mouse_pos = vec2( 0.0f, 0.0f );
 	sl_controller_global->mouse_pos_prev = vec2( 0.0f, 0.0f );
-	sl_controller_global->mouse_overs = vul_vector_create( sizeof( unsigned int ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	sl_controller_global->mouse_overs = vul_vector_create( sizeof( u64 ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	sl_controller_global->mouse_overs_next = vul_vector_create( sizeof( u64 ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	sl_controller_global->hover_hits = vul_vector_create( sizeof( u64 ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	sl_controller_global->scenes = vul_vector_create( sizeof( sl_scene* ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	sl_controller_global->hits = vul_vector_create( sizeof( unsigned int ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	sl_controller_global->coalesce_mouse = SL_FALSE;
+	sl_controller_global->pending_mouse_window = NULL;
+
+	memset( &sl_controller_global->state, 0, sizeof( sl_input_state ) );
+	sl_controller_global->queue_events = SL_FALSE;
+	sl_controller_global->event_head = 0;
+	sl_controller_global->event_count = 0;
+	sl_controller_global->events_dropped = 0;
+	sl_controller_global->timer = vul_timer_create( );
 }
 
 void sl_controller_destroy( )
@@ -46,49 +59,29 @@ void sl_controller_destroy( )
 	if( sl_controller_global == NULL ) {
 		return;
 	}
-	vul_map_destroy( sl_controller_global->mouse_down_callbacks );
-	vul_map_destroy( sl_controller_global->mouse_up_callbacks );
-	vul_map_destroy( sl_controller_global->mouse_over_callbacks );
-	vul_map_destroy( sl_controller_global->mouse_out_callbacks );
-	vul_map_destroy( sl_controller_global->key_pressed_callbacks );
-	vul_map_destroy( sl_controller_global->key_released_callbacks );
-	vul_map_destroy( sl_controller_global->key_repeat_callbacks );
-
-	vul_list_destroy( sl_controller_global->hash_map_keys, free );
-	vul_list_destroy( sl_controller_global->hash_map_key_pairs, free );
-	vul_list_destroy( sl_controller_global->hash_map_ptr_keys, free );
+	sl_hash_map_destroy( &sl_controller_global->mouse_enter_exit_callbacks );
+	sl_hash_map_destroy( &sl_controller_global->mouse_down_callbacks );
+	sl_hash_map_destroy( &sl_controller_global->mouse_up_callbacks );
+	sl_hash_map_destroy( &sl_controller_global->mouse_over_callbacks );
+	sl_hash_map_destroy( &sl_controller_global->mouse_out_callbacks );
 
 	vul_vector_destroy( sl_controller_global->mouse_overs );
+	vul_vector_destroy( sl_controller_global->mouse_overs_next );
+	vul_vector_destroy( sl_controller_global->hover_hits );
+	vul_vector_destroy( sl_controller_global->scenes );
+	vul_vector_destroy( sl_controller_global->hits );
+	vul_timer_destroy( sl_controller_global->timer );
 
 	SL_DEALLOC( sl_controller_global );
 }
 
 void sl_controller_add_mouse_enter_exit_callback( GLFWwindow* win_handle, SL_MOUSE_ENTER_EXIT_CALLBACK( callback ) )
 {
-	vul_hash_map_element *e, element;
-	vul_list_element *le;
-
 #ifdef SL_DEBUG
 	assert( sl_controller_global != NULL );
 #endif
 
-	// Check if this key is already in our map
-	e = vul_map_get( sl_controller_global->mouse_enter_exit_callbacks, ( u8* )&win_handle, sizeof( GLFWwindow* ) );
-	if( e != NULL ) {
-		e->data = callback;
-	} else {
-		// Store our key
-		le = vul_list_insert( sl_controller_global->hash_map_ptr_keys, &win_handle, sizeof( GLFWwindow* ), sl_controller_compare_ptr_func_raw, malloc );
-
-		// Create the element
-		element.data = callback;
-		element.data_size = sizeof( callback );
-		element.key = ( u8* )le->data;
-		element.key_size = sizeof( win_handle );
-
-		// Insert it
-		vul_map_insert( sl_controller_global->mouse_enter_exit_callbacks, &element ); 
-	}
+	sl_hash_map_insert( &sl_controller_global->mouse_enter_exit_callbacks, ( u64 )( size_t )win_handle, &callback );
 }
 
 void sl_controller_register_window( sl_window *win )
@@ -101,571 +94,679 @@ void sl_controller_register_window( sl_window *win )
 	glfwSetCharCallback( win->handle, sl_controller_glfw_char_callback );
 }
 
-void sl_controller_add_key_press_callback( int key, SL_KEY_PRESSED( callback ) )
+void sl_controller_set_mouse_coalescing( SL_BOOL enabled )
 {
-	vul_hash_map_element *e, element;
-	vul_list_element *le;
+	if( !enabled ) {
+		sl_controller_flush( );
+	}
+	sl_controller_global->coalesce_mouse = enabled;
+}
 
-#ifdef SL_DEBUG
-	assert( sl_controller_global != NULL );
-#endif
+/*
+ * Appends a callback to the slots of a key, unless it's there already. Press,
+ * release and repeat callbacks share their signature.
+ */
+static void sl_controller_add_key_slot( SL_KEY_PRESSED( *slots ), SL_KEY_PRESSED( callback ) )
+{
+	u32 i;
 
-	// Check if this key is already in our map
-	e = vul_map_get( sl_controller_global->key_pressed_callbacks, ( u8* )&key, sizeof( int ) );
-	if( e != NULL ) {
-		e->data = callback;
-	} else {
-		// Store our key
-		le = vul_list_insert( sl_controller_global->hash_map_keys, &key, sizeof( key ), sl_controller_compare_func_raw, malloc );
+	for( i = 0; i < SL_INPUT_CALLBACK_SLOTS; ++i ) {
+		if( slots[ i ] == callback ) {
+			return;
+		}
+		if( slots[ i ] == NULL ) {
+			slots[ i ] = callback;
+			return;
+		}
+	}
+	sl_print( 256, "Too many input callbacks for one key, at most %d fit.\n", SL_INPUT_CALLBACK_SLOTS );
+}
 
-		// Create the element
-		element.data = callback;
-		element.data_size = sizeof( callback );
-		element.key = ( u8* )le->data;
-		element.key_size = sizeof( key );
+/*
+ * Removes a callback from the slots of a key, keeping the others in order.
+ */
+static void sl_controller_remove_key_slot( SL_KEY_PRESSED( *slots ), SL_KEY_PRESSED( callback ) )
+{
+	u32 i;
 
-		// Insert it
-		vul_map_insert( sl_controller_global->key_pressed_callbacks, &element ); 
+	for( i = 0; i < SL_INPUT_CALLBACK_SLOTS && slots[ i ] != callback; ++i ) ;
+	if( i == SL_INPUT_CALLBACK_SLOTS || callback == NULL ) {
+		return;
 	}
+	for( ; i + 1 < SL_INPUT_CALLBACK_SLOTS; ++i ) {
+		slots[ i ] = slots[ i + 1 ];
+	}
+	slots[ SL_INPUT_CALLBACK_SLOTS - 1 ] = NULL;
 }
 
-void sl_controller_add_key_release_callback( int key, SL_KEY_RELEASED( callback ) )
+/*
+ * Appends a callback to the slots of a mouse button, unless it's there already.
+ * Down and up callbacks share their signature.
+ */
+static void sl_controller_add_button_slot( SL_MOUSE_DOWN_CALLBACK( *slots ), SL_MOUSE_DOWN_CALLBACK( callback ) )
 {
-	vul_hash_map_element *e, element;
-	vul_list_element *le;
-
-#ifdef SL_DEBUG
-	assert( sl_controller_global != NULL );
-#endif
+	u32 i;
 
-	// Check if this key is already in our map
-	e = vul_map_get( sl_controller_global->key_released_callbacks, ( u8* )&key, sizeof( int ) );
-	if( e != NULL ) {
-		e->data = callback;
-	} else {
-		// Store our key
-		le = vul_list_insert( sl_controller_global->hash_map_keys, &key, sizeof( key ), sl_controller_compare_func_raw, malloc );
+	for( i = 0; i < SL_INPUT_CALLBACK_SLOTS; ++i ) {
+		if( slots[ i ] == callback ) {
+			return;
+		}
+		if( slots[ i ] == NULL ) {
+			slots[ i ] = callback;
+			return;
+		}
+	}
+	sl_print( 256, "Too many input callbacks for one mouse button, at most %d fit.\n", SL_INPUT_CALLBACK_SLOTS );
+}
 
-		// Create the element
-		element.data = callback;
-		element.data_size = sizeof( callback );
-		element.key = ( u8* )le->data;
-		element.key_size = sizeof( key );
+/*
+ * Removes a callback from the slots of a mouse button, keeping the others in order.
+ */
+static void sl_controller_remove_button_slot( SL_MOUSE_DOWN_CALLBACK( *slots ), SL_MOUSE_DOWN_CALLBACK( callback ) )
+{
+	u32 i;
 
-		// Insert it
-		vul_map_insert( sl_controller_global->key_released_callbacks, &element ); 
+	for( i = 0; i < SL_INPUT_CALLBACK_SLOTS && slots[ i ] != callback; ++i ) ;
+	if( i == SL_INPUT_CALLBACK_SLOTS || callback == NULL ) {
+		return;
+	}
+	for( ; i + 1 < SL_INPUT_CALLBACK_SLOTS; ++i ) {
+		slots[ i ] = slots[ i + 1 ];
 	}
+	slots[ SL_INPUT_CALLBACK_SLOTS - 1 ] = NULL;
 }
 
-void sl_controller_add_key_repeat_callback( int key, SL_KEY_REPEAT( callback ) )
+static SL_BOOL sl_controller_valid_key( int key )
 {
-	vul_hash_map_element *e, element;
-	vul_list_element *le;
-
 #ifdef SL_DEBUG
 	assert( sl_controller_global != NULL );
 #endif
 
-	// Check if this key is already in our map
-	e = vul_map_get( sl_controller_global->key_repeat_callbacks, ( u8* )&key, sizeof( int ) );
-	if( e != NULL ) {
-		e->data = callback;
-	} else {
-		// Store our key
-		le = vul_list_insert( sl_controller_global->hash_map_keys, &key, sizeof( key ), sl_controller_compare_func_raw, malloc );
-
-		// Create the element
-		element.data = callback;
-		element.data_size = sizeof( callback );
-		element.key = ( u8* )le->data;
-		element.key_size = sizeof( key );
-
-		// Insert it
-		vul_map_insert( sl_controller_global->key_repeat_callbacks, &element ); 
+	if( key < 0 || key > GLFW_KEY_LAST ) {
+		sl_print( 256, "Key %d is not a GLFW key.\n", key );
+		return SL_FALSE;
 	}
+	return SL_TRUE;
 }
 
-void sl_controller_add_mouse_down_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_DOWN_CALLBACK( callback ) )
+static SL_BOOL sl_controller_valid_button( int button )
 {
-	vul_hash_map_element *e, element;
-	vul_list_element *le;
-	unsigned int pair[ 2 ];
-
 #ifdef SL_DEBUG
 	assert( sl_controller_global != NULL );
 #endif
 
-	// Check if this key is already in our map
-	pair[ 0 ] = scene_id;
-	pair[ 1 ] = entity_id;
-	e = vul_map_get( sl_controller_global->mouse_down_callbacks, ( u8* )pair, sizeof( unsigned int ) * 2 );
-	if( e != NULL ) {
-		e->data = callback;
-	} else {
-		// Store our key
-		le = vul_list_insert( sl_controller_global->hash_map_key_pairs, pair, sizeof( unsigned int ) * 2, sl_controller_compare_func_raw_pair, malloc );
+	if( button < 0 || button > GLFW_MOUSE_BUTTON_LAST ) {
+		sl_print( 256, "Button %d is not a GLFW mouse button.\n", button );
+		return SL_FALSE;
+	}
+	return SL_TRUE;
+}
 
-		// Create the element
-		element.data = callback;
-		element.data_size = sizeof( callback );
-		element.key = ( u8* )le->data;
-		element.key_size = sizeof( unsigned int ) * 2;
+void sl_controller_add_key_press_callback( int key, SL_KEY_PRESSED( callback ) )
+{
+	if( sl_controller_valid_key( key ) ) {
+		sl_controller_add_key_slot( sl_controller_global->key_pressed_callbacks[ key ], callback );
+	}
+}
 
-		// Insert it
-		vul_map_insert( sl_controller_global->mouse_down_callbacks, &element ); 
+void sl_controller_remove_key_press_callback( int key, SL_KEY_PRESSED( callback ) )
+{
+	if( sl_controller_valid_key( key ) ) {
+		sl_controller_remove_key_slot( sl_controller_global->key_pressed_callbacks[ key ], callback );
 	}
 }
 
-void sl_controller_add_mouse_up_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_UP_CALLBACK( callback ) )
+void sl_controller_add_key_release_callback( int key, SL_KEY_RELEASED( callback ) )
 {
-	vul_hash_map_element *e, element;
-	vul_list_element *le;
-	unsigned int pair[ 2 ];
+	if( sl_controller_valid_key( key ) ) {
+		sl_controller_add_key_slot( sl_controller_global->key_released_callbacks[ key ], callback );
+	}
+}
 
-#ifdef SL_DEBUG
-	assert( sl_controller_global != NULL );
-#endif
+void sl_controller_remove_key_release_callback( int key, SL_KEY_RELEASED( callback ) )
+{
+	if( sl_controller_valid_key( key ) ) {
+		sl_controller_remove_key_slot( sl_controller_global->key_released_callbacks[ key ], callback );
+	}
+}
 
-	// Check if this key is already in our map
-	pair[ 0 ] = scene_id;
-	pair[ 1 ] = entity_id;
-	e = vul_map_get( sl_controller_global->mouse_up_callbacks, ( u8* )pair, sizeof( unsigned int ) * 2 );
-	if( e != NULL ) {
-		e->data = callback;
-	} else {
-		// Store our key
-		le = vul_list_insert( sl_controller_global->hash_map_key_pairs, pair, sizeof( unsigned int ) * 2, sl_controller_compare_func_raw_pair, malloc );
+void sl_controller_add_key_repeat_callback( int key, SL_KEY_REPEAT( callback ) )
+{
+	if( sl_controller_valid_key( key ) ) {
+		sl_controller_add_key_slot( sl_controller_global->key_repeat_callbacks[ key ], callback );
+	}
+}
 
-		// Create the element
-		element.data = callback;
-		element.data_size = sizeof( callback );
-		element.key = ( u8* )le->data;
-		element.key_size = sizeof( unsigned int ) * 2;
+void sl_controller_remove_key_repeat_callback( int key, SL_KEY_REPEAT( callback ) )
+{
+	if( sl_controller_valid_key( key ) ) {
+		sl_controller_remove_key_slot( sl_controller_global->key_repeat_callbacks[ key ], callback );
+	}
+}
 
-		// Insert it
-		vul_map_insert( sl_controller_global->mouse_up_callbacks, &element ); 
+void sl_controller_add_button_down_callback( int button, SL_MOUSE_DOWN_CALLBACK( callback ) )
+{
+	if( sl_controller_valid_button( button ) ) {
+		sl_controller_add_button_slot( sl_controller_global->button_down_callbacks[ button ], callback );
 	}
 }
 
-void sl_controller_add_mouse_over_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_OVER_CALLBACK( callback ) )
+void sl_controller_remove_button_down_callback( int button, SL_MOUSE_DOWN_CALLBACK( callback ) )
+{
+	if( sl_controller_valid_button( button ) ) {
+		sl_controller_remove_button_slot( sl_controller_global->button_down_callbacks[ button ], callback );
+	}
+}
+
+void sl_controller_add_button_up_callback( int button, SL_MOUSE_UP_CALLBACK( callback ) )
+{
+	if( sl_controller_valid_button( button ) ) {
+		sl_controller_add_button_slot( sl_controller_global->button_up_callbacks[ button ], callback );
+	}
+}
+
+void sl_controller_remove_button_up_callback( int button, SL_MOUSE_UP_CALLBACK( callback ) )
 {
-	vul_hash_map_element *e, element;
-	vul_list_element *le;
-	unsigned int pair[ 2 ];
+	if( sl_controller_valid_button( button ) ) {
+		sl_controller_remove_button_slot( sl_controller_global->button_up_callbacks[ button ], callback );
+	}
+}
 
+void sl_controller_add_mouse_down_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_DOWN_CALLBACK( callback ) )
+{
 #ifdef SL_DEBUG
 	assert( sl_controller_global != NULL );
 #endif
 
-	// Check if this key is already in our map
-	pair[ 0 ] = scene_id;
-	pair[ 1 ] = entity_id;
-	e = vul_map_get( sl_controller_global->mouse_over_callbacks, ( u8* )pair, sizeof( unsigned int ) * 2 );
-	if( e != NULL ) {
-		e->data = callback;
-	} else {
-		// Store our key
-		le = vul_list_insert( sl_controller_global->hash_map_key_pairs, pair, sizeof( unsigned int ) * 2, sl_controller_compare_func_raw_pair, malloc );
-
-		// Create the element
-		element.data = callback;
-		element.data_size = sizeof( callback );
-		element.key = ( u8* )le->data;
-		element.key_size = sizeof( unsigned int ) * 2;
-
-		// Insert it
-		vul_map_insert( sl_controller_global->mouse_over_callbacks, &element ); 
+	if( scene_id == SL_CONTROLLER_UNIVERSAL && entity_id == SL_CONTROLLER_UNIVERSAL ) {
+		sl_controller_global->mouse_down_universal = callback;
+		return;
 	}
+	sl_hash_map_insert( &sl_controller_global->mouse_down_callbacks, SL_HASH_MAP_PAIR( scene_id, entity_id ), &callback );
 }
 
-void sl_controller_add_mouse_out_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_OUT_CALLBACK( callback ) )
+void sl_controller_add_mouse_up_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_UP_CALLBACK( callback ) )
 {
-	vul_hash_map_element *e, element;
-	vul_list_element *le;
-	unsigned int pair[ 2 ];
-
 #ifdef SL_DEBUG
 	assert( sl_controller_global != NULL );
 #endif
 
-	// Check if this key is already in our map
-	pair[ 0 ] = scene_id;
-	pair[ 1 ] = entity_id;
-	e = vul_map_get( sl_controller_global->mouse_out_callbacks, ( u8* )pair, sizeof( unsigned int ) * 2 );
-	if( e != NULL ) {
-		e->data = callback;
-	} else {
-		// Store our key
-		le = vul_list_insert( sl_controller_global->hash_map_key_pairs, pair, sizeof( unsigned int ) * 2, sl_controller_compare_func_raw_pair, malloc );
-
-		// Create the element
-		element.data = callback;
-		element.data_size = sizeof( callback );
-		element.key = ( u8* )le->data;
-		element.key_size = sizeof( unsigned int ) * 2;
-
-		// Insert it
-		vul_map_insert( sl_controller_global->mouse_out_callbacks, &element ); 
+	if( scene_id == SL_CONTROLLER_UNIVERSAL && entity_id == SL_CONTROLLER_UNIVERSAL ) {
+		sl_controller_global->mouse_up_universal = callback;
+		return;
 	}
+	sl_hash_map_insert( &sl_controller_global->mouse_up_callbacks, SL_HASH_MAP_PAIR( scene_id, entity_id ), &callback );
 }
 
-u32 sl_controller_hash_func( const u8* data, u32 len )
+void sl_controller_add_mouse_over_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_OVER_CALLBACK( callback ) )
 {
 #ifdef SL_DEBUG
-	assert( len == sizeof( unsigned int ) );
+	assert( sl_controller_global != NULL );
 #endif
 
-	return *( u32* )data;
+	sl_hash_map_insert( &sl_controller_global->mouse_over_callbacks, SL_HASH_MAP_PAIR( scene_id, entity_id ), &callback );
 }
 
-u32 sl_controller_hash_func_pair( const u8* data, u32 len )
+void sl_controller_add_mouse_out_callback( unsigned int scene_id, unsigned int entity_id, SL_MOUSE_OUT_CALLBACK( callback ) )
 {
 #ifdef SL_DEBUG
-	assert( len == sizeof( unsigned int ) * 2 );
+	assert( sl_controller_global != NULL );
 #endif
 
-	return ( ( ( u32* )data )[ 0 ] << 16 ) + ( ( u32* )data )[ 1 ];
+	sl_hash_map_insert( &sl_controller_global->mouse_out_callbacks, SL_HASH_MAP_PAIR( scene_id, entity_id ), &callback );
 }
 
-int sl_controller_compare_func_raw( void *a, void *b )
+// Callback functions registered with glfw. These call the controller's equivalent functions.
+/*
+ * Takes the next slot in the event ring, or NULL if the ring is full.
+ */
+static sl_input_event *sl_controller_push_event( u32 type, GLFWwindow *win_handle )
 {
-	u32 *ea, *eb;
-
-	ea = ( u32* )a;
-	eb = ( u32* )b;
+	sl_input_event *event;
 
-	return ( s32 )( ( s64 )ea - ( s64 )eb );
+	if( sl_controller_global->event_count == SL_INPUT_QUEUE_SIZE ) {
+		++sl_controller_global->events_dropped;
+		return NULL;
+	}
+	event = &sl_controller_global->events[ ( sl_controller_global->event_head + sl_controller_global->event_count ) 
+										   & ( SL_INPUT_QUEUE_SIZE - 1 ) ];
+	++sl_controller_global->event_count;
+	event->type = type;
+	event->window = win_handle;
+	event->time = vul_timer_get_micros( sl_controller_global->timer );
+	return event;
 }
 
-int sl_controller_compare_func_raw_pair( void *a, void *b )
+/*
+ * Updates a down bitset and its pressed and released edges for a press or release.
+ */
+static void sl_controller_set_bit( u32 *down, u32 *pressed, u32 *released, int bit, int action )
 {
-	u32 *ea, *eb;
-	int d;
-
-	ea = ( u32* )a;
-	eb = ( u32* )b;
-
-	d = ( s32 )( ( s64 )ea[ 0 ] - ( s64 )eb[ 0 ] );
-	if( d != 0 ) {
-		return d;
+	if( action == GLFW_PRESS ) {
+		down[ bit >> 5 ] |= 1u << ( bit & 31 );
+		pressed[ bit >> 5 ] |= 1u << ( bit & 31 );
+	} else if( action == GLFW_RELEASE ) {
+		down[ bit >> 5 ] &= ~( 1u << ( bit & 31 ) );
+		released[ bit >> 5 ] |= 1u << ( bit & 31 );
 	}
-
-	return ( s32 )( ( s64 )ea[ 1 ] - ( s64 )eb[ 1 ] );
 }
 
-int sl_controller_compare_func( void *a, void *b )
+/*
+ * Cursor position in window coordinates to [-1,1]^2, y up.
+ */
+static v2 sl_controller_normalize_pos( GLFWwindow *win_handle, double x, double y )
 {
-	vul_hash_map_element *ea, *eb;
-
-	ea = ( vul_hash_map_element* )a;
-	eb = ( vul_hash_map_element* )b;
+	int ww, wh;
 
-	return ( s32 )( ( s64 )*( u32* )ea->key - ( s64 )*( u32* )eb->key );
+	glfwGetWindowSize( win_handle, &ww, &wh );
+	return vec2( ( ( float )x / ( float )ww ) * 2.f - 1.f,
+				 -( ( float )y / ( float )wh ) * 2.f + 1.f );
 }
 
-int sl_controller_compare_func_pair( void *a, void *b )
+static void sl_controller_handle_mouse_enter_exit( GLFWwindow *win_handle, int state )
 {
-	vul_hash_map_element *ea, *eb;
-	int d;
-
-	ea = ( vul_hash_map_element* )a;
-	eb = ( vul_hash_map_element* )b;
+	SL_MOUSE_ENTER_EXIT_CALLBACK( *callback );
 
-	d = ( s32 )( ( s64 )( ( u32* )ea->key )[ 0 ] - ( s64 )( ( u32* )eb->key )[ 0 ] );
-	if( d != 0 ) {
-		return d;
+	callback = sl_hash_map_get( &sl_controller_global->mouse_enter_exit_callbacks, ( u64 )( size_t )win_handle );
+	if( callback != NULL ) {
+		( *callback )( win_handle, state == GL_TRUE ? SL_TRUE : SL_FALSE );
 	}
-
-	return ( s32 )( ( s64 )( ( u32* )ea->key )[ 1 ] - ( s64 )( ( u32* )eb->key )[ 1 ] );
 }
 
-u32 sl_controller_hash_ptr_func( const u8* data, u32 len )
+void sl_controller_glfw_mouse_enter_exit_callback( GLFWwindow *win_handle, int state )
 {
-#ifndef SL_DEBUG
-	u32 i, r;
-#endif
+	sl_input_event *event;
 
-	if( len == 4 ) {
-		return *( u32* )( data );
-	} else if ( len == 8 ) {
-		return ( u32 )( *( u64* )( data ) );
-	}
 #ifdef SL_DEBUG
-	assert( 0 ); return 0;
-#else
-	sl_print( 256, "Some really weird pointer size encountered: %d bytes", len );
-	r = 0;
-	for( i = 0; i < len; ++i ) {
-		r += ( u32 )data[ i ];
-	}
-	return r;
+	assert( sl_controller_global != NULL );
 #endif
+
+	if( sl_controller_global->queue_events ) {
+		event = sl_controller_push_event( SL_INPUT_MOUSE_ENTER_EXIT, win_handle );
+		if( event != NULL ) {
+			event->data.entered = state;
+		}
+		return;
+	}
+	sl_controller_handle_mouse_enter_exit( win_handle, state );
 }
 
-int sl_controller_compare_ptr_func( void *a, void *b )
+/*
+ * Orders hover pairs for the set difference of the old and new hovers.
+ */
+static int sl_controller_compare_hover( const void *a, const void *b )
 {
-	vul_hash_map_element *ea, *eb;
-	u32 ai, bi;
-	u64 al, bl;
+	u64 ha, hb;
 
-	ea = ( vul_hash_map_element* )a;
-	eb = ( vul_hash_map_element* )b;
-
-	if( sizeof( GLFWwindow* ) == 4 ) {
-		ai = *( u32* )ea->key;
-		bi = *( u32* )eb->key;
-		return ( int )( ( long long )ai - ( long long )bi );
-	} else if ( sizeof( GLFWwindow* ) == 8 ) {
-		al = *( u64* )ea->key;
-		bl = *( u64* )eb->key;
-		return ( int )( ( s64 )al - ( s64 )bl );
-	}
-#ifdef SL_DEBUG
-	assert( 0 );
-#else
-	sl_print( 256, "Some really weird pointer size encountered: %d bytes", sizeof( GLFWwindow* ) );
-	return *( u8* )a == *( u8* )b ? 0 : -1; // Don't care about order here
-#endif
+	ha = *( const u64* )a;
+	hb = *( const u64* )b;
+	return ha < hb ? -1 : ( ha > hb ? 1 : 0 );
 }
 
-int sl_controller_compare_ptr_func_raw( void *a, void *b )
+/*
+ * Picks what the mouse is over in every scene of the window, calls mouse out for
+ * what it left and mouse over for everything it is over.
+ */
+static void sl_controller_dispatch_mouse_move( GLFWwindow *win_handle )
 {
-	u32 ai, bi;
-	u64 al, bl;
-	
-	if( sizeof( GLFWwindow* ) == 4 ) {
-		ai = *( u32* )a;
-		bi = *( u32* )b;
-		return ( int )( ( long long )ai - ( long long )bi );
-	} else if( sizeof( GLFWwindow* ) == 8 ) {
-		al = *( u64* )a;
-		bl = *( u64* )b;
-		return ( int )( ( s64 )al - ( s64 )bl );
+	sl_scene **its, **last_its;
+	vul_vector *swap;
+	unsigned int *it, *last_it;
+	u64 *prev, *next, hover;
+	u32 i, j, prev_count, next_count;
+	SL_MOUSE_OVER_CALLBACK( *over );
+	SL_MOUSE_OUT_CALLBACK( *out );
+	v2 scene_local_pos;
+
+	// Gather what we're over now, across all the window's scenes
+	vul_vector_resize( sl_controller_global->scenes, 0, VUL_FALSE, VUL_FALSE );
+	vul_vector_resize( sl_controller_global->hover_hits, 0, VUL_FALSE, VUL_FALSE );
+	sl_renderer_get_scenes_by_window_handle( sl_controller_global->scenes, win_handle );
+	vul_foreach( sl_scene*, its, last_its, sl_controller_global->scenes )
+	{
+		// Calculate scene local position
+		scene_local_pos = vadd2( sl_controller_global->mouse_pos, ( *its )->camera_pos );
+		vul_vector_resize( sl_controller_global->hits, 0, VUL_FALSE, VUL_FALSE );
+		sl_scene_get_entities_at_pos( sl_controller_global->hits, *its, &scene_local_pos );
+		vul_foreach( unsigned int, it, last_it, sl_controller_global->hits )
+		{
+			hover = SL_HASH_MAP_PAIR( ( *its )->scene_id, *it );
+			vul_vector_add( sl_controller_global->hover_hits, &hover );
+		}
+	}
+	next_count = vul_vector_size( sl_controller_global->hover_hits );
+	vul_vector_resize( sl_controller_global->mouse_overs_next, next_count, VUL_FALSE, VUL_FALSE );
+	next = ( u64* )vul_vector_begin( sl_controller_global->mouse_overs_next );
+	if( next_count ) {
+		memcpy( next, vul_vector_begin( sl_controller_global->hover_hits ), sizeof( u64 ) * next_count );
+		qsort( next, next_count, sizeof( u64 ), sl_controller_compare_hover );
+	}
+
+	// Both lists are sorted, so one pass over them finds everything we left
+	prev = ( u64* )vul_vector_begin( sl_controller_global->mouse_overs );
+	prev_count = vul_vector_size( sl_controller_global->mouse_overs );
+	for( i = 0, j = 0; i < prev_count; ) {
+		if( j < next_count && next[ j ] < prev[ i ] ) {
+			++j;
+		} else if( j < next_count && next[ j ] == prev[ i ] ) {
+			++i;
+			++j;
+		} else {
+			// Hovers are keyed like the callbacks
+			out = sl_hash_map_get( &sl_controller_global->mouse_out_callbacks, prev[ i ] );
+			if( out != NULL ) {
+				( *out )( ( unsigned int )( prev[ i ] >> 32 ), ( unsigned int )prev[ i ] );
+			}
+			++i;
+		}
+	}
+	swap = sl_controller_global->mouse_overs;
+	sl_controller_global->mouse_overs = sl_controller_global->mouse_overs_next;
+	sl_controller_global->mouse_overs_next = swap;
+
+	// Mouse over is called for everything we're over on every move, topmost first
+	for( i = 0; i < vul_vector_size( sl_controller_global->hover_hits ); ++i ) {
+		hover = *( u64* )vul_vector_get( sl_controller_global->hover_hits, i );
+		over = sl_hash_map_get( &sl_controller_global->mouse_over_callbacks, hover );
+		if( over != NULL ) {
+			( *over )( ( unsigned int )( hover >> 32 ), ( unsigned int )hover );
+		}
 	}
-#ifdef SL_DEBUG
-	assert( 0 );
-#else
-	sl_print( 256, "Some really weird pointer size encountered: %d bytes", sizeof( GLFWwindow* ) );
-	return *( u8* )a == *( u8* )b ? 0 : -1; // Don't care about order here
-#endif
 }
 
-// Callback functions registered with glfw. These call the controller's equivalent functions.
-void sl_controller_glfw_mouse_enter_exit_callback( GLFWwindow *win_handle, int state )
+void sl_controller_flush( )
 {
-	const vul_hash_map_element *e;
-
-#ifdef SL_DEBUG
-	assert( sl_controller_global != NULL );
-#endif
-	
-	e = vul_map_get_const( sl_controller_global->mouse_enter_exit_callbacks, ( u8 * )&win_handle,sizeof( GLFWwindow* ) );
+	GLFWwindow *win_handle;
 
-	if( e != NULL ) {
-		( ( SL_MOUSE_ENTER_EXIT_PROTO )e->data )( win_handle, state == GL_TRUE ? SL_TRUE : SL_FALSE );
+	if( sl_controller_global == NULL || sl_controller_global->pending_mouse_window == NULL ) {
+		return;
 	}
+	win_handle = sl_controller_global->pending_mouse_window;
+	sl_controller_global->pending_mouse_window = NULL;
+	sl_controller_dispatch_mouse_move( win_handle );
 }
 
-void sl_controller_glfw_mouse_pos_callback( GLFWwindow *win_handle, double x, double y )
+static void sl_controller_handle_mouse_pos( GLFWwindow *win_handle, double x, double y )
 {
-	sl_scene **its, **last_its, **its2, **last_its2;
-	vul_vector *over, *scenes;
-	unsigned int *it, *last_it, *it2, *last_it2, i, pair[ 2 ];
-	int found, deleted;
-	vul_hash_map_element *e;
-	int ww, wh;
-	v2 scene_local_pos;
-
 	// Update mouse position
-	glfwGetWindowSize( win_handle, &ww, &wh );
 	sl_controller_global->mouse_pos_prev.x = sl_controller_global->mouse_pos.x;
 	sl_controller_global->mouse_pos_prev.y = sl_controller_global->mouse_pos.y;
-	sl_controller_global->mouse_pos = vec2( ( ( float )x / ( float )ww ) * 2.f - 1.f,
-										   -( ( float )y / ( float )wh ) * 2.f + 1.f );
-	
-	// Get the scene
-	scenes = vul_vector_create( sizeof( sl_scene* ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
-	sl_renderer_get_scenes_by_window_handle( scenes, win_handle );
-
-	vul_foreach( sl_scene*, its, last_its, scenes )
-	{
-		// Calculate scene local position
-		scene_local_pos = vadd2( sl_controller_global->mouse_pos, ( *its )->camera_pos );
-		// Get all entities we are hovering over
-		over = vul_vector_create( sizeof( unsigned int ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
-		sl_scene_get_entities_at_pos( over, *its, &scene_local_pos );
-
-		// Prune out all entities we were over but aren't any more. Slow!
-		while( 1 ) {
-			deleted = 0;			
-			i = 0;
-			vul_foreach( unsigned int, it, last_it, sl_controller_global->mouse_overs )
-			{
-				found = 0;
-				vul_foreach( unsigned int, it2, last_it2, over )
-				{
-					if( *it2 == *it ) {
-						found = 1;
-						break;
-					}
-				}
-				if( !found ) {
-					// Call mouse out for all scenes.
-					vul_foreach( sl_scene*, its2, last_its2, scenes )
-					{
-						// Play mouse out iteration!
-						pair[ 0 ] = ( *its2 )->scene_id;
-						pair[ 1 ] = *it;
-						e = vul_map_get( sl_controller_global->mouse_out_callbacks, ( u8* )pair, sizeof( unsigned int ) * 2 );
-						if( e != NULL ) {
-							( ( SL_MOUSE_OUT_PROTO )e->data )( ( *its2 )->scene_id, *it );
-						}
-					}
-					// Remove it
-					vul_vector_remove_swap( sl_controller_global->mouse_overs, i );
-					deleted = 1;
-					break;
-				}
-				++i;
-			}
-			if( !deleted ) {
-				break;
-			}
-		}
+	sl_controller_global->mouse_pos = sl_controller_normalize_pos( win_handle, x, y );
 
-		// Add new entities
-		vul_foreach( unsigned int, it, last_it, over )
-		{
-			found = 0;
-			i = 0;
-			vul_foreach( unsigned int, it2, last_it2, sl_controller_global->mouse_overs )
-			{
-				if( *it2 == *it ) {
-					found = 1;
-					break;
-				}
-				++i;
-			}
-			if( !found ) {
-				vul_vector_add( sl_controller_global->mouse_overs, it );
-			}
+	if( sl_controller_global->coalesce_mouse ) {
+		// A move into another window can't wait for this one's
+		if( sl_controller_global->pending_mouse_window != NULL && sl_controller_global->pending_mouse_window != win_handle ) {
+			sl_controller_flush( );
 		}
+		sl_controller_global->pending_mouse_window = win_handle;
+		return;
+	}
+	sl_controller_dispatch_mouse_move( win_handle );
+}
 
-		// Iterate over them
-		vul_foreach( unsigned int, it, last_it, over )
-		{
-			pair[ 0 ] = ( *its )->scene_id;
-			pair[ 1 ] = *it;
-			e = vul_map_get( sl_controller_global->mouse_over_callbacks, ( u8* )pair, sizeof( unsigned int ) * 2 );
-			if( e != NULL ) {
-				( ( SL_MOUSE_OVER_PROTO )e->data )( ( *its )->scene_id, *it );
-			}
+void sl_controller_glfw_mouse_pos_callback( GLFWwindow *win_handle, double x, double y )
+{
+	sl_input_event *event;
+
+	if( sl_controller_global->queue_events ) {
+		sl_controller_global->state.mouse_pos = sl_controller_normalize_pos( win_handle, x, y );
+		event = sl_controller_push_event( SL_INPUT_MOUSE_MOVE, win_handle );
+		if( event != NULL ) {
+			event->data.pos.x = x;
+			event->data.pos.y = y;
 		}
+		return;
 	}
+	sl_controller_handle_mouse_pos( win_handle, x, y );
+	sl_controller_global->state.mouse_pos = sl_controller_global->mouse_pos;
 }
 
-void sl_controller_glfw_mouse_button_callback( GLFWwindow *win_handle, int button, int action, int mods )
+static void sl_controller_handle_mouse_button( GLFWwindow *win_handle, int button, int action, int mods )
 {
-	const vul_hash_map_element *e;
 	sl_scene **its, **last_its;
-	vul_vector *over, *scenes;
-	unsigned int *it, *last_it, pair[ 2 ];
+	unsigned int *it, *last_it, scene_id;
 	v2 scene_local_pos;
+	SL_MOUSE_DOWN_CALLBACK( *down_slots );
+	SL_MOUSE_UP_CALLBACK( *up_slots );
+	SL_MOUSE_DOWN_CALLBACK( *down );
+	SL_MOUSE_UP_CALLBACK( *up );
+	u32 i;
 
-#ifdef SL_DEBUG
-	assert( sl_controller_global != NULL );
-#endif
+	// Hovering must be up to date before the click
+	sl_controller_flush( );
 
-	scenes = vul_vector_create( sizeof( sl_scene* ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
-	sl_renderer_get_scenes_by_window_handle( scenes, win_handle );
+	vul_vector_resize( sl_controller_global->scenes, 0, VUL_FALSE, VUL_FALSE );
+	sl_renderer_get_scenes_by_window_handle( sl_controller_global->scenes, win_handle );
 
-	vul_foreach( sl_scene*, its, last_its, scenes )
+	vul_foreach( sl_scene*, its, last_its, sl_controller_global->scenes )
 	{
+		scene_id = ( *its )->scene_id;
 		// Calculate scene local position
 		scene_local_pos = vadd2( sl_controller_global->mouse_pos, ( *its )->camera_pos );
 		// Get entities we overlap
-		over = vul_vector_create( sizeof( unsigned int ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
-		sl_scene_get_entities_at_pos( over, *its, &scene_local_pos );
+		vul_vector_resize( sl_controller_global->hits, 0, VUL_FALSE, VUL_FALSE );
+		sl_scene_get_entities_at_pos( sl_controller_global->hits, *its, &scene_local_pos );
 		
-		vul_foreach( unsigned int, it, last_it, over )
+		vul_foreach( unsigned int, it, last_it, sl_controller_global->hits )
 		{
-			pair[ 0 ] = ( *its )->scene_id;
-			pair[ 1 ] = *it;
 			if( action == GLFW_PRESS ) {
-				e = vul_map_get_const( sl_controller_global->mouse_down_callbacks, ( u8 * )pair, sizeof( unsigned int ) * 2 );
-				if( e != NULL ) {
-					( ( SL_MOUSE_DOWN_PROTO )e->data )( ( *its )->scene_id, *it, button );
+				down = sl_hash_map_get( &sl_controller_global->mouse_down_callbacks, SL_HASH_MAP_PAIR( scene_id, *it ) );
+				if( down != NULL ) {
+					( *down )( scene_id, *it, button );
 				}
 			} else if( action == GLFW_RELEASE ) {
-				e = vul_map_get_const( sl_controller_global->mouse_up_callbacks, ( u8 * )pair, sizeof( unsigned int ) * 2 );
-				if( e != NULL ) {
-					( ( SL_MOUSE_UP_PROTO )e->data )( ( *its )->scene_id, *it, button );
+				up = sl_hash_map_get( &sl_controller_global->mouse_up_callbacks, SL_HASH_MAP_PAIR( scene_id, *it ) );
+				if( up != NULL ) {
+					( *up )( scene_id, *it, button );
 				}
 			}
 		}
 
 		// Finally, dispatch the global callback, if it exist
-		pair[ 0 ] = ( *its )->scene_id;
-		pair[ 1 ] = SL_CONTROLLER_UNIVERSAL;
 		if( action == GLFW_PRESS ) {
-			e = vul_map_get( sl_controller_global->mouse_down_callbacks, ( u8* )pair, sizeof( unsigned int ) * 2 );
-			if( e != NULL ) {
-				( ( SL_MOUSE_DOWN_PROTO )e->data )( ( *its )->scene_id, SL_CONTROLLER_UNIVERSAL, button );
+			down = sl_hash_map_get( &sl_controller_global->mouse_down_callbacks, SL_HASH_MAP_PAIR( scene_id, SL_CONTROLLER_UNIVERSAL ) );
+			if( down != NULL ) {
+				( *down )( scene_id, SL_CONTROLLER_UNIVERSAL, button );
 			}
 		} else if( action == GLFW_RELEASE ) {
-			e = vul_map_get( sl_controller_global->mouse_up_callbacks, ( u8* )pair, sizeof( unsigned int ) * 2 );
-			if( e != NULL ) {
-				( ( SL_MOUSE_UP_PROTO )e->data )( ( *its )->scene_id, SL_CONTROLLER_UNIVERSAL, button );
+			up = sl_hash_map_get( &sl_controller_global->mouse_up_callbacks, SL_HASH_MAP_PAIR( scene_id, SL_CONTROLLER_UNIVERSAL ) );
+			if( up != NULL ) {
+				( *up )( scene_id, SL_CONTROLLER_UNIVERSAL, button );
 			}
 		}
 	}
 
 
-	// Finally, dispatch the global callback, if it exist
-	pair[ 0 ] = SL_CONTROLLER_UNIVERSAL;
-	pair[ 1 ] = SL_CONTROLLER_UNIVERSAL;
+	// Finally, dispatch the button's window-wide callbacks, then the universal one
 	if( action == GLFW_PRESS ) {
-		e = vul_map_get( sl_controller_global->mouse_down_callbacks, ( u8* )pair, sizeof( unsigned int ) * 2 );
-		if( e != NULL ) {
-			( ( SL_MOUSE_DOWN_PROTO )e->data )( SL_CONTROLLER_UNIVERSAL, SL_CONTROLLER_UNIVERSAL, button );
+		if( button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST ) {
+			down_slots = sl_controller_global->button_down_callbacks[ button ];
+			for( i = 0; i < SL_INPUT_CALLBACK_SLOTS && down_slots[ i ] != NULL; ++i ) {
+				down_slots[ i ]( SL_CONTROLLER_UNIVERSAL, SL_CONTROLLER_UNIVERSAL, button );
+			}
+		}
+		if( sl_controller_global->mouse_down_universal != NULL ) {
+			sl_controller_global->mouse_down_universal( SL_CONTROLLER_UNIVERSAL, SL_CONTROLLER_UNIVERSAL, button );
 		}
 	} else if( action == GLFW_RELEASE ) {
-		e = vul_map_get( sl_controller_global->mouse_up_callbacks, ( u8* )pair, sizeof( unsigned int ) * 2 );
-		if( e != NULL ) {
-			( ( SL_MOUSE_UP_PROTO )e->data )( SL_CONTROLLER_UNIVERSAL, SL_CONTROLLER_UNIVERSAL, button );
+		if( button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST ) {
+			up_slots = sl_controller_global->button_up_callbacks[ button ];
+			for( i = 0; i < SL_INPUT_CALLBACK_SLOTS && up_slots[ i ] != NULL; ++i ) {
+				up_slots[ i ]( SL_CONTROLLER_UNIVERSAL, SL_CONTROLLER_UNIVERSAL, button );
+			}
+		}
+		if( sl_controller_global->mouse_up_universal != NULL ) {
+			sl_controller_global->mouse_up_universal( SL_CONTROLLER_UNIVERSAL, SL_CONTROLLER_UNIVERSAL, button );
 		}
 	}
 	// @TODO: might want to add proper click-handling, so press and release on same button = click instead of realease = click where we release it.
 }
 
+void sl_controller_glfw_mouse_button_callback( GLFWwindow *win_handle, int button, int action, int mods )
+{
+	sl_input_event *event;
+	sl_input_state *state;
+
+#ifdef SL_DEBUG
+	assert( sl_controller_global != NULL );
+#endif
+
+	state = &sl_controller_global->state;
+	if( button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST ) {
+		sl_controller_set_bit( &state->buttons_down, &state->buttons_pressed, &state->buttons_released, button, action );
+	}
+	if( sl_controller_global->queue_events ) {
+		event = sl_controller_push_event( SL_INPUT_MOUSE_BUTTON, win_handle );
+		if( event != NULL ) {
+			event->data.button.button = button;
+			event->data.button.action = action;
+			event->data.button.mods = mods;
+		}
+		return;
+	}
+	sl_controller_handle_mouse_button( win_handle, button, action, mods );
+}
+
 void sl_controller_glfw_mouse_wheel_callback( GLFWwindow *win_handle, double x, double y )
 {
-	// @TODO: Scroll support
+	sl_input_event *event;
+
+	sl_controller_global->state.scroll.x += ( float )x;
+	sl_controller_global->state.scroll.y += ( float )y;
+	if( sl_controller_global->queue_events ) {
+		event = sl_controller_push_event( SL_INPUT_MOUSE_SCROLL, win_handle );
+		if( event != NULL ) {
+			event->data.pos.x = x;
+			event->data.pos.y = y;
+		}
+	}
+	// @TODO: Scroll callbacks
 }
 
-void sl_controller_glfw_key_callback( GLFWwindow *win_handle, int key, int scancode, int action, int mods )
+static void sl_controller_handle_key( GLFWwindow *win_handle, int key, int scancode, int action, int mods )
 {
-	vul_hash_map_element *e;
+	SL_KEY_PRESSED( *slots );
+	u32 i;
 
+	if( key < 0 || key > GLFW_KEY_LAST ) {
+		return; // GLFW_KEY_UNKNOWN
+	}
 	if( action == GLFW_PRESS ) {
-		e = vul_map_get( sl_controller_global->key_pressed_callbacks, ( u8* )&key, sizeof( int ) );
-		if( e != NULL ) {
-			( ( SL_KEY_PRESSED_PROTO )e->data )( win_handle, key, scancode, mods );
-		}
+		slots = sl_controller_global->key_pressed_callbacks[ key ];
 	} else if( action == GLFW_RELEASE ) {
-		e = vul_map_get( sl_controller_global->key_released_callbacks, ( u8* )&key, sizeof( int ) );
-		if( e != NULL ) {
-			( ( SL_KEY_RELEASED_PROTO )e->data )( win_handle, key, scancode, mods );
-		}
+		slots = sl_controller_global->key_released_callbacks[ key ];
 	} else if( action == GLFW_REPEAT ) {
-		e = vul_map_get( sl_controller_global->key_repeat_callbacks, ( u8* )&key, sizeof( int ) );
-		if( e != NULL ) {
-			( ( SL_KEY_REPEAT_PROTO )e->data )( win_handle, key, scancode, mods );
+		slots = sl_controller_global->key_repeat_callbacks[ key ];
+	} else {
+		return; // No other options
+	}
+	for( i = 0; i < SL_INPUT_CALLBACK_SLOTS && slots[ i ] != NULL; ++i ) {
+		slots[ i ]( win_handle, key, scancode, mods );
+	}
+}
+
+void sl_controller_glfw_key_callback( GLFWwindow *win_handle, int key, int scancode, int action, int mods )
+{
+	sl_input_event *event;
+	sl_input_state *state;
+
+	state = &sl_controller_global->state;
+	if( key >= 0 && key <= GLFW_KEY_LAST ) {
+		sl_controller_set_bit( state->keys_down, state->keys_pressed, state->keys_released, key, action );
+	}
+	if( sl_controller_global->queue_events ) {
+		event = sl_controller_push_event( SL_INPUT_KEY, win_handle );
+		if( event != NULL ) {
+			event->data.key.key = key;
+			event->data.key.scancode = scancode;
+			event->data.key.action = action;
+			event->data.key.mods = mods;
 		}
-	} // No other options
+		return;
+	}
+	sl_controller_handle_key( win_handle, key, scancode, action, mods );
 }
 
 void sl_controller_glfw_char_callback( GLFWwindow *win_handle, unsigned int unicode_char )
 {
+	sl_input_event *event;
+
+	if( sl_controller_global->queue_events ) {
+		event = sl_controller_push_event( SL_INPUT_CHAR, win_handle );
+		if( event != NULL ) {
+			event->data.codepoint = unicode_char;
+		}
+	}
 	// @TODO: Character callback
 }
+
+void sl_controller_set_event_queueing( SL_BOOL enabled )
+{
+	if( !enabled ) {
+		sl_controller_dispatch_events( );
+	}
+	sl_controller_global->queue_events = enabled;
+}
+
+SL_BOOL sl_controller_poll_event( sl_input_event *event )
+{
+	if( sl_controller_global->event_count == 0 ) {
+		return SL_FALSE;
+	}
+	*event = sl_controller_global->events[ sl_controller_global->event_head ];
+	sl_controller_global->event_head = ( sl_controller_global->event_head + 1 ) & ( SL_INPUT_QUEUE_SIZE - 1 );
+	--sl_controller_global->event_count;
+	return SL_TRUE;
+}
+
+void sl_controller_dispatch_events( )
+{
+	sl_input_event event;
+
+	// Callbacks may queue events of their own; they are dispatched too
+	while( sl_controller_poll_event( &event ) ) {
+		switch( event.type ) {
+		case SL_INPUT_KEY:
+			sl_controller_handle_key( event.window, event.data.key.key, event.data.key.scancode,
+									  event.data.key.action, event.data.key.mods );
+			break;
+		case SL_INPUT_MOUSE_MOVE:
+			sl_controller_handle_mouse_pos( event.window, event.data.pos.x, event.data.pos.y );
+			break;
+		case SL_INPUT_MOUSE_BUTTON:
+			sl_controller_handle_mouse_button( event.window, event.data.button.button,
+											   event.data.button.action, event.data.button.mods );
+			break;
+		case SL_INPUT_MOUSE_ENTER_EXIT:
+			sl_controller_handle_mouse_enter_exit( event.window, event.data.entered );
+			break;
+		} // Chars and scrolls have no callbacks yet
+	}
+	sl_controller_flush( );
+}
+
+void sl_controller_get_input_state( sl_input_state *state )
+{
+	*state = sl_controller_global->state;
+	memset( sl_controller_global->state.keys_pressed, 0, sizeof( sl_controller_global->state.keys_pressed ) );
+	memset( sl_controller_global->state.keys_released, 0, sizeof( sl_controller_global->state.keys_released ) );
+	sl_controller_global->state.buttons_pressed = 0;
+	sl_controller_global->state.buttons_released = 0;
+	sl_controller_global->state.scroll = vec2( 0.f, 0.f );
+}
+
+SL_BOOL sl_controller_key_down( int key )
+{
+	if( key < 0 || key > GLFW_KEY_LAST ) {
+		return SL_FALSE;
+	}
+	return ( sl_controller_global->state.keys_down[ key >> 5 ] >> ( key & 31 ) ) & 1;
+}
+
+SL_BOOL sl_controller_mouse_button_down( int button )
+{
+	if( button < 0 || button > GLFW_MOUSE_BUTTON_LAST ) {
+		return SL_FALSE;
+	}
+	return ( sl_controller_global->state.buttons_down >> button ) & 1;
+}
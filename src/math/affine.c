@@ -0,0 +1,75 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ * 
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "math/affine.h"
+
+#include <math.h>
+
+void sl_affine_identity( sl_affine *result )
+{
+	result->a00 = 1.0f; result->a01 = 0.0f;
+	result->a10 = 0.0f; result->a11 = 1.0f;
+	result->a20 = 0.0f; result->a21 = 0.0f;
+}
+
+void sl_affine_set_trs( sl_affine *result, const v2 *center, const v2 *scale, const float rotation )
+{
+	float cosr, sinr;
+
+	cosr = ( float )cos( rotation );
+	sinr = ( float )sin( rotation );
+
+	result->a00 = scale->x * cosr;
+	result->a01 = scale->x * -sinr;
+	result->a10 = -scale->y * sinr;
+	result->a11 = -scale->y * cosr; // Y is flipped in OpenGL
+	result->a20 = center->x;
+	result->a21 = center->y;
+}
+
+void sl_affine_to_m44( m44 *result, const sl_affine *a )
+{
+	result->a00 = a->a00; result->a01 = a->a01; result->a02 = 0.0f; result->a03 = 0.0f;
+	result->a10 = a->a10; result->a11 = a->a11; result->a12 = 0.0f; result->a13 = 0.0f;
+	result->a20 = 0.0f;   result->a21 = 0.0f;   result->a22 = 1.0f; result->a23 = 0.0f;
+	result->a30 = a->a20; result->a31 = a->a21; result->a32 = 0.0f; result->a33 = 1.0f;
+}
+
+void sl_affine_from_m44( sl_affine *result, const m44 *m )
+{
+	result->a00 = m->a00; result->a01 = m->a01;
+	result->a10 = m->a10; result->a11 = m->a11;
+	result->a20 = m->a30; result->a21 = m->a31;
+}
+
+void sl_affine_lerp( sl_affine *result, const sl_affine *a, const sl_affine *b, const float t )
+{
+	float t1;
+	int i;
+
+	t1 = 1.0f - t;
+	for( i = 0; i < 6; ++i ) {
+		result->A[ i ] = a->A[ i ] * t1 + b->A[ i ] * t;
+	}
+}
+
+void sl_affine_transform( v2 *result, const sl_affine *a, const v2 *p )
+{
+	float x, y;
+
+	x = p->x;
+	y = p->y;
+	result->x = a->a00 * x + a->a10 * y + a->a20;
+	result->y = a->a01 * x + a->a11 * y + a->a21;
+}
@@ -0,0 +1,293 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ * 
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "physics/broadphase.h"
+
+#include <math.h>
+
+#include "slenderer.h"
+
+void sl_broadphase_create( sl_broadphase *bp, u32 method, f32 cell_size )
+{
+	bp->sweep = vul_vector_create( sizeof( sl_broadphase_sweep_entry ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	bp->cells = vul_vector_create( sizeof( sl_broadphase_cell_entry ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	bp->buckets = vul_vector_create( sizeof( sl_broadphase_cell_entry ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	bp->bucket_starts = vul_vector_create( sizeof( u32 ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	bp->large = vul_vector_create( sizeof( u32 ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	sl_broadphase_set_method( bp, method, cell_size );
+}
+
+void sl_broadphase_destroy( sl_broadphase *bp )
+{
+	vul_vector_destroy( bp->sweep );
+	vul_vector_destroy( bp->cells );
+	vul_vector_destroy( bp->buckets );
+	vul_vector_destroy( bp->bucket_starts );
+	vul_vector_destroy( bp->large );
+}
+
+void sl_broadphase_set_method( sl_broadphase *bp, u32 method, f32 cell_size )
+{
+#ifdef SL_DEBUG
+	assert( method <= SL_BROADPHASE_SPATIAL_HASH );
+	assert( method != SL_BROADPHASE_SPATIAL_HASH || cell_size > 0.f );
+#else
+	if( method > SL_BROADPHASE_SPATIAL_HASH ) {
+		sl_print( 256, "Unknown broadphase method %d, using the default.\n", method );
+		method = SL_BROADPHASE_DEFAULT;
+	}
+	if( method == SL_BROADPHASE_SPATIAL_HASH && cell_size <= 0.f ) {
+		sl_print( 256, "Invalid broadphase cell size %f, using the default.\n", cell_size );
+		cell_size = SL_BROADPHASE_DEFAULT_CELL_SIZE;
+	}
+#endif
+	bp->method = method;
+	bp->cell_size = cell_size;
+	// The sweep order is only valid for the method that built it
+	vul_vector_resize( bp->sweep, 0, VUL_FALSE, VUL_FALSE );
+}
+
+/**
+ * Whether two AABBs overlap. Touching counts as overlapping.
+ */
+static int sl_broadphase_overlap( const sl_box *a, const sl_box *b )
+{
+	return a->min_p.x <= b->max_p.x && b->min_p.x <= a->max_p.x
+		&& a->min_p.y <= b->max_p.y && b->min_p.y <= a->max_p.y;
+}
+
+static void sl_broadphase_add_pair( vul_vector *pairs, u32 a, u32 b )
+{
+	sl_broadphase_pair *p;
+
+	p = ( sl_broadphase_pair* )vul_vector_add_empty( pairs );
+	p->a = SL_MIN( a, b );
+	p->b = SL_MAX( a, b );
+}
+
+static void sl_broadphase_brute_force( sl_broadphase *bp, vul_vector *pairs, const sl_box *aabbs, u32 count )
+{
+	u32 i, j;
+
+	for( i = 0; i < count; ++i ) {
+		for( j = i + 1; j < count; ++j ) {
+			if( sl_broadphase_overlap( &aabbs[ i ], &aabbs[ j ] ) ) {
+				sl_broadphase_add_pair( pairs, i, j );
+			}
+		}
+	}
+}
+
+static int sl_broadphase_sweep_compare( const void *a, const void *b )
+{
+	f32 xa, xb;
+
+	xa = ( ( const sl_broadphase_sweep_entry* )a )->min_x;
+	xb = ( ( const sl_broadphase_sweep_entry* )b )->min_x;
+	return xa < xb ? -1 : ( xa > xb );
+}
+
+static void sl_broadphase_sweep_and_prune( sl_broadphase *bp, vul_vector *pairs, const sl_box *aabbs, u32 count )
+{
+	sl_broadphase_sweep_entry *sweep, tmp;
+	u32 i, j, old_count;
+	s32 k;
+
+	// Keep last step's order; bodies move little between steps, so it is nearly sorted.
+	// If bodies were removed the indices are meaningless, so start over.
+	old_count = vul_vector_size( bp->sweep );
+	if( old_count > count ) {
+		old_count = 0;
+	}
+	vul_vector_resize( bp->sweep, count, VUL_FALSE, VUL_FALSE );
+	sweep = ( sl_broadphase_sweep_entry* )vul_vector_begin( bp->sweep );
+	for( i = old_count; i < count; ++i ) {
+		sweep[ i ].body = i;
+	}
+	for( i = 0; i < count; ++i ) {
+		sweep[ i ].min_x = aabbs[ sweep[ i ].body ].min_p.x;
+	}
+
+	if( old_count != count ) {
+		// New bodies are in no particular order, so do a full sort
+		qsort( sweep, count, sizeof( sl_broadphase_sweep_entry ), sl_broadphase_sweep_compare );
+	} else {
+		// Insertion sort is linear on nearly sorted input
+		for( i = 1; i < count; ++i ) {
+			tmp = sweep[ i ];
+			for( k = ( s32 )i - 1; k >= 0 && sweep[ k ].min_x > tmp.min_x; --k ) {
+				sweep[ k + 1 ] = sweep[ k ];
+			}
+			sweep[ k + 1 ] = tmp;
+		}
+	}
+
+	// Sweep; every body starting before our end overlaps us on x
+	for( i = 0; i < count; ++i ) {
+		for( j = i + 1; j < count && sweep[ j ].min_x <= aabbs[ sweep[ i ].body ].max_p.x; ++j ) {
+			if( sl_broadphase_overlap( &aabbs[ sweep[ i ].body ], &aabbs[ sweep[ j ].body ] ) ) {
+				sl_broadphase_add_pair( pairs, sweep[ i ].body, sweep[ j ].body );
+			}
+		}
+	}
+}
+
+static u32 sl_broadphase_cell_hash( s32 x, s32 y )
+{
+	return ( ( u32 )x * 73856093u ) ^ ( ( u32 )y * 19349663u );
+}
+
+/*
+ * The cell a coordinate falls in, clamped to +-SL_BROADPHASE_MAX_CELL before the
+ * conversion so huge or far away values (and NaNs) can't overflow it.
+ */
+static s32 sl_broadphase_cell( f32 v, f32 inv_size )
+{
+	v = floorf( v * inv_size );
+	if( !( v >= ( f32 )-SL_BROADPHASE_MAX_CELL ) ) {
+		return -SL_BROADPHASE_MAX_CELL;
+	}
+	if( v > ( f32 )SL_BROADPHASE_MAX_CELL ) {
+		return SL_BROADPHASE_MAX_CELL;
+	}
+	return ( s32 )v;
+}
+
+static void sl_broadphase_spatial_hash( sl_broadphase *bp, vul_vector *pairs, const sl_box *aabbs, u32 count )
+{
+	sl_broadphase_cell_entry *cells, *buckets, *e, *f;
+	u32 *starts, *large;
+	u32 i, j, k, n, bucket_count, mask, large_count;
+	s32 x, y, min_x, min_y, max_x, max_y;
+	f32 inv_size;
+
+	// Bin every body into each cell its AABB touches. Bodies touching too many
+	// cells would blow up the cell list, so they are set aside instead.
+	inv_size = 1.f / bp->cell_size;
+	vul_vector_resize( bp->cells, 0, VUL_FALSE, VUL_FALSE );
+	vul_vector_resize( bp->large, 0, VUL_FALSE, VUL_FALSE );
+	for( i = 0; i < count; ++i ) {
+		min_x = sl_broadphase_cell( aabbs[ i ].min_p.x, inv_size );
+		min_y = sl_broadphase_cell( aabbs[ i ].min_p.y, inv_size );
+		max_x = sl_broadphase_cell( aabbs[ i ].max_p.x, inv_size );
+		max_y = sl_broadphase_cell( aabbs[ i ].max_p.y, inv_size );
+		if( max_x < min_x || max_y < min_y
+		 || ( u64 )( max_x - min_x + 1 ) * ( u64 )( max_y - min_y + 1 ) > SL_BROADPHASE_MAX_BODY_CELLS ) {
+			*( u32* )vul_vector_add_empty( bp->large ) = i;
+			continue;
+		}
+		n = vul_vector_size( bp->cells );
+		vul_vector_resize( bp->cells, n + ( max_x - min_x + 1 ) * ( max_y - min_y + 1 ), VUL_FALSE, VUL_FALSE );
+		e = ( sl_broadphase_cell_entry* )vul_vector_begin( bp->cells ) + n;
+		for( y = min_y; y <= max_y; ++y ) {
+			for( x = min_x; x <= max_x; ++x, ++e ) {
+				e->x = x;
+				e->y = y;
+				e->min_x = min_x;
+				e->min_y = min_y;
+				e->body = i;
+			}
+		}
+	}
+
+	// Test the set aside bodies against every body. They are in body order, so
+	// skipping the ones up to and including us reports each pair of them once.
+	large_count = vul_vector_size( bp->large );
+	large = ( u32* )vul_vector_begin( bp->large );
+	for( i = 0; i < large_count; ++i ) {
+		k = 0;
+		for( j = 0; j < count; ++j ) {
+			while( k < large_count && large[ k ] < j ) {
+				++k;
+			}
+			if( k <= i && large[ k ] == j ) {
+				continue;
+			}
+			if( sl_broadphase_overlap( &aabbs[ large[ i ] ], &aabbs[ j ] ) ) {
+				sl_broadphase_add_pair( pairs, large[ i ], j );
+			}
+		}
+	}
+
+	n = vul_vector_size( bp->cells );
+	if( n == 0 ) {
+		return;
+	}
+
+	// Counting sort the entries into power of two buckets
+	bucket_count = 1;
+	while( bucket_count < n * 2 ) {
+		bucket_count <<= 1;
+	}
+	mask = bucket_count - 1;
+	vul_vector_resize( bp->bucket_starts, bucket_count + 1, VUL_FALSE, VUL_FALSE );
+	vul_vector_resize( bp->buckets, n, VUL_FALSE, VUL_FALSE );
+	starts = ( u32* )vul_vector_begin( bp->bucket_starts );
+	cells = ( sl_broadphase_cell_entry* )vul_vector_begin( bp->cells );
+	buckets = ( sl_broadphase_cell_entry* )vul_vector_begin( bp->buckets );
+	memset( starts, 0, sizeof( u32 ) * ( bucket_count + 1 ) );
+	for( i = 0; i < n; ++i ) {
+		cells[ i ].bucket = sl_broadphase_cell_hash( cells[ i ].x, cells[ i ].y ) & mask;
+		++starts[ cells[ i ].bucket + 1 ];
+	}
+	for( i = 0; i < bucket_count; ++i ) {
+		starts[ i + 1 ] += starts[ i ];
+	}
+	for( i = 0; i < n; ++i ) {
+		buckets[ starts[ cells[ i ].bucket ]++ ] = cells[ i ];
+	}
+	// The scatter advanced every start to the next bucket's; shift them back
+	for( i = bucket_count; i > 0; --i ) {
+		starts[ i ] = starts[ i - 1 ];
+	}
+	starts[ 0 ] = 0;
+
+	// Test bodies sharing a cell. A pair sharing several cells is only reported from
+	// the cell holding the min corner of their overlap, so it is reported once. The
+	// cell mapping is monotonic, so that is the larger of the bodies' first cells,
+	// which we check before touching the AABBs.
+	for( i = 0; i < bucket_count; ++i ) {
+		for( e = buckets + starts[ i ]; e != buckets + starts[ i + 1 ]; ++e ) {
+			for( f = e + 1; f != buckets + starts[ i + 1 ]; ++f ) {
+				if( e->x != f->x || e->y != f->y ) {
+					continue; // Different cells sharing the bucket
+				}
+				if( SL_MAX( e->min_x, f->min_x ) != e->x || SL_MAX( e->min_y, f->min_y ) != e->y ) {
+					continue; // Reported from another cell, if at all
+				}
+				if( sl_broadphase_overlap( &aabbs[ e->body ], &aabbs[ f->body ] ) ) {
+					sl_broadphase_add_pair( pairs, e->body, f->body );
+				}
+			}
+		}
+	}
+}
+
+void sl_broadphase_find_pairs( sl_broadphase *bp, vul_vector *pairs, const sl_box *aabbs, u32 count )
+{
+	vul_vector_resize( pairs, 0, VUL_FALSE, VUL_FALSE );
+
+	switch( bp->method ) {
+	case SL_BROADPHASE_BRUTE_FORCE:
+		sl_broadphase_brute_force( bp, pairs, aabbs, count );
+		break;
+	case SL_BROADPHASE_SWEEP_AND_PRUNE:
+		sl_broadphase_sweep_and_prune( bp, pairs, aabbs, count );
+		break;
+	case SL_BROADPHASE_SPATIAL_HASH:
+	default:
+		sl_broadphase_spatial_hash( bp, pairs, aabbs, count );
+		break;
+	}
+}
@@ -18,11 +18,17 @@
 void sl_simulator_create( sl_simulator *sim, sl_scene *scene )
 {
 	sim->entities = vul_vector_create( sizeof( sl_simulator_entity ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
-	sim->collision_callbacks = vul_map_create( SL_SIMULATOR_CALLBACK_BUCKETS, sl_simulator_callback_hash, sl_simulator_callback_comp, SL_ALLOC, SL_DEALLOC );
-	sim->collission_callback_keys = NULL;
+	sl_hash_map_create( &sim->collision_callbacks, sizeof( sl_simulator_collision_callback ) );
 	sim->scene_id = scene->scene_id;
+	sl_broadphase_create( &sim->broadphase, SL_BROADPHASE_DEFAULT, SL_BROADPHASE_DEFAULT_CELL_SIZE );
+	sim->aabbs = vul_vector_create( sizeof( sl_box ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	sim->pairs = vul_vector_create( sizeof( sl_broadphase_pair ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
 	sim->clock = vul_timer_create( );
 	sim->last_time = 0;
+	sim->fixed_step = SL_FALSE;
+	sim->step = SL_SIMULATOR_DEFAULT_STEP;
+	sim->max_substeps = SL_SIMULATOR_DEFAULT_MAX_SUBSTEPS;
+	sim->accumulator = 0.0;
 }
 
 void sl_simulator_destroy( sl_simulator *sim )
@@ -34,11 +40,18 @@ void sl_simulator_destroy( sl_simulator *sim )
 		vul_vector_destroy( it->forces );
 	}
 	vul_vector_destroy( sim->entities );
-	vul_map_destroy( sim->collision_callbacks );
-	vul_list_destroy( sim->collission_callback_keys, free );
+	sl_hash_map_destroy( &sim->collision_callbacks );
+	sl_broadphase_destroy( &sim->broadphase );
+	vul_vector_destroy( sim->aabbs );
+	vul_vector_destroy( sim->pairs );
 	vul_timer_destroy( sim->clock );
 }
 
+void sl_simulator_set_broadphase( sl_simulator *sim, u32 method, f32 cell_size )
+{
+	sl_broadphase_set_method( &sim->broadphase, method, cell_size );
+}
+
 sl_simulator_entity *sl_simulator_add_entity( sl_simulator *sim, unsigned int entity_id, v2 *start_velocity )
 {
 	sl_simulator_entity *q, *it, *last_it;
@@ -47,7 +60,7 @@ sl_simulator_entity *sl_simulator_add_entity( sl_simulator *sim, unsigned int en
 	vul_foreach( sl_simulator_entity, it, last_it, sim->entities )
 	{
 		// If it already exists in our vector, update and return
-		if( it->entity->entity_id == entity_id ) {
+		if( it->entity_id == entity_id ) {
 			it->velocity = *start_velocity;
 			return it;
 		}
@@ -57,9 +70,11 @@ sl_simulator_entity *sl_simulator_add_entity( sl_simulator *sim, unsigned int en
 	s = sl_renderer_get_scene_by_id( sim->scene_id );
 	q = ( sl_simulator_entity* )vul_vector_add_empty( sim->entities );
 	q->forces = vul_vector_create( sizeof( v2 ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
-	q->entity = sl_scene_get_const_entity( s, entity_id, 0xffffffff );
+	q->entity_id = entity_id;
+	q->transform = sl_scene_get_transform( s, entity_id );
 	q->velocity = *start_velocity;
-	q->pos = vec2( q->entity->world_matrix.a30, q->entity->world_matrix.a31 );
+	q->pos = vec2( q->transform->a20, q->transform->a21 );
+	q->prev_pos = q->pos;
 		
 
 	return q;
@@ -72,7 +87,7 @@ v2 *sl_simulator_add_force( sl_simulator *sim, unsigned int entity_id, v2 *force
 
 	vul_foreach( sl_simulator_entity, it, last_it, sim->entities )
 	{
-		if( it->entity->entity_id == entity_id ) {
+		if( it->entity_id == entity_id ) {
 			ret = ( v2* )vul_vector_add_empty( it->forces );			
 			ret->x = force->x;
 			ret->y = force->y;
@@ -94,7 +109,7 @@ void sl_simulator_add_impulse( sl_simulator *sim, unsigned int entity_id, v2 *im
 
 	vul_foreach( sl_simulator_entity, it, last_it, sim->entities )
 	{
-		if( it->entity->entity_id == entity_id ) {
+		if( it->entity_id == entity_id ) {
 			it->velocity = vadd2( it->velocity, *impulse );
 			return;
 		}
@@ -109,49 +124,30 @@ void sl_simulator_add_impulse( sl_simulator *sim, unsigned int entity_id, v2 *im
 
 void sl_simulator_add_callback( sl_simulator *sim, unsigned int entity_id_a, unsigned int entity_id_b, sl_simulator_collider_pair_callback callback )
 {
-	sl_simulator_collider_pair pair;
-	vul_hash_map_element *element, el;
-	vul_list_element *le;
-
-	pair.entity_id_a = SL_MIN( entity_id_a, entity_id_b );
-	pair.entity_id_b = SL_MAX( entity_id_a, entity_id_b );
+	sl_simulator_collision_callback cc;
 
-	element = vul_map_get( sim->collision_callbacks, ( u8* )&pair, sizeof( pair ) );
-	if( element != NULL ) {
-		// Update element
-		element->data = callback;
-	} else {
-		// Store our key
-		le = vul_list_insert( sim->collission_callback_keys, &pair, sizeof( sl_simulator_collider_pair ), sl_simulator_callback_comp, malloc );
-
-		// Create a new element
-		el.data = callback;
-		el.data_size = sizeof( callback );
-		el.key = ( u8* )le->data;
-		el.key_size = sizeof( pair );
-		vul_map_insert( sim->collision_callbacks, &el );
-	}
+	cc.callback = callback;
+	cc.entity_id_first = entity_id_a;
+	sl_hash_map_insert( &sim->collision_callbacks, SL_HASH_MAP_PAIR( SL_MIN( entity_id_a, entity_id_b ), SL_MAX( entity_id_a, entity_id_b ) ), &cc );
 }
 
-void sl_simulator_update( sl_simulator *sim )
+/**
+ * Advances the simulation by one step of the given length:
+ * integrates, moves the rendering quads and handles collisions.
+ */
+static void sl_simulator_tick( sl_simulator *sim, sl_scene *s, float time_delta_in_s )
 {
-	sl_simulator_entity *it, *lit, *it2, *lit2;
-	sl_scene *s;
+	sl_simulator_entity *it, *lit, *it2;
+	sl_broadphase_pair *pit, *lpit;
 	v2 *vit, *lvit, tmp;
-	sl_box aabb, aabb2;
-	const vul_hash_map_element *el;
-	sl_simulator_collider_pair pair;
-	sl_entity *q;
-	float time_delta_in_s;
-	unsigned long long time_now;
-
-	// Get time delta and reset clock
-	time_now = vul_timer_get_micros( sim->clock );
-	time_delta_in_s = ( float )( ( double )( time_now - sim->last_time ) / 1000000.0 );
-	sim->last_time = time_now;
+	sl_box *aabbs;
+	u32 i;
+	const sl_simulator_collision_callback *cc;
+	sl_affine *q;
 
 	vul_foreach( sl_simulator_entity, it, lit, sim->entities )
 	{
+		it->prev_pos = it->pos;
 		// Aplly all forces
 		vul_foreach( v2, vit, lvit, it->forces )
 		{
@@ -164,79 +160,138 @@ void sl_simulator_update( sl_simulator *sim )
 	}
 
 	// Update the rendering quads (if this simulation quad has one
-	s = sl_renderer_get_scene_by_id( sim->scene_id );
 	vul_foreach( sl_simulator_entity, it, lit, sim->entities )
 	{
-		q = sl_scene_get_volitile_entity( s, it->entity->entity_id, 0xffffffff );
-		q->world_matrix.a30 = it->pos.x;
-		q->world_matrix.a31 = it->pos.y;
+		q = sl_scene_get_transform( s, it->entity_id );
+		q->a20 = it->pos.x;
+		q->a21 = it->pos.y;
+		it->transform = q;
 	}
 
-	// With the new positions, calculate collissions
+	// With the new positions, calculate the AABBs once
+	vul_vector_resize( sim->aabbs, vul_vector_size( sim->entities ), VUL_FALSE, VUL_FALSE );
+	aabbs = ( sl_box* )vul_vector_begin( sim->aabbs );
+	i = 0;
 	vul_foreach( sl_simulator_entity, it, lit, sim->entities )
 	{
-		vul_foreach( sl_simulator_entity, it2, lit2, sim->entities )
-		{
-			if( it == it2 ) {
-				continue; // Skip self-collissions
-			}
-			sl_entity_aabb( &aabb, it->entity );
-			sl_entity_aabb( &aabb2, it2->entity );
-			if( sl_bintersect( &aabb, &aabb2 ) ) {
-				// Call callback if there is one (if not, the collission isn't handled!)
-				// @NOTE: If this adjusts positions, you need to update the rendering quads from the callback!
-				pair.entity_id_a = SL_MIN( it->entity->entity_id, it2->entity->entity_id );
-				pair.entity_id_b = SL_MAX( it->entity->entity_id, it2->entity->entity_id );
-				el = vul_map_get_const( sim->collision_callbacks, ( u8* )&pair, sizeof( pair ) );
-				if( el != NULL ) {
-					( ( sl_simulator_collider_pair_callback )el->data )( s, it, it2, time_delta_in_s );
-				}
+		sl_entity_aabb_transform( &aabbs[ i++ ], it->transform );
+	}
+
+	// and find the overlapping pairs
+	sl_broadphase_find_pairs( &sim->broadphase, sim->pairs, aabbs, vul_vector_size( sim->entities ) );
+	vul_foreach( sl_broadphase_pair, pit, lpit, sim->pairs )
+	{
+		// Call callback if there is one (if not, the collission isn't handled!)
+		// @NOTE: If this adjusts positions, you need to update the rendering quads from the callback!
+		it = ( sl_simulator_entity* )vul_vector_get( sim->entities, pit->a );
+		it2 = ( sl_simulator_entity* )vul_vector_get( sim->entities, pit->b );
+		cc = ( const sl_simulator_collision_callback* )sl_hash_map_get( &sim->collision_callbacks,
+					SL_HASH_MAP_PAIR( SL_MIN( it->entity_id, it2->entity_id ), SL_MAX( it->entity_id, it2->entity_id ) ) );
+		if( cc != NULL ) {
+			if( cc->entity_id_first == it->entity_id ) {
+				cc->callback( s, it, it2, time_delta_in_s );
+			} else {
+				cc->callback( s, it2, it, time_delta_in_s );
 			}
 		}
 	}
 }
 
+/**
+ * Moves the rendering quads to where the bodies are alpha of the way
+ * from their previous to their current position.
+ */
+static void sl_simulator_interpolate( sl_simulator *sim, sl_scene *s, float alpha )
+{
+	sl_simulator_entity *it, *lit;
+	sl_affine *q;
 
+	vul_foreach( sl_simulator_entity, it, lit, sim->entities )
+	{
+		q = sl_scene_get_transform( s, it->entity_id );
+		q->a20 = it->prev_pos.x + ( it->pos.x - it->prev_pos.x ) * alpha;
+		q->a21 = it->prev_pos.y + ( it->pos.y - it->prev_pos.y ) * alpha;
+	}
+}
 
-u32 sl_simulator_callback_hash( const u8 *key, u32 keylen )
+void sl_simulator_update( sl_simulator *sim )
 {
-	u32 qa, qb;
+	sl_scene *s;
+	float time_delta_in_s;
+	unsigned long long time_now;
+	u32 steps;
+
+	// Get time delta and reset clock
+	time_now = vul_timer_get_micros( sim->clock );
+	time_delta_in_s = ( float )( ( double )( time_now - sim->last_time ) / 1000000.0 );
+	sim->last_time = time_now;
+
+	s = sl_renderer_get_scene_by_id( sim->scene_id );
+	if( !sim->fixed_step ) {
+		sl_simulator_tick( sim, s, time_delta_in_s );
+		return;
+	}
+
+	// Consume the elapsed time in fixed steps
+	sim->accumulator += time_delta_in_s;
+	steps = 0;
+	while( sim->accumulator >= sim->step && steps < sim->max_substeps ) {
+		sl_simulator_tick( sim, s, sim->step );
+		sim->accumulator -= sim->step;
+		++steps;
+	}
+	// If we can't keep up, drop the backlog rather than fall further behind
+	if( sim->accumulator >= sim->step ) {
+		sim->accumulator = fmod( sim->accumulator, sim->step );
+	}
+
+	// Render the remainder as a blend of the last two steps
+	sl_simulator_interpolate( sim, s, ( float )( sim->accumulator / sim->step ) );
+}
 
+void sl_simulator_set_fixed_step( sl_simulator *sim, float step, u32 max_substeps )
+{
+	if( step <= 0.f ) {
+		if( sim->fixed_step ) {
+			// Time spent in fixed step mode is already simulated, so start the clock over
+			sim->fixed_step = SL_FALSE;
+			sim->last_time = vul_timer_get_micros( sim->clock );
+		}
+		return;
+	}
 #ifdef SL_DEBUG
-	assert( keylen == sizeof( sl_simulator_collider_pair ) );
+	assert( max_substeps > 0 );
 #else
-	if( keylen !=  sizeof( sl_simulator_collider_pair ) ) {
-		sl_print( 256, "Key length in simulator callback hash function is not %d, but %d.\n", sizeof( sl_simulator_collider_pair ), keylen );
-		return 0;
+	if( max_substeps == 0 ) {
+		sl_print( 256, "A fixed step simulator needs at least one substep per update, using one.\n" );
+		max_substeps = 1;
 	}
 #endif
-	
-	qa = *( u32* )key;
-	qb = *( u32* )( key + sizeof( u32 ) );
-
-	return ( qa << 16 ) + qb; 
+	sim->max_substeps = max_substeps;
+	if( sim->fixed_step && sim->step == step ) {
+		return;
+	}
+	// Entering fixed step mode or changing the step: time elapsed before now belongs
+	// to the old mode, so restart the clock rather than catch up on it in a burst.
+	sim->fixed_step = SL_TRUE;
+	sim->step = step;
+	sim->accumulator = 0.0;
+	sim->last_time = vul_timer_get_micros( sim->clock );
 }
 
-int sl_simulator_callback_comp( void *a, void *b )
-{	
-	vul_hash_map_element *ea, *eb;
-	u32 qaa, qab, qba, qbb;
-
-	ea = ( vul_hash_map_element* )a;
-	eb = ( vul_hash_map_element* )b;
-
-	qaa = ( ( sl_simulator_collider_pair* )ea->key )->entity_id_a;
-	qab = ( ( sl_simulator_collider_pair* )ea->key )->entity_id_b;
-	qba = ( ( sl_simulator_collider_pair* )eb->key )->entity_id_a;
-	qbb = ( ( sl_simulator_collider_pair* )eb->key )->entity_id_b;
+void sl_simulator_step( sl_simulator *sim, u32 ticks )
+{
+	sl_scene *s;
+	u32 i;
 
-	if( qaa != qba ) {
-		return ( int )( ( s32 )qaa - ( s32 )qba ); // Compare a with a first
-	} else {
-		return ( int )( ( s32 )qab - ( s32 )qbb ); // If a == a, compare bs
+	s = sl_renderer_get_scene_by_id( sim->scene_id );
+	for( i = 0; i < ticks; ++i ) {
+		sl_simulator_tick( sim, s, sim->step );
 	}
 }
 
+
+
 void sl_simulator_callback_quad_quad( sl_scene *scene, sl_simulator_entity *a, sl_simulator_entity *b, double time_frame_delta )
 {
 	v2 inv_vel_a, inv_vel_b;				// Inverse velocities to find intersection
@@ -247,8 +302,8 @@ void sl_simulator_callback_quad_quad( sl_scene *scene, sl_simulator_entity *a, s
 	v2 corner_a, corner_b;					// AABB corner closest to intersection point
 
 	// Get the aabbs @TODO: Pass these in for less recalculations?
-	sl_entity_aabb( &aabb_a, a->entity );
-	sl_entity_aabb( &aabb_b, b->entity );
+	sl_entity_aabb_transform( &aabb_a, a->transform );
+	sl_entity_aabb_transform( &aabb_b, b->transform );
 
 	// Get corner of AABB closest to intersection
 	if( a->velocity.x > 0.0f ){
@@ -316,10 +371,10 @@ void sl_simulator_callback_quad_quad( sl_scene *scene, sl_simulator_entity *a, s
 	b->velocity.y = inv_vel_b.y;
 
 	// @NOTE: We don't care about rotation here...
-	sl_scene_get_volitile_entity( scene, a->entity->entity_id, 0xffffffff )->world_matrix.a30 = a->pos.x;
-	sl_scene_get_volitile_entity( scene, a->entity->entity_id, 0xffffffff )->world_matrix.a31 = a->pos.y;
-	sl_scene_get_volitile_entity( scene, b->entity->entity_id, 0xffffffff )->world_matrix.a30 = b->pos.x;
-	sl_scene_get_volitile_entity( scene, b->entity->entity_id, 0xffffffff )->world_matrix.a31 = b->pos.y;
+	sl_scene_get_transform( scene, a->entity_id )->a20 = a->pos.x;
+	sl_scene_get_transform( scene, a->entity_id )->a21 = a->pos.y;
+	sl_scene_get_transform( scene, b->entity_id )->a20 = b->pos.x;
+	sl_scene_get_transform( scene, b->entity_id )->a21 = b->pos.y;
 }
 
 void sl_simulator_callback_quad_sphere( sl_scene *scene, sl_simulator_entity *quad, sl_simulator_entity *sphere, double time_frame_delta )
@@ -337,14 +392,14 @@ void sl_simulator_callback_quad_sphere( sl_scene *scene, sl_simulator_entity *qu
 	v2 old_vel_q, old_vel_s;			// Store old velocities
 	
 	// Get aabbs
-	sl_entity_aabb( &quad_aabb, quad->entity );
-	sl_entity_aabb( &sphere_aabb, sphere->entity );
+	sl_entity_aabb_transform( &quad_aabb, quad->transform );
+	sl_entity_aabb_transform( &sphere_aabb, sphere->transform );
 
 	// Get sphere radius
-	angle = ( float )asin( sphere->entity->world_matrix.A[ 1 ] );
+	angle = ( float )asin( sphere->transform->a01 );
 	half_inv_cos_a = 1.0f / ( ( float )cos( angle ) * 2.0f );
-	sphere_radius = vec2( sphere->entity->world_matrix.A[ 0 ] * half_inv_cos_a,
-						  sphere->entity->world_matrix.A[ 5 ] * half_inv_cos_a );
+	sphere_radius = vec2( sphere->transform->a00 * half_inv_cos_a,
+						  sphere->transform->a11 * half_inv_cos_a );
 	// Get sphere center
 	sl_bcenter( &sphere_center, &sphere_aabb );
 
@@ -423,14 +478,14 @@ void sl_simulator_callback_sphere_sphere( sl_scene *scene, sl_simulator_entity *
 	v2 old_vel_a, old_vel_b;					// Store old velocities
 	
 	// Get aabbs
-	sl_entity_aabb( &aabb_a, a->entity );
-	sl_entity_aabb( &aabb_b, b->entity );
+	sl_entity_aabb_transform( &aabb_a, a->transform );
+	sl_entity_aabb_transform( &aabb_b, b->transform );
 
 	// Get sphere radius
-	angle_a = ( float )asin( a->entity->world_matrix.A[ 1 ] );
+	angle_a = ( float )asin( a->transform->a01 );
 	half_inv_cos_a = 1.0f / ( ( float )cos( angle_a ) * 2.0f );
-	radius_a = vec2( a->entity->world_matrix.A[ 0 ] * half_inv_cos_a,
-					 a->entity->world_matrix.A[ 5 ] * half_inv_cos_a );
+	radius_a = vec2( a->transform->a00 * half_inv_cos_a,
+					 a->transform->a11 * half_inv_cos_a );
 	// Get sphere center
 	sl_bcenter( &center_a, &aabb_a );
 	sl_bcenter( &center_b, &aabb_b );
@@ -36,7 +36,7 @@ void sl_animator_destroy( sl_animator *animator )
 	vul_timer_destroy( animator->clock );
 }
 
-unsigned int sl_animator_add_transform( sl_animator *animator, unsigned int entity_id, const m44 *end_world_matrix, unsigned long long length_in_ms, sl_animation_state state )
+unsigned int sl_animator_add_affine( sl_animator *animator, unsigned int entity_id, const sl_affine *end_transform, unsigned long long length_in_ms, sl_animation_state state )
 {
 	sl_animation_transform* t;
 	sl_scene *s;
@@ -47,14 +47,22 @@ unsigned int sl_animator_add_transform( sl_animator *animator, unsigned int enti
 	t->entity_id = entity_id;
 	t->start_time = vul_timer_get_millis( animator->clock );
 	t->end_time = t->start_time + length_in_ms;
-	t->start_world_mat = sl_scene_get_const_entity( s, entity_id, 0xffffffff )->world_matrix;
-	t->end_world_mat = *end_world_matrix;
+	t->start_transform = *sl_scene_get_transform( s, entity_id );
+	t->end_transform = *end_transform;
 	assert( state == SL_ANIMATION_RUNNING || SL_ANIMATION_RUNNING_LOOPED || SL_ANIMATION_RUNNING_PERIODIC );
 	t->state = state;
 
 	return t->animation_id;
 }
 
+unsigned int sl_animator_add_transform( sl_animator *animator, unsigned int entity_id, const m44 *end_world_matrix, unsigned long long length_in_ms, sl_animation_state state )
+{
+	sl_affine end;
+
+	sl_affine_from_m44( &end, end_world_matrix );
+	return sl_animator_add_affine( animator, entity_id, &end, length_in_ms, state );
+}
+
 unsigned int sl_animator_add_sprite( sl_animator *animator, unsigned int entity_id, vul_vector *frames, unsigned long long ms_per_frame, sl_animation_state state )
 {
 	sl_animation_sprite* t;
@@ -115,11 +123,11 @@ void sl_animator_update( sl_animator *animator )
 	float t;
 	sl_animation_transform *ita, *last_ita;
 	sl_animation_sprite *its, *last_its;
-	sl_entity *entity;
+	sl_affine *transform;
 	sl_animation_sprite_state *state;
 	sl_scene *s;
 	int deleted;
-	m44 tmp;
+	sl_affine tmp;
 
 	// Calculate time since last frame
 	now = vul_timer_get_millis( animator->clock );
@@ -153,15 +161,15 @@ void sl_animator_update( sl_animator *animator )
 					ita->start_time = now;
 					ita->end_time = now + length_in_ms;
 					// Swap end and beginning matrices
-					memcpy( &tmp, &ita->end_world_mat, sizeof( m44 ) );
-					memcpy( &ita->end_world_mat, &ita->start_world_mat, sizeof( m44 ) );
-					memcpy( &ita->start_world_mat, &tmp, sizeof( m44 ) );
+					tmp = ita->end_transform;
+					ita->end_transform = ita->start_transform;
+					ita->start_transform = tmp;
 					// @TODO: Add callbacks that are called at loop reset/periodic reset
 					// to f.ex. add an effect there.
 				} else {
 					// Move to final matrix when done
-					entity = sl_scene_get_volitile_entity( s, ita->entity_id, 0xffffffff );
-					memcpy( &entity->world_matrix, &ita->end_world_mat, sizeof( m44 ) );
+					transform = sl_scene_get_transform( s, ita->entity_id );
+					*transform = ita->end_transform;
 					ita->state = SL_ANIMATION_FINISHED;
 				}
 				if( ita->state == SL_ANIMATION_FINISHED ) {
@@ -222,11 +230,11 @@ void sl_animator_update( sl_animator *animator )
 			t = 1.f;
 		}
 
-		// Grab the entity
-		entity = sl_scene_get_volitile_entity( s, ita->entity_id, 0xffffffff ); // @TODO: This is why we want layer info when we add a transform!
+		// Grab the entity's transform
+		transform = sl_scene_get_transform( s, ita->entity_id );
 
 		// Set the new matrix, a linear interpolation at t. @TODO: Might want to quaternion it up at some point; slerp for the orientation here!
-		entity->world_matrix = mlerp44( &ita->start_world_mat, &ita->end_world_mat, t );
+		sl_affine_lerp( transform, &ita->start_transform, &ita->end_transform, t );
 	}
 
 	// Iterate over the sprites and update them.
@@ -237,15 +245,14 @@ void sl_animator_update( sl_animator *animator )
 			// Advance the animation
 			its->time_since_current_frame -= its->time_per_frame_in_ms;
 
-			entity = sl_scene_get_volitile_entity( s, its->entity_id, 0xffffffff ); // @TODO: This is why we want layer info when we add a sprite!
 			if( its->period_rising ) {
 				state = ( sl_animation_sprite_state* )vul_vector_get( its->frames, ++its->current_frame );
 			} else {
 				state = ( sl_animation_sprite_state* )vul_vector_get( its->frames, --its->current_frame );
 			}
 
-			entity->uvs = state->uvs;
-			entity->texture_id = state->texture_id;
+			*sl_scene_get_uvs( s, its->entity_id ) = state->uvs;
+			sl_scene_set_texture( s, its->entity_id, state->texture_id );
 		}
 	}
 }
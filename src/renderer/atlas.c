@@ -0,0 +1,375 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "renderer/atlas.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stb_image.h> // Implemented in src/dependancies/stb_image.c
+
+#include "slenderer.h"
+
+typedef struct {
+	u32 height, width, image;
+} sl_atlas_repack_entry;
+
+/*
+ * Finds the lowest y a rect can be placed at with its left edge at the given
+ * skyline node. Returns SL_FALSE if it doesn't fit there.
+ */
+static SL_BOOL sl_atlas_skyline_fit( sl_atlas *atlas, sl_atlas_page *page, u32 index, u32 width, u32 height, u32 *y )
+{
+	sl_atlas_skyline_node *nodes;
+	u32 remaining;
+
+	nodes = ( sl_atlas_skyline_node* )vul_vector_begin( page->skyline );
+	if( nodes[ index ].x + width > atlas->page_width ) {
+		return SL_FALSE;
+	}
+
+	// The rect rests on the highest node it spans; the nodes cover the page, so we can't run out
+	*y = 0;
+	remaining = width;
+	for( ;; ) {
+		if( nodes[ index ].y > *y ) {
+			*y = nodes[ index ].y;
+		}
+		if( *y + height > atlas->page_height ) {
+			return SL_FALSE;
+		}
+		if( nodes[ index ].width >= remaining ) {
+			return SL_TRUE;
+		}
+		remaining -= nodes[ index ].width;
+		++index;
+	}
+}
+
+/*
+ * Finds where in the page a rect fits best: lowest top edge, then narrowest
+ * node. Returns the node index, or -1 if it doesn't fit.
+ */
+static s32 sl_atlas_skyline_find( sl_atlas *atlas, sl_atlas_page *page, u32 width, u32 height, u32 *x, u32 *y )
+{
+	sl_atlas_skyline_node *node;
+	u32 i, top, best_top, best_width, node_y;
+	s32 best;
+
+	best = -1;
+	best_top = best_width = 0xffffffff;
+	for( i = 0; i < vul_vector_size( page->skyline ); ++i ) {
+		node = ( sl_atlas_skyline_node* )vul_vector_get( page->skyline, i );
+		if( !sl_atlas_skyline_fit( atlas, page, i, width, height, &node_y ) ) {
+			continue;
+		}
+		top = node_y + height;
+		if( top < best_top || ( top == best_top && node->width < best_width ) ) {
+			best = ( s32 )i;
+			best_top = top;
+			best_width = node->width;
+			*x = node->x;
+			*y = node_y;
+		}
+	}
+	return best;
+}
+
+/*
+ * Raises the skyline where a rect was placed at the given node: inserts its top
+ * edge, cuts away the nodes it covers and merges neighbours of equal height.
+ */
+static void sl_atlas_skyline_add( sl_atlas_page *page, u32 index, u32 x, u32 y, u32 width, u32 height )
+{
+	sl_atlas_skyline_node *node, *prev;
+	u32 end;
+
+	// vul_vector_insert_empty shifts bytes, not elements, so make room by hand
+	vul_vector_add_empty( page->skyline );
+	node = ( sl_atlas_skyline_node* )vul_vector_get( page->skyline, index );
+	memmove( node + 1, node, sizeof( sl_atlas_skyline_node ) * ( vul_vector_size( page->skyline ) - 1 - index ) );
+	node->x = x;
+	node->y = y + height;
+	node->width = width;
+
+	end = x + width;
+	while( index + 1 < vul_vector_size( page->skyline ) ) {
+		node = ( sl_atlas_skyline_node* )vul_vector_get( page->skyline, index + 1 );
+		if( node->x >= end ) {
+			break;
+		}
+		if( node->x + node->width <= end ) {
+			vul_vector_remove_cascade( page->skyline, index + 1 );
+			continue;
+		}
+		node->width -= end - node->x;
+		node->x = end;
+		break;
+	}
+
+	for( index = 1; index < vul_vector_size( page->skyline ); ) {
+		prev = ( sl_atlas_skyline_node* )vul_vector_get( page->skyline, index - 1 );
+		node = ( sl_atlas_skyline_node* )vul_vector_get( page->skyline, index );
+		if( prev->y == node->y ) {
+			prev->width += node->width;
+			vul_vector_remove_cascade( page->skyline, index );
+		} else {
+			++index;
+		}
+	}
+}
+
+/*
+ * Empties a page's skyline.
+ */
+static void sl_atlas_skyline_reset( sl_atlas *atlas, sl_atlas_page *page )
+{
+	sl_atlas_skyline_node *node;
+
+	vul_vector_resize( page->skyline, 0, VUL_FALSE, VUL_FALSE );
+	node = ( sl_atlas_skyline_node* )vul_vector_add_empty( page->skyline );
+	node->x = 0;
+	node->y = 0;
+	node->width = atlas->page_width;
+}
+
+/*
+ * Uploads a tightly packed RGBA8 rect into a page's texture.
+ */
+static void sl_atlas_upload( sl_atlas *atlas, u32 page, u32 x, u32 y, u32 width, u32 height, const unsigned char *pixels )
+{
+	sl_texture *tex;
+
+	tex = sl_renderer_get_texture_by_id( ( ( sl_atlas_page* )vul_vector_get( atlas->pages, page ) )->texture_id );
+	sl_texture_bind( NULL, tex );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	glTexSubImage2D( GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+	sl_texture_unbind( tex );
+}
+
+/*
+ * Clears a page's texture to transparent black.
+ */
+static void sl_atlas_clear( sl_atlas *atlas, u32 page )
+{
+	unsigned char *zero;
+
+	zero = ( unsigned char* )SL_ALLOC( atlas->page_width * atlas->page_height * 4 );
+	memset( zero, 0, atlas->page_width * atlas->page_height * 4 );
+	sl_atlas_upload( atlas, page, 0, 0, atlas->page_width, atlas->page_height, zero );
+	SL_DEALLOC( zero );
+}
+
+static u32 sl_atlas_add_page( sl_atlas *atlas )
+{
+	sl_atlas_page *page;
+	sl_texture *tex;
+	u32 index;
+
+	index = vul_vector_size( atlas->pages );
+	page = ( sl_atlas_page* )vul_vector_add_empty( atlas->pages );
+	page->skyline = vul_vector_create( sizeof( sl_atlas_skyline_node ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	sl_atlas_skyline_reset( atlas, page );
+
+	tex = sl_renderer_allocate_texture( );
+	page->texture_id = tex->texture_id;
+	sl_texture_create( tex, NULL, atlas->page_width, atlas->page_height, GL_RGBA, GL_RGBA );
+	sl_atlas_clear( atlas, index );
+
+	return index;
+}
+
+/*
+ * Finds a place for the image in the first page it fits in, opening a new
+ * page if none has room. The image must fit in an empty page.
+ */
+static void sl_atlas_place( sl_atlas *atlas, sl_atlas_image *img )
+{
+	sl_atlas_page *page;
+	u32 p, width, height;
+	s32 node;
+
+	// Pad right and up, unless the image spans the page
+	width = SL_MIN( img->width + SL_ATLAS_PADDING, atlas->page_width );
+	height = SL_MIN( img->height + SL_ATLAS_PADDING, atlas->page_height );
+
+	for( p = 0; p < vul_vector_size( atlas->pages ); ++p ) {
+		page = ( sl_atlas_page* )vul_vector_get( atlas->pages, p );
+		node = sl_atlas_skyline_find( atlas, page, width, height, &img->x, &img->y );
+		if( node >= 0 ) {
+			sl_atlas_skyline_add( page, ( u32 )node, img->x, img->y, width, height );
+			img->page = p;
+			return;
+		}
+	}
+
+	p = sl_atlas_add_page( atlas );
+	page = ( sl_atlas_page* )vul_vector_get( atlas->pages, p );
+	node = sl_atlas_skyline_find( atlas, page, width, height, &img->x, &img->y );
+	assert( node == 0 );
+	sl_atlas_skyline_add( page, ( u32 )node, img->x, img->y, width, height );
+	img->page = p;
+}
+
+void sl_atlas_create( sl_atlas *atlas, u32 page_width, u32 page_height )
+{
+	atlas->page_width = page_width;
+	atlas->page_height = page_height;
+	atlas->pages = vul_vector_create( sizeof( sl_atlas_page ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	atlas->images = vul_vector_create( sizeof( sl_atlas_image ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+}
+
+void sl_atlas_destroy( sl_atlas *atlas )
+{
+	sl_atlas_page *pit, *plast;
+	sl_atlas_image *iit, *ilast;
+
+	vul_foreach( sl_atlas_page, pit, plast, atlas->pages ) {
+		vul_vector_destroy( pit->skyline );
+	}
+	vul_foreach( sl_atlas_image, iit, ilast, atlas->images ) {
+		SL_DEALLOC( iit->pixels );
+	}
+	vul_vector_destroy( atlas->pages );
+	vul_vector_destroy( atlas->images );
+}
+
+u32 sl_atlas_add_image( sl_atlas *atlas, const unsigned char *pixels, u32 width, u32 height )
+{
+	sl_atlas_image *img;
+	u32 id;
+
+	if( width == 0 || height == 0 || width > atlas->page_width || height > atlas->page_height ) {
+		sl_print( 256, "Image of %dx%d does not fit an atlas page of %dx%d.\n", width, height, atlas->page_width, atlas->page_height );
+		return SL_ATLAS_INVALID_IMAGE;
+	}
+
+	id = vul_vector_size( atlas->images );
+	img = ( sl_atlas_image* )vul_vector_add_empty( atlas->images );
+	img->width = width;
+	img->height = height;
+	img->pixels = ( unsigned char* )SL_ALLOC( width * height * 4 );
+	memcpy( img->pixels, pixels, width * height * 4 );
+
+	sl_atlas_place( atlas, img );
+	sl_atlas_upload( atlas, img->page, img->x, img->y, width, height, img->pixels );
+
+	return id;
+}
+
+u32 sl_atlas_add_file( sl_atlas *atlas, const char *path )
+{
+	unsigned char *pixels;
+	int width, height, components;
+	u32 id;
+
+	pixels = stbi_load( path, &width, &height, &components, 4 );
+	if( !pixels ) {
+		sl_print( 256, "Failed to load image %s: %s\n", path, stbi_failure_reason( ) );
+		return SL_ATLAS_INVALID_IMAGE;
+	}
+	id = sl_atlas_add_image( atlas, pixels, ( u32 )width, ( u32 )height );
+	stbi_image_free( pixels );
+
+	return id;
+}
+
+void sl_atlas_get_uvs( sl_atlas *atlas, u32 image, unsigned int *texture_id, sl_box *uvs )
+{
+	sl_atlas_image *img;
+	f32 w, h;
+
+	img = ( sl_atlas_image* )vul_vector_get( atlas->images, image );
+	*texture_id = ( ( sl_atlas_page* )vul_vector_get( atlas->pages, img->page ) )->texture_id;
+	w = ( f32 )atlas->page_width;
+	h = ( f32 )atlas->page_height;
+	sl_bset_scalar( uvs, ( f32 )img->x / w, ( f32 )img->y / h,
+					( f32 )( img->x + img->width ) / w, ( f32 )( img->y + img->height ) / h );
+}
+
+static int sl_atlas_repack_compare( const void *a, const void *b )
+{
+	const sl_atlas_repack_entry *ea, *eb;
+
+	ea = ( const sl_atlas_repack_entry* )a;
+	eb = ( const sl_atlas_repack_entry* )b;
+	if( ea->height != eb->height ) {
+		return ea->height > eb->height ? -1 : 1;
+	}
+	if( ea->width != eb->width ) {
+		return ea->width > eb->width ? -1 : 1;
+	}
+	return ea->image < eb->image ? -1 : 1;
+}
+
+u32 sl_atlas_repack( sl_atlas *atlas )
+{
+	sl_atlas_repack_entry *order;
+	sl_atlas_image *img, *old;
+	unsigned char *dirty;
+	u32 i, count, pages, moved;
+
+	count = vul_vector_size( atlas->images );
+	pages = vul_vector_size( atlas->pages );
+	if( count == 0 ) {
+		return 0;
+	}
+
+	// Remember where everything was, then place the images again, tallest first
+	order = ( sl_atlas_repack_entry* )SL_ALLOC( sizeof( sl_atlas_repack_entry ) * count );
+	old = ( sl_atlas_image* )SL_ALLOC( sizeof( sl_atlas_image ) * count );
+	memcpy( old, vul_vector_begin( atlas->images ), sizeof( sl_atlas_image ) * count );
+	for( i = 0; i < count; ++i ) {
+		order[ i ].height = old[ i ].height;
+		order[ i ].width = old[ i ].width;
+		order[ i ].image = i;
+	}
+	qsort( order, count, sizeof( sl_atlas_repack_entry ), sl_atlas_repack_compare );
+	for( i = 0; i < pages; ++i ) {
+		sl_atlas_skyline_reset( atlas, ( sl_atlas_page* )vul_vector_get( atlas->pages, i ) );
+	}
+	for( i = 0; i < count; ++i ) {
+		sl_atlas_place( atlas, ( sl_atlas_image* )vul_vector_get( atlas->images, order[ i ].image ) );
+	}
+
+	// Pages that lost or gained an image are redrawn from scratch
+	pages = vul_vector_size( atlas->pages );
+	dirty = ( unsigned char* )SL_ALLOC( pages );
+	memset( dirty, 0, pages );
+	moved = 0;
+	for( i = 0; i < count; ++i ) {
+		img = ( sl_atlas_image* )vul_vector_get( atlas->images, i );
+		if( img->page != old[ i ].page || img->x != old[ i ].x || img->y != old[ i ].y ) {
+			dirty[ img->page ] = 1;
+			dirty[ old[ i ].page ] = 1;
+			++moved;
+		}
+	}
+	for( i = 0; i < pages; ++i ) {
+		if( dirty[ i ] ) {
+			sl_atlas_clear( atlas, i );
+		}
+	}
+	for( i = 0; i < count; ++i ) {
+		img = ( sl_atlas_image* )vul_vector_get( atlas->images, i );
+		if( dirty[ img->page ] ) {
+			sl_atlas_upload( atlas, img->page, img->x, img->y, img->width, img->height, img->pixels );
+		}
+	}
+
+	SL_DEALLOC( dirty );
+	SL_DEALLOC( old );
+	SL_DEALLOC( order );
+	return moved;
+}
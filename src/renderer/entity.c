@@ -15,23 +15,18 @@
 #include "renderer/entity.h"
 
 void sl_entity_aabb( sl_box *result, const sl_entity *q )
+{
+	sl_entity_aabb_transform( result, &q->transform );
+}
+
+void sl_entity_aabb_transform( sl_box *result, const sl_affine *transform )
 {
 	v2 min_p1, max_p1;
-	v2 min_p2, max_p2, offset;
-	m22 m2;
 
 	min_p1 = vec2( -1.0f, -1.0f );
 	max_p1 = vec2( 1.0f,  1.0f );
-	m2 = mtruncate42( &q->world_matrix );
-
-	min_p2 = vmulm2( &m2, min_p1 );
-	max_p2 = vmulm2( &m2, max_p1 );
-
-	offset.x = q->world_matrix.A[ 12 ];
-	offset.y = q->world_matrix.A[ 13 ];
-
-	min_p1 = vadd2( min_p2, offset );
-	max_p1 = vadd2( max_p2, offset );
+	sl_affine_transform( &min_p1, transform, &min_p1 );
+	sl_affine_transform( &max_p1, transform, &max_p1 );
 
 	result->min_p = vmin2( min_p1, max_p1 );
 	result->max_p = vmax2( min_p1, max_p1 );
@@ -39,26 +34,26 @@ void sl_entity_aabb( sl_box *result, const sl_entity *q )
 
 void sl_entity_create_world_matrix( sl_entity *result, const v2 *center, const v2 *scale, const float rotation )
 {
-	float cosr, sinr;
-
-	cosr = ( float )cos( rotation );
-	sinr = ( float )sin( rotation );
-
-	result->world_matrix.A[ 0 ] = scale->x * cosr;
-	result->world_matrix.A[ 1 ] = scale->x * -sinr;
-	result->world_matrix.A[ 2 ] = result->world_matrix.A[ 3 ] = 0.0f;
-	
-	result->world_matrix.A[ 4 ] = -scale->y * sinr;
-	result->world_matrix.A[ 5 ] = -scale->y * cosr; // Y is flipped in OpenGL
-	result->world_matrix.A[ 6 ] = result->world_matrix.A[ 7 ] = 0.0f;
-
-	result->world_matrix.A[ 10 ] = 1.0f;
-	result->world_matrix.A[ 8 ] = result->world_matrix.A[ 9 ] = result->world_matrix.A[ 11 ] = 0.0f;
-
-	result->world_matrix.A[ 12 ] = center->x;
-	result->world_matrix.A[ 13 ] = center->y;
-	result->world_matrix.A[ 14 ] = 0.0f;
-	result->world_matrix.A[ 15 ] = 1.0f;
+	sl_affine_set_trs( &result->transform, center, scale, rotation );
+}
+
+void sl_entity_world_matrix( m44 *result, const v2 *center, const v2 *scale, const float rotation )
+{
+	sl_affine a;
+
+	sl_affine_set_trs( &a, center, scale, rotation );
+	sl_affine_to_m44( result, &a );
+}
+
+u64 sl_entity_sort_key( const unsigned int layer, const unsigned int program_id, const unsigned int texture_id, const unsigned int renderable_id )
+{
+	u64 key;
+
+	key = ( u64 )( layer & ( ( 1u << SL_SORT_KEY_LAYER_BITS ) - 1u ) );
+	key = ( key << SL_SORT_KEY_PROGRAM_BITS ) | ( program_id & ( ( 1u << SL_SORT_KEY_PROGRAM_BITS ) - 1u ) );
+	key = ( key << SL_SORT_KEY_TEXTURE_BITS ) | ( texture_id & ( ( 1u << SL_SORT_KEY_TEXTURE_BITS ) - 1u ) );
+	key = ( key << SL_SORT_KEY_RENDERABLE_BITS ) | ( renderable_id & ( ( 1u << SL_SORT_KEY_RENDERABLE_BITS ) - 1u ) );
+	return key;
 }
 
 int sl_entity_sort( const void *a, const void *b )
@@ -68,37 +63,66 @@ int sl_entity_sort( const void *a, const void *b )
 	qa = ( const sl_entity* )a;
 	qb = ( const sl_entity* )b;
 
-	return qa->program_id != qb->program_id ?
-				( qa->program_id < qb->program_id )
-			  : ( qa->texture_id < qb->texture_id );
+	// vul_sort wants a three-way comparison; a boolean leaves thynnsort unsorted
+	if( qa->program_id != qb->program_id ) {
+		return qa->program_id < qb->program_id ? -1 : 1;
+	}
+	if( qa->texture_id != qb->texture_id ) {
+		return qa->texture_id < qb->texture_id ? -1 : 1;
+	}
+	if( qa->renderable_id != qb->renderable_id ) {
+		return qa->renderable_id < qb->renderable_id ? -1 : 1;
+	}
+	return 0;
 }
 
-void sl_entity_bind( sl_entity *entity, v2 *camera_offset, sl_program *prog )
+/**
+ * Calculates the camera-relative transform and the (possibly flipped) uvs of an entity.
+ */
+static void sl_entity_prepare( sl_affine *mat, sl_box *uvs, const sl_affine *transform, const sl_box *entity_uvs, const v2 *flip_uvs, const v2 *camera_offset )
 {
-	m44 mat;
-	sl_box uvs;
 	f32 tmp;
 
 	// Calculate offset into matrix
-	memcpy( &mat, &entity->world_matrix, sizeof( m44 ) );
-	mat.A[ 12 ] -= camera_offset->x;
-	mat.A[ 13 ] -= camera_offset->y;
+	*mat = *transform;
+	mat->a20 -= camera_offset->x;
+	mat->a21 -= camera_offset->y;
 
 	// Calculate the uvs; they may be flipped
-	sl_bset( &uvs, &entity->uvs );
-	if( entity->flip_uvs.x != 0.f ) {
-		tmp = uvs.min_p.x;
-		uvs.min_p.x = uvs.max_p.x;
-		uvs.max_p.x = tmp;
+	sl_bset( uvs, entity_uvs );
+	if( flip_uvs->x != 0.f ) {
+		tmp = uvs->min_p.x;
+		uvs->min_p.x = uvs->max_p.x;
+		uvs->max_p.x = tmp;
 	}
-	if( entity->flip_uvs.y != 0.f ) {
-		tmp = uvs.min_p.y;
-		uvs.min_p.y = uvs.max_p.y;
-		uvs.max_p.y = tmp;
+	if( flip_uvs->y != 0.f ) {
+		tmp = uvs->min_p.y;
+		uvs->min_p.y = uvs->max_p.y;
+		uvs->max_p.y = tmp;
 	}
+}
+
+void sl_entity_bind( const sl_affine *transform, const float color[ 4 ], const sl_box *uvs, const v2 *flip_uvs, const v2 *camera_offset, sl_program *prog )
+{
+	sl_affine mat;
+	m44 mvp;
+	sl_box prepared_uvs;
+
+	sl_entity_prepare( &mat, &prepared_uvs, transform, uvs, flip_uvs, camera_offset );
+
+	// Set world matrix; 24 bytes for programs that take the affine form, the full 64 otherwise
+	if( prog->loc_transform != -1 ) {
+		glUniform2fv( prog->loc_transform, 3, ( ( GLfloat* )&mat.A[ 0 ] ) );
+	} else {
+		sl_affine_to_m44( &mvp, &mat );
+		glUniformMatrix4fv( prog->loc_mvp, 1, GL_FALSE, ( ( GLfloat* )&mvp.A[ 0 ] ) );
+	}
+	glUniform4fv( prog->loc_color, 1, ( ( const GLfloat* )color ) );
+	glUniform4fv( prog->loc_texcoord_offset_scale, 1, ( ( GLfloat* )&prepared_uvs ) );
+}
 
-	// Set world matrix
-	glUniformMatrix4fv( glGetUniformLocation( prog->gl_prog_id, "mvp" ), 1, GL_FALSE, ( ( GLfloat* )&mat.A[ 0 ] ) );
-	glUniform4fv( glGetUniformLocation( prog->gl_prog_id, "color" ), 1, ( ( GLfloat* )&entity->color ) );
-	glUniform4fv( glGetUniformLocation( prog->gl_prog_id, "texcoord_offset_scale" ), 1, ( ( GLfloat* )&uvs ) );
+void sl_entity_pack_instance( sl_entity_instance *result, const sl_affine *transform, const float color[ 4 ], const sl_box *uvs, const v2 *flip_uvs, const v2 *camera_offset )
+{
+	sl_entity_prepare( &result->transform, &result->texcoord_offset_scale, transform, uvs, flip_uvs, camera_offset );
+	memcpy( result->color, color, sizeof( float ) * 4 );
 }
\ No newline at end of file
@@ -34,7 +34,7 @@ const char *sl_program_default_fp_src =	"#version 120\n"
 					"}";
 #elif defined( SL_OPENGL_ES )
 const char *sl_program_default_vp_src =  "#version 110\n"
-										 "uniform mat4 mvp;\n"
+										 "uniform vec2 transform[3];\n"
 										 "uniform vec4 color;\n"
 										 "uniform vec4 texcoord_offset_scale;\n"
 										 "attribute vec2 position;\n"
@@ -45,7 +45,7 @@ const char *sl_program_default_vp_src =  "#version 110\n"
 										 "	vec2 texscale = texcoord_offset_scale.zw - texcoord_offset_scale.xy;\n"
 										 "	texcoord_out.xy = texcoord_in.xy * texscale.xy + texcoord_offset_scale.xy;\n"
 										 "	color_out = color;\n"
-										 "	gl_Position = mvp * vec4(position, 0.0, 1.0);\n"
+										 "	gl_Position = vec4(transform[0] * position.x + transform[1] * position.y + transform[2], 0.0, 1.0);\n"
 										 "}";
 
 const char *sl_program_default_fp_src =	"#version 110\n"
@@ -74,7 +74,7 @@ const char *sl_program_default_post_fp_src =	"#version 110\n"
 												"}";
 #else 
 const char *sl_program_default_vp_src =  "#version 150 core\n"
-										 "uniform mat4 mvp;\n"
+										 "uniform vec2 transform[3];\n"
 										 "uniform vec4 color;\n"
 										 "uniform vec4 texcoord_offset_scale;\n"
 										 "in vec2 position;\n"
@@ -85,7 +85,7 @@ const char *sl_program_default_vp_src =  "#version 150 core\n"
 										 "	vec2 texscale = texcoord_offset_scale.zw - texcoord_offset_scale.xy;\n"
 										 "	texcoord_out.xy = texcoord_in.xy * texscale.xy + texcoord_offset_scale.xy;\n"
 										 "	color_out = color;\n"
-										 "	gl_Position = mvp * vec4(position, 0.0, 1.0);\n"
+										 "	gl_Position = vec4(transform[0] * position.x + transform[1] * position.y + transform[2], 0.0, 1.0);\n"
 										 "}";
 
 const char *sl_program_default_fp_src =	"#version 150 core\n"
@@ -114,6 +114,30 @@ const char *sl_program_default_post_fp_src =	"#version 150 core\n"
 												"void main() {\n"
 												"    oColor = texture( tex, texcoord_out.xy ).rgba;\n"
 												"}";
+
+const char *sl_program_default_instanced_vp_src =  "#version 150 core\n"
+												   "in vec2 position;\n"
+												   "in vec2 texcoord_in;\n"
+												   "in mat3x2 instance_transform;\n"
+												   "in vec4 instance_color;\n"
+												   "in vec4 instance_texcoord_offset_scale;\n"
+												   "out vec2 texcoord_out;\n"
+												   "out vec4 color_out;\n"
+												   "void main()	{\n"
+												   "	vec2 texscale = instance_texcoord_offset_scale.zw - instance_texcoord_offset_scale.xy;\n"
+												   "	texcoord_out.xy = texcoord_in.xy * texscale.xy + instance_texcoord_offset_scale.xy;\n"
+												   "	color_out = instance_color;\n"
+												   "	gl_Position = vec4(instance_transform * vec3(position, 1.0), 0.0, 1.0);\n"
+												   "}";
+
+const char *sl_program_default_instanced_fp_src =	"#version 150 core\n"
+													"in vec2 texcoord_out;\n"
+													"in vec4 color_out;\n"
+													"out vec4 oColor;\n"
+													"uniform sampler2D tex;\n"
+													"void main() {\n"
+													"	oColor = clamp( color_out * texture( tex, texcoord_out.xy ).rgba, 0.0, 1.0 );\n"
+													"}";
 #endif
 
 
@@ -121,6 +145,15 @@ void sl_program_create( sl_program* prog )
 {
 	GLint src_len;
 
+	prog->reads_instances = SL_FALSE;
+	prog->instanced = SL_FALSE;
+	prog->loc_transform = -1;
+	prog->loc_mvp = -1;
+	prog->loc_color = -1;
+	prog->loc_texcoord_offset_scale = -1;
+	prog->loc_texture = -1;
+	prog->uniforms = vul_vector_create( sizeof( sl_program_uniform ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+
 	// Create the vertex program
 	prog->gl_vp_id = glCreateShader( GL_VERTEX_SHADER );
 	src_len = ( GLint )strlen( prog->vert_prog_src );
@@ -151,6 +184,15 @@ void sl_program_create( sl_program* prog )
 	
 	glAttachShader( prog->gl_prog_id, prog->gl_vp_id );
 	glAttachShader( prog->gl_prog_id, prog->gl_fp_id );
+
+	// Pin the attribute locations so renderables and the instance stream agree with every program
+	glBindAttribLocation( prog->gl_prog_id, SL_ATTRIB_POSITION, "position" );
+	glBindAttribLocation( prog->gl_prog_id, SL_ATTRIB_TEXCOORD, "texcoord_in" );
+#ifdef SL_INSTANCING
+	glBindAttribLocation( prog->gl_prog_id, SL_ATTRIB_INSTANCE_TRANSFORM, "instance_transform" );
+	glBindAttribLocation( prog->gl_prog_id, SL_ATTRIB_INSTANCE_COLOR, "instance_color" );
+	glBindAttribLocation( prog->gl_prog_id, SL_ATTRIB_INSTANCE_TEXCOORD_OFFSET_SCALE, "instance_texcoord_offset_scale" );
+#endif
 	glLinkProgram( prog->gl_prog_id );
 	
 	if( !sl_program_check_link( prog->gl_prog_id ) )
@@ -158,24 +200,89 @@ void sl_program_create( sl_program* prog )
 		glDeleteShader( prog->gl_vp_id );
 		glDeleteShader( prog->gl_fp_id );
 		glDeleteProgram( prog->gl_prog_id );
+		return;
+	}
+#ifdef SL_INSTANCING
+	prog->reads_instances = glGetAttribLocation( prog->gl_prog_id, "instance_transform" ) != -1;
+	prog->instanced = prog->reads_instances && sl_renderable_instancing_supported( );
+#endif
+
+	// Resolve the locations of the uniforms set every draw
+	prog->loc_transform = glGetUniformLocation( prog->gl_prog_id, "transform" );
+	prog->loc_mvp = glGetUniformLocation( prog->gl_prog_id, "mvp" );
+	prog->loc_color = glGetUniformLocation( prog->gl_prog_id, "color" );
+	prog->loc_texcoord_offset_scale = glGetUniformLocation( prog->gl_prog_id, "texcoord_offset_scale" );
+	// The default programs call the sampler "tex"; older custom programs may use "texture"
+	prog->loc_texture = glGetUniformLocation( prog->gl_prog_id, "tex" );
+	if( prog->loc_texture == -1 ) {
+		prog->loc_texture = glGetUniformLocation( prog->gl_prog_id, "texture" );
+	}
+}
+
+/**
+ * Finds a registered uniform by name, or NULL if it isn't registered.
+ */
+static sl_program_uniform *sl_program_find_uniform( sl_program *prog, const char *name )
+{
+	sl_program_uniform *it, *last_it;
+
+	vul_foreach( sl_program_uniform, it, last_it, prog->uniforms ) {
+		if( strcmp( it->name, name ) == 0 ) {
+			return it;
+		}
+	}
+	return NULL;
+}
+
+GLint sl_program_register_uniform( sl_program *prog, const char *name )
+{
+	sl_program_uniform *u;
+
+	u = sl_program_find_uniform( prog, name );
+	if( u != NULL ) {
+		return u->location;
+	}
+
+#ifdef SL_DEBUG
+	assert( strlen( name ) < SL_PROGRAM_UNIFORM_NAME_MAX );
+#else
+	if( strlen( name ) >= SL_PROGRAM_UNIFORM_NAME_MAX ) {
+		sl_print( 256, "Uniform name %s is too long to register.\n", name );
+		return glGetUniformLocation( prog->gl_prog_id, name );
 	}
+#endif
+	u = ( sl_program_uniform* )vul_vector_add_empty( prog->uniforms );
+	strcpy( u->name, name );
+	u->location = glGetUniformLocation( prog->gl_prog_id, name );
+
+	return u->location;
+}
+
+GLint sl_program_get_uniform( sl_program *prog, const char *name )
+{
+	sl_program_uniform *u;
+
+	u = sl_program_find_uniform( prog, name );
+	return u != NULL ? u->location : -1;
 }
 
 void sl_program_destroy( sl_program* prog )
 {
+	vul_vector_destroy( prog->uniforms );
 	glDeleteShader( prog->gl_vp_id );
 	glDeleteShader( prog->gl_fp_id );
 	glDeleteProgram( prog->gl_prog_id );
+	sl_gl_state_deleted( GL_CURRENT_PROGRAM, prog->gl_prog_id );
 }
 
 void sl_program_bind( sl_program* prog )
 {
-	glUseProgram( prog->gl_prog_id );
+	sl_gl_use_program( prog->gl_prog_id );
 }
 
 void sl_program_unbind( sl_program* prog )
 {
-	glUseProgram( 0 );
+	sl_gl_use_program( 0 );
 }
 
 int sl_program_check_shader_compile( GLuint prog_id, const char *src )
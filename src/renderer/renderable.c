@@ -14,6 +14,42 @@
  */
 #include "renderer/renderable.h"
 
+#include <stddef.h>
+
+#ifndef SL_LEGACY_OPENGL
+/*
+ * Creates the vertex array object with its vertex and index buffers. The
+ * attribute arrays and the index buffer are recorded in the vertex array, so
+ * binding it is all a draw needs.
+ */
+static void sl_renderable_upload( sl_renderable *ren, const sl_vertex *vertices, const unsigned short *indices )
+{
+	// Create the vertex array object
+	glGenVertexArrays( 1, &ren->arrayBufferIndex );
+	sl_gl_bind_vertex_array( ren->arrayBufferIndex );
+
+	// Create and upload the vertex data
+	glGenBuffers( 1, &ren->vertBufferObjectIndex );
+	sl_gl_bind_array_buffer( ren->vertBufferObjectIndex );
+	glBufferData( GL_ARRAY_BUFFER, ren->vertex_count * sizeof( sl_vertex ), vertices, GL_STATIC_DRAW );
+
+	// Set and enable attribute pointers
+	glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof( sl_vertex ), 0 );
+	glVertexAttribPointer( 1, 2, GL_FLOAT, GL_TRUE, sizeof( sl_vertex ), ( GLvoid* )( 2 * sizeof( GLfloat ) ) );
+	glEnableVertexAttribArray( 0 );
+	glEnableVertexAttribArray( 1 );
+
+	// Create the index buffer and upload it; bound while the vertex array is, so it keeps it
+	glGenBuffers( 1, &ren->indexBufferObjectIndex );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ren->indexBufferObjectIndex );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, ren->index_count * sizeof( unsigned short ), indices, GL_STATIC_DRAW );
+
+	// Unbind the vertex array before the buffers, so it doesn't lose them
+	sl_gl_bind_vertex_array( 0 );
+	sl_gl_bind_array_buffer( 0 );
+}
+#endif
+
 void sl_renderable_create_quad( sl_renderable *ren, sl_box *uvs )
 {
 #ifdef SL_LEGACY_OPENGL
@@ -65,33 +101,7 @@ void sl_renderable_create_quad( sl_renderable *ren, sl_box *uvs )
 	triangles[ 4 ] = 2;
 	triangles[ 5 ] = 3;
 
-	// Create the vertex array object
-	glGenVertexArrays( 1, &ren->arrayBufferIndex );
-	glBindVertexArray( ren->arrayBufferIndex );
-	
-	// Create and upload the vertex data
-	glGenBuffers(1, &ren->vertBufferObjectIndex);
-	glBindBuffer( GL_ARRAY_BUFFER, ren->vertBufferObjectIndex );
-	glBufferData( GL_ARRAY_BUFFER, 4 * sizeof( sl_vertex ), NULL, GL_STATIC_DRAW );
-	glBufferSubData( GL_ARRAY_BUFFER, 0, 4 * sizeof( sl_vertex ), vertices);
-
-	// Set attribute pointers
-	glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof( sl_vertex ), 0 );
-	glVertexAttribPointer( 1, 2, GL_FLOAT, GL_TRUE, sizeof( sl_vertex ), (GLvoid*)( 2 * sizeof( GLfloat ) ) );
-
-	// Unbind buffer object and buffer
-	glEnableVertexAttribArray( 0 );
-	glBindVertexArray( 0 );
-	glBindBuffer( GL_ARRAY_BUFFER, 0 );
-
-	// Create the index buffer and upload it
-	glGenBuffers( 1, &ren->indexBufferObjectIndex );
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ren->indexBufferObjectIndex );
-	glBufferData( GL_ELEMENT_ARRAY_BUFFER, 2 * 3 * sizeof( unsigned short ), NULL, GL_STATIC_DRAW );
-	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, 2 * 3 * sizeof( unsigned short ), triangles );
-
-	// Unbind the Index buffer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	sl_renderable_upload( ren, vertices, triangles );
 #endif
 }
 
@@ -151,33 +161,7 @@ void sl_renderable_create_hex_pointy( sl_renderable *ren, sl_box *uv_aabb )
 		triangles[ i * 3 + 2 ] = 1 + ( ( 1 + i ) % 6 );
 	}
 	
-	// Create the vertex array object
-	glGenVertexArrays( 1, &ren->arrayBufferIndex );
-	glBindVertexArray( ren->arrayBufferIndex );
-
-	// Create and upload the vertex data
-	glGenBuffers( 1, &ren->vertBufferObjectIndex );
-	glBindBuffer( GL_ARRAY_BUFFER, ren->vertBufferObjectIndex );
-	glBufferData( GL_ARRAY_BUFFER, 7 * sizeof( sl_vertex ), NULL, GL_STATIC_DRAW );
-	glBufferSubData( GL_ARRAY_BUFFER, 0, 7 * sizeof( sl_vertex ), vertices );
-
-	// Set attribute pointers
-	glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof( sl_vertex ), 0 );
-	glVertexAttribPointer( 1, 2, GL_FLOAT, GL_TRUE, sizeof( sl_vertex ), ( GLvoid* )( 2 * sizeof( GLfloat ) ) );
-
-	// Unbind buffer object and buffer
-	glEnableVertexAttribArray( 0 );
-	glBindVertexArray( 0 );
-	glBindBuffer( GL_ARRAY_BUFFER, 0 );
-
-	// Create the index buffer and upload it
-	glGenBuffers( 1, &ren->indexBufferObjectIndex );
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ren->indexBufferObjectIndex );
-	glBufferData( GL_ELEMENT_ARRAY_BUFFER, 18 * sizeof( unsigned short ), NULL, GL_STATIC_DRAW );
-	glBufferSubData( GL_ELEMENT_ARRAY_BUFFER, 0, 18 * sizeof( unsigned short ), triangles );
-
-	// Unbind the Index buffer
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	sl_renderable_upload( ren, vertices, triangles );
 #endif
 }
 
@@ -237,33 +221,7 @@ void sl_renderable_create_hex_flat( sl_renderable *ren, sl_box *uv_aabb )
 		triangles[ i * 3 + 2 ] = 1 + ( ( 1 + i ) % 6 );
 	}
 
-	// Create the vertex array object
-	glGenVertexArrays( 1, &ren->arrayBufferIndex );
-	glBindVertexArray( ren->arrayBufferIndex );
-
-	// Create and upload the vertex data
-	glGenBuffers( 1, &ren->vertBufferObjectIndex );
-	glBindBuffer( GL_ARRAY_BUFFER, ren->vertBufferObjectIndex );
-	glBufferData( GL_ARRAY_BUFFER, 7 * sizeof( sl_vertex ), NULL, GL_STATIC_DRAW );
-	glBufferSubData( GL_ARRAY_BUFFER, 0, 7 * sizeof( sl_vertex ), vertices );
-
-	// Set attribute pointers
-	glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof( sl_vertex ), 0 );
-	glVertexAttribPointer( 1, 2, GL_FLOAT, GL_TRUE, sizeof( sl_vertex ), ( GLvoid* )( 2 * sizeof( GLfloat ) ) );
-
-	// Unbind buffer object and buffer
-	glEnableVertexAttribArray( 0 );
-	glBindVertexArray( 0 );
-	glBindBuffer( GL_ARRAY_BUFFER, 0 );
-
-	// Create the index buffer and upload it
-	glGenBuffers( 1, &ren->indexBufferObjectIndex );
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ren->indexBufferObjectIndex );
-	glBufferData( GL_ELEMENT_ARRAY_BUFFER, 18 * sizeof( unsigned short ), NULL, GL_STATIC_DRAW );
-	glBufferSubData( GL_ELEMENT_ARRAY_BUFFER, 0, 18 * sizeof( unsigned short ), triangles );
-
-	// Unbind the Index buffer
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	sl_renderable_upload( ren, vertices, triangles );
 #endif
 }
 
@@ -276,31 +234,88 @@ void sl_renderable_destroy( sl_renderable *ren )
 	// Destroy our buffers
 	glDeleteBuffers( 1, &ren->indexBufferObjectIndex );
 	glDeleteBuffers( 1, &ren->vertBufferObjectIndex );
+	sl_gl_state_deleted( GL_ARRAY_BUFFER_BINDING, ren->vertBufferObjectIndex );
 	glDeleteVertexArrays( 1, &ren->arrayBufferIndex );
+	sl_gl_state_deleted( GL_VERTEX_ARRAY_BINDING, ren->arrayBufferIndex );
 #endif
 }
 
 void sl_renderable_bind( sl_renderable *ren )
 {
 #ifndef SL_LEGACY_OPENGL
-	glBindVertexArray( ren->arrayBufferIndex );
-	glBindBuffer( GL_ARRAY_BUFFER, ren->vertBufferObjectIndex );
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, ren->indexBufferObjectIndex );
-	glEnableVertexAttribArray( 0 );
-	glEnableVertexAttribArray( 1 );
+	sl_gl_bind_vertex_array( ren->arrayBufferIndex );
 #endif
 }
 
 void sl_renderable_unbind( )
 {
 #ifndef SL_LEGACY_OPENGL
-	glDisableVertexAttribArray( 0 );
-	glDisableVertexAttribArray( 1 );
-	glBindBuffer( GL_ARRAY_BUFFER, 0 );
-	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
-	glBindVertexArray( 0 );
+	sl_gl_bind_vertex_array( 0 );
 #endif
 }
 
 
 	
+
+#ifdef SL_INSTANCING
+int sl_renderable_instancing_supported( )
+{
+	return GLEW_VERSION_3_3 || GLEW_ARB_instanced_arrays;
+}
+
+/**
+ * Attribute divisors are core in GL 3.3; the 3.2 context we ask for may only have
+ * them through ARB_instanced_arrays. Only called if one of them is there.
+ */
+static void sl_renderable_attrib_divisor( GLuint index, GLuint divisor )
+{
+	if( GLEW_VERSION_3_3 ) {
+		glVertexAttribDivisor( index, divisor );
+	} else {
+		glVertexAttribDivisorARB( index, divisor );
+	}
+}
+
+void sl_renderable_bind_instances( sl_renderable *ren, GLuint instance_buffer, u32 offset )
+{
+	GLuint i;
+
+	sl_gl_bind_array_buffer( instance_buffer );
+
+	// The transform is passed as three vec2 columns
+	for( i = 0; i < 3; ++i ) {
+		glVertexAttribPointer( SL_ATTRIB_INSTANCE_TRANSFORM + i, 2, GL_FLOAT, GL_FALSE, sizeof( sl_entity_instance ), 
+							   ( GLvoid* )( offset + offsetof( sl_entity_instance, transform ) + i * 2 * sizeof( GLfloat ) ) );
+		sl_renderable_attrib_divisor( SL_ATTRIB_INSTANCE_TRANSFORM + i, 1 );
+		glEnableVertexAttribArray( SL_ATTRIB_INSTANCE_TRANSFORM + i );
+	}
+	glVertexAttribPointer( SL_ATTRIB_INSTANCE_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof( sl_entity_instance ), 
+						   ( GLvoid* )( offset + offsetof( sl_entity_instance, color ) ) );
+	sl_renderable_attrib_divisor( SL_ATTRIB_INSTANCE_COLOR, 1 );
+	glEnableVertexAttribArray( SL_ATTRIB_INSTANCE_COLOR );
+	glVertexAttribPointer( SL_ATTRIB_INSTANCE_TEXCOORD_OFFSET_SCALE, 4, GL_FLOAT, GL_FALSE, sizeof( sl_entity_instance ), 
+						   ( GLvoid* )( offset + offsetof( sl_entity_instance, texcoord_offset_scale ) ) );
+	sl_renderable_attrib_divisor( SL_ATTRIB_INSTANCE_TEXCOORD_OFFSET_SCALE, 1 );
+	glEnableVertexAttribArray( SL_ATTRIB_INSTANCE_TEXCOORD_OFFSET_SCALE );
+}
+
+void sl_renderable_set_instance( const sl_entity_instance *instance )
+{
+	GLuint i;
+
+	for( i = 0; i < 3; ++i ) {
+		glVertexAttrib2fv( SL_ATTRIB_INSTANCE_TRANSFORM + i, ( const GLfloat* )&instance->transform + i * 2 );
+	}
+	glVertexAttrib4fv( SL_ATTRIB_INSTANCE_COLOR, instance->color );
+	glVertexAttrib4fv( SL_ATTRIB_INSTANCE_TEXCOORD_OFFSET_SCALE, ( const GLfloat* )&instance->texcoord_offset_scale );
+}
+
+void sl_renderable_unbind_instances( )
+{
+	GLuint i;
+
+	for( i = SL_ATTRIB_INSTANCE_TRANSFORM; i <= SL_ATTRIB_INSTANCE_TEXCOORD_OFFSET_SCALE; ++i ) {
+		glDisableVertexAttribArray( i );
+	}
+}
+#endif
@@ -23,16 +23,156 @@
 
 #include "slenderer.h"
 
+// Up to this many queued entities (and removals) are moved into place one by one; more rebuild the
+// layer's order. A move costs about a microsecond in a 100k layer and a rebuild about 2ms, and it
+// has to stay fixed, as removals rely on the sort rebuilding once they stop fixing up the order.
+#define SL_SCENE_RESORT_MAX_MOVES 256
+
+#ifdef SL_SOA_LAYERS
+	#define SL_LAYER_IS_QUEUED( scene, l, i ) ( ( scene )->layers[ l ].flags[ i ] & SL_ENTITY_FLAG_QUEUED )
+	#define SL_LAYER_SET_QUEUED( scene, l, i ) ( ( scene )->layers[ l ].flags[ i ] |= SL_ENTITY_FLAG_QUEUED )
+	#define SL_LAYER_CLEAR_QUEUED( scene, l, i ) ( ( scene )->layers[ l ].flags[ i ] &= ~SL_ENTITY_FLAG_QUEUED )
+#else
+	#define SL_LAYER_IS_QUEUED( scene, l, i ) ( SL_LAYER_ENTITY( scene, l, i )->queued )
+	#define SL_LAYER_SET_QUEUED( scene, l, i ) ( SL_LAYER_ENTITY( scene, l, i )->queued = 1 )
+	#define SL_LAYER_CLEAR_QUEUED( scene, l, i ) ( SL_LAYER_ENTITY( scene, l, i )->queued = 0 )
+#endif
+
+#ifdef SL_SOA_LAYERS
+/**
+ * Grows every stream of a layer to hold at least the given number of entities.
+ */
+static void sl_layer_reserve( sl_layer *layer, u32 capacity )
+{
+	if( capacity <= layer->capacity ) {
+		return;
+	}
+	capacity = SL_MAX( capacity, layer->capacity * 2 );
+	capacity = SL_MAX( capacity, SL_LAYER_CHUNK_SIZE );
+
+	layer->ids = ( unsigned int* )SL_REALLOC( layer->ids, sizeof( unsigned int ) * capacity );
+	layer->transforms = ( sl_affine* )SL_REALLOC( layer->transforms, sizeof( sl_affine ) * capacity );
+	layer->colors = ( v4* )SL_REALLOC( layer->colors, sizeof( v4 ) * capacity );
+	layer->uvs = ( sl_box* )SL_REALLOC( layer->uvs, sizeof( sl_box ) * capacity );
+	layer->flip_uvs = ( v2* )SL_REALLOC( layer->flip_uvs, sizeof( v2 ) * capacity );
+	layer->keys = ( sl_entity_key* )SL_REALLOC( layer->keys, sizeof( sl_entity_key ) * capacity );
+	layer->sort_keys = ( u64* )SL_REALLOC( layer->sort_keys, sizeof( u64 ) * capacity );
+	layer->flags = ( u8* )SL_REALLOC( layer->flags, sizeof( u8 ) * capacity );
+	layer->capacity = capacity;
+}
+
+static void sl_layer_destroy( sl_layer *layer )
+{
+	if( layer->capacity ) {
+		SL_DEALLOC( layer->ids );
+		SL_DEALLOC( layer->transforms );
+		SL_DEALLOC( layer->colors );
+		SL_DEALLOC( layer->uvs );
+		SL_DEALLOC( layer->flip_uvs );
+		SL_DEALLOC( layer->keys );
+		SL_DEALLOC( layer->sort_keys );
+		SL_DEALLOC( layer->flags );
+	}
+	memset( layer, 0, sizeof( sl_layer ) );
+}
+
+/**
+ * Moves the entity at index from to index to in every stream.
+ */
+static void sl_layer_move( sl_layer *layer, u32 to, u32 from )
+{
+	layer->ids[ to ] = layer->ids[ from ];
+	layer->transforms[ to ] = layer->transforms[ from ];
+	layer->colors[ to ] = layer->colors[ from ];
+	layer->uvs[ to ] = layer->uvs[ from ];
+	layer->flip_uvs[ to ] = layer->flip_uvs[ from ];
+	layer->keys[ to ] = layer->keys[ from ];
+	layer->sort_keys[ to ] = layer->sort_keys[ from ];
+	layer->flags[ to ] = layer->flags[ from ];
+}
+#endif
+
+/**
+ * Grows the scene's sort buffers to sort a layer of the given size.
+ */
+static void sl_scene_sort_reserve( sl_scene *scene, u32 count )
+{
+	if( count <= scene->sort_capacity ) {
+		return;
+	}
+	count = SL_MAX( count, scene->sort_capacity * 2 );
+	scene->sort_entries = ( sl_layer_sort_entry* )SL_REALLOC( scene->sort_entries, sizeof( sl_layer_sort_entry ) * count * 2 );
+	scene->sort_capacity = count;
+}
+
+/**
+ * Stable LSD radix sort of sort entries by key, a byte per pass. Bytes every key
+ * shares (the layer, the high bits of small ids) are found up front and skipped,
+ * so a layer with a few programs and textures takes two or three passes.
+ * tmp must hold as many entries as entries; returns whichever of the two ends
+ * up holding the result.
+ */
+static sl_layer_sort_entry *sl_scene_radix_sort( sl_layer_sort_entry *entries, sl_layer_sort_entry *tmp, u32 count )
+{
+	u32 hist[ 256 ];
+	u32 i, shift, sum, c;
+	u64 varying, all_or, all_and;
+	sl_layer_sort_entry *src, *dst, *swap;
+
+	all_or = 0;
+	all_and = ~( u64 )0;
+	for( i = 0; i < count; ++i ) {
+		all_or |= entries[ i ].key;
+		all_and &= entries[ i ].key;
+	}
+	varying = all_or ^ all_and;
+
+	src = entries;
+	dst = tmp;
+	for( shift = 0; shift < 64; shift += 8 ) {
+		if( ( ( varying >> shift ) & 0xff ) == 0 ) {
+			continue;
+		}
+		memset( hist, 0, sizeof( hist ) );
+		for( i = 0; i < count; ++i ) {
+			++hist[ ( src[ i ].key >> shift ) & 0xff ];
+		}
+		sum = 0;
+		for( i = 0; i < 256; ++i ) {
+			c = hist[ i ];
+			hist[ i ] = sum;
+			sum += c;
+		}
+		for( i = 0; i < count; ++i ) {
+			dst[ hist[ ( src[ i ].key >> shift ) & 0xff ]++ ] = src[ i ];
+		}
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+	return src;
+}
+
 void sl_scene_create( sl_scene *scene, u32 parent_window_id, unsigned int scene_id, u32 post_program_id )
 {
 	unsigned int i;
 	sl_box uvs;
 
 	for( i = 0; i < SL_MAX_LAYERS; ++i ) {
+#ifdef SL_SOA_LAYERS
+		memset( &scene->layers[ i ], 0, sizeof( sl_layer ) );
+#else
 		scene->layers[ i ] = vul_vector_create( sizeof( sl_entity ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+#endif
+		scene->resort[ i ] = vul_vector_create( sizeof( unsigned int ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+		scene->order[ i ] = vul_vector_create( sizeof( u32 ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
 	}
 	scene->layer_dirty = 0;
-	scene->next_entity_id = 0;
+	scene->sort_entries = NULL;
+	scene->sort_capacity = 0;
+	scene->slots = vul_vector_create( sizeof( sl_scene_slot ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	scene->free_slot = SL_ENTITY_NO_SLOT;
+	sl_spatial_create( &scene->spatial );
 	scene->window_id = parent_window_id;
 	scene->scene_id = scene_id;
 
@@ -52,10 +192,222 @@ void sl_scene_destroy( sl_scene *scene )
 	unsigned int i;
 
 	for( i = 0; i < SL_MAX_LAYERS; ++i ) {
+#ifdef SL_SOA_LAYERS
+		sl_layer_destroy( &scene->layers[ i ] );
+#else
 		vul_vector_destroy( scene->layers[ i ] );
+#endif
+		vul_vector_destroy( scene->resort[ i ] );
+		vul_vector_destroy( scene->order[ i ] );
+	}
+	vul_vector_destroy( scene->slots );
+	sl_spatial_destroy( &scene->spatial );
+	if( scene->sort_capacity ) {
+		SL_DEALLOC( scene->sort_entries );
 	}
+	scene->sort_entries = NULL;
+	scene->sort_capacity = 0;
 	scene->layer_dirty = 0;
-	scene->next_entity_id = 0;
+	scene->free_slot = SL_ENTITY_NO_SLOT;
+}
+
+/**
+ * Finds the slot of an entity id, or NULL if the id is stale or not in the given layer.
+ */
+static sl_scene_slot *sl_scene_find_slot( sl_scene *scene, const unsigned int id, const unsigned int layer )
+{
+	sl_scene_slot *slot;
+	u32 index;
+
+	index = id & SL_ENTITY_SLOT_MASK;
+	if( index >= vul_vector_size( scene->slots ) ) {
+		return NULL;
+	}
+	slot = ( sl_scene_slot* )vul_vector_get( scene->slots, index );
+	if( slot->layer == SL_ENTITY_FREE_SLOT 
+		|| slot->generation != ( id >> SL_ENTITY_SLOT_BITS ) ) {
+		return NULL;
+	}
+	if( layer != 0xffffffff ) {
+#ifdef SL_DEBUG
+		assert( layer < SL_MAX_LAYERS );
+#endif
+		if( slot->layer != layer ) {
+			return NULL;
+		}
+	}
+	return slot;
+}
+
+/**
+ * Queues the entity at the given index for re-sorting, once, and marks its layer.
+ */
+static void sl_scene_queue_resort( sl_scene *scene, const unsigned int layer, const u32 index )
+{
+	if( SL_LAYER_IS_QUEUED( scene, layer, index ) ) {
+		return;
+	}
+	SL_LAYER_SET_QUEUED( scene, layer, index );
+	vul_vector_add( scene->resort[ layer ], &SL_LAYER_ID( scene, layer, index ) );
+	scene->layer_dirty |= 1 << layer;
+}
+
+/**
+ * The position of (key, index) in a layer's render order, which is sorted by the
+ * entities' sort keys, then their indices: where its entry is, or would go.
+ */
+static u32 sl_scene_order_find( sl_scene *scene, const unsigned int layer, const u64 key, const u32 index )
+{
+	u32 *order;
+	u32 lo, hi, mid;
+	u64 k;
+
+	order = ( u32* )vul_vector_begin( scene->order[ layer ] );
+	lo = 0;
+	hi = vul_vector_size( scene->order[ layer ] );
+	while( lo < hi ) {
+		mid = lo + ( hi - lo ) / 2;
+		k = SL_LAYER_SORT_KEY( scene, layer, order[ mid ] );
+		if( k < key || ( k == key && order[ mid ] < index ) ) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/**
+ * Moves the entry at position from of a layer's render order to position to,
+ * shifting only the entries in between.
+ */
+static void sl_scene_order_move( sl_scene *scene, const unsigned int layer, const u32 from, const u32 to )
+{
+	u32 *order;
+	u32 index;
+
+	order = ( u32* )vul_vector_begin( scene->order[ layer ] );
+	index = order[ from ];
+	if( to > from ) {
+		memmove( &order[ from ], &order[ from + 1 ], sizeof( u32 ) * ( to - from ) );
+	} else if( to < from ) {
+		memmove( &order[ to + 1 ], &order[ to ], sizeof( u32 ) * ( from - to ) );
+	}
+	order[ to ] = index;
+}
+
+/**
+ * Moves an entity's entry in the render order to where the given key puts it,
+ * and makes that its sort key. Entities not in the order yet (added since the
+ * last sort) get a new entry.
+ */
+static void sl_scene_order_update( sl_scene *scene, const unsigned int layer, const u32 index, const u64 key )
+{
+	u32 from, to, count;
+
+	count = vul_vector_size( scene->order[ layer ] );
+	from = sl_scene_order_find( scene, layer, SL_LAYER_SORT_KEY( scene, layer, index ), index );
+	if( from < count && *( u32* )vul_vector_get( scene->order[ layer ], from ) == index ) {
+		if( key == SL_LAYER_SORT_KEY( scene, layer, index ) ) {
+			return;
+		}
+		// The entry is still in the array, so if it goes further down it lands one earlier
+		to = sl_scene_order_find( scene, layer, key, index );
+		if( to > from ) {
+			--to;
+		}
+	} else {
+		to = sl_scene_order_find( scene, layer, key, index );
+		from = count;
+		*( u32* )vul_vector_add_empty( scene->order[ layer ] ) = index;
+	}
+	sl_scene_order_move( scene, layer, from, to );
+	SL_LAYER_SORT_KEY( scene, layer, index ) = key;
+}
+
+/**
+ * Fixes up the render order for the removal of the entity at index, which the
+ * entity at last is about to replace: drops the removed one's entry and gives the
+ * moved one's the new index (which may reorder it among entities with equal keys).
+ */
+static void sl_scene_order_remove( sl_scene *scene, const unsigned int layer, const u32 index, const u32 last )
+{
+	u32 *order;
+	u32 pos, to, count;
+
+	count = vul_vector_size( scene->order[ layer ] );
+	pos = sl_scene_order_find( scene, layer, SL_LAYER_SORT_KEY( scene, layer, index ), index );
+	if( pos < count && *( u32* )vul_vector_get( scene->order[ layer ], pos ) == index ) {
+		sl_scene_order_move( scene, layer, pos, count - 1 );
+		vul_vector_resize( scene->order[ layer ], --count, VUL_FALSE, VUL_FALSE );
+	}
+	if( index == last ) {
+		return;
+	}
+	pos = sl_scene_order_find( scene, layer, SL_LAYER_SORT_KEY( scene, layer, last ), last );
+	if( pos < count && *( u32* )vul_vector_get( scene->order[ layer ], pos ) == last ) {
+		// index < last, so the entry only ever goes up
+		to = sl_scene_order_find( scene, layer, SL_LAYER_SORT_KEY( scene, layer, last ), index );
+		sl_scene_order_move( scene, layer, pos, to );
+		order = ( u32* )vul_vector_begin( scene->order[ layer ] );
+		order[ to ] = index;
+	}
+}
+
+/**
+ * Brings a layer's render order up to date with the entities in its re-sort
+ * queue. Only the order's entity indices move, never the entities.
+ * - If few entities are queued, each is found in the order by binary search and
+ *   moved to where its new key puts it, shifting just the entries in between.
+ *   Entities whose key ended up unchanged cost two searches.
+ * - Otherwise the whole order is rebuilt with a radix sort of the layer's keys,
+ *   in a single pass over the layer.
+ */
+static void sl_scene_sort_layer( sl_scene *scene, const unsigned int layer )
+{
+	sl_layer_sort_entry *entries;
+	sl_scene_slot *slot;
+	unsigned int *ids;
+	u32 *order;
+	u32 i, j, size;
+
+	size = SL_LAYER_SIZE( scene, layer );
+	ids = ( unsigned int* )vul_vector_begin( scene->resort[ layer ] );
+
+	if( vul_vector_size( scene->resort[ layer ] ) <= SL_SCENE_RESORT_MAX_MOVES ) {
+		// Entities removed since were queued under ids that are now stale
+		for( i = 0; i < vul_vector_size( scene->resort[ layer ] ); ++i ) {
+			slot = sl_scene_find_slot( scene, ids[ i ], layer );
+			if( slot == NULL ) {
+				continue;
+			}
+			j = slot->index;
+			SL_LAYER_CLEAR_QUEUED( scene, layer, j );
+			sl_scene_order_update( scene, layer, j, sl_entity_sort_key( layer, SL_LAYER_PROGRAM( scene, layer, j ),
+																			SL_LAYER_TEXTURE( scene, layer, j ),
+																			SL_LAYER_RENDERABLE( scene, layer, j ) ) );
+		}
+		vul_vector_resize( scene->resort[ layer ], 0, VUL_FALSE, VUL_FALSE );
+		return;
+	}
+
+	vul_vector_resize( scene->resort[ layer ], 0, VUL_FALSE, VUL_FALSE );
+	sl_scene_sort_reserve( scene, size );
+	entries = scene->sort_entries;
+	for( i = 0; i < size; ++i ) {
+		SL_LAYER_SORT_KEY( scene, layer, i ) = sl_entity_sort_key( layer, SL_LAYER_PROGRAM( scene, layer, i ),
+																	SL_LAYER_TEXTURE( scene, layer, i ),
+																	SL_LAYER_RENDERABLE( scene, layer, i ) );
+		SL_LAYER_CLEAR_QUEUED( scene, layer, i );
+		entries[ i ].key = SL_LAYER_SORT_KEY( scene, layer, i );
+		entries[ i ].index = i;
+	}
+	// The radix sort is stable, so equal keys stay in index order
+	entries = sl_scene_radix_sort( entries, entries + size, size );
+	order = ( u32* )vul_vector_resize( scene->order[ layer ], size, VUL_FALSE, VUL_FALSE );
+	for( i = 0; i < size; ++i ) {
+		order[ i ] = entries[ i ].index;
+	}
 }
 
 void sl_scene_sort( sl_scene *scene )
@@ -66,7 +418,7 @@ void sl_scene_sort( sl_scene *scene )
 		if( ( scene->layer_dirty & ( 1 << i ) ) == 0 ) {
 			continue;
 		}
-		vul_sort_vector( scene->layers[ i ], &sl_entity_sort, 0, vul_vector_size( scene->layers[ i ] ) - 1 );
+		sl_scene_sort_layer( scene, i );
 	}
 	scene->layer_dirty = 0;
 }
@@ -84,158 +436,353 @@ unsigned int sl_scene_add_sprite( sl_scene *scene, const unsigned int layer,
 								  const sl_box *uvs, const v2 *flip_uvs,
 								  const float color[ 4 ], unsigned char is_hidden )
 {
+#ifdef SL_SOA_LAYERS
+	sl_layer *l;
+#else
 	sl_entity *q;
+#endif
+	sl_scene_slot *slot;
+	sl_box aabb;
+	u32 index, i;
+	float *c;
 
 #ifdef SL_DEBUG
 	assert( layer < SL_MAX_LAYERS );
 #endif
 
+	// Grab a free slot, or a new one if none are free
+	if( scene->free_slot != SL_ENTITY_NO_SLOT ) {
+		index = scene->free_slot;
+		slot = ( sl_scene_slot* )vul_vector_get( scene->slots, index );
+		scene->free_slot = slot->index;
+	} else {
+		index = vul_vector_size( scene->slots );
+#ifdef SL_DEBUG
+		assert( index < SL_ENTITY_MAX_SLOTS );
+#else
+		if( index >= SL_ENTITY_MAX_SLOTS ) {
+			sl_print( 256, "Scene %d is full, could not add sprite.\n", scene->scene_id );
+			return 0xffffffff;
+		}
+#endif
+		slot = ( sl_scene_slot* )vul_vector_add_empty( scene->slots );
+		slot->generation = 0;
+	}
+	slot->layer = ( u8 )layer;
+	slot->index = i = SL_LAYER_SIZE( scene, layer );
+
+#ifdef SL_SOA_LAYERS
+	l = &scene->layers[ layer ];
+	sl_layer_reserve( l, l->count + 1 );
+	++l->count;
+	l->flags[ i ] = is_hidden ? SL_ENTITY_FLAG_HIDDEN : 0;
+	l->keys[ i ].texture_id = texture_id;
+	l->keys[ i ].program_id = program_id;
+	l->keys[ i ].renderable_id = renderable_id;
+#else
 	q = ( sl_entity* )vul_vector_add_empty( scene->layers[ layer ] );
 	q->hidden = is_hidden;
-	q->entity_id = scene->next_entity_id++;
+	q->queued = 0;
 	q->texture_id = texture_id;
 	q->program_id = program_id;
 	q->renderable_id = renderable_id;
-	q->uvs = *uvs;
-	q->flip_uvs = *flip_uvs;
-	sl_entity_create_world_matrix( q, center, scale, rotation );
+#endif
+	SL_LAYER_ID( scene, layer, i ) = ( ( u32 )slot->generation << SL_ENTITY_SLOT_BITS ) | index;
+	*SL_LAYER_UVS( scene, layer, i ) = *uvs;
+	*SL_LAYER_FLIP_UVS( scene, layer, i ) = *flip_uvs;
+	sl_affine_set_trs( SL_LAYER_TRANSFORM( scene, layer, i ), center, scale, rotation );
+	SL_LAYER_SORT_KEY( scene, layer, i ) = sl_entity_sort_key( layer, program_id, texture_id, renderable_id );
 
+	c = SL_LAYER_COLOR( scene, layer, i );
 	if( color == NULL ) {
-		q->color[ 0 ] = q->color[ 1 ] = q->color[ 2 ] = q->color[ 3 ] = 1.f;
+		c[ 0 ] = c[ 1 ] = c[ 2 ] = c[ 3 ] = 1.f;
 	} else {
-		q->color[ 0 ] = color[ 0 ];
-		q->color[ 1 ] = color[ 1 ];
-		q->color[ 2 ] = color[ 2 ];
-		q->color[ 3 ] = color[ 3 ];
+		c[ 0 ] = color[ 0 ];
+		c[ 1 ] = color[ 1 ];
+		c[ 2 ] = color[ 2 ];
+		c[ 3 ] = color[ 3 ];
 	}
 
-	return q->entity_id;
+	sl_scene_queue_resort( scene, layer, i );
+
+	sl_entity_aabb_transform( &aabb, SL_LAYER_TRANSFORM( scene, layer, i ) );
+	sl_spatial_insert( &scene->spatial, index, layer, &aabb );
+
+	return SL_LAYER_ID( scene, layer, i );
 }
 void sl_scene_remove_sprite( sl_scene *scene, const unsigned int id, const unsigned int layer )
 {
-	unsigned int i, j;
-	sl_entity *it, *last_it;
-
-	if( layer == 0xffffffff ) {
-		for( i = 0; i < SL_MAX_LAYERS; ++i ) {
-			if( scene->layers[ i ] ) {
-				j = 0;
-				vul_foreach( sl_entity, it, last_it, scene->layers[ i ] ) {
-					if( it->entity_id == id ) {
-						vul_vector_remove_cascade( scene->layers[ i ], j ); 
-						// After this operation, it is no longer stable, but we don't care, since
-						// we return anyway!
-						return;
-					}
-					++j;
-				}
-			}
-		}
-	} else {
-#ifdef SL_DEBUG
-		assert( layer < SL_MAX_LAYERS );
-#endif
-		if( scene->layers[ layer ] ) {
-			j = 0;
-			vul_foreach( sl_entity, it, last_it, scene->layers[ layer ] ) {
-				if( it->entity_id == id ) {
-					vul_vector_remove_cascade( scene->layers[ layer ], j ); 
-					// After this operation, it is no longer stable, but we don't care, since
-					// we return anyway!
-					return;
-				}
-			}
-		}
+	sl_scene_slot *slot, *moved;
+	u32 l, i, size;
+
+	slot = sl_scene_find_slot( scene, id, layer );
+	if( slot == NULL ) {
+		return;
+	}
+	l = slot->layer;
+	i = slot->index;
+	size = SL_LAYER_SIZE( scene, l );
+
+	// The render order is fixed up in place unless the next sort rebuilds it anyway.
+	// The stale id queued below counts towards that, so removals are bounded too.
+	if( vul_vector_size( scene->resort[ l ] ) < SL_SCENE_RESORT_MAX_MOVES ) {
+		sl_scene_order_remove( scene, l, i, size - 1 );
 	}
+	*( unsigned int* )vul_vector_add_empty( scene->resort[ l ] ) = id;
+	scene->layer_dirty |= 1 << l;
+
+	// The last quad takes the removed one's place
+	if( i != size - 1 ) {
+		moved = ( sl_scene_slot* )vul_vector_get( scene->slots, SL_LAYER_ID( scene, l, size - 1 ) & SL_ENTITY_SLOT_MASK );
+		moved->index = i;
+	}
+#ifdef SL_SOA_LAYERS
+	if( i != size - 1 ) {
+		sl_layer_move( &scene->layers[ l ], i, size - 1 );
+	}
+	--scene->layers[ l ].count;
+#else
+	vul_vector_remove_swap( scene->layers[ l ], i );
+#endif
+
+	sl_spatial_remove( &scene->spatial, id & SL_ENTITY_SLOT_MASK );
+
+	// Retire the id and put the slot on the free list
+	slot->layer = SL_ENTITY_FREE_SLOT;
+	slot->generation = ( u16 )( ( slot->generation + 1 ) & SL_ENTITY_GENERATION_MASK );
+	slot->index = scene->free_slot;
+	scene->free_slot = id & SL_ENTITY_SLOT_MASK;
 }
 
+#ifndef SL_SOA_LAYERS
 sl_entity *sl_scene_get_volitile_entity( sl_scene *scene, const unsigned int id, const unsigned int layer )
 {
-	unsigned int i, lret;
-	sl_entity *ret;
-	sl_entity *it, *last_it;
-
-	ret = NULL;
-	if( layer == 0xffffffff ) {
-		for( i = 0; i < SL_MAX_LAYERS; ++i ) {
-			if( scene->layers[ i ] ) {
-				vul_foreach( sl_entity, it, last_it, scene->layers[ i ] ) {
-					if( it->entity_id == id ) {
-						ret = it;
-						lret = i;
-					}
-				}
-			}
-		}
-	} else {
-#ifdef SL_DEBUG
-		assert( layer < SL_MAX_LAYERS );
+	sl_scene_slot *slot;
+
+	slot = sl_scene_find_slot( scene, id, layer );
+	if( slot == NULL ) {
+		return NULL;
+	}
+	// Its ids and transform may be changed through the pointer; the sort and the next pick check
+	sl_scene_queue_resort( scene, slot->layer, slot->index );
+	sl_spatial_mark_moved( &scene->spatial, id & SL_ENTITY_SLOT_MASK );
+
+	return ( sl_entity* )vul_vector_get( scene->layers[ slot->layer ], slot->index );
+}
+
+const sl_entity *sl_scene_get_const_entity( sl_scene *scene, const unsigned int id, const unsigned int layer )
+{
+	sl_scene_slot *slot;
+
+	slot = sl_scene_find_slot( scene, id, layer );
+	if( slot == NULL ) {
+		// We have failed, return NULL
+		return NULL;
+	}
+
+	return ( const sl_entity* )vul_vector_get( scene->layers[ slot->layer ], slot->index );
+}
 #endif
-		lret = layer;
-		if( scene->layers[ layer ] ) {
-			vul_foreach( sl_entity, it, last_it, scene->layers[ layer ] ) {
-				if( it->entity_id == id ) {
-					ret = it;
-				}
-			}
-		}
+
+sl_affine *sl_scene_get_transform( sl_scene *scene, const unsigned int id )
+{
+	sl_scene_slot *slot;
+
+	slot = sl_scene_find_slot( scene, id, 0xffffffff );
+	if( slot == NULL ) {
+		return NULL;
 	}
+	sl_spatial_mark_moved( &scene->spatial, id & SL_ENTITY_SLOT_MASK );
+	return SL_LAYER_TRANSFORM( scene, slot->layer, slot->index );
+}
 
-	if( ret ) {
-		scene->layer_dirty |= 1 << lret;
+SL_BOOL sl_scene_get_world_matrix( sl_scene *scene, const unsigned int id, m44 *result )
+{
+	sl_affine *t;
+
+	t = sl_scene_get_transform( scene, id );
+	if( t == NULL ) {
+		return SL_FALSE;
 	}
+	sl_affine_to_m44( result, t );
+	return SL_TRUE;
+}
 
-	return ret;
+SL_BOOL sl_scene_set_world_matrix( sl_scene *scene, const unsigned int id, const m44 *world_matrix )
+{
+	sl_affine *t;
+
+	t = sl_scene_get_transform( scene, id );
+	if( t == NULL ) {
+		return SL_FALSE;
+	}
+	sl_affine_from_m44( t, world_matrix );
+	return SL_TRUE;
 }
 
-const sl_entity *sl_scene_get_const_entity( sl_scene *scene, const unsigned int id, const unsigned int layer )
+float *sl_scene_get_color( sl_scene *scene, const unsigned int id )
 {
-	unsigned int i, lret;
-	sl_entity *it, *last_it;
-	
-	if( layer == 0xffffffff ) {
-		for( i = 0; i < SL_MAX_LAYERS; ++i ) {
-			if( scene->layers[ i ] ) {
-				vul_foreach( sl_entity, it, last_it, scene->layers[ i ] ) {
-					if( it->entity_id == id ) {
-						return it;
-					}
-				}
-			}
-		}
+	sl_scene_slot *slot;
+
+	slot = sl_scene_find_slot( scene, id, 0xffffffff );
+	return slot ? SL_LAYER_COLOR( scene, slot->layer, slot->index ) : NULL;
+}
+
+sl_box *sl_scene_get_uvs( sl_scene *scene, const unsigned int id )
+{
+	sl_scene_slot *slot;
+
+	slot = sl_scene_find_slot( scene, id, 0xffffffff );
+	return slot ? SL_LAYER_UVS( scene, slot->layer, slot->index ) : NULL;
+}
+
+/**
+ * Queues an entity for re-sorting if its ids changed its sort key. The stored key
+ * is the one the render order is sorted under, so only the sort updates it.
+ */
+static void sl_scene_rekey( sl_scene *scene, const sl_scene_slot *slot )
+{
+	u64 key;
+
+	key = sl_entity_sort_key( slot->layer, SL_LAYER_PROGRAM( scene, slot->layer, slot->index ),
+							  SL_LAYER_TEXTURE( scene, slot->layer, slot->index ),
+							  SL_LAYER_RENDERABLE( scene, slot->layer, slot->index ) );
+	if( key != SL_LAYER_SORT_KEY( scene, slot->layer, slot->index ) ) {
+		sl_scene_queue_resort( scene, slot->layer, slot->index );
+	}
+}
+
+void sl_scene_set_texture( sl_scene *scene, const unsigned int id, const unsigned int texture_id )
+{
+	sl_scene_slot *slot;
+
+	slot = sl_scene_find_slot( scene, id, 0xffffffff );
+	if( slot != NULL ) {
+		SL_LAYER_TEXTURE( scene, slot->layer, slot->index ) = texture_id;
+		sl_scene_rekey( scene, slot );
+	}
+}
+
+void sl_scene_set_program( sl_scene *scene, const unsigned int id, const unsigned int program_id )
+{
+	sl_scene_slot *slot;
+
+	slot = sl_scene_find_slot( scene, id, 0xffffffff );
+	if( slot != NULL ) {
+		SL_LAYER_PROGRAM( scene, slot->layer, slot->index ) = program_id;
+		sl_scene_rekey( scene, slot );
+	}
+}
+
+void sl_scene_set_renderable( sl_scene *scene, const unsigned int id, const unsigned int renderable_id )
+{
+	sl_scene_slot *slot;
+
+	slot = sl_scene_find_slot( scene, id, 0xffffffff );
+	if( slot != NULL ) {
+		SL_LAYER_RENDERABLE( scene, slot->layer, slot->index ) = renderable_id;
+		sl_scene_rekey( scene, slot );
+	}
+}
+
+void sl_scene_set_hidden( sl_scene *scene, const unsigned int id, unsigned char is_hidden )
+{
+	sl_scene_slot *slot;
+
+	slot = sl_scene_find_slot( scene, id, 0xffffffff );
+	if( slot == NULL ) {
+		return;
+	}
+#ifdef SL_SOA_LAYERS
+	if( is_hidden ) {
+		scene->layers[ slot->layer ].flags[ slot->index ] |= SL_ENTITY_FLAG_HIDDEN;
 	} else {
-#ifdef SL_DEBUG
-		assert( layer < SL_MAX_LAYERS );
+		scene->layers[ slot->layer ].flags[ slot->index ] &= ~SL_ENTITY_FLAG_HIDDEN;
+	}
+#else
+	SL_LAYER_ENTITY( scene, slot->layer, slot->index )->hidden = is_hidden;
 #endif
-		if( scene->layers[ layer ] ) {
-			vul_foreach( sl_entity, it, last_it, scene->layers[ layer ] ) {
-				if( it->entity_id == id ) {
-					return it;
-				}
-			}
+}
+
+/**
+ * Re-indexes the AABBs of the entities marked as moved since the last query.
+ */
+static void sl_scene_refresh_spatial( sl_scene *scene )
+{
+	sl_spatial_entry *entry;
+	sl_scene_slot *slot;
+	sl_box aabb;
+	u32 *moved;
+	u32 i, count;
+
+	moved = ( u32* )vul_vector_begin( scene->spatial.moved );
+	count = vul_vector_size( scene->spatial.moved );
+	for( i = 0; i < count; ++i ) {
+		entry = ( sl_spatial_entry* )vul_vector_get( scene->spatial.entries, moved[ i ] );
+		if( !entry->moved ) {
+			continue; // Removed since it was marked
 		}
+		entry->moved = 0;
+		slot = ( sl_scene_slot* )vul_vector_get( scene->slots, moved[ i ] );
+		sl_entity_aabb_transform( &aabb, SL_LAYER_TRANSFORM( scene, slot->layer, slot->index ) );
+		sl_spatial_update( &scene->spatial, moved[ i ], &aabb );
 	}
+	vul_vector_resize( scene->spatial.moved, 0, VUL_FALSE, VUL_FALSE );
+}
 
-	// We have failed, return NULL
-	return NULL;
+/**
+ * Turns the slots a layer's query appended to vec, from start on, into entity
+ * ids in layer order, dropping hidden entities. Queries hit few entities, so an
+ * insertion sort does.
+ */
+static void sl_scene_finish_hits( sl_scene *scene, vul_vector *vec, u32 start )
+{
+	sl_scene_slot *slots;
+	unsigned int *hits;
+	u32 i, j, count, hit;
+
+	slots = ( sl_scene_slot* )vul_vector_begin( scene->slots );
+	hits = ( unsigned int* )vul_vector_begin( vec );
+	count = start;
+	for( i = start; i < vul_vector_size( vec ); ++i ) {
+		hit = hits[ i ];
+		if( SL_LAYER_HIDDEN( scene, slots[ hit ].layer, slots[ hit ].index ) ) {
+			continue;
+		}
+		for( j = count; j > start && slots[ hits[ j - 1 ] ].index > slots[ hit ].index; --j ) {
+			hits[ j ] = hits[ j - 1 ];
+		}
+		hits[ j ] = hit;
+		++count;
+	}
+	for( i = start; i < count; ++i ) {
+		hits[ i ] = SL_LAYER_ID( scene, slots[ hits[ i ] ].layer, slots[ hits[ i ] ].index );
+	}
+	vul_vector_resize( vec, count, VUL_FALSE, VUL_FALSE );
 }
 
 void sl_scene_get_entities_at_pos( vul_vector *vec, sl_scene *scene, v2 *pos )
 {
-	sl_entity *it, *last_it;
 	int i;
-	sl_box aabb;
+	u32 start;
 
+	sl_scene_refresh_spatial( scene );
 	for( i = SL_MAX_LAYERS - 1; i >= 0; --i ) {
-		if( scene->layers[ i ] == NULL ) {
-			continue;
-		}
-		vul_foreach( sl_entity, it, last_it, scene->layers[ i ] )
-		{
-			sl_entity_aabb( &aabb, it );
-			if( sl_binside( &aabb, pos ) && !it->hidden ) {
-				vul_vector_add( vec, &it->entity_id );
-			}
-		}
+		start = vul_vector_size( vec );
+		sl_spatial_query_point( &scene->spatial, i, pos, vec );
+		sl_scene_finish_hits( scene, vec, start );
+	}
+}
+
+void sl_scene_get_entities_in_box( vul_vector *vec, sl_scene *scene, const sl_box *area )
+{
+	int i;
+	u32 start;
+
+	sl_scene_refresh_spatial( scene );
+	for( i = SL_MAX_LAYERS - 1; i >= 0; --i ) {
+		start = vul_vector_size( vec );
+		sl_spatial_query_box( &scene->spatial, i, area, vec );
+		sl_scene_finish_hits( scene, vec, start );
 	}
 }
@@ -0,0 +1,348 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "renderer/spatial.h"
+
+#include <string.h>
+
+#include "slenderer.h"
+
+#define SL_SPATIAL_NODE( tree, n ) ( ( sl_spatial_node* )vul_vector_get( ( tree )->nodes, n ) )
+#define SL_SPATIAL_ENTRY( index, s ) ( ( sl_spatial_entry* )vul_vector_get( ( index )->entries, s ) )
+#define SL_SPATIAL_SLACK 0.52f // How far, in cells, entries may reach out of their node's cell; half plus a little against rounding
+
+/*
+ * Unlike sl_bintersect, also true when the boxes cross without either holding
+ * a corner of the other.
+ */
+static int sl_spatial_overlaps( const sl_box *a, const sl_box *b )
+{
+	return a->min_p.x <= b->max_p.x && b->min_p.x <= a->max_p.x
+		&& a->min_p.y <= b->max_p.y && b->min_p.y <= a->max_p.y;
+}
+
+/*
+ * Whether an AABB with the given center and extent belongs in the node's grown
+ * cell: its center is in the cell and it's no larger than the cell.
+ */
+static int sl_spatial_fits( const sl_spatial_node *node, const v2 *center, f32 extent )
+{
+	return extent <= node->size
+		&& center->x >= node->min_p.x && center->x < node->min_p.x + node->size
+		&& center->y >= node->min_p.y && center->y < node->min_p.y + node->size;
+}
+
+static u32 sl_spatial_alloc_node( sl_spatial_tree *tree, u32 parent, const v2 *min_p, f32 size )
+{
+	sl_spatial_node *node;
+	u32 n;
+
+	if( tree->free_node != SL_SPATIAL_NONE ) {
+		n = tree->free_node;
+		node = SL_SPATIAL_NODE( tree, n );
+		tree->free_node = node->first;
+	} else {
+		n = vul_vector_size( tree->nodes );
+		node = ( sl_spatial_node* )vul_vector_add_empty( tree->nodes );
+	}
+	node->min_p = *min_p;
+	node->size = size;
+	node->parent = parent;
+	node->children[ 0 ] = node->children[ 1 ] = node->children[ 2 ] = node->children[ 3 ] = SL_SPATIAL_NONE;
+	node->first = SL_SPATIAL_NONE;
+	node->count = 0;
+	return n;
+}
+
+/*
+ * Makes the root twice as large, toward the given point; the old root becomes
+ * one of its quadrants.
+ */
+static void sl_spatial_grow( sl_spatial_tree *tree, const v2 *toward )
+{
+	sl_spatial_node *old;
+	v2 min_p;
+	u32 n, quadrant, count;
+	f32 size;
+
+	old = SL_SPATIAL_NODE( tree, tree->root );
+	size = old->size;
+	min_p = old->min_p;
+	count = old->count;
+	quadrant = 0;
+	if( toward->x < min_p.x ) {
+		min_p.x -= size;
+		quadrant |= 1;
+	}
+	if( toward->y < min_p.y ) {
+		min_p.y -= size;
+		quadrant |= 2;
+	}
+	n = sl_spatial_alloc_node( tree, SL_SPATIAL_NONE, &min_p, size * 2.f );
+	SL_SPATIAL_NODE( tree, n )->children[ quadrant ] = tree->root;
+	SL_SPATIAL_NODE( tree, n )->count = count;
+	SL_SPATIAL_NODE( tree, tree->root )->parent = n;
+	tree->root = n;
+}
+
+/*
+ * Finds the node an AABB belongs in, creating nodes as needed, and counts the
+ * entry in every node on the way down.
+ */
+static u32 sl_spatial_place( sl_spatial_tree *tree, const sl_box *aabb )
+{
+	sl_spatial_node *node;
+	v2 center, min_p;
+	f32 extent, half;
+	u32 n, child, quadrant, depth;
+
+	center = vec2( ( aabb->min_p.x + aabb->max_p.x ) * 0.5f, ( aabb->min_p.y + aabb->max_p.y ) * 0.5f );
+	extent = SL_MAX( aabb->max_p.x - aabb->min_p.x, aabb->max_p.y - aabb->min_p.y );
+
+	node = SL_SPATIAL_NODE( tree, tree->root );
+	if( !( extent - extent == 0.f && center.x - center.x == 0.f && center.y - center.y == 0.f ) ) {
+		// Not finite; the root is always searched, so it can hold it
+		++node->count;
+		return tree->root;
+	}
+	if( node->count == 0 ) {
+		// An empty tree can start over around the entity
+		node->size = extent > 0.f ? extent * 4.f : 1.f;
+		node->min_p = vec2( center.x - node->size * 0.5f, center.y - node->size * 0.5f );
+	}
+	for( depth = 0; depth < SL_SPATIAL_MAX_GROWTH && !sl_spatial_fits( node, &center, extent ); ++depth ) {
+		sl_spatial_grow( tree, &center );
+		node = SL_SPATIAL_NODE( tree, tree->root );
+	}
+	if( !sl_spatial_fits( node, &center, extent ) ) {
+		// Too far out to grow to
+		++node->count;
+		return tree->root;
+	}
+
+	n = tree->root;
+	for( depth = 0; ; ++depth ) {
+		node = SL_SPATIAL_NODE( tree, n );
+		++node->count;
+		half = node->size * 0.5f;
+		if( depth == SL_SPATIAL_MAX_DEPTH || extent > half ) {
+			return n;
+		}
+		quadrant = ( center.x >= node->min_p.x + half ? 1 : 0 ) | ( center.y >= node->min_p.y + half ? 2 : 0 );
+		child = node->children[ quadrant ];
+		if( child == SL_SPATIAL_NONE ) {
+			min_p = vec2( node->min_p.x + ( quadrant & 1 ? half : 0.f ), node->min_p.y + ( quadrant & 2 ? half : 0.f ) );
+			child = sl_spatial_alloc_node( tree, n, &min_p, half ); // May move the nodes
+			SL_SPATIAL_NODE( tree, n )->children[ quadrant ] = child;
+		}
+		n = child;
+	}
+}
+
+static void sl_spatial_link( sl_spatial_index *index, u32 slot )
+{
+	sl_spatial_tree *tree;
+	sl_spatial_entry *entry;
+	sl_spatial_node *node;
+
+	entry = SL_SPATIAL_ENTRY( index, slot );
+	tree = &index->trees[ entry->layer ];
+	entry->node = sl_spatial_place( tree, &entry->aabb );
+	node = SL_SPATIAL_NODE( tree, entry->node );
+	entry->prev = SL_SPATIAL_NONE;
+	entry->next = node->first;
+	if( node->first != SL_SPATIAL_NONE ) {
+		SL_SPATIAL_ENTRY( index, node->first )->prev = slot;
+	}
+	node->first = slot;
+}
+
+/*
+ * Takes an entry out of its node, and uncounts it up to the root. Nodes left
+ * with nothing in or below them are recycled; a child always empties before its
+ * parent, so no live node is ever left below a free one.
+ */
+static void sl_spatial_unlink( sl_spatial_index *index, u32 slot )
+{
+	sl_spatial_tree *tree;
+	sl_spatial_entry *entry;
+	sl_spatial_node *node, *parent;
+	u32 n, i;
+
+	entry = SL_SPATIAL_ENTRY( index, slot );
+	tree = &index->trees[ entry->layer ];
+	n = entry->node;
+	node = SL_SPATIAL_NODE( tree, n );
+	if( entry->prev != SL_SPATIAL_NONE ) {
+		SL_SPATIAL_ENTRY( index, entry->prev )->next = entry->next;
+	} else {
+		node->first = entry->next;
+	}
+	if( entry->next != SL_SPATIAL_NONE ) {
+		SL_SPATIAL_ENTRY( index, entry->next )->prev = entry->prev;
+	}
+	entry->node = SL_SPATIAL_NONE;
+
+	while( n != SL_SPATIAL_NONE ) {
+		node = SL_SPATIAL_NODE( tree, n );
+		--node->count;
+		if( node->count == 0 && n != tree->root ) {
+			parent = SL_SPATIAL_NODE( tree, node->parent );
+			for( i = 0; i < 4; ++i ) {
+				if( parent->children[ i ] == n ) {
+					parent->children[ i ] = SL_SPATIAL_NONE;
+				}
+			}
+			node->first = tree->free_node;
+			tree->free_node = n;
+		}
+		n = node->parent;
+	}
+}
+
+/*
+ * Collects the entries of a node and the nodes below it that the area touches.
+ * A point query tests the entries like sl_binside does.
+ */
+static void sl_spatial_query_node( sl_spatial_index *index, sl_spatial_tree *tree, u32 n,
+								   const sl_box *area, SL_BOOL point, vul_vector *slots )
+{
+	sl_spatial_node *node, *child;
+	sl_spatial_entry *entry;
+	sl_box grown;
+	f32 half;
+	u32 s, i;
+
+	node = SL_SPATIAL_NODE( tree, n );
+	for( s = node->first; s != SL_SPATIAL_NONE; s = entry->next ) {
+		entry = SL_SPATIAL_ENTRY( index, s );
+		if( point ? sl_binside( &entry->aabb, &area->min_p ) : sl_spatial_overlaps( &entry->aabb, area ) ) {
+			vul_vector_add( slots, &s );
+		}
+	}
+	for( i = 0; i < 4; ++i ) {
+		if( node->children[ i ] == SL_SPATIAL_NONE ) {
+			continue;
+		}
+		child = SL_SPATIAL_NODE( tree, node->children[ i ] );
+		half = child->size * SL_SPATIAL_SLACK;
+		sl_bset_scalar( &grown, child->min_p.x - half, child->min_p.y - half,
+								child->min_p.x + child->size + half, child->min_p.y + child->size + half );
+		if( sl_spatial_overlaps( &grown, area ) ) {
+			sl_spatial_query_node( index, tree, node->children[ i ], area, point, slots );
+		}
+	}
+}
+
+void sl_spatial_create( sl_spatial_index *index )
+{
+	sl_spatial_tree *tree;
+	v2 origin;
+	u32 i;
+
+	origin = vec2( 0.f, 0.f );
+	for( i = 0; i < SL_SPATIAL_LAYERS; ++i ) {
+		tree = &index->trees[ i ];
+		tree->nodes = vul_vector_create( sizeof( sl_spatial_node ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+		tree->free_node = SL_SPATIAL_NONE;
+		tree->root = sl_spatial_alloc_node( tree, SL_SPATIAL_NONE, &origin, 1.f );
+	}
+	index->entries = vul_vector_create( sizeof( sl_spatial_entry ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	index->moved = vul_vector_create( sizeof( u32 ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+}
+
+void sl_spatial_destroy( sl_spatial_index *index )
+{
+	u32 i;
+
+	for( i = 0; i < SL_SPATIAL_LAYERS; ++i ) {
+		vul_vector_destroy( index->trees[ i ].nodes );
+	}
+	vul_vector_destroy( index->entries );
+	vul_vector_destroy( index->moved );
+}
+
+void sl_spatial_insert( sl_spatial_index *index, u32 slot, u32 layer, const sl_box *aabb )
+{
+	sl_spatial_entry *entry;
+
+	while( vul_vector_size( index->entries ) <= slot ) {
+		entry = ( sl_spatial_entry* )vul_vector_add_empty( index->entries );
+		entry->node = SL_SPATIAL_NONE;
+		entry->moved = 0;
+	}
+	entry = SL_SPATIAL_ENTRY( index, slot );
+#ifdef SL_DEBUG
+	assert( entry->node == SL_SPATIAL_NONE );
+#else
+	if( entry->node != SL_SPATIAL_NONE ) {
+		sl_print( 128, "Slot %u is already in the spatial index, moving it.\n", slot );
+		sl_spatial_remove( index, slot );
+	}
+#endif
+	entry->aabb = *aabb;
+	entry->layer = ( u8 )layer;
+	entry->moved = 0;
+	sl_spatial_link( index, slot );
+}
+
+void sl_spatial_remove( sl_spatial_index *index, u32 slot )
+{
+	sl_spatial_entry *entry;
+
+	entry = SL_SPATIAL_ENTRY( index, slot );
+	if( entry->node == SL_SPATIAL_NONE ) {
+		return;
+	}
+	sl_spatial_unlink( index, slot );
+	entry->moved = 0; // Any copy left in the moved list is skipped
+}
+
+void sl_spatial_update( sl_spatial_index *index, u32 slot, const sl_box *aabb )
+{
+	sl_spatial_entry *entry;
+
+	entry = SL_SPATIAL_ENTRY( index, slot );
+	if( memcmp( &entry->aabb, aabb, sizeof( sl_box ) ) == 0 ) {
+		return;
+	}
+	sl_spatial_unlink( index, slot );
+	entry->aabb = *aabb;
+	sl_spatial_link( index, slot );
+}
+
+void sl_spatial_mark_moved( sl_spatial_index *index, u32 slot )
+{
+	sl_spatial_entry *entry;
+
+	entry = SL_SPATIAL_ENTRY( index, slot );
+	if( entry->moved ) {
+		return;
+	}
+	entry->moved = 1;
+	vul_vector_add( index->moved, &slot );
+}
+
+void sl_spatial_query_point( sl_spatial_index *index, u32 layer, const v2 *pos, vul_vector *slots )
+{
+	sl_box area;
+
+	area.min_p = area.max_p = *pos;
+	sl_spatial_query_node( index, &index->trees[ layer ], index->trees[ layer ].root, &area, SL_TRUE, slots );
+}
+
+void sl_spatial_query_box( sl_spatial_index *index, u32 layer, const sl_box *area, vul_vector *slots )
+{
+	sl_spatial_query_node( index, &index->trees[ layer ], index->trees[ layer ].root, area, SL_FALSE, slots );
+}
@@ -0,0 +1,269 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "renderer/state.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+static sl_gl_state *sl_gl_state_current = NULL;
+static sl_gl_state *sl_gl_state_list = NULL; // Every created state
+static u64 sl_gl_state_issued = 0;
+static u64 sl_gl_state_skipped = 0;
+
+/*
+ * Counts a call, and returns whether it must be issued.
+ */
+static int sl_gl_state_changes( GLuint *value, GLuint wanted )
+{
+	if( *value == wanted ) {
+		++sl_gl_state_skipped;
+		return 0;
+	}
+	*value = wanted;
+	++sl_gl_state_issued;
+	return 1;
+}
+
+void sl_gl_state_invalidate( sl_gl_state *state )
+{
+	GLuint i;
+
+	assert( state );
+	state->program = SL_GL_STATE_UNKNOWN;
+	state->active_texture = SL_GL_STATE_UNKNOWN;
+	for( i = 0; i < SL_GL_STATE_TEXTURE_UNITS; ++i ) {
+		state->textures[ i ] = SL_GL_STATE_UNKNOWN;
+	}
+	state->vertex_array = SL_GL_STATE_UNKNOWN;
+	state->array_buffer = SL_GL_STATE_UNKNOWN;
+	state->framebuffer = SL_GL_STATE_UNKNOWN;
+	state->blend = SL_GL_STATE_UNKNOWN;
+	state->depth_test = SL_GL_STATE_UNKNOWN;
+	state->texture_2d = SL_GL_STATE_UNKNOWN;
+	state->blend_src = SL_GL_STATE_UNKNOWN;
+	state->blend_dst = SL_GL_STATE_UNKNOWN;
+	state->viewport[ 0 ] = state->viewport[ 1 ] = 0;
+	state->viewport[ 2 ] = state->viewport[ 3 ] = -1;
+}
+
+void sl_gl_state_create( sl_gl_state *state )
+{
+	sl_gl_state_invalidate( state );
+	state->next = sl_gl_state_list;
+	sl_gl_state_list = state;
+}
+
+void sl_gl_state_destroy( sl_gl_state *state )
+{
+	sl_gl_state **it;
+
+	for( it = &sl_gl_state_list; *it; it = &( *it )->next ) {
+		if( *it == state ) {
+			*it = state->next;
+			break;
+		}
+	}
+	if( sl_gl_state_current == state ) {
+		sl_gl_state_current = NULL;
+	}
+}
+
+void sl_gl_state_make_current( sl_gl_state *state )
+{
+	sl_gl_state_current = state;
+}
+
+sl_gl_state *sl_gl_state_get_current( )
+{
+	return sl_gl_state_current;
+}
+
+void sl_gl_state_get_counters( u64 *issued, u64 *skipped )
+{
+	*issued = sl_gl_state_issued;
+	*skipped = sl_gl_state_skipped;
+}
+
+void sl_gl_state_reset_counters( )
+{
+	sl_gl_state_issued = 0;
+	sl_gl_state_skipped = 0;
+}
+
+/*
+ * Replaces the deleted name wherever the state has it bound with unbound.
+ */
+static void sl_gl_state_forget( sl_gl_state *s, GLenum binding, GLuint name, GLuint unbound )
+{
+	GLuint i;
+
+	switch( binding ) {
+	case GL_CURRENT_PROGRAM:
+		// A deleted program stays in use until replaced; just stop trusting the name
+		if( s->program == name ) {
+			s->program = SL_GL_STATE_UNKNOWN;
+		}
+		break;
+	case GL_TEXTURE_BINDING_2D:
+		for( i = 0; i < SL_GL_STATE_TEXTURE_UNITS; ++i ) {
+			if( s->textures[ i ] == name ) {
+				s->textures[ i ] = unbound;
+			}
+		}
+		break;
+	case GL_VERTEX_ARRAY_BINDING:
+		if( s->vertex_array == name ) {
+			s->vertex_array = unbound;
+		}
+		break;
+	case GL_ARRAY_BUFFER_BINDING:
+		if( s->array_buffer == name ) {
+			s->array_buffer = unbound;
+		}
+		break;
+	case GL_FRAMEBUFFER_BINDING:
+		if( s->framebuffer == name ) {
+			s->framebuffer = unbound;
+		}
+		break;
+	default:
+		assert( 0 ); // Not a binding we track
+	}
+}
+
+void sl_gl_state_deleted( GLenum binding, GLuint name )
+{
+	sl_gl_state *s;
+
+	assert( sl_gl_state_current );
+	// Only the current context unbinds the object; the others just can't trust the name anymore
+	for( s = sl_gl_state_list; s; s = s->next ) {
+		sl_gl_state_forget( s, binding, name, s == sl_gl_state_current ? 0 : SL_GL_STATE_UNKNOWN );
+	}
+}
+
+void sl_gl_use_program( GLuint program )
+{
+	assert( sl_gl_state_current );
+	if( sl_gl_state_changes( &sl_gl_state_current->program, program ) ) {
+		glUseProgram( program );
+	}
+}
+
+void sl_gl_bind_texture( GLuint unit, GLuint texture )
+{
+	assert( sl_gl_state_current );
+	assert( unit < SL_GL_STATE_TEXTURE_UNITS );
+	if( sl_gl_state_current->textures[ unit ] == texture ) {
+		++sl_gl_state_skipped;
+		return;
+	}
+	if( sl_gl_state_changes( &sl_gl_state_current->active_texture, unit ) ) {
+		glActiveTexture( GL_TEXTURE0 + unit );
+	}
+	sl_gl_state_changes( &sl_gl_state_current->textures[ unit ], texture );
+	glBindTexture( GL_TEXTURE_2D, texture );
+}
+
+void sl_gl_bind_vertex_array( GLuint vertex_array )
+{
+	assert( sl_gl_state_current );
+#ifndef SL_LEGACY_OPENGL
+	if( sl_gl_state_changes( &sl_gl_state_current->vertex_array, vertex_array ) ) {
+		glBindVertexArray( vertex_array );
+	}
+#endif
+}
+
+void sl_gl_bind_array_buffer( GLuint buffer )
+{
+	assert( sl_gl_state_current );
+	if( sl_gl_state_changes( &sl_gl_state_current->array_buffer, buffer ) ) {
+		glBindBuffer( GL_ARRAY_BUFFER, buffer );
+	}
+}
+
+void sl_gl_bind_framebuffer( GLuint framebuffer )
+{
+	assert( sl_gl_state_current );
+#ifndef SL_LEGACY_OPENGL
+	if( sl_gl_state_changes( &sl_gl_state_current->framebuffer, framebuffer ) ) {
+		glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+	}
+#endif
+}
+
+void sl_gl_set_capability( GLenum capability, int enabled )
+{
+	GLuint *value;
+
+	assert( sl_gl_state_current );
+	switch( capability ) {
+	case GL_BLEND:
+		value = &sl_gl_state_current->blend;
+		break;
+	case GL_DEPTH_TEST:
+		value = &sl_gl_state_current->depth_test;
+		break;
+	case GL_TEXTURE_2D:
+		value = &sl_gl_state_current->texture_2d;
+		break;
+	default:
+		assert( 0 ); // Not a capability we track
+		return;
+	}
+	if( sl_gl_state_changes( value, enabled ? 1 : 0 ) ) {
+		if( enabled ) {
+			glEnable( capability );
+		} else {
+			glDisable( capability );
+		}
+	}
+}
+
+void sl_gl_blend_func( GLenum src, GLenum dst )
+{
+	sl_gl_state *s;
+
+	s = sl_gl_state_current;
+	assert( s );
+	if( s->blend_src == src && s->blend_dst == dst ) {
+		++sl_gl_state_skipped;
+		return;
+	}
+	s->blend_src = src;
+	s->blend_dst = dst;
+	++sl_gl_state_issued;
+	glBlendFunc( src, dst );
+}
+
+void sl_gl_viewport( GLint x, GLint y, GLint width, GLint height )
+{
+	sl_gl_state *s;
+
+	s = sl_gl_state_current;
+	assert( s );
+	if( s->viewport[ 0 ] == x && s->viewport[ 1 ] == y
+		&& s->viewport[ 2 ] == width && s->viewport[ 3 ] == height ) {
+		++sl_gl_state_skipped;
+		return;
+	}
+	s->viewport[ 0 ] = x;
+	s->viewport[ 1 ] = y;
+	s->viewport[ 2 ] = width;
+	s->viewport[ 3 ] = height;
+	++sl_gl_state_issued;
+	glViewport( x, y, width, height );
+}
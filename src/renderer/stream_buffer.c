@@ -0,0 +1,210 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "renderer/stream_buffer.h"
+
+#if !defined( SL_LEGACY_OPENGL ) && !defined( SL_OPENGL_ES )
+
+#include <string.h>
+
+#include "slenderer.h"
+
+#define SL_STREAM_BUFFER_WAIT_NS 1000000 // Timeout of each wait on a fence
+#define SL_STREAM_BUFFER_PERSISTENT_FLAGS ( GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT )
+
+static u32 sl_stream_buffer_align( u32 size )
+{
+	return ( size + SL_STREAM_BUFFER_ALIGNMENT - 1 ) & ~( SL_STREAM_BUFFER_ALIGNMENT - 1 );
+}
+
+/*
+ * Creates the GL buffer for the current region size, and maps it if persistent.
+ */
+static void sl_stream_buffer_allocate( sl_stream_buffer *stream )
+{
+	GLsizeiptr total;
+
+	total = ( GLsizeiptr )stream->region_size * SL_STREAM_BUFFER_FRAMES;
+	glGenBuffers( 1, &stream->buffer );
+	sl_gl_bind_array_buffer( stream->buffer );
+	if( stream->mode == SL_STREAM_BUFFER_PERSISTENT ) {
+		glBufferStorage( GL_ARRAY_BUFFER, total, NULL, SL_STREAM_BUFFER_PERSISTENT_FLAGS );
+		stream->mapping = ( unsigned char* )glMapBufferRange( GL_ARRAY_BUFFER, 0, total, SL_STREAM_BUFFER_PERSISTENT_FLAGS );
+		assert( stream->mapping );
+	} else {
+		glBufferData( GL_ARRAY_BUFFER, total, NULL, GL_STREAM_DRAW );
+	}
+	stream->region = 0;
+	stream->offset = 0;
+	memset( stream->fences, 0, sizeof( stream->fences ) );
+}
+
+/*
+ * Deletes the GL buffer and its fences. GL keeps it alive until draws still
+ * reading from it are done, so nothing is waited on.
+ */
+static void sl_stream_buffer_release( sl_stream_buffer *stream )
+{
+	u32 i;
+
+	for( i = 0; i < SL_STREAM_BUFFER_FRAMES; ++i ) {
+		if( stream->fences[ i ] ) {
+			glDeleteSync( stream->fences[ i ] );
+			stream->fences[ i ] = 0;
+		}
+	}
+	if( stream->mode == SL_STREAM_BUFFER_PERSISTENT ) {
+		sl_gl_bind_array_buffer( stream->buffer );
+		glUnmapBuffer( GL_ARRAY_BUFFER );
+		stream->mapping = NULL;
+	}
+	glDeleteBuffers( 1, &stream->buffer );
+	sl_gl_state_deleted( GL_ARRAY_BUFFER_BINDING, stream->buffer );
+	stream->buffer = 0;
+}
+
+/*
+ * Replaces the buffer by one whose regions hold at least size bytes.
+ */
+static void sl_stream_buffer_grow( sl_stream_buffer *stream, u32 size )
+{
+	sl_stream_buffer_release( stream );
+	stream->region_size *= 2;
+	if( stream->region_size < sl_stream_buffer_align( size ) ) {
+		stream->region_size = sl_stream_buffer_align( size );
+	}
+	if( stream->mode == SL_STREAM_BUFFER_ORPHANED ) {
+		stream->mapping = ( unsigned char* )SL_REALLOC( stream->mapping, stream->region_size );
+	}
+	sl_stream_buffer_allocate( stream );
+}
+
+/*
+ * Waits until the GPU is done with the current region's draws from the last
+ * time around the ring.
+ */
+static void sl_stream_buffer_wait( sl_stream_buffer *stream )
+{
+	GLsync fence;
+	GLenum result;
+
+	fence = stream->fences[ stream->region ];
+	if( !fence ) {
+		return;
+	}
+	result = glClientWaitSync( fence, 0, 0 );
+	if( result == GL_TIMEOUT_EXPIRED ) {
+		++stream->stalls;
+		do {
+			result = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, SL_STREAM_BUFFER_WAIT_NS );
+		} while( result == GL_TIMEOUT_EXPIRED );
+	}
+	glDeleteSync( fence );
+	stream->fences[ stream->region ] = 0;
+}
+
+void sl_stream_buffer_create( sl_stream_buffer *stream, u32 region_size )
+{
+	memset( stream, 0, sizeof( sl_stream_buffer ) );
+	stream->region_size = sl_stream_buffer_align( region_size > 0 ? region_size : SL_STREAM_BUFFER_ALIGNMENT );
+	if( GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage ) {
+		stream->mode = SL_STREAM_BUFFER_PERSISTENT;
+	} else if( GLEW_VERSION_3_2 || GLEW_ARB_sync ) {
+		stream->mode = SL_STREAM_BUFFER_MAPPED;
+	} else {
+		stream->mode = SL_STREAM_BUFFER_ORPHANED;
+		stream->mapping = ( unsigned char* )SL_ALLOC( stream->region_size );
+	}
+	sl_stream_buffer_allocate( stream );
+}
+
+void sl_stream_buffer_destroy( sl_stream_buffer *stream )
+{
+	sl_stream_buffer_release( stream );
+	if( stream->mode == SL_STREAM_BUFFER_ORPHANED ) {
+		SL_DEALLOC( stream->mapping );
+		stream->mapping = NULL;
+	}
+}
+
+void *sl_stream_buffer_reserve( sl_stream_buffer *stream, u32 size, u32 *offset )
+{
+	u32 start;
+	void *ptr;
+
+	assert( stream->reserved == 0 ); // The last write must be committed first
+	start = sl_stream_buffer_align( stream->offset );
+
+	if( stream->mode == SL_STREAM_BUFFER_ORPHANED ) {
+		// The whole buffer is one ring; when it's full, orphan it and start over
+		if( size > stream->region_size ) {
+			sl_stream_buffer_grow( stream, size );
+			start = 0;
+		} else if( start + size > stream->region_size * SL_STREAM_BUFFER_FRAMES ) {
+			sl_gl_bind_array_buffer( stream->buffer );
+			glBufferData( GL_ARRAY_BUFFER, ( GLsizeiptr )stream->region_size * SL_STREAM_BUFFER_FRAMES, NULL, GL_STREAM_DRAW );
+			start = 0;
+		}
+		ptr = stream->mapping;
+		*offset = start;
+	} else {
+		// A frame writing more than its region gets a bigger buffer
+		if( start + size > stream->region_size ) {
+			sl_stream_buffer_grow( stream, start + size );
+			start = 0;
+		}
+		sl_stream_buffer_wait( stream );
+		*offset = stream->region * stream->region_size + start;
+		if( stream->mode == SL_STREAM_BUFFER_PERSISTENT ) {
+			ptr = stream->mapping + *offset;
+		} else {
+			// The fence guarantees nothing reads the range, so don't let GL sync on it
+			sl_gl_bind_array_buffer( stream->buffer );
+			ptr = glMapBufferRange( GL_ARRAY_BUFFER, *offset, size,
+									GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT );
+		}
+	}
+	stream->offset = start;
+	stream->reserved = size;
+	return ptr;
+}
+
+void sl_stream_buffer_commit( sl_stream_buffer *stream, u32 used )
+{
+	assert( used <= stream->reserved );
+
+	sl_gl_bind_array_buffer( stream->buffer );
+	if( stream->mode == SL_STREAM_BUFFER_MAPPED ) {
+		glUnmapBuffer( GL_ARRAY_BUFFER );
+	} else if( stream->mode == SL_STREAM_BUFFER_ORPHANED && used > 0 ) {
+		glBufferSubData( GL_ARRAY_BUFFER, stream->offset, used, stream->mapping );
+	}
+	stream->offset += used;
+	stream->reserved = 0;
+}
+
+void sl_stream_buffer_end_frame( sl_stream_buffer *stream )
+{
+	assert( stream->reserved == 0 );
+
+	// Orphaning needs no fences, and an untouched region needs no new one
+	if( stream->mode == SL_STREAM_BUFFER_ORPHANED || stream->offset == 0 ) {
+		return;
+	}
+	stream->fences[ stream->region ] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	stream->region = ( stream->region + 1 ) % SL_STREAM_BUFFER_FRAMES;
+	stream->offset = 0;
+}
+
+#endif
@@ -20,6 +20,7 @@ void sl_texture_create( sl_texture* tex, void *data, unsigned int width, unsigne
 	tex->height = height;
 	tex->format = format;
 	tex->internal_format = internal_format;
+	tex->load_state = SL_TEXTURE_LOADED;
 
 	glGenTextures( 1, &tex->gl_id );
 
@@ -36,20 +37,19 @@ void sl_texture_create( sl_texture* tex, void *data, unsigned int width, unsigne
 void sl_texture_destroy( sl_texture* tex )
 {
 	glDeleteTextures( 1, &tex->gl_id );
+	sl_gl_state_deleted( GL_TEXTURE_BINDING_2D, tex->gl_id );
 }
 
 void sl_texture_bind( sl_program *prog, sl_texture* tex )
 {
-	glActiveTexture( GL_TEXTURE0 );
-	glBindTexture( GL_TEXTURE_2D, tex->gl_id );
+	sl_gl_bind_texture( 0, tex->gl_id );
 
 	if( prog != NULL ) {
-		glUniform1i( glGetUniformLocation( prog->gl_prog_id, "texture" ), 0 );
+		glUniform1i( prog->loc_texture, 0 );
 	}
 }
 
 void sl_texture_unbind( sl_texture* tex )
 {
-	glActiveTexture( GL_TEXTURE0 );
-	glBindTexture( GL_TEXTURE_2D, 0 );
+	sl_gl_bind_texture( 0, 0 );
 }
@@ -0,0 +1,375 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "renderer/texture_loader.h"
+
+#include <string.h>
+#include <stb_image.h> // Implemented in src/dependancies/stb_image.c
+
+#include "slenderer.h"
+
+// Acquire/release access to the slot states shared between the render and worker threads
+#if defined( _MSC_VER )
+static u32 sl_texture_loader_load( volatile u32 *ptr )
+{
+	u32 val = *ptr;
+	MemoryBarrier( );
+	return val;
+}
+static void sl_texture_loader_store( volatile u32 *ptr, u32 val )
+{
+	MemoryBarrier( );
+	*ptr = val;
+}
+static SL_BOOL sl_texture_loader_claim( volatile u32 *ptr, u32 from, u32 to )
+{
+	return ( u32 )InterlockedCompareExchange( ( volatile LONG* )ptr, ( LONG )to, ( LONG )from ) == from;
+}
+#else
+	#define sl_texture_loader_load( ptr ) __atomic_load_n( ptr, __ATOMIC_ACQUIRE )
+	#define sl_texture_loader_store( ptr, val ) __atomic_store_n( ptr, val, __ATOMIC_RELEASE )
+static SL_BOOL sl_texture_loader_claim( volatile u32 *ptr, u32 from, u32 to )
+{
+	return __atomic_compare_exchange_n( ptr, &from, to, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+}
+#endif
+
+/*
+ * A 1x1 PNG compressed with zlib's fixed Huffman codes. stb_image builds its tables
+ * for those codes the first time it meets them, which isn't thread safe, so the
+ * loader decodes this once before starting the workers.
+ */
+static const unsigned char sl_texture_loader_warmup_png[ ] = {
+	0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52,
+	0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06, 0x00, 0x00, 0x00, 0x1f, 0x15, 0xc4,
+	0x89, 0x00, 0x00, 0x00, 0x0b, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x63, 0x60, 0x00, 0x02, 0x00,
+	0x00, 0x05, 0x00, 0x01, 0xe9, 0xfa, 0xdc, 0xd8, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4e, 0x44,
+	0xae, 0x42, 0x60, 0x82
+};
+
+/*
+ * Lets count waiting workers go, now or as soon as they wait.
+ */
+static void sl_texture_loader_wake( sl_texture_loader *loader, u32 count )
+{
+#if defined( VUL_WINDOWS )
+	ReleaseSemaphore( loader->wake, ( LONG )count, NULL );
+#else
+	pthread_mutex_lock( &loader->wake_lock );
+	loader->wakeups += count;
+	pthread_cond_broadcast( &loader->wake );
+	pthread_mutex_unlock( &loader->wake_lock );
+#endif
+}
+
+/*
+ * Blocks the calling worker until it's woken.
+ */
+static void sl_texture_loader_wait( sl_texture_loader *loader )
+{
+#if defined( VUL_WINDOWS )
+	WaitForSingleObject( loader->wake, INFINITE );
+#else
+	pthread_mutex_lock( &loader->wake_lock );
+	while( loader->wakeups == 0 ) {
+		pthread_cond_wait( &loader->wake, &loader->wake_lock );
+	}
+	--loader->wakeups;
+	pthread_mutex_unlock( &loader->wake_lock );
+#endif
+}
+
+/*
+ * Claims a queued slot and decodes it every time the worker is woken, until told
+ * to quit. Slots are queued before their wakeup, so there's always one to claim.
+ */
+static void sl_texture_loader_work( sl_texture_loader *loader )
+{
+	sl_texture_load_slot *slot;
+	const char *reason;
+	int components;
+	u32 i;
+
+#ifdef SL_PROFILER
+	sl_profiler_name_thread( "texture decode" );
+#endif
+	for( ;; ) {
+		sl_texture_loader_wait( loader );
+		if( sl_texture_loader_load( &loader->quit ) ) {
+			break;
+		}
+		for( i = 0; i < SL_TEXTURE_LOADER_SLOTS; ++i ) {
+			slot = &loader->slots[ i ];
+			if( !sl_texture_loader_claim( &slot->state, SL_TEXTURE_SLOT_QUEUED, SL_TEXTURE_SLOT_DECODING ) ) {
+				continue;
+			}
+			SL_PROFILE_ZONE_BEGIN( "texture decode" );
+			slot->pixels = stbi_load( slot->path, &slot->width, &slot->height, &components, 4 );
+			SL_PROFILE_ZONE_END( );
+			if( !slot->pixels ) {
+				// The reason is only kept until the worker's next decode
+				reason = stbi_failure_reason( );
+				strncpy( slot->failure, reason ? reason : "unknown error", SL_TEXTURE_LOADER_FAILURE_MAX - 1 );
+				slot->failure[ SL_TEXTURE_LOADER_FAILURE_MAX - 1 ] = 0;
+			}
+			sl_texture_loader_store( &slot->state, slot->pixels ? SL_TEXTURE_SLOT_DECODED : SL_TEXTURE_SLOT_FAILED );
+			break;
+		}
+	}
+}
+
+#if defined( VUL_WINDOWS )
+static DWORD WINAPI sl_texture_loader_thread( LPVOID data )
+{
+	sl_texture_loader_work( ( sl_texture_loader* )data );
+	return 0;
+}
+#else
+static void *sl_texture_loader_thread( void *data )
+{
+	sl_texture_loader_work( ( sl_texture_loader* )data );
+	return NULL;
+}
+#endif
+
+static void sl_texture_loader_start( sl_texture_loader *loader )
+{
+	unsigned char *pixels;
+	int width, height, components;
+	u32 i;
+
+	// Let stb_image finish its lazy setup on this thread, before any worker can race on it
+	pixels = stbi_load_from_memory( sl_texture_loader_warmup_png, sizeof( sl_texture_loader_warmup_png ),
+									&width, &height, &components, 4 );
+	assert( pixels );
+	stbi_image_free( pixels );
+
+#if defined( VUL_WINDOWS )
+	loader->wake = CreateSemaphore( NULL, 0, SL_TEXTURE_LOADER_SLOTS + SL_TEXTURE_LOADER_THREADS, NULL );
+	assert( loader->wake );
+#else
+	pthread_mutex_init( &loader->wake_lock, NULL );
+	pthread_cond_init( &loader->wake, NULL );
+	loader->wakeups = 0;
+#endif
+	for( i = 0; i < SL_TEXTURE_LOADER_THREADS; ++i ) {
+#if defined( VUL_WINDOWS )
+		loader->threads[ i ] = CreateThread( NULL, 0, sl_texture_loader_thread, loader, 0, NULL );
+		assert( loader->threads[ i ] );
+#else
+		if( pthread_create( &loader->threads[ i ], NULL, sl_texture_loader_thread, loader ) ) {
+			assert( SL_FALSE ); // Failed to start a texture loader thread
+		}
+#endif
+	}
+	loader->started = SL_TRUE;
+}
+
+/*
+ * Moves queued requests into free slots, oldest first.
+ */
+static void sl_texture_loader_fill_slots( sl_texture_loader *loader )
+{
+	sl_texture_load_request *req;
+	sl_texture_load_slot *slot;
+	u32 i, taken;
+
+	taken = 0;
+	for( i = 0; i < SL_TEXTURE_LOADER_SLOTS && taken < vul_vector_size( loader->queue ); ++i ) {
+		slot = &loader->slots[ i ];
+		if( sl_texture_loader_load( &slot->state ) != SL_TEXTURE_SLOT_FREE ) {
+			continue;
+		}
+		req = ( sl_texture_load_request* )vul_vector_get( loader->queue, taken++ );
+		slot->path = req->path;
+		slot->texture_id = req->texture_id;
+		slot->pixels = NULL;
+		slot->gl_id = 0;
+		slot->rows_uploaded = 0;
+		sl_texture_loader_store( &slot->state, SL_TEXTURE_SLOT_QUEUED );
+	}
+	if( taken == 0 ) {
+		return;
+	}
+	sl_texture_loader_wake( loader, taken );
+	req = ( sl_texture_load_request* )vul_vector_begin( loader->queue );
+	memmove( req, req + taken, sizeof( sl_texture_load_request ) * ( vul_vector_size( loader->queue ) - taken ) );
+	vul_vector_resize( loader->queue, vul_vector_size( loader->queue ) - taken, VUL_FALSE, VUL_FALSE );
+}
+
+/*
+ * Hands a slot back once its image is in, or has failed.
+ */
+static void sl_texture_loader_release( sl_texture_loader *loader, sl_texture_load_slot *slot )
+{
+	if( slot->pixels ) {
+		stbi_image_free( slot->pixels );
+		slot->pixels = NULL;
+	}
+	SL_DEALLOC( slot->path );
+	slot->path = NULL;
+	--loader->pending;
+	sl_texture_loader_store( &slot->state, SL_TEXTURE_SLOT_FREE );
+}
+
+void sl_texture_loader_create( sl_texture_loader *loader )
+{
+	memset( loader, 0, sizeof( sl_texture_loader ) );
+	loader->queue = vul_vector_create( sizeof( sl_texture_load_request ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+}
+
+void sl_texture_loader_destroy( sl_texture_loader *loader )
+{
+	sl_texture_load_request *it, *last;
+	u32 i;
+
+	if( loader->started ) {
+		sl_texture_loader_store( &loader->quit, SL_TRUE );
+		sl_texture_loader_wake( loader, SL_TEXTURE_LOADER_THREADS );
+		for( i = 0; i < SL_TEXTURE_LOADER_THREADS; ++i ) {
+#if defined( VUL_WINDOWS )
+			WaitForSingleObject( loader->threads[ i ], INFINITE );
+			CloseHandle( loader->threads[ i ] );
+#else
+			pthread_join( loader->threads[ i ], NULL );
+#endif
+		}
+#if defined( VUL_WINDOWS )
+		CloseHandle( loader->wake );
+#else
+		pthread_cond_destroy( &loader->wake );
+		pthread_mutex_destroy( &loader->wake_lock );
+#endif
+	}
+
+	// The workers are gone, so every slot is ours
+	for( i = 0; i < SL_TEXTURE_LOADER_SLOTS; ++i ) {
+		if( loader->slots[ i ].state == SL_TEXTURE_SLOT_FREE ) {
+			continue;
+		}
+		if( loader->slots[ i ].gl_id ) {
+			glDeleteTextures( 1, &loader->slots[ i ].gl_id );
+			sl_gl_state_deleted( GL_TEXTURE_BINDING_2D, loader->slots[ i ].gl_id );
+		}
+		sl_texture_loader_release( loader, &loader->slots[ i ] );
+	}
+	vul_foreach( sl_texture_load_request, it, last, loader->queue ) {
+		SL_DEALLOC( it->path );
+	}
+	vul_vector_destroy( loader->queue );
+}
+
+void sl_texture_loader_update( sl_texture_loader *loader, u32 budget )
+{
+	sl_texture_load_slot *slot;
+	sl_texture *tex;
+	u32 i, row_bytes;
+	int rows;
+	SL_BOOL uploaded;
+
+	if( loader->pending == 0 ) {
+		return;
+	}
+
+	uploaded = SL_FALSE;
+	for( i = 0; i < SL_TEXTURE_LOADER_SLOTS; ++i ) {
+		slot = &loader->slots[ i ];
+		switch( sl_texture_loader_load( &slot->state ) ) {
+		case SL_TEXTURE_SLOT_FAILED:
+			sl_print( 256, "Failed to load texture %s: %s\n", slot->path, slot->failure );
+			tex = sl_renderer_get_texture_by_id( slot->texture_id );
+			tex->load_state = SL_TEXTURE_LOAD_FAILED;
+			sl_texture_loader_release( loader, slot );
+			break;
+		case SL_TEXTURE_SLOT_DECODED:
+			// Upload as many rows as the budget allows, but always some so every image gets in
+			row_bytes = ( u32 )slot->width * 4;
+			rows = ( int )( budget / row_bytes );
+			if( rows == 0 ) {
+				if( uploaded ) {
+					break;
+				}
+				rows = 1;
+			}
+			rows = SL_MIN( rows, slot->height - slot->rows_uploaded );
+
+			if( slot->gl_id == 0 ) {
+				// Upload into a texture of its own, so the placeholder shows until it's complete
+				glGenTextures( 1, &slot->gl_id );
+				sl_gl_bind_texture( 0, slot->gl_id );
+				glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+				glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+				glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, slot->width, slot->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+			} else {
+				sl_gl_bind_texture( 0, slot->gl_id );
+			}
+			glTexSubImage2D( GL_TEXTURE_2D, 0, 0, slot->rows_uploaded, slot->width, rows, GL_RGBA, GL_UNSIGNED_BYTE,
+							 slot->pixels + ( size_t )slot->rows_uploaded * row_bytes );
+			slot->rows_uploaded += rows;
+			budget = ( u32 )rows * row_bytes >= budget ? 0 : budget - ( u32 )rows * row_bytes;
+			uploaded = SL_TRUE;
+
+			if( slot->rows_uploaded == slot->height ) {
+				// Swap the placeholder out for the real thing
+				tex = sl_renderer_get_texture_by_id( slot->texture_id );
+				glDeleteTextures( 1, &tex->gl_id );
+				sl_gl_state_deleted( GL_TEXTURE_BINDING_2D, tex->gl_id );
+				tex->gl_id = slot->gl_id;
+				tex->width = ( unsigned int )slot->width;
+				tex->height = ( unsigned int )slot->height;
+				tex->load_state = SL_TEXTURE_LOADED;
+				slot->gl_id = 0;
+				sl_texture_loader_release( loader, slot );
+			}
+			break;
+		}
+	}
+	sl_texture_unbind( NULL );
+
+	sl_texture_loader_fill_slots( loader );
+}
+
+unsigned int sl_texture_load_async( const char *path )
+{
+	sl_texture_loader *loader;
+	sl_texture_load_request *req;
+	sl_texture *tex;
+	unsigned char placeholder[ 4 ] = { 0, 0, 0, 0 };
+	size_t length;
+
+	loader = &sl_renderer_global->texture_loader;
+	if( !loader->started ) {
+		sl_texture_loader_start( loader );
+	}
+
+	tex = sl_renderer_allocate_texture( );
+	sl_texture_create( tex, placeholder, 1, 1, GL_RGBA, GL_RGBA );
+	tex->load_state = SL_TEXTURE_LOADING;
+
+	length = strlen( path ) + 1;
+	req = ( sl_texture_load_request* )vul_vector_add_empty( loader->queue );
+	req->path = ( char* )SL_ALLOC( length );
+	memcpy( req->path, path, length );
+	req->texture_id = tex->texture_id;
+	++loader->pending;
+
+	sl_texture_loader_fill_slots( loader );
+
+	return tex->texture_id;
+}
+
+u32 sl_texture_loads_pending( )
+{
+	return sl_renderer_global->texture_loader.pending;
+}
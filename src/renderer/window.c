@@ -34,29 +34,77 @@ void sl_window_create( sl_window* win, unsigned int width, unsigned int height,
 		glfwWindowHint( GLFW_RESIZABLE, GL_FALSE );
 	}
 			
+	// Nothing is bound in a new context
+	win->gl_state = ( sl_gl_state* )SL_ALLOC( sizeof( sl_gl_state ) );
+	sl_gl_state_create( win->gl_state );
+	sl_window_make_current( win );
+
 	if( !vsync ) {
 		// If no VSYNC, turn it off.
-		glfwMakeContextCurrent( win->handle );
 		glfwSwapInterval( 0 );
 	}
 
+	win->offscreen = SL_FALSE;
 	glfwSetWindowSizeCallback( win->handle, sl_window_size_callback );
 }
 
-void sl_window_create_fbo( sl_window *win, unsigned int width, unsigned int height )
-{	
-	GLenum status;
+void sl_window_create_offscreen( sl_window* win, unsigned int width, unsigned int height, sl_window *context_share )
+{
+	glfwWindowHint( GLFW_VISIBLE, GL_FALSE );
+#if defined( SL_OSMESA ) && defined( GLFW_OSMESA_CONTEXT_API )
+	glfwWindowHint( GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API );
+#endif
+	win->handle = glfwCreateWindow( width, 
+									height, 
+									"", 
+									NULL,
+									context_share == NULL ? NULL : context_share->handle );
+	// Restore the hints so later windows are visible
+	glfwWindowHint( GLFW_VISIBLE, GL_TRUE );
+#if defined( SL_OSMESA ) && defined( GLFW_OSMESA_CONTEXT_API )
+	glfwWindowHint( GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API );
+#endif
 
-	/* Create the framebufferobject we render to before post */
-	glActiveTexture( GL_TEXTURE0 );
-	glGenTextures( 1, &win->fbo_texture );
-	glBindTexture( GL_TEXTURE_2D, win->fbo_texture );
+	if ( !win->handle )
+	{
+		assert( SL_FALSE ); //Failed to create a GLFW window
+		return;
+	}
+
+	// Nothing is presented, so never wait for a vertical blank
+	win->gl_state = ( sl_gl_state* )SL_ALLOC( sizeof( sl_gl_state ) );
+	sl_gl_state_create( win->gl_state );
+	sl_window_make_current( win );
+	glfwSwapInterval( 0 );
+
+	win->offscreen = SL_TRUE;
+}
+
+/*
+ * Creates an RGBA8 texture of the given size to render into.
+ */
+static GLuint sl_window_create_color_texture( unsigned int width, unsigned int height )
+{
+	GLuint texture;
+
+	glGenTextures( 1, &texture );
+	sl_gl_bind_texture( 0, texture );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
 	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
 	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
-	glBindTexture( GL_TEXTURE_2D, 0 );
+	sl_gl_bind_texture( 0, 0 );
+
+	return texture;
+}
+
+void sl_window_create_fbo( sl_window *win, unsigned int width, unsigned int height )
+{	
+	GLenum status;
+
+	/* Create the framebufferobject we render to before post */
+	win->fbo_texture = sl_window_create_color_texture( width, height );
 
 	/* Depth buffer */
 	glGenRenderbuffers( 1, &win->rbo_depth );
@@ -66,19 +114,47 @@ void sl_window_create_fbo( sl_window *win, unsigned int width, unsigned int heig
 
 	/* Link them */
 	glGenFramebuffers( 1, &win->fbo );
-	glBindFramebuffer( GL_FRAMEBUFFER, win->fbo );
+	sl_gl_bind_framebuffer( win->fbo );
 	glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, win->fbo_texture, 0 );
 	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, win->rbo_depth );
 	
 	assert( ( status = glCheckFramebufferStatus( GL_FRAMEBUFFER ) ) == GL_FRAMEBUFFER_COMPLETE );
-	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	sl_gl_bind_framebuffer( 0 );
+
+	/* A hidden window's own framebuffer isn't guaranteed to hold anything, so post renders to another FBO */
+	if( win->offscreen ) {
+		win->post_texture = sl_window_create_color_texture( width, height );
+		glGenFramebuffers( 1, &win->post_fbo );
+		sl_gl_bind_framebuffer( win->post_fbo );
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, win->post_texture, 0 );
+
+		assert( ( status = glCheckFramebufferStatus( GL_FRAMEBUFFER ) ) == GL_FRAMEBUFFER_COMPLETE );
+		sl_gl_bind_framebuffer( 0 );
+	}
 }
 
 void sl_window_destroy_fbo( sl_window *win )
 {
+	sl_window_make_current( win );
 	glDeleteRenderbuffers( 1, &win->rbo_depth );
 	glDeleteTextures( 1, &win->fbo_texture);
+	sl_gl_state_deleted( GL_TEXTURE_BINDING_2D, win->fbo_texture );
 	glDeleteFramebuffers( 1, &win->fbo );
+	sl_gl_state_deleted( GL_FRAMEBUFFER_BINDING, win->fbo );
+	if( win->offscreen ) {
+		glDeleteTextures( 1, &win->post_texture );
+		sl_gl_state_deleted( GL_TEXTURE_BINDING_2D, win->post_texture );
+		glDeleteFramebuffers( 1, &win->post_fbo );
+		sl_gl_state_deleted( GL_FRAMEBUFFER_BINDING, win->post_fbo );
+	}
+}
+
+void sl_window_make_current( sl_window *win )
+{
+	if( glfwGetCurrentContext( ) != win->handle ) {
+		glfwMakeContextCurrent( win->handle );
+	}
+	sl_gl_state_make_current( win->gl_state );
 }
 
 void sl_window_destroy( sl_window* win )
@@ -88,6 +164,8 @@ void sl_window_destroy( sl_window* win )
 #endif
 
 	glfwDestroyWindow( win->handle );
+	sl_gl_state_destroy( win->gl_state );
+	SL_DEALLOC( win->gl_state );
 }
 
 void sl_window_bind_framebuffer_fbo( sl_window* win )
@@ -95,14 +173,14 @@ void sl_window_bind_framebuffer_fbo( sl_window* win )
 	int w, h;
 
 	// Make the context current
-	glfwMakeContextCurrent( win->handle );
+	sl_window_make_current( win );
 
 	// Set up viewport
 	glfwGetFramebufferSize( win->handle, &w, &h );
-	glViewport( 0, 0, w, h );
+	sl_gl_viewport( 0, 0, w, h );
 
 	// Select the FBO
-	glBindFramebuffer( GL_FRAMEBUFFER, win->fbo );
+	sl_gl_bind_framebuffer( win->fbo );
 
 	// Clear the famebuffer
 	glClearColor( 0.f, 0.f, 0.f, 1.f );
@@ -114,14 +192,14 @@ void sl_window_bind_framebuffer_post( sl_window* win )
 	int w, h;
 
 	// Make the context current
-	glfwMakeContextCurrent( win->handle );
+	sl_window_make_current( win );
 
 	// Set up viewport
 	glfwGetFramebufferSize( win->handle, &w, &h );
-	glViewport( 0, 0, w, h );
+	sl_gl_viewport( 0, 0, w, h );
 	
-	// Select the Window
-	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	// Select the Window, or what stands in for it
+	sl_gl_bind_framebuffer( win->offscreen ? win->post_fbo : 0 );
 
 	// Clear the famebuffer
 	glClearColor( 0.f, 0.f, 0.f, 1.f ); // @TODO: Make this black again I guess..
@@ -130,13 +208,53 @@ void sl_window_bind_framebuffer_post( sl_window* win )
 
 void sl_window_swap_buffers( sl_window *win )
 {
-	// Issue the command to swap buffers
-	glfwSwapBuffers( win->handle );
+	if( win->offscreen ) {
+		// Nothing to present; wait for the frame instead so it is timed in full.
+		glFinish( );
+	} else {
+		// Issue the command to swap buffers
+		glfwSwapBuffers( win->handle );
+	}
 
 	// Poll events before we hand over the spotlight.
 	glfwPollEvents( );
 }
 
+void sl_window_read_pixels( sl_window *win, int from_fbo, unsigned char *out )
+{
+	int w, h, y, x;
+	unsigned char *top, *bottom, tmp;
+
+	sl_window_make_current( win );
+	glfwGetFramebufferSize( win->handle, &w, &h );
+
+	// Select what to read from
+#ifdef SL_LEGACY_OPENGL
+	glReadBuffer( GL_BACK );
+#else
+	// Offscreen windows never read their own framebuffer; post rendered to post_fbo
+	sl_gl_bind_framebuffer( from_fbo ? win->fbo : win->offscreen ? win->post_fbo : 0 );
+#ifndef SL_OPENGL_ES
+	glReadBuffer( from_fbo || win->offscreen ? GL_COLOR_ATTACHMENT0 : GL_BACK );
+#endif
+#endif
+
+	// Rows are tightly packed; glReadPixels waits for rendering to finish.
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, out );
+	sl_gl_bind_framebuffer( 0 );
+
+	// GL returns the bottom row first; flip it.
+	for( y = 0; y < h / 2; ++y ) {
+		top = out + y * w * 4;
+		bottom = out + ( h - 1 - y ) * w * 4;
+		for( x = 0; x < w * 4; ++x ) {
+			tmp = top[ x ];
+			top[ x ] = bottom[ x ];
+			bottom[ x ] = tmp;
+		}
+	}
+}
 
 void sl_window_size_callback( GLFWwindow* window, int width, int height )
 {
@@ -19,6 +19,14 @@ sl_renderer *sl_renderer_global = NULL;
 
 void sl_renderer_create(  )
 {
+#ifdef SL_PROFILER
+	char zone_name[ SL_PROFILER_ZONE_NAME_MAX ];
+	int i;
+
+	// Before any thread is started, so this one owns the frame stats
+	sl_profiler_init( );
+#endif
+
 	// Init glfw
 #ifdef SL_DEBUG
 	assert( glfwInit( ) );
@@ -50,15 +58,26 @@ void sl_renderer_create(  )
 	sl_renderer_global->animators = vul_vector_create( sizeof( sl_animator ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
 	sl_renderer_global->simulators = vul_vector_create( sizeof( sl_simulator ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
 	sl_renderer_global->textures = vul_vector_create( sizeof( sl_texture ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
+	sl_texture_loader_create( &sl_renderer_global->texture_loader );
 	sl_renderer_global->programs = vul_vector_create( sizeof( sl_program ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
 	sl_renderer_global->renderables = vul_vector_create( sizeof( sl_renderable ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
 #ifndef SL_NO_AUDIO
 	sl_renderer_global->aurators = vul_vector_create( sizeof( sl_aurator ), 0, SL_ALLOC, SL_DEALLOC, SL_REALLOC );
 #endif
+#ifdef SL_INSTANCING
+	memset( &sl_renderer_global->instance_stream, 0, sizeof( sl_stream_buffer ) );
+#endif
 	
 	sl_controller_create( );
 
 	sl_renderer_global->next_scene_id = 0;
+
+#ifdef SL_PROFILER
+	for( i = 0; i < SL_MAX_LAYERS; ++i ) {
+		snprintf( zone_name, SL_PROFILER_ZONE_NAME_MAX, "layer %d", i );
+		sl_renderer_global->profiler_layer_zones[ i ] = sl_profiler_zone_id( zone_name );
+	}
+#endif
 }
 
 void sl_renderer_destroy( )
@@ -75,10 +94,17 @@ void sl_renderer_destroy( )
 #endif
 
 	// Clean up
+	sl_texture_loader_destroy( &sl_renderer_global->texture_loader );
+
 	vul_foreach( sl_renderable, itr, lastr, sl_renderer_global->renderables ) {
 		sl_renderable_destroy( itr );
 	}
 	vul_vector_destroy( sl_renderer_global->renderables );
+#ifdef SL_INSTANCING
+	if( sl_renderer_global->instance_stream.buffer ) {
+		sl_stream_buffer_destroy( &sl_renderer_global->instance_stream );
+	}
+#endif
 
 	vul_foreach( sl_program, itp, lastp, sl_renderer_global->programs ) {
 		sl_program_destroy( itp );
@@ -122,20 +148,22 @@ void sl_renderer_destroy( )
 	// Destroy the controller
 	sl_controller_destroy( );
 
+#ifdef SL_PROFILER
+	// Every thread that could still be tracing has stopped by now
+	sl_profiler_shutdown( );
+#endif
+
 	SL_DEALLOC( sl_renderer_global );
 
 	// And shut down glfw
 	glfwTerminate( );
 }
 
-sl_window *sl_renderer_open_window( unsigned int width, unsigned int height, const char *title, int fullscreen, int vsync )
+/*
+ * Sets up the GL side of a newly created window.
+ */
+static void sl_renderer_init_window( sl_window *win, unsigned int width, unsigned int height )
 {
-	sl_window *win;
-	
-	win = ( sl_window* )vul_vector_add_empty( sl_renderer_global->windows );
-	win->window_id = vul_vector_size( sl_renderer_global->windows ) - 1;
-	sl_window_create( win, width, height, title, fullscreen, vsync, NULL );
-
 	// Need to initalize glew if we haven't
 	if( win->window_id == 0 ) {
 		glewExperimental = GL_TRUE;
@@ -144,12 +172,46 @@ sl_window *sl_renderer_open_window( unsigned int width, unsigned int height, con
 		// And create the FBO
 #ifndef SL_LEGACY_OPENGL
 		sl_window_create_fbo( win, width, height );
+#endif
+#ifdef SL_INSTANCING
+		// And the buffer we stream instanced runs through
+		sl_stream_buffer_create( &sl_renderer_global->instance_stream, SL_INSTANCE_STREAM_INSTANCES * sizeof( sl_entity_instance ) );
 #endif
 	}
+}
+
+sl_window *sl_renderer_open_window( unsigned int width, unsigned int height, const char *title, int fullscreen, int vsync )
+{
+	sl_window *win;
+	
+	win = ( sl_window* )vul_vector_add_empty( sl_renderer_global->windows );
+	win->window_id = vul_vector_size( sl_renderer_global->windows ) - 1;
+	sl_window_create( win, width, height, title, fullscreen, vsync, NULL );
+	sl_renderer_init_window( win, width, height );
 
 	return win;
 }
 
+sl_window *sl_renderer_open_offscreen( unsigned int width, unsigned int height )
+{
+	sl_window *win;
+	
+	win = ( sl_window* )vul_vector_add_empty( sl_renderer_global->windows );
+	win->window_id = vul_vector_size( sl_renderer_global->windows ) - 1;
+	sl_window_create_offscreen( win, width, height, NULL );
+	sl_renderer_init_window( win, width, height );
+
+	return win;
+}
+
+void sl_renderer_read_pixels( unsigned int window_index, SL_BOOL from_fbo, unsigned char *out )
+{
+	sl_window *win;
+
+	win = ( sl_window* )vul_vector_get( sl_renderer_global->windows, window_index );
+	sl_window_read_pixels( win, from_fbo, out );
+}
+
 void sl_renderer_close_window( u32 win_id )
 {
 	sl_window *win;
@@ -326,6 +388,28 @@ sl_program *sl_renderer_allocate_program( )
 	return p;
 }
 
+#ifdef SL_PROFILER
+SL_BOOL sl_renderer_capture_trace( const char *path, u32 frame_count )
+{
+	return sl_profiler_capture_trace( path, frame_count );
+}
+#endif
+
+#ifdef SL_INSTANCING
+/*
+ * Draws count instances whose records are offset bytes into the instance stream.
+ */
+static void sl_renderer_draw_instance_range( sl_renderable *ren, u32 offset, u32 count )
+{
+	if( count == 0 ) {
+		return;
+	}
+	sl_renderable_bind_instances( ren, sl_renderer_global->instance_stream.buffer, offset );
+	glDrawElementsInstanced( GL_TRIANGLES, ren->index_count, GL_UNSIGNED_SHORT, 0, count );
+	sl_renderable_unbind_instances( );
+}
+#endif
+
 void sl_renderer_render_scene( unsigned int scene_index, unsigned int window_index, SL_BOOL swap_buffers )
 {
 	sl_scene *scene;
@@ -335,19 +419,19 @@ void sl_renderer_render_scene( unsigned int scene_index, unsigned int window_ind
 #endif
 	sl_simulator *sim;
 	sl_window *win;
-	sl_entity *it, *last_it; // iterator
+	u32 it, last_it; // iterator, an index into the layer's render order
+	u32 e; // The entity at it, an index into the layer
 	int i, cpi, cti, cri;
 	sl_program *cp; // Current program
 	sl_texture *ct; // Current texture
 	sl_renderable *cr; // Current renderable
-#ifdef SL_DEBUG
-	vul_timer *timer;
-	u64 last, now, elapsed, first, time_layers[ SL_MAX_LAYERS ];
-	timer = vul_timer_create( );
-	last = vul_timer_get_micros( timer );
-	first = last;
+#ifdef SL_INSTANCING
+	sl_entity_instance *instances; // Instances of the current run
+	sl_entity_instance single; // An entity's instance attributes when they can't be streamed
+	u32 instance_count, instance_offset, run_end;
 #endif
 
+	SL_PROFILE_ZONE_BEGIN( "setup" );
 	// Check that the window is still open, and make it current
 	win = ( sl_window* )vul_vector_get( sl_renderer_global->windows, window_index );
 #ifdef SL_DEBUG
@@ -363,48 +447,33 @@ void sl_renderer_render_scene( unsigned int scene_index, unsigned int window_ind
 #else
 	sl_window_bind_framebuffer_fbo( win );
 #endif
-#ifdef SL_DEBUG
-	now = vul_timer_get_micros( timer );
-	elapsed = now - last;
-	sl_print( 64, "Frame time (setup): %llu micros\n", elapsed );
-	last = now;
-#endif
+	SL_PROFILE_ZONE_END( );
 
 	// Update the corresponding animator
+	SL_PROFILE_ZONE_BEGIN( "animation" );
 	anim = sl_renderer_get_animator_for_scene( scene_index );
 	sl_animator_update( anim );
-#ifdef SL_DEBUG
-	now = vul_timer_get_micros( timer );
-	elapsed = now - last;
-	sl_print( 64, "Frame time (animation): %llu micros\n", elapsed );
-	last = now;
-#endif
+	SL_PROFILE_ZONE_END( );
 
 	// Update the corresponding simulator
+	SL_PROFILE_ZONE_BEGIN( "simulation" );
 	sim = sl_renderer_get_simulator_for_scene( scene_index );
 	sl_simulator_update( sim );
-#ifdef SL_DEBUG
-	now = vul_timer_get_micros( timer );
-	elapsed = now - last;
-	sl_print( 64, "Frame time (simulation): %llu micros\n", elapsed );
-	last = now;
-#endif
+	SL_PROFILE_ZONE_END( );
 
 	// Grab the scene and sort it
+	SL_PROFILE_ZONE_BEGIN( "sort" );
 	scene = sl_renderer_get_scene_by_id( scene_index );
 	sl_scene_sort( scene );
-#ifdef SL_DEBUG
-	now = vul_timer_get_micros( timer );
-	elapsed = now - last;
-	sl_print( 64, "Frame time (sort): %llu micros\n", elapsed );
-	last = now;
-#endif
+	SL_PROFILE_ZONE_END( );
 	
-	// Set GL state
-	glDisable( GL_DEPTH_TEST );
-	glEnable( GL_TEXTURE_2D );
-	glEnable( GL_BLEND );
-	glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+	// Set GL state; only what changed since the last frame is issued
+	sl_gl_set_capability( GL_DEPTH_TEST, SL_FALSE );
+#ifdef SL_LEGACY_OPENGL
+	sl_gl_set_capability( GL_TEXTURE_2D, SL_TRUE );
+#endif
+	sl_gl_set_capability( GL_BLEND, SL_TRUE );
+	sl_gl_blend_func( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
 
 	cp = NULL;
 	ct = NULL;
@@ -414,108 +483,135 @@ void sl_renderer_render_scene( unsigned int scene_index, unsigned int window_ind
 	cri = -1;
 	for( i = 0; i < SL_MAX_LAYERS; ++i )
 	{
-		vul_foreach( sl_entity, it, last_it, scene->layers[ i ] )
+		SL_PROFILE_ZONE_BEGIN_ID( sl_renderer_global->profiler_layer_zones[ i ] );
+		it = 0;
+		last_it = SL_LAYER_ORDER_SIZE( scene, i );
+		while( it != last_it )
 		{
+			e = SL_LAYER_ORDER( scene, i, it );
 			// If the quad is invisible, don't render it
-			if( it->hidden ) {
+			if( SL_LAYER_HIDDEN( scene, i, e ) ) {
+				++it;
 				continue;
 			}
-			// If new program, rebind it
-			if( cpi != it->program_id ) {
-				cpi = it->program_id;
-				sl_program_unbind( cp );
+			// If new program, rebind it. Binds are tracked, so the previous one needn't be unbound
+			if( cpi != SL_LAYER_PROGRAM( scene, i, e ) ) {
+				cpi = SL_LAYER_PROGRAM( scene, i, e );
 				cp = ( sl_program* )vul_vector_get( sl_renderer_global->programs, cpi );
 				sl_program_bind( cp );
 			}
 			// If new texture, rebind it
-			if( cti != it->texture_id ) {
-				cti = it->texture_id;
-				sl_texture_unbind( ct );
+			if( cti != SL_LAYER_TEXTURE( scene, i, e ) ) {
+				cti = SL_LAYER_TEXTURE( scene, i, e );
 				if( cti != SL_INVISIBLE_TEXTURE ) {
 					ct = ( sl_texture* )vul_vector_get( sl_renderer_global->textures, cti );
 					sl_texture_bind( cp, ct );
+				} else {
+					sl_texture_unbind( ct );
 				}
 			}
 			// If new renderable, rebind it
-			if( cri != it->renderable_id ) {
-				cri = it->renderable_id;
-				sl_renderable_unbind( );
+			if( cri != SL_LAYER_RENDERABLE( scene, i, e ) ) {
+				cri = SL_LAYER_RENDERABLE( scene, i, e );
 				cr = ( sl_renderable* )vul_vector_get( sl_renderer_global->renderables, cri );
 				sl_renderable_bind( cr );
 			}
 #ifdef SL_LEGACY_OPENGL
-			sl_renderer_draw_legacy_instance( &scene->camera_pos, cr, it );
+			sl_renderer_draw_legacy_instance( &scene->camera_pos, cr, SL_LAYER_TRANSFORM( scene, i, e ), SL_LAYER_COLOR( scene, i, e ),
+											  SL_LAYER_UVS( scene, i, e ), SL_LAYER_FLIP_UVS( scene, i, e ) );
 #else
-			sl_entity_bind( it, &scene->camera_pos, cp );
+#ifdef SL_INSTANCING
+			if( cp->instanced ) {
+				// Find the run sharing program, texture and renderable, pack it straight
+				// into the stream buffer and draw it at once
+				for( run_end = it + 1; run_end != last_it; ++run_end ) {
+					e = SL_LAYER_ORDER( scene, i, run_end );
+					if( SL_LAYER_PROGRAM( scene, i, e ) != cpi 
+					 || SL_LAYER_TEXTURE( scene, i, e ) != cti 
+					 || SL_LAYER_RENDERABLE( scene, i, e ) != cri ) {
+						break;
+					}
+				}
+				instances = ( sl_entity_instance* )sl_stream_buffer_reserve( &sl_renderer_global->instance_stream, 
+																			 ( run_end - it ) * sizeof( sl_entity_instance ), &instance_offset );
+				instance_count = 0;
+				for( ; it != run_end; ++it ) {
+					e = SL_LAYER_ORDER( scene, i, it );
+					if( !SL_LAYER_HIDDEN( scene, i, e ) ) {
+						sl_entity_pack_instance( &instances[ instance_count++ ], SL_LAYER_TRANSFORM( scene, i, e ), SL_LAYER_COLOR( scene, i, e ),
+												 SL_LAYER_UVS( scene, i, e ), SL_LAYER_FLIP_UVS( scene, i, e ), &scene->camera_pos );
+					}
+				}
+				sl_stream_buffer_commit( &sl_renderer_global->instance_stream, instance_count * sizeof( sl_entity_instance ) );
+				sl_renderer_draw_instance_range( cr, instance_offset, instance_count );
+				continue;
+			}
+			if( cp->reads_instances ) {
+				// No attribute divisors; pass the instance attributes as constants, one entity at a time
+				sl_entity_pack_instance( &single, SL_LAYER_TRANSFORM( scene, i, e ), SL_LAYER_COLOR( scene, i, e ),
+										 SL_LAYER_UVS( scene, i, e ), SL_LAYER_FLIP_UVS( scene, i, e ), &scene->camera_pos );
+				sl_renderable_set_instance( &single );
+				sl_renderer_draw_instance( cr );
+				++it;
+				continue;
+			}
+#endif
+			sl_entity_bind( SL_LAYER_TRANSFORM( scene, i, e ), SL_LAYER_COLOR( scene, i, e ), SL_LAYER_UVS( scene, i, e ),
+							SL_LAYER_FLIP_UVS( scene, i, e ), &scene->camera_pos, cp );
 			sl_renderer_draw_instance( cr );
 #endif
+			++it;
 		}
-#ifdef SL_DEBUG
-		now = vul_timer_get_micros( timer );
-		time_layers[ i ] = now - last;
-		last = now;
-#endif
+		SL_PROFILE_ZONE_END( );
 	}
-#ifdef SL_DEBUG
-	elapsed = 0;
-	for( i = 0; i < SL_MAX_LAYERS; ++i ) {
-		elapsed += time_layers[ i ];
-	}
-	sl_print( 64, "Frame time (render): %llu micros\n", elapsed );
-	last = now;
-#endif
 
 	// Render post
 #ifndef SL_LEGACY_OPENGL
+	SL_PROFILE_ZONE_BEGIN( "post" );
 	sl_window_bind_framebuffer_post( win );
 	{
 		// Bind the program
 		cp = sl_renderer_get_program_by_id( scene->post_program_id );
 		sl_program_bind( cp );
 		// Bind the FBO as the texture
-		glActiveTexture( GL_TEXTURE0 );
-		glBindTexture( GL_TEXTURE_2D, win->fbo_texture );
-		glUniform1i( glGetUniformLocation( cp->gl_prog_id, "texture" ), 0 );
+		sl_gl_bind_texture( 0, win->fbo_texture );
+		glUniform1i( cp->loc_texture, 0 );
 		// Bind the renderable
 		sl_renderable_bind( &scene->post_renderable );
 		// Bind program parameters
 		if( scene->post_program_callback ) {
 			scene->post_program_callback( cp );
 		}
-		// And draw the instance
+		// And draw the instance. Everything is left bound; the next frame rebinds
+		// only what differs.
 		glDrawElements( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0 );
-		// And unbind things
-		sl_renderable_unbind( &scene->post_renderable );
-		glBindTexture( GL_TEXTURE_2D, 0 );
-		sl_program_unbind( cp );
 	}
-#ifdef SL_DEBUG
-	now = vul_timer_get_micros( timer );
-	elapsed = now - last;
-	sl_print( 64, "Frame time (render post): %llu micros\n", elapsed );
-	last = now;
-#endif
+	SL_PROFILE_ZONE_END( );
 #endif
 
-	// Swap buffers
+	// Swap buffers; this ends the frame, of however many scenes were rendered into it
 	if( swap_buffers ) {
+		SL_PROFILE_ZONE_BEGIN( "swap" );
 		sl_window_swap_buffers( win );
-	}
-
-#ifdef SL_DEBUG
-	now = vul_timer_get_micros( timer );
-	elapsed = now - last;
-	sl_print( 64, "Frame time (swap): %llu micros\n", elapsed );
-	elapsed = now - first;
-	sl_print( 64, "Frame time (TOTAL): %llu micros\n", elapsed );
-	last = now;
+		sl_controller_flush( ); // Swapping polled events; dispatch the cursor moves they coalesced into
+		SL_PROFILE_ZONE_END( );
+#ifdef SL_INSTANCING
+		// Fence the frame's instances; their part of the stream buffer is reused in a few frames
+		sl_stream_buffer_end_frame( &sl_renderer_global->instance_stream );
 #endif
+		// Upload what the texture loader has decoded since the last frame, for the next one
+		SL_PROFILE_ZONE_BEGIN( "texture uploads" );
+		sl_texture_loader_update( &sl_renderer_global->texture_loader, SL_TEXTURE_UPLOAD_BUDGET );
+		SL_PROFILE_ZONE_END( );
+		SL_PROFILE_END_FRAME( );
+	}
 }
 
 #ifdef SL_LEGACY_OPENGL
-void sl_renderer_draw_legacy_instance( v2 *camera_offset, sl_renderable *rend, sl_entity *entity )
+void sl_renderer_draw_legacy_instance( v2 *camera_offset, sl_renderable *rend, const sl_affine *transform, const float color[ 4 ],
+									   const sl_box *entity_uvs, const v2 *flip_uvs )
 {
-	m44 mat;
+	sl_affine mat;
 	sl_box uvs;
 	f32 tmp;
 	u32 i;
@@ -523,21 +619,21 @@ void sl_renderer_draw_legacy_instance( v2 *camera_offset, sl_renderable *rend, s
 
 	assert( rend );
 	assert( camera_offset );
-	assert( entity );
+	assert( transform );
 
 	// Calculate offset into matrix
-	memcpy( &mat, &entity->world_matrix, sizeof( m44 ) );
-	mat.A[ 12 ] -= camera_offset->x;
-	mat.A[ 13 ] -= camera_offset->y;
+	mat = *transform;
+	mat.a20 -= camera_offset->x;
+	mat.a21 -= camera_offset->y;
 
 	// Calculate the uvs; they may be flipped
-	sl_bset( &uvs, &entity->uvs );
-	if( entity->flip_uvs.x != 0.f ) {
+	sl_bset( &uvs, entity_uvs );
+	if( flip_uvs->x != 0.f ) {
 		tmp = uvs.min_p.x;
 		uvs.min_p.x = uvs.max_p.x;
 		uvs.max_p.x = tmp;
 	}
-	if( entity->flip_uvs.y != 0.f ) {
+	if( flip_uvs->y != 0.f ) {
 		tmp = uvs.min_p.y;
 		uvs.min_p.y = uvs.max_p.y;
 		uvs.max_p.y = tmp;
@@ -546,10 +642,9 @@ void sl_renderer_draw_legacy_instance( v2 *camera_offset, sl_renderable *rend, s
 	// Start the draw
 	glBegin( GL_TRIANGLES );
 	for( i = 0u; i < rend->index_count; ++i ) {
-		vert.x = mat.A[ 0 ] * rend->vertices[ i ].position.x + mat.A[ 1 ] * rend->vertices[ i ].position.y + mat.A[ 9 ];
-		vert.y = mat.A[ 3 ] * rend->vertices[ i ].position.x + mat.A[ 4 ] * rend->vertices[ i ].position.y + mat.A[ 10 ];
+		sl_affine_transform( &vert, &mat, &rend->vertices[ i ].position );
 		glVertex2f( vert.x, vert.y );
-		glColor4f( entity->color[ 0 ], entity->color[ 1 ], entity->color[ 2 ], entity->color[ 3 ] );
+		glColor4f( color[ 0 ], color[ 1 ], color[ 2 ], color[ 3 ] );
 		texc = vsub2( uvs.max_p, uvs.min_p );
 		texc = vmul2( texc, rend->vertices[ i ].texcoords );
 		texc = vadd2( texc, uvs.min_p );
@@ -566,6 +661,31 @@ void sl_renderer_draw_instance( sl_renderable *ren )
 }
 #endif
 
+#ifdef SL_INSTANCING
+void sl_renderer_draw_instances( sl_renderable *ren, const sl_entity_instance *instances, u32 count )
+{
+	void *dst;
+	u32 offset, i;
+
+	assert( ren );
+	if( count == 0 ) {
+		return;
+	}
+	if( !sl_renderable_instancing_supported( ) ) {
+		for( i = 0; i < count; ++i ) {
+			sl_renderable_set_instance( &instances[ i ] );
+			sl_renderer_draw_instance( ren );
+		}
+		return;
+	}
+
+	dst = sl_stream_buffer_reserve( &sl_renderer_global->instance_stream, count * sizeof( sl_entity_instance ), &offset );
+	memcpy( dst, instances, count * sizeof( sl_entity_instance ) );
+	sl_stream_buffer_commit( &sl_renderer_global->instance_stream, count * sizeof( sl_entity_instance ) );
+	sl_renderer_draw_instance_range( ren, offset, count );
+}
+#endif
+
 void sl_renderer_get_scenes_by_window_handle( vul_vector *vec, GLFWwindow *win_handle )
 {
 	sl_scene *it, *last_it;
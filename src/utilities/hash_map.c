@@ -0,0 +1,217 @@
+/*
+ * Slenderer - Thomas Martin Schmid, 2014. Public domain¹
+ *
+ * ¹ If public domain is not legally valid in your legal jurisdiction
+ *   the MIT licence applies (see the LICENCE file)
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include "utilities/hash_map.h"
+
+#include <string.h>
+
+#include "slenderer.h"
+
+#define SL_HASH_MAP_NONE 0xffffffff
+#define SL_HASH_MAP_VALUE( map, i ) ( ( map )->values + ( size_t )( i ) * ( map )->value_size )
+
+/*
+ * Mixes every bit of the key into the low ones, which pick the home slot (this
+ * is MurmurHash3's finalizer). Entity ids are consecutive and pairs of them share
+ * their high half, so masking them directly would pile them up in a few runs.
+ */
+static u64 sl_hash_map_hash( u64 key )
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+/*
+ * Gives the map an empty table of the given capacity, dropping the old one
+ * without freeing it.
+ */
+static void sl_hash_map_alloc( sl_hash_map *map, u32 capacity )
+{
+	map->slots = ( sl_hash_map_slot* )SL_ALLOC( sizeof( sl_hash_map_slot ) * capacity );
+	memset( map->slots, 0, sizeof( sl_hash_map_slot ) * capacity );
+	map->values = ( u8* )SL_ALLOC( ( size_t )map->value_size * ( capacity + 2 ) );
+	map->capacity = capacity;
+	map->count = 0;
+}
+
+/*
+ * Returns the slot holding the key, or SL_HASH_MAP_NONE. The probe stops at the
+ * first slot whose entry is closer to its home than the key would be to its own;
+ * insertion guarantees the key isn't past it.
+ */
+static u32 sl_hash_map_find( const sl_hash_map *map, u64 key )
+{
+	u32 mask, i, dist;
+
+	if( map->count == 0 ) {
+		return SL_HASH_MAP_NONE;
+	}
+	mask = map->capacity - 1;
+	i = ( u32 )sl_hash_map_hash( key ) & mask;
+	for( dist = 1; map->slots[ i ].dist >= dist; ++dist ) {
+		if( map->slots[ i ].key == key ) {
+			return i;
+		}
+		i = ( i + 1 ) & mask;
+	}
+	return SL_HASH_MAP_NONE;
+}
+
+/*
+ * Inserts a key that isn't in the map yet; there must be room for it. Whenever
+ * the entry being placed is further from home than the one in its way, they trade
+ * places and the displaced entry is carried on. Returns the key's slot.
+ */
+static u32 sl_hash_map_place( sl_hash_map *map, u64 key, const void *value )
+{
+	sl_hash_map_slot *slot, displaced;
+	u8 *carried, *spare, *tmp;
+	u32 mask, i, dist, placed;
+
+	mask = map->capacity - 1;
+	carried = SL_HASH_MAP_VALUE( map, map->capacity );
+	spare = SL_HASH_MAP_VALUE( map, map->capacity + 1 );
+	memcpy( carried, value, map->value_size );
+	i = ( u32 )sl_hash_map_hash( key ) & mask;
+	dist = 1;
+	placed = SL_HASH_MAP_NONE;
+	for( ;; ) {
+		slot = &map->slots[ i ];
+		if( slot->dist == 0 ) {
+			slot->key = key;
+			slot->dist = dist;
+			memcpy( SL_HASH_MAP_VALUE( map, i ), carried, map->value_size );
+			++map->count;
+			return placed == SL_HASH_MAP_NONE ? i : placed;
+		}
+		if( slot->dist < dist ) {
+			displaced = *slot;
+			slot->key = key;
+			slot->dist = dist;
+			memcpy( spare, SL_HASH_MAP_VALUE( map, i ), map->value_size );
+			memcpy( SL_HASH_MAP_VALUE( map, i ), carried, map->value_size );
+			tmp = carried;
+			carried = spare;
+			spare = tmp;
+			key = displaced.key;
+			dist = displaced.dist;
+			if( placed == SL_HASH_MAP_NONE ) {
+				placed = i;
+			}
+		}
+		i = ( i + 1 ) & mask;
+		++dist;
+	}
+}
+
+/*
+ * Doubles the table and reinserts every entry.
+ */
+static void sl_hash_map_grow( sl_hash_map *map )
+{
+	sl_hash_map_slot *old_slots;
+	u8 *old_values;
+	u32 old_capacity, i;
+
+	old_slots = map->slots;
+	old_values = map->values;
+	old_capacity = map->capacity;
+	sl_hash_map_alloc( map, old_capacity ? old_capacity * 2 : SL_HASH_MAP_MIN_CAPACITY );
+	for( i = 0; i < old_capacity; ++i ) {
+		if( old_slots[ i ].dist != 0 ) {
+			sl_hash_map_place( map, old_slots[ i ].key, old_values + ( size_t )i * map->value_size );
+		}
+	}
+	if( old_capacity != 0 ) {
+		SL_DEALLOC( old_slots );
+		SL_DEALLOC( old_values );
+	}
+}
+
+void sl_hash_map_create( sl_hash_map *map, u32 value_size )
+{
+	map->slots = NULL;
+	map->values = NULL;
+	map->capacity = 0;
+	map->count = 0;
+	map->value_size = value_size;
+}
+
+void sl_hash_map_destroy( sl_hash_map *map )
+{
+	if( map->capacity != 0 ) {
+		SL_DEALLOC( map->slots );
+		SL_DEALLOC( map->values );
+	}
+	sl_hash_map_create( map, map->value_size );
+}
+
+void sl_hash_map_clear( sl_hash_map *map )
+{
+	if( map->capacity != 0 ) {
+		memset( map->slots, 0, sizeof( sl_hash_map_slot ) * map->capacity );
+	}
+	map->count = 0;
+}
+
+void *sl_hash_map_get( const sl_hash_map *map, u64 key )
+{
+	u32 i;
+
+	i = sl_hash_map_find( map, key );
+	return i == SL_HASH_MAP_NONE ? NULL : SL_HASH_MAP_VALUE( map, i );
+}
+
+void *sl_hash_map_insert( sl_hash_map *map, u64 key, const void *value )
+{
+	u32 i;
+
+	i = sl_hash_map_find( map, key );
+	if( i != SL_HASH_MAP_NONE ) {
+		memmove( SL_HASH_MAP_VALUE( map, i ), value, map->value_size );
+		return SL_HASH_MAP_VALUE( map, i );
+	}
+	if( ( u64 )( map->count + 1 ) * 8 > ( u64 )map->capacity * SL_HASH_MAP_MAX_LOAD ) {
+		sl_hash_map_grow( map );
+	}
+	i = sl_hash_map_place( map, key, value );
+	return SL_HASH_MAP_VALUE( map, i );
+}
+
+int sl_hash_map_remove( sl_hash_map *map, u64 key )
+{
+	u32 mask, i, next;
+
+	i = sl_hash_map_find( map, key );
+	if( i == SL_HASH_MAP_NONE ) {
+		return SL_FALSE;
+	}
+	// Shift the entries after it back toward their homes until one is already home
+	mask = map->capacity - 1;
+	next = ( i + 1 ) & mask;
+	while( map->slots[ next ].dist > 1 ) {
+		map->slots[ i ].key = map->slots[ next ].key;
+		map->slots[ i ].dist = map->slots[ next ].dist - 1;
+		memcpy( SL_HASH_MAP_VALUE( map, i ), SL_HASH_MAP_VALUE( map, next ), map->value_size );
+		i = next;
+		next = ( next + 1 ) & mask;
+	}
+	map->slots[ i ].dist = 0;
+	--map->count;
+	return SL_TRUE;
+}